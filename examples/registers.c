@@ -5,6 +5,7 @@ int main(void)
     HANDLE h = 0;
     DWORD tmp;
     struct fscc_registers regs;
+    struct fscc_register_op ops[2];
 
     h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
                    OPEN_EXISTING, 0, NULL);
@@ -34,6 +35,24 @@ int main(void)
                     &regs, sizeof(regs),
                     &tmp, (LPOVERLAPPED)NULL);
 
+    /* Switch CCR0 to transparent mode and read it back in a single call */
+    ops[0].bar = 0;
+    ops[0].offset = 0x1c;
+    ops[0].type = FSCC_REGISTER_MODIFY;
+    ops[0].mask = 0x00000003;
+    ops[0].value = 0x00000002;
+
+    ops[1].bar = 0;
+    ops[1].offset = 0x1c;
+    ops[1].type = FSCC_REGISTER_READ;
+    ops[1].mask = 0;
+    ops[1].value = 0;
+
+    DeviceIoControl(h, FSCC_REGISTER_TRANSACTION,
+                    ops, sizeof(ops),
+                    ops, sizeof(ops),
+                    &tmp, (LPOVERLAPPED)NULL);
+
     CloseHandle(h);
 
     return 0;
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <string.h>
+#include <fscc.h>
+
+/* Only receive frames sent to address 0x03 or the broadcast address */
+int main(void)
+{
+    HANDLE h;
+    DWORD tmp;
+    struct fscc_rx_filter filter;
+    char odata[] = "\x03Hello world!";
+    char idata[20];
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, 0, NULL);
+
+    memset(&filter, 0, sizeof(filter));
+    FSCC_RX_FILTER_ADD(filter, 0x03);
+    FSCC_RX_FILTER_ADD(filter, 0xff);
+
+    DeviceIoControl(h, FSCC_SET_RX_FILTER,
+                    &filter, sizeof(filter),
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    DeviceIoControl(h, FSCC_GET_RX_FILTER,
+                    NULL, 0,
+                    &filter, sizeof(filter),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    WriteFile(h, odata, sizeof(odata), &tmp, NULL);
+    ReadFile(h, idata, sizeof(idata), &tmp, NULL);
+
+    fprintf(stdout, "%s\n", idata + 1);
+
+    DeviceIoControl(h, FSCC_CLEAR_RX_FILTER,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    CloseHandle(h);
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <string.h>
+#include <fscc.h>
+
+/* Two handles on the same port, each receiving one HDLC address */
+int main(void)
+{
+    HANDLE h[2];
+    DWORD tmp;
+    struct fscc_rx_match match;
+    char odata[] = "\x01Hello world!";
+    char idata[20];
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        h[i] = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          OPEN_EXISTING, 0, NULL);
+
+        memset(&match, 0, sizeof(match));
+        match.length = 1;
+        match.value[0] = (unsigned char)(i + 1);
+        match.mask[0] = 0xff;
+
+        DeviceIoControl(h[i], FSCC_SET_RX_MATCH,
+                        &match, sizeof(match),
+                        NULL, 0,
+                        &tmp, (LPOVERLAPPED)NULL);
+    }
+
+    DeviceIoControl(h[0], FSCC_GET_RX_MATCH,
+                    NULL, 0,
+                    &match, sizeof(match),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    /* Address 1 goes to the first handle */
+    WriteFile(h[0], odata, sizeof(odata), &tmp, NULL);
+    ReadFile(h[0], idata, sizeof(idata), &tmp, NULL);
+
+    fprintf(stdout, "%s\n", idata + 1);
+
+    for (i = 0; i < 2; i++) {
+        DeviceIoControl(h[i], FSCC_CLEAR_RX_MATCH,
+                        NULL, 0,
+                        NULL, 0,
+                        &tmp, (LPOVERLAPPED)NULL);
+
+        CloseHandle(h[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <fscc.h>
+
+int main(void)
+{
+    HANDLE h = 0;
+    DWORD tmp;
+    UINT32 interval;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, 0, NULL);
+
+    DeviceIoControl(h, FSCC_GET_RX_POLL_INTERVAL,
+                    NULL, 0,
+                    &interval, sizeof(interval),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    printf("RX poll interval: %u us\n", interval);
+
+    interval = 200;
+
+    DeviceIoControl(h, FSCC_SET_RX_POLL_INTERVAL,
+                    &interval, sizeof(interval),
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    CloseHandle(h);
+
+    return 0;
+}
\ No newline at end of file
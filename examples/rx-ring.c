@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <fscc.h>
+
+#define RING_SIZE (1 << 20)
+
+int main(void)
+{
+    HANDLE h = 0;
+    DWORD tmp;
+    OVERLAPPED map_ol, wait_ol;
+    struct fscc_ring *ring;
+    unsigned char *data;
+    UINT32 tail;
+    int frames = 0;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+
+    memset(&map_ol, 0, sizeof(map_ol));
+    memset(&wait_ol, 0, sizeof(wait_ol));
+    map_ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    wait_ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    ring = VirtualAlloc(NULL, sizeof(*ring) + RING_SIZE,
+                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ring->size = RING_SIZE;
+    data = FSCC_RING_DATA(ring);
+
+    /* Stays pending until the ring is unmapped */
+    DeviceIoControl(h, FSCC_MAP_RX_RING,
+                    NULL, 0,
+                    ring, sizeof(*ring) + RING_SIZE,
+                    &tmp, &map_ol);
+
+    tail = 0;
+
+    while (frames < 100) {
+        struct fscc_ring_record *record;
+
+        if (tail == ring->head) {
+            DeviceIoControl(h, FSCC_WAIT_RX_RING,
+                            NULL, 0,
+                            NULL, 0,
+                            &tmp, &wait_ol);
+            GetOverlappedResult(h, &wait_ol, &tmp, TRUE);
+            continue;
+        }
+
+        record = (struct fscc_ring_record *)(data + (tail & (ring->size - 1)));
+
+        if (record->flags & FSCC_RING_PAD) {
+            tail += sizeof(*record) + record->length;
+        }
+        else {
+            printf("Received %u bytes\n", record->length);
+            tail += sizeof(*record) + FSCC_RING_ALIGN(record->length);
+            frames++;
+        }
+
+        /* Gives the space back to the driver */
+        ring->tail = tail;
+    }
+
+    DeviceIoControl(h, FSCC_UNMAP_RX_RING,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, &wait_ol);
+    GetOverlappedResult(h, &wait_ol, &tmp, TRUE);
+    GetOverlappedResult(h, &map_ol, &tmp, TRUE);
+
+    VirtualFree(ring, 0, MEM_RELEASE);
+    CloseHandle(map_ol.hEvent);
+    CloseHandle(wait_ol.hEvent);
+    CloseHandle(h);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <fscc.h>
+
+int main(void)
+{
+    HANDLE h = 0;
+    DWORD tmp;
+    struct fscc_stats stats;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, 0, NULL);
+
+    DeviceIoControl(h, FSCC_GET_STATS,
+                    NULL, 0,
+                    &stats, sizeof(stats),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    printf("MMIO reads avoided: %llu\n", stats.mmio_reads_avoided);
+    printf("RX polls: %llu (%llu found data, %llu us max latency)\n",
+           stats.rx_polls, stats.rx_poll_notifications,
+           stats.rx_poll_latency_max);
+    printf("RX frames: %llu (%llu buffers), suggested RxSize %u RxNum %u\n",
+           stats.rx_frames, stats.rx_descriptors_used,
+           stats.rx_size_hint, stats.rx_num_hint);
+    printf("Start: %llu us (rx buffers %llu, tx buffers %llu, registers %llu, "
+           "clock %llu, purge %llu)\n",
+           stats.init_total_time, stats.init_rx_ring_time,
+           stats.init_tx_ring_time, stats.init_registers_time,
+           stats.init_clock_time, stats.init_purge_time);
+
+    CloseHandle(h);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <fscc.h>
+
+int main(void)
+{
+    HANDLE h = 0;
+    DWORD tmp;
+    UINT32 period;
+    struct fscc_stats before, after;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, 0, NULL);
+
+    DeviceIoControl(h, FSCC_GET_TIMER_PERIOD,
+                    NULL, 0,
+                    &period, sizeof(period),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    printf("Timer period: %u us\n", period);
+
+    period = 500;
+
+    DeviceIoControl(h, FSCC_SET_TIMER_PERIOD,
+                    &period, sizeof(period),
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    DeviceIoControl(h, FSCC_GET_STATS,
+                    NULL, 0,
+                    &before, sizeof(before),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    Sleep(1000);
+
+    DeviceIoControl(h, FSCC_GET_STATS,
+                    NULL, 0,
+                    &after, sizeof(after),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    printf("Timer wakeups per second: %llu\n",
+           after.timer_wakeups - before.timer_wakeups);
+
+    CloseHandle(h);
+
+    return 0;
+}
\ No newline at end of file
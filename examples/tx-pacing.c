@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <fscc.h>
+
+int main(void)
+{
+    HANDLE h = 0;
+    DWORD tmp;
+    struct fscc_tx_pacing pacing;
+    char odata[] = "Hello world!";
+    int i;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, 0, NULL);
+
+    /* No more than 100 frames per second */
+    pacing.bytes_per_second = 0;
+    pacing.burst = 0;
+    pacing.gap = 10000;
+
+    DeviceIoControl(h, FSCC_SET_TX_PACING,
+                    &pacing, sizeof(pacing),
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    DeviceIoControl(h, FSCC_GET_TX_PACING,
+                    NULL, 0,
+                    &pacing, sizeof(pacing),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    for (i = 0; i < 100; i++)
+        WriteFile(h, odata, sizeof(odata), &tmp, NULL);
+
+    pacing.gap = 0;
+
+    DeviceIoControl(h, FSCC_SET_TX_PACING,
+                    &pacing, sizeof(pacing),
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    CloseHandle(h);
+
+    return 0;
+}
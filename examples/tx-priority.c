@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <fscc.h>
+
+/* A bulk handle and an urgent handle on the same port */
+int main(void)
+{
+    HANDLE bulk = 0, urgent = 0;
+    DWORD tmp;
+    UINT32 priority = 0;
+    struct fscc_stats stats;
+    char odata[] = "Hello world!";
+
+    bulk = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                      OPEN_EXISTING, 0, NULL);
+    urgent = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                        OPEN_EXISTING, 0, NULL);
+
+    DeviceIoControl(bulk, FSCC_ENABLE_BLOCKING_WRITE,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    priority = 3;
+    DeviceIoControl(urgent, FSCC_SET_TX_PRIORITY,
+                    &priority, sizeof(priority),
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    DeviceIoControl(urgent, FSCC_GET_TX_PRIORITY,
+                    NULL, 0,
+                    &priority, sizeof(priority),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    WriteFile(bulk, odata, sizeof(odata), &tmp, NULL);
+    WriteFile(urgent, odata, sizeof(odata), &tmp, NULL);
+
+    DeviceIoControl(urgent, FSCC_GET_STATS,
+                    NULL, 0,
+                    &stats, sizeof(stats),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    printf("Priority %u: %llu writes, %llu us max wait\n", priority,
+           stats.tx_priority_frames[priority],
+           stats.tx_priority_latency_max[priority]);
+
+    DeviceIoControl(bulk, FSCC_DISABLE_BLOCKING_WRITE,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    CloseHandle(urgent);
+    CloseHandle(bulk);
+
+    return 0;
+}
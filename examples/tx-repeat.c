@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include <fscc.h>
+
+/* Appends a frame to a list for FSCC_SET_TX_REPEAT */
+static size_t add_frame(char *frames, size_t used, const char *data, UINT32 length)
+{
+    memcpy(frames + used, &length, sizeof(length));
+    memcpy(frames + used + sizeof(length), data, length);
+
+    return used + sizeof(length) + length;
+}
+
+int main(void)
+{
+    HANDLE h;
+    DWORD tmp;
+    struct fscc_stats stats;
+    char pattern[2000];
+    char frames[2 * sizeof(UINT32) + sizeof(pattern) + 5];
+    size_t used = 0;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, 0, NULL);
+
+    /* A frame larger than a transmit buffer followed by a short one */
+    memset(pattern, 0x55, sizeof(pattern));
+    used = add_frame(frames, used, pattern, sizeof(pattern));
+    used = add_frame(frames, used, "Hello", 5);
+
+    DeviceIoControl(h, FSCC_SET_TX_REPEAT,
+                    frames, (DWORD)used,
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    Sleep(1000);
+
+    /* Swap in a different pattern between repetitions */
+    memset(pattern, 0xaa, sizeof(pattern));
+    used = add_frame(frames, 0, pattern, sizeof(pattern));
+
+    DeviceIoControl(h, FSCC_SET_TX_REPEAT,
+                    frames, (DWORD)used,
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    Sleep(1000);
+
+    DeviceIoControl(h, FSCC_CLEAR_TX_REPEAT,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    DeviceIoControl(h, FSCC_GET_STATS,
+                    NULL, 0,
+                    &stats, sizeof(stats),
+                    &tmp, (LPOVERLAPPED)NULL);
+
+    fprintf(stdout, "Repeated %llu times, %llu stalls\n",
+            stats.tx_repeats, stats.tx_repeat_stalls);
+
+    CloseHandle(h);
+
+    return 0;
+}
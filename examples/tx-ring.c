@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <fscc.h>
+
+#define RING_SIZE (1 << 20)
+
+/* Returns 0 if there isn't room for the frame yet */
+int push_frame(struct fscc_ring *ring, const char *frame, UINT32 length)
+{
+    unsigned char *data = FSCC_RING_DATA(ring);
+    struct fscc_ring_record *record;
+    UINT32 head = ring->head;
+    UINT32 offset = head & (ring->size - 1);
+    UINT32 contiguous = ring->size - offset;
+    UINT32 needed = sizeof(*record) + FSCC_RING_ALIGN(length);
+    UINT32 free_space = ring->size - (head - ring->tail);
+
+    if (contiguous < needed) {
+        if (free_space < contiguous + needed)
+            return 0;
+
+        record = (struct fscc_ring_record *)(data + offset);
+        record->length = contiguous - sizeof(*record);
+        record->flags = FSCC_RING_PAD;
+
+        head += contiguous;
+        offset = 0;
+    }
+    else if (free_space < needed) {
+        return 0;
+    }
+
+    record = (struct fscc_ring_record *)(data + offset);
+    record->length = length;
+    record->flags = 0;
+    memcpy(record + 1, frame, length);
+
+    /* The record has to be written before the driver can see it */
+    MemoryBarrier();
+    ring->head = head + needed;
+
+    return 1;
+}
+
+int main(void)
+{
+    HANDLE h = 0;
+    DWORD tmp;
+    OVERLAPPED map_ol, ol;
+    struct fscc_ring *ring;
+    int frames = 0;
+
+    h = CreateFile("\\\\.\\FSCC0", GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                   OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+
+    memset(&map_ol, 0, sizeof(map_ol));
+    memset(&ol, 0, sizeof(ol));
+    map_ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    ring = VirtualAlloc(NULL, sizeof(*ring) + RING_SIZE,
+                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ring->size = RING_SIZE;
+
+    /* Stays pending until the ring is unmapped */
+    DeviceIoControl(h, FSCC_MAP_TX_RING,
+                    NULL, 0,
+                    ring, sizeof(*ring) + RING_SIZE,
+                    &tmp, &map_ol);
+
+    while (frames < 100) {
+        if (push_frame(ring, "Hello world!", 12)) {
+            frames++;
+            continue;
+        }
+
+        /* Full, let the driver catch up */
+        DeviceIoControl(h, FSCC_KICK_TX_RING,
+                        NULL, 0,
+                        NULL, 0,
+                        &tmp, &ol);
+        GetOverlappedResult(h, &ol, &tmp, TRUE);
+        Sleep(1);
+    }
+
+    DeviceIoControl(h, FSCC_KICK_TX_RING,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, &ol);
+    GetOverlappedResult(h, &ol, &tmp, TRUE);
+
+    DeviceIoControl(h, FSCC_WAIT_TX_RING,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, &ol);
+    GetOverlappedResult(h, &ol, &tmp, TRUE);
+
+    DeviceIoControl(h, FSCC_UNMAP_TX_RING,
+                    NULL, 0,
+                    NULL, 0,
+                    &tmp, &ol);
+    GetOverlappedResult(h, &ol, &tmp, TRUE);
+    GetOverlappedResult(h, &map_ol, &tmp, TRUE);
+
+    VirtualFree(ring, 0, MEM_RELEASE);
+    CloseHandle(map_ol.hEvent);
+    CloseHandle(ol.hEvent);
+    CloseHandle(h);
+
+    return 0;
+}
\ No newline at end of file
@@ -26,6 +26,13 @@ THE SOFTWARE.
 #include <math.h>
 #include "calculate-clock-bits.h"
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #define result_array_size 512
 
 struct ResultStruct {
@@ -51,6 +58,31 @@ struct IcpRsStruct {
 int GetICS30703Data(struct clock_data_fscc *clock_data, unsigned long ppm);
 int GetICS30702Data(struct clock_data_335 *clock_data);
 
+const char *calculate_clock_bits_fscc_error(int error)
+{
+    switch(error)
+    {
+    case 0:
+        return "Success";
+    case 1:
+        return "Rs case error";
+    case 2:
+        return "no solutions found, try increasing ppm";
+    case 3:
+        return "Table 1: Input Divider is out of range.";
+    case 4:
+        return "Table 2: VCODivider is out of range.";
+    case 5:
+        return "Table 4: LoopFilterResistor is incorrect.";
+    case 6:
+        return "Table 3: Charge Pump Current is incorrect.";
+    case 7:
+        return "Table 5: OutputDividerOut1 is out of range.";
+    default:
+        return "Unknown error number.";
+    }
+}
+
 int calculate_clock_bits_fscc(clock_data_fscc *clock_data, unsigned long ppm)
 {
     int t;
@@ -61,38 +93,11 @@ int calculate_clock_bits_fscc(clock_data_fscc *clock_data, unsigned long ppm)
     desiredppm = ppm;
 
     t=GetICS30703Data(clock_data, desiredppm);
-        switch(t)
-        {
-        case 0:
-            break;
-        case 1:
-            printf("ICS30703: Rs case error\n");
-            break;
-        case 2:
-            printf("ICS30703: no solutions found, try increasing ppm\n");
-            break;
-        case 3:
-            printf("ICS30703: Table 1: Input Divider is out of rante.\n");
-            break;
-        case 4:
-            printf("ICS30703: Table 2: VCODivider is out of range.\n");
-            break;
-        case 5:
-            printf("ICS30703: Table 4: LoopFilterResistor is incorrect.\n");
-            break;
-        case 6:
-            printf("ICS30703: Table 3: Charge Pump Current is incorrect.\n");
-            break;
-        case 7:
-            printf("ICS30703: Table 5: OutputDividerOut1 is out of range.\n");
-            break;
-        default:
-            printf("ICS30703: Unknown error number.\n");
-            break;
-        }
+    if(t!=0)
+        printf("ICS30703: %s\n", calculate_clock_bits_fscc_error(t));
 
-	if(t==0)    return 0;
-	else return 1;
+    if(t==0)    return 0;
+    else return 1;
 }
 
 int calculate_clock_bits_asynccom(clock_data_asynccom *clock_data, unsigned long ppm)
@@ -110,309 +115,504 @@ int calculate_clock_bits_335(clock_data_335 *clock_data)
     return GetICS30702Data(clock_data);
 }
 
-int GetICS30703Data(struct clock_data_fscc *clock_data, unsigned long ppm)
+struct clock_batch {
+    clock_request_fscc *requests;
+    size_t count;
+    size_t next;
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+/* Hands out the next request to solve, or count when there are none left. */
+static size_t clock_batch_next(struct clock_batch *batch)
 {
-    //  double inputfreq=18432000.0;
-    double inputfreq=24000000.0;
-
-    unsigned long od=0; //Output Divider
-    unsigned r=0;
-    unsigned v=0;
-    unsigned V_Divstart=0;
-    double freq=0;
-    unsigned maxR;
-    unsigned minR;
-    unsigned max_V=2055;
-    unsigned min_V=12;
-    double allowable_error;
-    double freq_err;
-    struct ResultStruct Results;
-	struct ResultStruct theOne;
-    unsigned long i,j;
-    struct IcpRsStruct IRStruct;
-	struct IcpRsStruct theOther;
-    unsigned count;
-    unsigned long Rs;
-    double rule1, rule2;
-    int tempint;
-	unsigned char progdata[20];
-	unsigned long desired;
+    size_t next;
 
-    int InputDivider=0;
-    int VCODivider=0;
-    unsigned long ChargePumpCurrent=0;
-    unsigned long LoopFilterResistor=0;
-    unsigned long OutputDividerOut1=0;
-    unsigned long temp=0;
-    unsigned long requestedppm;
+#ifdef _WIN32
+    EnterCriticalSection(&batch->lock);
+#else
+    pthread_mutex_lock(&batch->lock);
+#endif
 
-    memset(&theOne,0,sizeof(struct ResultStruct));
-    memset(&theOther,0,sizeof(struct IcpRsStruct));
-	desired = clock_data->frequency;
-	clock_data->frequency = 0;
-    requestedppm=ppm;
+    next = batch->next;
+    if (batch->next < batch->count)
+        batch->next++;
 
-    if( inputfreq == 18432000.0) 
-    {
-        maxR = 921;
-        minR = 1;
-    }
-    else if( inputfreq == 24000000.0) 
-    {
-        maxR = 1200;
-        minR = 1;
+#ifdef _WIN32
+    LeaveCriticalSection(&batch->lock);
+#else
+    pthread_mutex_unlock(&batch->lock);
+#endif
+
+    return next;
+}
+
+/* Each result is written to its own request so the output order never
+   depends on which thread solved it. */
+static void clock_batch_work(struct clock_batch *batch)
+{
+    clock_request_fscc *request;
+    size_t i;
+
+    while ((i = clock_batch_next(batch)) < batch->count) {
+        request = &batch->requests[i];
+
+        memset(&request->clock_data, 0, sizeof(request->clock_data));
+        request->clock_data.frequency = request->frequency;
+        request->status = GetICS30703Data(&request->clock_data, request->ppm);
     }
+}
 
-    ppm=0;
-increaseppm:
-    //printf("ICS30703: ppm = %ld\n",ppm);
-    allowable_error  = ppm * desired/1e6; // * 1e6
+#ifdef _WIN32
+static DWORD WINAPI clock_batch_thread(LPVOID arg)
+{
+    clock_batch_work((struct clock_batch *)arg);
+    return 0;
+}
+#else
+static void *clock_batch_thread(void *arg)
+{
+    clock_batch_work((struct clock_batch *)arg);
+    return NULL;
+}
+#endif
 
-    for( r = minR; r <= maxR; r++ )
-    {
-        rule2 = inputfreq /(double)r;
-        if ( (rule2 < 20000.0) || (rule2 > 100000000.0) )
-        {
-            //          printk("Rule2(r=%d): 20,000<%f<100000000\n",r,rule2);
-            continue;   //next r
+static unsigned clock_batch_processors(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return processors > 0 ? (unsigned)processors : 1;
+#endif
+}
+
+int calculate_clock_bits_fscc_batch(clock_request_fscc *requests, size_t count, unsigned threads)
+{
+    struct clock_batch batch;
+#ifdef _WIN32
+    HANDLE *handles;
+#else
+    pthread_t *handles;
+#endif
+    unsigned started = 0;
+    unsigned i;
+    size_t j;
+    int failures = 0;
+
+    if (!requests || count == 0)
+        return 0;
+
+    if (threads == 0)
+        threads = clock_batch_processors();
+
+    if (threads > count)
+        threads = (unsigned)count;
+
+    batch.requests = requests;
+    batch.count = count;
+    batch.next = 0;
+
+#ifdef _WIN32
+    InitializeCriticalSection(&batch.lock);
+#else
+    pthread_mutex_init(&batch.lock, NULL);
+#endif
+
+    /* The calling thread does its share of the work, so only the extra
+       threads are started. If any of them fail to start the rest of the
+       work is simply spread over fewer threads. */
+    handles = (threads > 1) ? malloc((threads - 1) * sizeof(*handles)) : NULL;
+
+    if (handles) {
+        for (i = 0; i < threads - 1; i++) {
+#ifdef _WIN32
+            handles[started] = CreateThread(NULL, 0, clock_batch_thread, &batch, 0, NULL);
+            if (handles[started] == NULL)
+                break;
+#else
+            if (pthread_create(&handles[started], NULL, clock_batch_thread, &batch) != 0)
+                break;
+#endif
+            started++;
         }
+    }
 
-        od=8232;
-        while(od > 1)
-        {
-            //set starting VCO setting with output freq just below target
-            V_Divstart = (int) (((desired - (allowable_error) ) * r * od) / (inputfreq));
+    clock_batch_work(&batch);
 
-            //check if starting VCO setting too low
-            if (V_Divstart < min_V)
-                V_Divstart = min_V;
+    for (i = 0; i < started; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+    }
 
-            //check if starting VCO setting too high
-            else if (V_Divstart > max_V)
-                V_Divstart = max_V;
+    free(handles);
 
-            /** Loop thru VCO divide settings**/
-            //Loop through all VCO divider ratios
-            for( v = V_Divstart; v <= max_V; v++ ) //Check all Vco divider settings
-            {
-                rule1 = (inputfreq * ((double)v / (double)r) );
+#ifdef _WIN32
+    DeleteCriticalSection(&batch.lock);
+#else
+    pthread_mutex_destroy(&batch.lock);
+#endif
 
-                        if(od==2)
-                {
-                    if( (rule1 < 90000000.0) || (rule1 > 540000000.0)  )
-                    {
-                        continue;   //next VCO_Div
-                    }
-                }
-                else if(od==3)
-                {
-                    if( (rule1 < 90000000.0) || (rule1 > 720000000.0)  )
-                    {
-                        continue;   //next VCO_Div
-                    }
-                }
-                else if( (od>=38) && (od<=1029) )
-                {
-                    if( (rule1 < 90000000.0) || (rule1 > 570000000.0)  )
-                    {
-                        continue;   //next VCO_Div
-                    }
-                }
-                else
-                {
-                    if( (rule1 < 90000000.0) || (rule1 > 730000000.0)  )
-                    {
-                        continue;   //next VCO_Div
-                    }
-                }
+    for (j = 0; j < count; j++) {
+        if (requests[j].status != 0)
+            failures++;
+    }
 
-                freq = (inputfreq * ((double)v / ((double)r * (double)od)));
-                freq_err    = fabs(freq - desired) ; //Hz
+    return failures;
+}
 
-                if ((freq_err) > allowable_error)
-                {
-                    continue; //next VCO_Div
-                }
-                else if((freq_err) <= allowable_error)
-                {
-                    count=0;
-                    for(i=0;i<4;i++)
-                    {
-                        switch(i)
-                        {
-                        case 0:
-                            Rs = 64000;
-                            break;
-                        case 1:
-                            Rs = 52000;
-                            break;
-                        case 2:
-                            Rs = 16000;
-                            break;
-                        case 3:
-                            Rs = 4000;
-                            break;
-                        default:
-                            return 1;
-                        }
+/* ICS30703 constraints shared by the divider search below. */
+#define ICS30703_INPUT_FREQ 24000000.0
+#define ICS30703_INPUT_HZ 24000000U
+#define ICS30703_MIN_R 1
+#define ICS30703_MAX_R 1200
+#define ICS30703_MIN_V 12
+#define ICS30703_MAX_V 2055
+#define ICS30703_MIN_OD 2
+#define ICS30703_MAX_OD 8232
+#define ICS30703_MIN_VCO 90000000.0
+#define ICS30703_MAX_VCO 730000000.0
+
+/* Loop filter resistor and charge pump current settings, in the order the
+   loop filter is chosen (the first one that is stable wins). */
+static const unsigned long ics30703_rs[4] = { 64000, 52000, 16000, 4000 };
+
+static const struct {
+    double icp;
+    unsigned long icpnum;   //I have to use this in the switch statement because 8.75e-6 becomes 874
+} ics30703_icp[20] = {
+    { 1.25e-6, 125 }, { 2.5e-6, 250 }, { 3.75e-6, 375 }, { 5.0e-6, 500 },
+    { 6.25e-6, 625 }, { 7.5e-6, 750 }, { 8.75e-6, 875 }, { 10.0e-6, 1000 },
+    { 11.25e-6, 1125 }, { 12.5e-6, 1250 }, { 15.0e-6, 1500 }, { 17.5e-6, 1750 },
+    { 18.75e-6, 1875 }, { 20.0e-6, 2000 }, { 22.5e-6, 2250 }, { 25.0e-6, 2500 },
+    { 26.25e-6, 2625 }, { 30.0e-6, 3000 }, { 35.0e-6, 3500 }, { 40.0e-6, 4000 }
+};
 
-                        for(j=0;j<20;j++)
-                        {
-                            IRStruct.Rs=Rs;
-                            switch(j)
-                            {
-                            case 0:
-                                IRStruct.icp=1.25e-6;
-                                IRStruct.icpnum=125;
-                                break;
-                            case 1:
-                                IRStruct.icp=2.5e-6;
-                                IRStruct.icpnum=250;
-                                break;
-                            case 2:
-                                IRStruct.icp=3.75e-6;
-                                IRStruct.icpnum=375;
-                                break;
-                            case 3:
-                                IRStruct.icp=5.0e-6;
-                                IRStruct.icpnum=500;
-                                break;
-                            case 4:
-                                IRStruct.icp=6.25e-6;
-                                IRStruct.icpnum=625;
-                                break;
-                            case 5:
-                                IRStruct.icp=7.5e-6;
-                                IRStruct.icpnum=750;
-                                break;
-                            case 6:
-                                IRStruct.icp=8.75e-6;
-                                IRStruct.icpnum=875;
-                                break;
-                            case 7:
-                                IRStruct.icp=10.0e-6;
-                                IRStruct.icpnum=1000;
-                                break;
-                            case 8:
-                                IRStruct.icp=11.25e-6;
-                                IRStruct.icpnum=1125;
-                                break;
-                            case 9:
-                                IRStruct.icp=12.5e-6;
-                                IRStruct.icpnum=1250;
-                                break;
-                            case 10:
-                                IRStruct.icp=15.0e-6;
-                                IRStruct.icpnum=1500;
-                                break;
-                            case 11:
-                                IRStruct.icp=17.5e-6;
-                                IRStruct.icpnum=1750;
-                                break;
-                            case 12:
-                                IRStruct.icp=18.75e-6;
-                                IRStruct.icpnum=1875;
-                                break;
-                            case 13:
-                                IRStruct.icp=20.0e-6;
-                                IRStruct.icpnum=2000;
-                                break;
-                            case 14:
-                                IRStruct.icp=22.5e-6;
-                                IRStruct.icpnum=2250;
-                                break;
-                            case 15:
-                                IRStruct.icp=25.0e-6;
-                                IRStruct.icpnum=2500;
-                                break;
-                            case 16:
-                                IRStruct.icp=26.25e-6;
-                                IRStruct.icpnum=2625;
-                                break;
-                            case 17:
-                                IRStruct.icp=30.0e-6;
-                                IRStruct.icpnum=3000;
-                                break;
-                            case 18:
-                                IRStruct.icp=35.0e-6;
-                                IRStruct.icpnum=3500;
-                                break;
-                            case 19:
-                                IRStruct.icp=40.0e-6;
-                                IRStruct.icpnum=4000;
-                                break;
-                            default:
-                                printf("ICS30703: switch(j:icp) - You shouldn't get here! %ld\n",j);
-                            }//end switch(j)
-
-
-                            //                          printf("Rs=%5d ",IRStruct.Rs);
-                            //                          printf("Icp=%2.2f ",IRStruct.icp*10e5);
-
-                            IRStruct.pdf = (inputfreq / (double)r) ;
-                            //                          printf("pdf=%12.2f ",IRStruct.pdf);
-
-                            IRStruct.nbw = ( ((double)IRStruct.Rs * IRStruct.icp * 310.0e6) / (2.0 * 3.14159 * (double)v) );
-                            //                          printf("nbw=%15.3f ",IRStruct.nbw);
-
-                            IRStruct.ratio = (IRStruct.pdf/IRStruct.nbw);
-
-                            tempint = (int)(IRStruct.ratio*10.0);
-                            if((IRStruct.ratio*10.0)-tempint>=0.0) tempint++;
-                            IRStruct.ratio = (double)tempint/10.0;
-
-                            //                          IRStruct.ratio = ceil(IRStruct.ratio*10.0); //these two statements make the
-                            //                          IRStruct.ratio = IRStruct.ratio/10.0;       //ratio a little nicer to compare
-
-                            //                          printf("ratio=%2.4f ",IRStruct.ratio);
-
-                            IRStruct.df = ( ((double)IRStruct.Rs / 2) * (sqrt( ((IRStruct.icp * 0.093) / (double)v))) );
-                            //                          printf("ndf=%12.3f\n",IRStruct.df);
-
-                            count++;
-                            if( (IRStruct.ratio>30) || (IRStruct.ratio<7) || (IRStruct.df>2.0) || (IRStruct.df<0.2) )
-                            {
-                                continue;
-                            }
-                            else
-                            {
-                                Results.target    = desired;
-                                Results.freq      = freq;
-                                Results.errorPPM     = freq_err / desired * 1.0e6 ;
-                                Results.VCO_Div   = v;
-                                Results.refDiv    = r;
-                                Results.outDiv    = od;
-                                Results.failed = 1;
-                                goto finished;
-                            }
-                        }//end for(j=0;j<20;j++)
-                    }//end for(i=0;i<4;i++)
-                }
-            }//end of for( v = V_Divstart; v < max_V; v++ )
+/* The output divider only has single steps up to 1030, then steps of 2, 4
+   and 8 up to the maximum of 8232. Listed from the highest divider down,
+   which is the order the dividers are searched in. */
+static const struct {
+    unsigned long low;
+    unsigned long high;
+    unsigned long step;
+} ics30703_od_ranges[4] = {
+    { 4128, 8232, 8 },
+    { 2064, 4120, 4 },
+    { 1032, 2060, 2 },
+    { 2, 1030, 1 }
+};
 
-            if(od<=1030)
-                od--;
-            else if(od<=2060)
-                od=od-2;
-            else if(od<=4120)
-                od=od-4;
-            else od=od-8;
+/* Maximum VCO frequency (rule 1) for a given output divider. */
+static double ics30703_max_vco(unsigned long od)
+{
+    if (od == 2)
+        return 540000000.0;
+    else if (od == 3)
+        return 720000000.0;
+    else if ((od >= 38) && (od <= 1029))
+        return 570000000.0;
+
+    return ICS30703_MAX_VCO;
+}
 
-        }//end of while(od <= 8232)
-    }//end of for( r = maxR, *saved_result_num = 0; r >= minR; r-- )
+static int ics30703_vco_valid(unsigned r, unsigned v, unsigned long od)
+{
+    double rule1 = (ICS30703_INPUT_FREQ * ((double)v / (double)r));
 
-    ppm++;
-    if(ppm>requestedppm)
-    {
-        return 2;
+    return (rule1 >= ICS30703_MIN_VCO) && (rule1 <= ics30703_max_vco(od));
+}
+
+static double ics30703_error(unsigned r, unsigned v, unsigned long od, unsigned long desired, double *freq)
+{
+    *freq = (ICS30703_INPUT_FREQ * ((double)v / ((double)r * (double)od)));
+
+    return fabs(*freq - desired);
+}
+
+/* Finds the first loop filter setting that keeps the PDF/NBW ratio between
+   7 and 30 and the damping factor between 0.2 and 2. */
+static int ics30703_loop_filter(unsigned r, unsigned v, struct IcpRsStruct *IRStruct)
+{
+    unsigned i, j;
+    int tempint;
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 20; j++) {
+            IRStruct->Rs = ics30703_rs[i];
+            IRStruct->icp = ics30703_icp[j].icp;
+            IRStruct->icpnum = ics30703_icp[j].icpnum;
+
+            IRStruct->pdf = (ICS30703_INPUT_FREQ / (double)r);
+            IRStruct->nbw = ( ((double)IRStruct->Rs * IRStruct->icp * 310.0e6) / (2.0 * 3.14159 * (double)v) );
+            IRStruct->ratio = (IRStruct->pdf / IRStruct->nbw);
+
+            tempint = (int)(IRStruct->ratio * 10.0);
+            if ((IRStruct->ratio * 10.0) - tempint >= 0.0) tempint++;
+            IRStruct->ratio = (double)tempint / 10.0;
+
+            IRStruct->df = ( ((double)IRStruct->Rs / 2) * (sqrt( ((IRStruct->icp * 0.093) / (double)v))) );
+
+            if ((IRStruct->ratio > 30) || (IRStruct->ratio < 7) || (IRStruct->df > 2.0) || (IRStruct->df < 0.2))
+                continue;
+
+            return 1;
+        }
     }
+
+    return 0;
+}
+
+struct ics30703_search_state {
+    unsigned long desired;
+    double best_error;
+    int found;
+    struct ResultStruct *Results;
+    struct IcpRsStruct *IRStruct;
+};
+
+/* Checks the V settings for a single (R, OD) pair, closest to the target
+   first, and records the first one that passes the VCO and loop filter
+   rules if it beats the best result so far. */
+static void ics30703_check_dividers(struct ics30703_search_state *state, unsigned r, unsigned long od, double ideal_v)
+{
+    struct IcpRsStruct ir;
+    double freq, lo_freq, hi_freq, lo_error, hi_error, error;
+    unsigned lo_v, hi_v, v;
+
+    if (ideal_v < ICS30703_MIN_V)
+        lo_v = ICS30703_MIN_V - 1;
+    else if (ideal_v > ICS30703_MAX_V)
+        lo_v = ICS30703_MAX_V;
     else
-    {
-        //      printk("ICS30703: increasing ppm to %d\n",ppm);
-        goto increaseppm;
+        lo_v = (unsigned)ideal_v;
+
+    hi_v = lo_v + 1;
+
+    while (lo_v >= ICS30703_MIN_V || hi_v <= ICS30703_MAX_V) {
+        lo_error = (lo_v >= ICS30703_MIN_V) ? ics30703_error(r, lo_v, od, state->desired, &lo_freq) : -1;
+        hi_error = (hi_v <= ICS30703_MAX_V) ? ics30703_error(r, hi_v, od, state->desired, &hi_freq) : -1;
+
+        if (lo_error >= 0 && (hi_error < 0 || lo_error <= hi_error)) {
+            v = lo_v--;
+            freq = lo_freq;
+            error = lo_error;
+        }
+        else {
+            v = hi_v++;
+            freq = hi_freq;
+            error = hi_error;
+        }
+
+        /* Equal errors keep the earlier result (lowest R, highest OD) */
+        if (error > state->best_error || (state->found && error == state->best_error))
+            return;
+
+        if (!ics30703_vco_valid(r, v, od))
+            continue;
+
+        if (!ics30703_loop_filter(r, v, &ir))
+            continue;
+
+        state->Results->target = state->desired;
+        state->Results->freq = freq;
+        state->Results->errorPPM = error / state->desired * 1.0e6;
+        state->Results->VCO_Div = v;
+        state->Results->refDiv = r;
+        state->Results->outDiv = od;
+        state->Results->failed = 1;
+        memcpy(state->IRStruct, &ir, sizeof(struct IcpRsStruct));
+
+        state->best_error = error;
+        state->found = 1;
+        return;
     }
+}
+
+/*
+    Smallest x >= 0 where lo <= (a * x) % m <= hi, or -1 if there isn't one.
 
-finished:
+    This is the same Euclid style reduction used to find continued fraction
+    convergents: when no multiple of a lands in the range directly, the
+    problem is swapped to one in terms of m % a and solved recursively.
+*/
+static long long ics30703_first_multiple(unsigned a, unsigned m, unsigned lo, unsigned hi)
+{
+    unsigned k;
+    long long y;
+
+    if (lo == 0)
+        return 0;
+
+    a %= m;
+    if (a == 0)
+        return -1;
+
+    k = (lo + a - 1) / a;
+    if (a * k <= hi)
+        return k;
+
+    y = ics30703_first_multiple(m % a, a, a - hi % a, a - lo % a);
+    if (y < 0)
+        return -1;
+
+    return (long long)((lo + (unsigned long long)m * y + a - 1) / a);
+}
+
+/*
+    Searches for the dividers (R, V and OD) with the lowest frequency error
+    that also have a stable loop filter.
+
+    The output frequency is input * V / (R * OD), so for a given R and OD the
+    best V is simply the one closest to desired * R * OD / input, and it can
+    only be within the best error if desired * R * OD lands close to a
+    multiple of the input frequency. For each R only the output dividers
+    whose VCO frequency can reach the target are considered, and rather than
+    stepping through them one at a time the next divider that lands close
+    enough is found directly (see ics30703_first_multiple). The search
+    narrows as better results are found and stops on an exact match.
+
+    Ties are broken in the original search order (lowest R, highest OD,
+    lowest V).
+
+    Returns 0 on success, 2 if nothing is within ppm of the desired frequency.
+*/
+static int ics30703_search(unsigned long desired, unsigned long ppm, struct ResultStruct *Results, struct IcpRsStruct *IRStruct)
+{
+    struct ics30703_search_state state;
+    double rule2, vco_lo, vco_hi, od_lo, od_hi, limit;
+    unsigned long long desired_r;
+    unsigned back, band, position, lo, hi;
+    unsigned long od, od_start, od_end, step;
+    long long skip;
+    unsigned r, i;
+
+    if (desired == 0)
+        return 2;
+
+    state.desired = desired;
+    state.best_error = (double)ppm * desired / 1e6;
+    state.found = 0;
+    state.Results = Results;
+    state.IRStruct = IRStruct;
+
+    for (r = ICS30703_MIN_R; r <= ICS30703_MAX_R; r++) {
+        rule2 = ICS30703_INPUT_FREQ / (double)r;
+
+        if ((rule2 < 20000.0) || (rule2 > 100000000.0))
+            continue;
+
+        /* Range of VCO frequencies reachable with this R */
+        vco_lo = rule2 * ICS30703_MIN_V;
+        vco_hi = rule2 * ICS30703_MAX_V;
+
+        if (vco_lo < ICS30703_MIN_VCO)
+            vco_lo = ICS30703_MIN_VCO;
+
+        if (vco_hi > ICS30703_MAX_VCO)
+            vco_hi = ICS30703_MAX_VCO;
+
+        if (vco_lo > vco_hi)
+            continue;
+
+        /* Output dividers that can land within the current best error. The
+           window is padded by one so rounding never hides a candidate. */
+        od_lo = vco_lo / (desired + state.best_error) - 1;
+        od_hi = (desired > state.best_error) ? vco_hi / (desired - state.best_error) + 1 : ICS30703_MAX_OD;
+
+        if (od_hi < ICS30703_MIN_OD || od_lo > ICS30703_MAX_OD)
+            continue;
+
+        desired_r = (unsigned long long)(desired % ICS30703_INPUT_HZ) * r % ICS30703_INPUT_HZ;
+
+        for (i = 0; i < 4; i++) {
+            step = ics30703_od_ranges[i].step;
+            od_start = (od_hi > ics30703_od_ranges[i].high) ? ics30703_od_ranges[i].high : (unsigned long)od_hi;
+            od_end = (od_lo < ics30703_od_ranges[i].low) ? ics30703_od_ranges[i].low : (unsigned long)od_lo;
+
+            od = od_start - od_start % step;
+
+            /* Each step down in OD moves desired * R * OD back by this much */
+            back = (unsigned)((ICS30703_INPUT_HZ - desired_r * step % ICS30703_INPUT_HZ) % ICS30703_INPUT_HZ);
+
+            while (od >= od_end) {
+                /* desired * R * OD must be within this much of a multiple of
+                   the input frequency for the error to be good enough. Once
+                   there is a result only strictly better ones are wanted. */
+                limit = state.best_error * r * od;
+                limit *= state.found ? (1 - 1e-9) : (1 + 1e-9);
+
+                if (2 * limit + 1 < ICS30703_INPUT_HZ) {
+                    band = (unsigned)limit;
+                    position = (unsigned)(desired_r * od % ICS30703_INPUT_HZ);
+
+                    /* Range that one of the steps down has to land in */
+                    lo = (ICS30703_INPUT_HZ - band + ICS30703_INPUT_HZ - position) % ICS30703_INPUT_HZ;
+                    hi = (band + ICS30703_INPUT_HZ - position) % ICS30703_INPUT_HZ;
+
+                    skip = (lo > hi) ? 0 : ics30703_first_multiple(back, ICS30703_INPUT_HZ, lo, hi);
+
+                    if (skip < 0 || (unsigned long long)skip > (od - od_end) / step)
+                        break;
+
+                    /* The limit shrinks along with OD, so check the
+                       divider that was skipped to against its own limit */
+                    if (skip > 0) {
+                        od -= (unsigned long)skip * step;
+                        continue;
+                    }
+                }
+
+                ics30703_check_dividers(&state, r, od, (double)desired * r * od / ICS30703_INPUT_FREQ);
+
+                if (state.found && state.best_error == 0)
+                    return 0;
+
+                if (od < od_end + step)
+                    break;
+
+                od -= step;
+            }
+        }
+    }
+
+    return state.found ? 0 : 2;
+}
+
+int GetICS30703Data(struct clock_data_fscc *clock_data, unsigned long ppm)
+{
+    struct ResultStruct Results;
+	struct ResultStruct theOne;
+    unsigned long i;
+    struct IcpRsStruct IRStruct;
+	struct IcpRsStruct theOther;
+	unsigned char progdata[20];
+	unsigned long desired;
+
+    int InputDivider=0;
+    int VCODivider=0;
+    unsigned long ChargePumpCurrent=0;
+    unsigned long LoopFilterResistor=0;
+    unsigned long OutputDividerOut1=0;
+    unsigned long temp=0;
+
+    memset(&theOne,0,sizeof(struct ResultStruct));
+    memset(&theOther,0,sizeof(struct IcpRsStruct));
+	desired = clock_data->frequency;
+	clock_data->frequency = 0;
+
+    if (ics30703_search(desired, ppm, &Results, &IRStruct) != 0)
+        return 2;
 
     memcpy(&theOne,&Results,sizeof(struct ResultStruct));
 
@@ -1177,4 +1377,4 @@ int GetICS30702Data(struct clock_data_335 *clock_data)
 //      DBGP("The best VDW = %d  RDW = %d  OD = %d.\n", bestVDW, bestRDW, bestOD);
 //      DBGP("CH_ID = %d \n", extension->chid);
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -24,6 +24,7 @@ THE SOFTWARE.
 #define CALCULATE_CLOCK_BITS_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 struct clock_data_fscc {
 	unsigned long frequency;
@@ -42,9 +43,27 @@ typedef struct clock_data_fscc clock_data_synccom;
 typedef struct clock_data_fscc clock_data_asynccom;
 typedef struct clock_data_335 clock_data_335;
 
+// One target for calculate_clock_bits_fscc_batch. The frequency and ppm are
+// filled in by the caller, clock_data and status are filled in by the batch.
+struct clock_request_fscc {
+	unsigned long frequency;
+	unsigned long ppm;
+	clock_data_fscc clock_data;
+	int status; // 0 on success, see calculate_clock_bits_fscc_error
+};
+
+typedef struct clock_request_fscc clock_request_fscc;
+
 int calculate_clock_bits_fscc(clock_data_fscc *clock_data, unsigned long ppm);
 int calculate_clock_bits_asynccom(clock_data_asynccom *clock_data, unsigned long ppm);
 int calculate_clock_bits_synccom(clock_data_synccom *clock_data, unsigned long ppm);
 int calculate_clock_bits_335(clock_data_335 *clock_data);
 
+// Solves every request across the given number of threads (0 uses one per
+// processor) without printing anything. Results are stored in each request,
+// so the output order always matches the input. Returns the number of
+// requests that failed.
+int calculate_clock_bits_fscc_batch(clock_request_fscc *requests, size_t count, unsigned threads);
+const char *calculate_clock_bits_fscc_error(int error);
+
 #endif
\ No newline at end of file
@@ -74,6 +74,101 @@ struct fscc_registers {
 	fscc_register DSTAR;
 };
 
+#define FSCC_RX_FRAME_SIZE_BUCKETS 16
+#define FSCC_TX_PRIORITIES 4
+#define FSCC_STATS_CPUS 64 /* Higher processors are counted in the last entry */
+
+struct fscc_stats {
+    UINT64 mmio_reads_avoided;
+    UINT64 rx_polls;
+    UINT64 rx_poll_notifications;
+    UINT64 rx_poll_latency_total; /* Microseconds */
+    UINT64 rx_poll_latency_max; /* Microseconds */
+    UINT64 timer_wakeups;
+    UINT64 rx_frames;
+    UINT64 rx_descriptors_used; /* By those frames */
+    UINT64 rx_frame_sizes[FSCC_RX_FRAME_SIZE_BUCKETS]; /* Bucket n is up to 16 << n bytes, the last is everything larger */
+    UINT32 rx_size_hint;
+    UINT32 rx_num_hint;
+    UINT64 rx_frames_unclaimed; /* Dropped because no open handle matched them */
+    UINT64 tx_priority_frames[FSCC_TX_PRIORITIES]; /* Blocking writes sent */
+    UINT64 tx_priority_latency_total[FSCC_TX_PRIORITIES]; /* Microseconds waiting to be sent */
+    UINT64 tx_priority_latency_max[FSCC_TX_PRIORITIES]; /* Microseconds */
+    UINT32 tx_priority_queued[FSCC_TX_PRIORITIES]; /* Blocking writes waiting now */
+    UINT64 isr_calls;
+    UINT64 isr_handled; /* Interrupts that were from this port */
+    UINT64 isr_reads_skipped; /* Calls that didn't read ISR because IMR masks everything */
+    UINT64 isr_cpu[FSCC_STATS_CPUS]; /* Interrupts handled on each processor */
+    UINT64 dpc_cpu[FSCC_STATS_CPUS]; /* DPCs run on each processor */
+    UINT64 init_defaults_time; /* Microseconds each step of the last start took */
+    UINT64 init_rx_ring_time;
+    UINT64 init_tx_ring_time;
+    UINT64 init_registers_time;
+    UINT64 init_clock_time;
+    UINT64 init_purge_time;
+    UINT64 init_total_time;
+    UINT64 init_resume_time; /* The last return to D0 */
+    UINT64 rx_frames_filtered; /* Dropped by the rx filter */
+    UINT64 tx_repeats; /* Times the repeated frames were sent */
+    UINT64 tx_repeat_stalls; /* Times the card caught up and had to be started again */
+};
+
+struct fscc_tx_pacing {
+    UINT32 bytes_per_second; /* 0 for no byte rate limit */
+    UINT32 burst; /* Bytes that can go at once after being idle */
+    UINT32 gap; /* Minimum microseconds between frames, 0 for none */
+};
+
+#define FSCC_RX_MATCH_BYTES 8
+
+struct fscc_rx_match {
+    UINT32 length; /* Leading bytes compared, 1 to FSCC_RX_MATCH_BYTES */
+    unsigned char value[FSCC_RX_MATCH_BYTES];
+    unsigned char mask[FSCC_RX_MATCH_BYTES]; /* Bits of value that have to match */
+};
+
+#define FSCC_RX_FILTER_BYTES 32
+
+struct fscc_rx_filter {
+    unsigned char addresses[FSCC_RX_FILTER_BYTES]; /* Bit n accepts frames starting with byte n */
+};
+
+#define FSCC_RX_FILTER_ADD(filter, address) \
+    ((filter).addresses[(unsigned char)(address) >> 3] |= (unsigned char)(1 << ((address) & 7)))
+
+enum register_op_type {
+    FSCC_REGISTER_READ=0, /* value = register */
+    FSCC_REGISTER_WRITE=1, /* register = value */
+    FSCC_REGISTER_MODIFY=2, /* register = (register & ~mask) | (value & mask) */
+    FSCC_REGISTER_WAIT=3 /* Wait for (register & mask) == (value & mask) */
+};
+
+struct fscc_register_op {
+    UINT32 bar;
+    UINT32 offset;
+    UINT32 type; /* enum register_op_type */
+    UINT32 mask;
+    UINT32 value;
+};
+
+#define FSCC_MAX_REGISTER_OPS 64
+
+struct fscc_ring {
+    UINT32 size; /* Bytes of records after this header, a power of two */
+    volatile UINT32 head; /* Only written by the producer */
+    volatile UINT32 tail; /* Only written by the consumer */
+    UINT32 reserved;
+};
+
+struct fscc_ring_record {
+    UINT32 length; /* Bytes of data after this record */
+    UINT32 flags;
+};
+
+#define FSCC_RING_PAD 0x1 /* Skip to the start of the ring */
+#define FSCC_RING_ALIGN(n) (((n) + 7) & ~7)
+#define FSCC_RING_DATA(ring) ((unsigned char *)(ring) + sizeof(struct fscc_ring))
+
 #define FSCC_IOCTL_MAGIC 0x8018
 
 #define FSCC_GET_REGISTERS CTL_CODE(FSCC_IOCTL_MAGIC, 0x800, METHOD_BUFFERED, FILE_ANY_ACCESS)
@@ -117,6 +212,42 @@ struct fscc_registers {
 #define FSCC_DISABLE_FORCE_FIFO CTL_CODE(FSCC_IOCTL_MAGIC, 0x81F, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #define FSCC_GET_FORCE_FIFO CTL_CODE(FSCC_IOCTL_MAGIC, 0x820, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+#define FSCC_GET_STATS CTL_CODE(FSCC_IOCTL_MAGIC, 0x824, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_REGISTER_TRANSACTION CTL_CODE(FSCC_IOCTL_MAGIC, 0x825, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_MAP_RX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x826, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+#define FSCC_UNMAP_RX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x827, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_WAIT_RX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x828, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_MAP_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x829, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+#define FSCC_UNMAP_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x82A, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_WAIT_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x82B, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_KICK_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x82C, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_RX_POLL_INTERVAL CTL_CODE(FSCC_IOCTL_MAGIC, 0x82D, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_RX_POLL_INTERVAL CTL_CODE(FSCC_IOCTL_MAGIC, 0x82E, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TIMER_PERIOD CTL_CODE(FSCC_IOCTL_MAGIC, 0x82F, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_TIMER_PERIOD CTL_CODE(FSCC_IOCTL_MAGIC, 0x830, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_RX_MATCH CTL_CODE(FSCC_IOCTL_MAGIC, 0x834, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_CLEAR_RX_MATCH CTL_CODE(FSCC_IOCTL_MAGIC, 0x835, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_RX_MATCH CTL_CODE(FSCC_IOCTL_MAGIC, 0x836, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TX_PRIORITY CTL_CODE(FSCC_IOCTL_MAGIC, 0x837, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_TX_PRIORITY CTL_CODE(FSCC_IOCTL_MAGIC, 0x838, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TX_PACING CTL_CODE(FSCC_IOCTL_MAGIC, 0x839, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_TX_PACING CTL_CODE(FSCC_IOCTL_MAGIC, 0x83A, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_RX_FILTER CTL_CODE(FSCC_IOCTL_MAGIC, 0x83B, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_CLEAR_RX_FILTER CTL_CODE(FSCC_IOCTL_MAGIC, 0x83C, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_RX_FILTER CTL_CODE(FSCC_IOCTL_MAGIC, 0x83D, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TX_REPEAT CTL_CODE(FSCC_IOCTL_MAGIC, 0x83E, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_CLEAR_TX_REPEAT CTL_CODE(FSCC_IOCTL_MAGIC, 0x83F, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 //#define FSCC_RESET_DMA CTL_CODE(FSCC_IOCTL_MAGIC, 0x823, METHOD_BUFFERED, FILE_ANY_ACCESS) //NYI
 
 #ifdef __cplusplus
@@ -0,0 +1,97 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+#include "port.h"
+#include "utils.h"
+#include "debug.h"
+#include "config.h"
+
+#if defined(EVENT_TRACING)
+#include "affinity.tmh"
+#endif
+
+/*
+	Spreads busy ports over processors. The interrupt goes to the processors
+	in InterruptAffinity, and the DPCs to DpcProcessor instead of whichever
+	processor took the interrupt. Both are read once when the port is added.
+*/
+void fscc_port_set_affinity(struct fscc_port *port)
+{
+	NTSTATUS status;
+	ULONG interrupt_affinity = 0;
+	ULONG dpc_processor = 0;
+	PROCESSOR_NUMBER processor;
+	WDFDPC dpcs[8];
+	unsigned i;
+
+	return_if_untrue(port);
+
+	interrupt_affinity = port->defaults.values[FSCC_DEFAULT_INTERRUPT_AFFINITY];
+	dpc_processor = port->defaults.values[FSCC_DEFAULT_DPC_PROCESSOR];
+
+	if (interrupt_affinity != DEFAULT_INTERRUPT_AFFINITY_VALUE) {
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "Interrupt affinity = 0x%x", interrupt_affinity);
+
+		WdfInterruptSetPolicy(port->interrupt, WdfIrqPolicySpecifiedProcessors,
+		WdfIrqPriorityUndefined, (KAFFINITY)interrupt_affinity);
+	}
+
+	if (dpc_processor == DEFAULT_DPC_PROCESSOR_VALUE)
+		return;
+
+	status = KeGetProcessorNumberFromIndex(dpc_processor, &processor);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+		"DpcProcessor %u isn't a processor %!STATUS!", dpc_processor, status);
+		return;
+	}
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "DPC processor = %u", dpc_processor);
+
+	dpcs[0] = port->oframe_dpc;
+	dpcs[1] = port->iframe_dpc;
+	dpcs[2] = port->isr_alert_dpc;
+	dpcs[3] = port->request_dpc;
+	dpcs[4] = port->process_read_dpc;
+	dpcs[5] = port->alls_dpc;
+	dpcs[6] = port->timestamp_dpc;
+	dpcs[7] = port->repeat_dpc;
+
+	for (i = 0; i < sizeof(dpcs) / sizeof(dpcs[0]); i++)
+		KeSetTargetProcessorDpcEx(WdfDpcWdmGetDpc(dpcs[i]), &processor);
+}
+
+/* Index into isr_cpu and dpc_cpu for the current processor */
+unsigned fscc_port_stats_cpu(void)
+{
+	ULONG cpu = KeGetCurrentProcessorNumberEx(NULL);
+
+	return (cpu < FSCC_STATS_CPUS) ? cpu : FSCC_STATS_CPUS - 1;
+}
+
+void fscc_port_count_dpc(struct fscc_port *port)
+{
+	return_if_untrue(port);
+
+	InterlockedIncrement64(&port->dpc_cpu[fscc_port_stats_cpu()]);
+}
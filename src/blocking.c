@@ -0,0 +1,188 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+#include "isr.h"
+#include "port.h"
+#include "utils.h"
+#include "io.h"
+#include "pacer.h"
+
+#if defined(EVENT_TRACING)
+#include "blocking.tmh"
+#endif
+
+/*
+	Finds the blocking write to send next: the oldest one of the highest
+	priority waiting. The caller owns a reference to the request returned
+	in found. Frames are never split, so if this one doesn't fit the caller
+	waits for room instead of sending a lower priority frame that does.
+*/
+NTSTATUS fscc_port_next_blocking_write(struct fscc_port *port, WDFREQUEST *found, UINT32 *length)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	WDFREQUEST previous = NULL, request = NULL;
+	WDF_REQUEST_PARAMETERS params;
+	UINT32 priority = 0;
+
+	*found = NULL;
+
+	while (1) {
+		WDF_REQUEST_PARAMETERS_INIT(&params);
+		status = WdfIoQueueFindRequest(port->blocking_request_queue, previous, NULL, &params, &request);
+
+		if (previous && previous != *found)
+			WdfObjectDereference(previous);
+
+		previous = NULL;
+
+		if (status == STATUS_NOT_FOUND) {
+			/* previous was canceled, start over. found would be found
+			   again with another reference. */
+			if (*found)
+				WdfObjectDereference(*found);
+
+			*found = NULL;
+			continue;
+		}
+
+		if (!NT_SUCCESS(status))
+			break;
+
+		priority = WdfObjectGet_FSCC_REQUEST(request)->tx_priority;
+		if (*found == NULL || priority > WdfObjectGet_FSCC_REQUEST(*found)->tx_priority) {
+			if (*found)
+				WdfObjectDereference(*found);
+
+			*found = request;
+			*length = (UINT32)params.Parameters.Write.Length;
+
+			if (priority == FSCC_TX_PRIORITIES - 1)
+				break; /* Nothing can beat it */
+		}
+
+		previous = request;
+	}
+
+	return (*found) ? STATUS_SUCCESS : status;
+}
+
+/* Counts what is waiting in blocking_request_queue right now */
+void fscc_port_get_tx_priority_queued(struct fscc_port *port, UINT32 *queued)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	WDFREQUEST previous = NULL, request = NULL;
+
+	RtlZeroMemory(queued, sizeof(UINT32) * FSCC_TX_PRIORITIES);
+
+	while (1) {
+		status = WdfIoQueueFindRequest(port->blocking_request_queue, previous, NULL, NULL, &request);
+
+		if (previous)
+			WdfObjectDereference(previous);
+
+		previous = NULL;
+
+		if (status == STATUS_NOT_FOUND) {
+			RtlZeroMemory(queued, sizeof(UINT32) * FSCC_TX_PRIORITIES);
+			continue; /* previous was canceled, start over */
+		}
+
+		if (!NT_SUCCESS(status))
+			break;
+
+		queued[WdfObjectGet_FSCC_REQUEST(request)->tx_priority]++;
+		previous = request;
+	}
+}
+
+/*
+	Writes as many of the queued blocking writes as there is room for, in the
+	order fscc_port_next_blocking_write picks them. Stops at the first one
+	that doesn't fit so a large write can't be passed by smaller ones behind
+	it. Runs whenever transmit buffers are freed, not just from the timer.
+*/
+void request_worker(WDFDPC Dpc)
+{
+	struct fscc_port *port = 0;
+	char *data_buffer = NULL;
+	UINT32 write_count = 0;
+	NTSTATUS status = STATUS_SUCCESS;
+	WDFREQUEST Request = NULL, tagRequest = NULL;
+	struct fscc_request *context = 0;
+	UINT32 Length;
+	UINT64 latency;
+	unsigned written = 0;
+
+	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
+
+	while (1) {
+		status = fscc_port_next_blocking_write(port, &tagRequest, &Length);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "fscc_port_next_blocking_write failed %!STATUS!", status);
+			break;
+		}
+		
+		if(fscc_user_get_tx_space(port) < Length || !fscc_pacer_ready(port, Length)) {
+			WdfObjectDereference(tagRequest);
+			break;
+		}
+		
+		status = WdfIoQueueRetrieveFoundRequest(port->blocking_request_queue, tagRequest, &Request);
+		WdfObjectDereference(tagRequest);
+		if (status == STATUS_NOT_FOUND)
+			continue; /* Canceled after we found it */
+		if (!NT_SUCCESS(status))
+			break;
+
+		status = WdfRequestRetrieveInputBuffer(Request, Length, (PVOID *)&data_buffer, NULL);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+			WdfRequestComplete(Request, status);
+			continue;
+		}
+		// TODO can I pass the request to wait_on_write queue here?
+		status = fscc_user_write_frame(port, data_buffer, Length, &write_count);
+		if (!NT_SUCCESS(status)) {
+			/* Nothing went to the card, so nothing to pace or time */
+			WdfRequestCompleteWithInformation(Request, status, write_count);
+			continue;
+		}
+
+		fscc_pacer_charge(port, Length);
+
+		context = WdfObjectGet_FSCC_REQUEST(Request);
+		latency = (KeQueryInterruptTime() - context->queued_time) / 10;
+
+		port->tx_priority_frames[context->tx_priority]++;
+		port->tx_priority_latency_total[context->tx_priority] += latency;
+		if (latency > port->tx_priority_latency_max[context->tx_priority])
+			port->tx_priority_latency_max[context->tx_priority] = latency;
+
+		WdfRequestCompleteWithInformation(Request, status, write_count);
+		written++;
+	}
+
+	if(written && !fscc_port_uses_dma(port))
+		WdfDpcEnqueue(port->oframe_dpc);
+}
@@ -136,160 +136,6 @@ WDFCMRESLIST ResourcesTranslated)
 	return STATUS_SUCCESS;
 }
 
-void *fscc_card_get_BAR(struct fscc_card *card, unsigned number)
-{
-	if (number > 2)
-	return 0;
-
-	return card->bar[number].address;
-}
-
-UINT32 io_read(struct fscc_card *card, unsigned bar, PULONG Address)
-{
-	if (card->bar[bar].memory_mapped)
-	return READ_REGISTER_ULONG(Address);
-	else
-	return READ_PORT_ULONG(Address);
-}
-
-void io_write(struct fscc_card *card, unsigned bar, PULONG Address,
-ULONG Value)
-{
-	if (card->bar[bar].memory_mapped)
-	WRITE_REGISTER_ULONG(Address, Value);
-	else
-	WRITE_PORT_ULONG(Address, Value);
-}
-
-UINT32 fscc_card_get_register(struct fscc_card *card, unsigned bar,
-unsigned offset)
-{
-	void *address = 0;
-
-	address = fscc_card_get_BAR(card, bar);
-
-	return io_read(card, bar, (ULONG *)((char *)address + offset));
-}
-
-void fscc_card_set_register(struct fscc_card *card, unsigned bar,
-unsigned offset, UINT32 value)
-{
-	void *address = 0;
-
-	address = fscc_card_get_BAR(card, bar);
-
-	io_write(card, bar, (ULONG *)((char *)address + offset), value);
-}
-
-/*
-	At the card level there is no offset manipulation to get to the second port
-	on each card. If you would like to pass in a register offset and get the
-	appropriate address on a port basis use the fscc_port_* functions.
-*/
-void fscc_card_get_register_rep(struct fscc_card *card, unsigned bar,
-unsigned offset, char *buf,
-unsigned byte_count)
-{
-	void *address = 0;
-	unsigned leftover_count = 0;
-	UINT32 incoming_data = 0;
-	unsigned chunks = 0;
-	unsigned i = 0;
-
-	return_if_untrue(card);
-	return_if_untrue(bar <= 2);
-	return_if_untrue(buf);
-	return_if_untrue(byte_count > 0);
-
-	address = fscc_card_get_BAR(card, bar);
-	leftover_count = byte_count % 4;
-	chunks = (byte_count - leftover_count) / 4;
-
-	for (i = 0; i < chunks; i++) {
-		UINT32 value = 0;
-
-		value = io_read(card, bar, (ULONG *)((char *)address + offset));
-
-		RtlCopyMemory(&buf[i * 4], &value, sizeof(value));
-	}
-
-	if (leftover_count) {
-		incoming_data = io_read(card, bar, (ULONG *)((char *)address + offset));
-
-		RtlCopyMemory(buf + (byte_count - leftover_count),
-		(char *)(&incoming_data), leftover_count);
-	}
-
-#ifdef __BIG_ENDIAN
-	{
-		unsigned i = 0;
-
-		for (i = 0; i < (int)(byte_count / 2); i++) {
-			char first, last;
-
-			first = buf[i];
-			last = buf[byte_count - i - 1];
-
-			buf[i] = last;
-			buf[byte_count - i - 1] = first;
-		}
-	}
-#endif
-}
-
-/*
-	At the card level there is no offset manipulation to get to the second port
-	on each card. If you would like to pass in a register offset and get the
-	appropriate address on a port basis use the fscc_port_* functions.
-*/
-void fscc_card_set_register_rep(struct fscc_card *card, unsigned bar,
-unsigned offset, const char *data,
-unsigned byte_count)
-{
-	void *address = 0;
-	unsigned leftover_count = 0;
-	unsigned chunks = 0;
-	char *reversed_data = 0;
-	const char *outgoing_data = 0;
-	unsigned i = 0;
-
-	return_if_untrue(card);
-	return_if_untrue(bar <= 2);
-	return_if_untrue(data);
-	return_if_untrue(byte_count > 0);
-
-	address = fscc_card_get_BAR(card, bar);
-	leftover_count = byte_count % 4;
-	chunks = (byte_count - leftover_count) / 4;
-
-	outgoing_data = data;
-
-#ifdef __BIG_ENDIAN
-	{
-		unsigned i = 0;
-
-		reversed_data = (char *)ExAllocatePoolWithTag(POOL_FLAG_NON_PAGED, byte_count,
-		'ataD');
-
-		for (i = 0; i < byte_count; i++)
-		reversed_data[i] = data[byte_count - i - 1];
-
-		outgoing_data = reversed_data;
-	}
-#endif
-
-	for (i = 0; i < chunks; i++)
-	io_write(card, bar, (ULONG *)((char *)address + offset),
-	chars_to_u32(outgoing_data + (i * 4)));
-
-	if (leftover_count)
-	io_write(card, bar, (ULONG *)((char *)address + offset),
-	chars_to_u32(outgoing_data + (byte_count - leftover_count)));
-
-	if (reversed_data)
-	ExFreePoolWithTag (reversed_data, 'ataD');
-}
-
 char *fscc_card_get_name(struct fscc_card *card)
 {
 	switch (card->device_id) {
@@ -52,6 +52,10 @@ THE SOFTWARE.
 #define DEFAULT_RX_MULTIPLE_VALUE 0
 #define DEFAULT_WAIT_ON_WRITE_VALUE 0
 #define DEFAULT_BLOCKING_WRITE_VALUE 0
+#define DEFAULT_RX_POLL_INTERVAL_VALUE 1000 /* Microseconds, 0 disables */
+#define DEFAULT_TIMER_PERIOD_VALUE 250000 /* Microseconds */
+#define DEFAULT_INTERRUPT_AFFINITY_VALUE 0 /* Processor mask, 0 leaves it to Windows */
+#define DEFAULT_DPC_PROCESSOR_VALUE 0xffffffff /* Processor index, 0xffffffff for the one that took the interrupt */
 
 #define DEFAULT_FIFOT_VALUE 0x08001000
 #define DEFAULT_CCR0_VALUE 0x0011201c
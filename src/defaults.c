@@ -0,0 +1,258 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "defaults.h"
+#include "utils.h"
+
+#if defined(EVENT_TRACING)
+#include "defaults.tmh"
+#endif
+
+/*
+	The per-value keys in Device Parameters (TxNum, CCR0, ...) are what
+	users edit, but reading them one at a time costs two dozen registry
+	calls per port. A copy of all of them is kept as one REG_BINARY value in
+	the Defaults subkey, along with the Device Parameters last write time it
+	was made from. Writing a value in a subkey doesn't change its parent's
+	time, so while the two times match nothing has been edited and the copy
+	is used as is. Otherwise the per-value keys are read again, missing ones
+	are written with the driver defaults, and a new copy is saved.
+
+	The copy is little endian UINT32s:
+		magic, version, count, write time low, write time high, values[count]
+	New values are only ever added to the end of fscc_default, so a copy
+	from an older driver is still read and only the values it is missing come
+	from the per-value keys. version only changes if the header does.
+*/
+
+#define DEFAULTS_MAGIC 0x44435346 /* "FSCD" */
+#define DEFAULTS_VERSION 1
+
+static const struct {
+	PCWSTR name;
+	ULONG value;
+} default_values[] = {
+	{ L"TxNum", DEFAULT_BUFFER_TX_NUM },
+	{ L"RxNum", DEFAULT_BUFFER_RX_NUM },
+	{ L"TxSize", DEFAULT_BUFFER_TX_SIZE },
+	{ L"RxSize", DEFAULT_BUFFER_RX_SIZE },
+	{ L"InterruptAffinity", DEFAULT_INTERRUPT_AFFINITY_VALUE },
+	{ L"DpcProcessor", DEFAULT_DPC_PROCESSOR_VALUE },
+	{ L"FIFOT", DEFAULT_FIFOT_VALUE },
+	{ L"CCR0", DEFAULT_CCR0_VALUE },
+	{ L"CCR1", DEFAULT_CCR1_VALUE },
+	{ L"CCR2", DEFAULT_CCR2_VALUE },
+	{ L"BGR", DEFAULT_BGR_VALUE },
+	{ L"SSR", DEFAULT_SSR_VALUE },
+	{ L"SMR", DEFAULT_SMR_VALUE },
+	{ L"TSR", DEFAULT_TSR_VALUE },
+	{ L"TMR", DEFAULT_TMR_VALUE },
+	{ L"RAR", DEFAULT_RAR_VALUE },
+	{ L"RAMR", DEFAULT_RAMR_VALUE },
+	{ L"PPR", DEFAULT_PPR_VALUE },
+	{ L"TCR", DEFAULT_TCR_VALUE },
+	{ L"IMR", DEFAULT_IMR_VALUE },
+	{ L"DPLLR", DEFAULT_DPLLR_VALUE },
+	{ L"FCR", DEFAULT_FCR_VALUE },
+};
+
+C_ASSERT(sizeof(default_values) / sizeof(default_values[0]) == FSCC_DEFAULTS_COUNT);
+
+static ULONG get_le32(const UCHAR *p)
+{
+	return (ULONG)p[0] | ((ULONG)p[1] << 8) | ((ULONG)p[2] << 16) | ((ULONG)p[3] << 24);
+}
+
+static void put_le32(UCHAR *p, ULONG value)
+{
+	p[0] = (UCHAR)value;
+	p[1] = (UCHAR)(value >> 8);
+	p[2] = (UCHAR)(value >> 16);
+	p[3] = (UCHAR)(value >> 24);
+}
+
+/*
+	Returns the number of values read into defaults, or -1 if blob isn't a
+	copy this driver can read. Values past the ones in blob are left alone.
+*/
+int fscc_defaults_parse(const UCHAR *blob, ULONG length, struct fscc_defaults *defaults, LARGE_INTEGER *write_time)
+{
+	ULONG count = 0;
+	ULONG i = 0;
+
+	return_val_if_untrue(blob, -1);
+	return_val_if_untrue(defaults, -1);
+	return_val_if_untrue(write_time, -1);
+
+	if (length < FSCC_DEFAULTS_HEADER_WORDS * 4)
+		return -1;
+
+	if (get_le32(blob) != DEFAULTS_MAGIC || get_le32(blob + 4) != DEFAULTS_VERSION)
+		return -1;
+
+	count = get_le32(blob + 8);
+	if (count > length / 4 - FSCC_DEFAULTS_HEADER_WORDS)
+		return -1;
+
+	write_time->LowPart = get_le32(blob + 12);
+	write_time->HighPart = (LONG)get_le32(blob + 16);
+
+	if (count > FSCC_DEFAULTS_COUNT)
+		count = FSCC_DEFAULTS_COUNT;
+
+	for (i = 0; i < count; i++)
+		defaults->values[i] = get_le32(blob + (FSCC_DEFAULTS_HEADER_WORDS + i) * 4);
+
+	return (int)count;
+}
+
+/* blob has to hold FSCC_DEFAULTS_BLOB_SIZE bytes. Returns the bytes used. */
+ULONG fscc_defaults_serialize(const struct fscc_defaults *defaults, LARGE_INTEGER write_time, UCHAR *blob)
+{
+	ULONG i = 0;
+
+	return_val_if_untrue(defaults, 0);
+	return_val_if_untrue(blob, 0);
+
+	put_le32(blob, DEFAULTS_MAGIC);
+	put_le32(blob + 4, DEFAULTS_VERSION);
+	put_le32(blob + 8, FSCC_DEFAULTS_COUNT);
+	put_le32(blob + 12, write_time.LowPart);
+	put_le32(blob + 16, (ULONG)write_time.HighPart);
+
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++)
+		put_le32(blob + (FSCC_DEFAULTS_HEADER_WORDS + i) * 4, defaults->values[i]);
+
+	return FSCC_DEFAULTS_BLOB_SIZE;
+}
+
+static NTSTATUS fscc_defaults_write_time(WDFKEY key, LARGE_INTEGER *write_time)
+{
+	NTSTATUS status;
+	ULONG length = 0;
+	struct {
+		KEY_BASIC_INFORMATION info;
+		WCHAR name[32];
+	} buffer;
+
+	/* Only the fixed part is needed, so a name too long to fit is fine. */
+	status = ZwQueryKey(WdfRegistryWdmGetHandle(key), KeyBasicInformation,
+	&buffer, sizeof(buffer), &length);
+	if (!NT_SUCCESS(status) && status != STATUS_BUFFER_OVERFLOW)
+		return status;
+
+	*write_time = buffer.info.LastWriteTime;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS fscc_defaults_load(WDFDEVICE device, struct fscc_defaults *defaults)
+{
+	NTSTATUS status;
+	WDFKEY devkey;
+	WDFKEY key = NULL;
+	UNICODE_STRING key_str;
+	UNICODE_STRING value_str;
+	LARGE_INTEGER write_time;
+	LARGE_INTEGER saved_time;
+	UCHAR blob[FSCC_DEFAULTS_BLOB_SIZE * 2]; /* Room for a newer driver's copy */
+	ULONG length = 0;
+	ULONG type = REG_NONE;
+	ULONG value = 0;
+	int count = -1;
+	int first = 0;
+	int i = 0;
+
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++)
+		defaults->values[i] = default_values[i].value;
+
+	status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE,
+	KEY_READ | KEY_WRITE,
+	WDF_NO_OBJECT_ATTRIBUTES, &devkey);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfDeviceOpenRegistryKey failed %!STATUS!", status);
+		return status;
+	}
+
+	RtlInitUnicodeString(&key_str, L"Defaults");
+	RtlInitUnicodeString(&value_str, L"Values");
+
+	/* Creating the subkey changes the parent's time, so do it first. */
+	status = WdfRegistryCreateKey(devkey, &key_str, KEY_READ | KEY_WRITE,
+	REG_OPTION_NON_VOLATILE, NULL, WDF_NO_OBJECT_ATTRIBUTES, &key);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+		"WdfRegistryCreateKey failed %!STATUS!", status);
+		key = NULL;
+	}
+
+	if (key && NT_SUCCESS(fscc_defaults_write_time(devkey, &write_time))) {
+		status = WdfRegistryQueryValue(key, &value_str, sizeof(blob), blob, &length, &type);
+		if (NT_SUCCESS(status) && type == REG_BINARY)
+			count = fscc_defaults_parse(blob, length, defaults, &saved_time);
+
+		if (count >= 0 && saved_time.QuadPart != write_time.QuadPart)
+			count = -1;
+	}
+
+	if (count == FSCC_DEFAULTS_COUNT) {
+		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Using saved defaults");
+		WdfRegistryClose(key);
+		WdfRegistryClose(devkey);
+		return STATUS_SUCCESS;
+	}
+
+	first = (count > 0) ? count : 0;
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+	"Reading defaults from %i registry values", FSCC_DEFAULTS_COUNT - first);
+
+	for (i = first; i < FSCC_DEFAULTS_COUNT; i++) {
+		RtlInitUnicodeString(&key_str, default_values[i].name);
+		status = WdfRegistryQueryULong(devkey, &key_str, &value);
+		if (!NT_SUCCESS(status)) {
+			value = default_values[i].value;
+			status = WdfRegistryAssignULong(devkey, &key_str, value);
+		}
+		defaults->values[i] = value;
+	}
+
+	if (key) {
+		if (NT_SUCCESS(fscc_defaults_write_time(devkey, &write_time))) {
+			length = fscc_defaults_serialize(defaults, write_time, blob);
+			status = WdfRegistryAssignValue(key, &value_str, REG_BINARY, length, blob);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRegistryAssignValue failed %!STATUS!", status);
+			}
+		}
+
+		WdfRegistryClose(key);
+	}
+
+	WdfRegistryClose(devkey);
+
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FSCC_DEFAULTS_H
+#define FSCC_DEFAULTS_H
+
+#include <ntddk.h>
+#include <wdf.h>
+
+#include "defines.h"
+#include "Trace.h"
+
+#define FSCC_DEFAULTS_HEADER_WORDS 5
+#define FSCC_DEFAULTS_BLOB_SIZE ((FSCC_DEFAULTS_HEADER_WORDS + FSCC_DEFAULTS_COUNT) * 4)
+
+NTSTATUS fscc_defaults_load(WDFDEVICE device, struct fscc_defaults *defaults);
+int fscc_defaults_parse(const UCHAR *blob, ULONG length, struct fscc_defaults *defaults, LARGE_INTEGER *write_time);
+ULONG fscc_defaults_serialize(const struct fscc_defaults *defaults, LARGE_INTEGER write_time, UCHAR *blob);
+
+#endif
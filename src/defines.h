@@ -24,6 +24,8 @@ THE SOFTWARE.
 #include <ntddk.h>
 #include <wdf.h>
 
+#include "ringlayout.h"
+
 struct clock_data_fscc {
 	unsigned long frequency;
 	unsigned char clock_bits[20];
@@ -77,6 +79,18 @@ struct fscc_registers {
 	fscc_register DSTAR;
 };
 
+/* The registers and clock bits saved over a power transition, see snapshot.c */
+#define FSCC_SNAPSHOT_HEADER_WORDS 3
+#define FSCC_SNAPSHOT_REGISTERS (sizeof(struct fscc_registers) / sizeof(fscc_register))
+#define FSCC_SNAPSHOT_CLOCK_WORDS 6 /* frequency and the 20 clock bytes */
+#define FSCC_SNAPSHOT_SIZE ((FSCC_SNAPSHOT_HEADER_WORDS + 2 * FSCC_SNAPSHOT_REGISTERS + \
+		FSCC_SNAPSHOT_CLOCK_WORDS) * 4)
+
+/* FCR writes needed to shift the 20 clock bytes into a port's clock
+   generator: one to clear the lines, a rising and falling clock edge per
+   bit, then the strobe and the original FCR value. */
+#define CLOCK_BITS_WORDS (1 + (20 * 8 * 2) + 2)
+
 struct fscc_memory {
 	UINT32 tx_size;
 	UINT32 tx_num;
@@ -84,13 +98,149 @@ struct fscc_memory {
 	UINT32 rx_num;
 };
 
+/* Settings read from the port's Device Parameters key, see defaults.c. New
+   ones are only ever added at the end. */
+enum fscc_default {
+	FSCC_DEFAULT_TX_NUM,
+	FSCC_DEFAULT_RX_NUM,
+	FSCC_DEFAULT_TX_SIZE,
+	FSCC_DEFAULT_RX_SIZE,
+	FSCC_DEFAULT_INTERRUPT_AFFINITY,
+	FSCC_DEFAULT_DPC_PROCESSOR,
+	FSCC_DEFAULT_FIFOT,
+	FSCC_DEFAULT_CCR0,
+	FSCC_DEFAULT_CCR1,
+	FSCC_DEFAULT_CCR2,
+	FSCC_DEFAULT_BGR,
+	FSCC_DEFAULT_SSR,
+	FSCC_DEFAULT_SMR,
+	FSCC_DEFAULT_TSR,
+	FSCC_DEFAULT_TMR,
+	FSCC_DEFAULT_RAR,
+	FSCC_DEFAULT_RAMR,
+	FSCC_DEFAULT_PPR,
+	FSCC_DEFAULT_TCR,
+	FSCC_DEFAULT_IMR,
+	FSCC_DEFAULT_DPLLR,
+	FSCC_DEFAULT_FCR,
+	FSCC_DEFAULTS_COUNT
+};
+
+struct fscc_defaults {
+	ULONG values[FSCC_DEFAULTS_COUNT];
+};
+
+#define FSCC_RX_FRAME_SIZE_BUCKETS 16
+#define FSCC_TX_PRIORITIES 4
+#define FSCC_STATS_CPUS 64 /* Higher processors are counted in the last entry */
+
+struct fscc_stats {
+	UINT64 mmio_reads_avoided;
+	UINT64 rx_polls;
+	UINT64 rx_poll_notifications;
+	UINT64 rx_poll_latency_total; /* Microseconds */
+	UINT64 rx_poll_latency_max; /* Microseconds */
+	UINT64 timer_wakeups;
+	UINT64 rx_frames;
+	UINT64 rx_descriptors_used; /* By those frames */
+	UINT64 rx_frame_sizes[FSCC_RX_FRAME_SIZE_BUCKETS]; /* Bucket n is up to 16 << n bytes, the last is everything larger */
+	UINT32 rx_size_hint;
+	UINT32 rx_num_hint;
+	UINT64 rx_frames_unclaimed; /* Dropped because no open handle matched them */
+	UINT64 tx_priority_frames[FSCC_TX_PRIORITIES]; /* Blocking writes sent */
+	UINT64 tx_priority_latency_total[FSCC_TX_PRIORITIES]; /* Microseconds waiting to be sent */
+	UINT64 tx_priority_latency_max[FSCC_TX_PRIORITIES]; /* Microseconds */
+	UINT32 tx_priority_queued[FSCC_TX_PRIORITIES]; /* Blocking writes waiting now */
+	UINT64 isr_calls;
+	UINT64 isr_handled; /* Interrupts that were from this port */
+	UINT64 isr_reads_skipped; /* Calls that didn't read ISR because IMR masks everything */
+	UINT64 isr_cpu[FSCC_STATS_CPUS]; /* Interrupts handled on each processor */
+	UINT64 dpc_cpu[FSCC_STATS_CPUS]; /* DPCs run on each processor */
+	UINT64 init_defaults_time; /* Microseconds each step of the last start took */
+	UINT64 init_rx_ring_time;
+	UINT64 init_tx_ring_time;
+	UINT64 init_registers_time;
+	UINT64 init_clock_time;
+	UINT64 init_purge_time;
+	UINT64 init_total_time;
+	UINT64 init_resume_time; /* The last return to D0 */
+	UINT64 rx_frames_filtered; /* Dropped by the rx filter */
+	UINT64 tx_repeats; /* Times the repeated frames were sent */
+	UINT64 tx_repeat_stalls; /* Times the card caught up and had to be started again */
+};
+
+/* See pacer.c */
+struct fscc_tx_pacing {
+	UINT32 bytes_per_second; /* 0 for no byte rate limit */
+	UINT32 burst; /* Bytes that can go at once after being idle */
+	UINT32 gap; /* Minimum microseconds between frames, 0 for none */
+};
+
+#define FSCC_RX_MATCH_BYTES 8
+
+/* See match.c */
+struct fscc_rx_match {
+	UINT32 length; /* Leading bytes compared, 1 to FSCC_RX_MATCH_BYTES */
+	unsigned char value[FSCC_RX_MATCH_BYTES];
+	unsigned char mask[FSCC_RX_MATCH_BYTES]; /* Bits of value that have to match */
+};
+
+#define FSCC_RX_FILTER_BYTES 32
+
+/* See rxfilter.c */
+struct fscc_rx_filter {
+	unsigned char addresses[FSCC_RX_FILTER_BYTES]; /* Bit n accepts frames starting with byte n */
+};
+
+struct fscc_register_op {
+	UINT32 bar;
+	UINT32 offset;
+	UINT32 type; /* enum register_op_type */
+	UINT32 mask;
+	UINT32 value;
+};
+
+struct fscc_ring_state {
+	struct fscc_ring *ring; /* System address of the application's ring */
+	WDFREQUEST request; /* Pending request that keeps the ring mapped */
+	WDFFILEOBJECT file;
+	WDFQUEUE wait_queue;
+	UINT32 size;
+	UINT32 index; /* Our copy of head for rx, tail for tx */
+};
+
+/* See repeat.c */
+struct fscc_repeat_loop {
+	struct dma_frame **descriptors; /* Copies of the frames, linked in a circle */
+	UINT32 *controls; /* What each control word is set back to after it is sent */
+	UINT32 count;
+	UINT32 copy_length; /* Descriptors in each copy */
+	UINT32 next; /* First descriptor the card hasn't sent this time around */
+};
+
 typedef struct fscc_port {
 	WDFDEVICE device;
 
 	struct fscc_card card;
 
 	unsigned channel;
-	struct fscc_registers register_storage; /* Only valid on suspend/resume */
+	struct fscc_registers register_storage; /* Last values written, see register_cache_class */
+	volatile LONG64 mmio_reads_avoided;
+	volatile LONG64 isr_calls;
+	volatile LONG64 isr_handled;
+	volatile LONG64 isr_reads_skipped;
+	volatile LONG64 isr_cpu[FSCC_STATS_CPUS];
+	volatile LONG64 dpc_cpu[FSCC_STATS_CPUS];
+	UINT64 init_defaults_time; /* Only written while the port is starting */
+	UINT64 init_rx_ring_time;
+	UINT64 init_tx_ring_time;
+	UINT64 init_registers_time;
+	UINT64 init_clock_time;
+	UINT64 init_purge_time;
+	UINT64 init_total_time;
+	UINT64 init_resume_time;
+	volatile BOOLEAN clock_present; /* Last result of fscc_port_timed_out */
+	volatile ULONGLONG clock_present_time; /* Interrupt time clock_present was set */
 	BOOLEAN append_status;
 	BOOLEAN append_timestamp;
 	BOOLEAN ignore_timeout;
@@ -98,10 +248,50 @@ typedef struct fscc_port {
 	BOOLEAN wait_on_write;
 	BOOLEAN blocking_write;
 	BOOLEAN force_fifo;
+	UINT32 timer_period; /* Microseconds between timer_handler runs while busy */
+	volatile LONG timer_armed;
+	volatile LONG64 timer_wakeups;
+	UINT32 rx_poll_interval; /* Microseconds, 0 disables rx_poll_timer */
+	volatile LONG rx_poll_armed;
+	ULONGLONG rx_poll_empty_time; /* Interrupt time of the last poll that found nothing */
+	volatile LONG64 rx_polls;
+	volatile LONG64 rx_poll_notifications;
+	volatile LONG64 rx_poll_latency_total;
+	volatile LONG64 rx_poll_latency_max;
+	UINT64 rx_frames; /* rx_frame counters are only used under board_rx_spinlock */
+	UINT64 rx_descriptors_used;
+	UINT64 rx_frame_sizes[FSCC_RX_FRAME_SIZE_BUCKETS];
+	UINT64 rx_frames_unclaimed;
+	LIST_ENTRY rx_matches; /* struct fscc_file, under board_rx_spinlock */
+	unsigned rx_match_count;
+	struct fscc_rx_filter rx_filter; /* Under board_rx_spinlock */
+	BOOLEAN rx_filter_enabled;
+	UINT64 rx_frames_filtered;
+	fscc_register rx_filter_saved_RAR; /* RAR and RAMR before the filter set them, -1 if it didn't */
+	fscc_register rx_filter_saved_RAMR;
+	UINT64 tx_priority_frames[FSCC_TX_PRIORITIES]; /* tx_priority counters are only written by request_worker */
+	UINT64 tx_priority_latency_total[FSCC_TX_PRIORITIES];
+	UINT64 tx_priority_latency_max[FSCC_TX_PRIORITIES];
+	struct fscc_tx_pacing tx_pacing;
+	LONG64 pacer_tokens; /* pacer state is only used under board_tx_spinlock */
+	ULONGLONG pacer_time; /* Interrupt time of the last refill */
+	ULONGLONG pacer_last_frame; /* Interrupt time of the last paced frame */
+	volatile LONG pacer_armed;
+	struct fscc_repeat_loop *tx_repeat; /* Repeat loops are only used under board_tx_spinlock */
+	struct fscc_repeat_loop *tx_repeat_next; /* Set, but the card hasn't reached it yet */
+	struct fscc_repeat_loop *tx_repeat_old; /* Left by the card, waiting to be freed */
+	UINT64 tx_repeats;
+	UINT64 tx_repeat_stalls;
 	int tx_modifiers;
+	UINT32 clock_bits_words[CLOCK_BITS_WORDS]; /* Only used under board_settings_spinlock */
+	struct clock_data_fscc clock_data; /* Last sent to the clock generator, same lock */
+	UCHAR power_snapshot[FSCC_SNAPSHOT_SIZE]; /* Saved by FsccEvtDeviceD0Exit */
+	ULONG power_snapshot_length;
+	BOOLEAN power_saved;
 	unsigned last_isr_value;
 	unsigned open_counter;
 	struct fscc_memory memory;
+	struct fscc_defaults defaults; /* Read once when the port is added */
 
 	WDFQUEUE write_queue;
 	WDFQUEUE write_queue2; /* TODO: Change name to be more descriptive. */
@@ -110,10 +300,15 @@ typedef struct fscc_port {
 	WDFQUEUE ioctl_queue;
 	WDFQUEUE isr_queue; /* List of user tracked interrupts */
 	WDFQUEUE blocking_request_queue; /* For blocking write requests */
+	WDFQUEUE ring_queue; /* Requests that keep a ring mapped */
 
 	WDFSPINLOCK board_settings_spinlock; /* Anything that will alter the settings at a board level */
 	WDFSPINLOCK board_rx_spinlock; /* Anything that will alter the state of rx at a board level */
 	WDFSPINLOCK board_tx_spinlock; /* Anything that will alter the state of rx at a board level */
+	WDFSPINLOCK ring_spinlock; /* Taken before board_rx_spinlock */
+
+	struct fscc_ring_state rx_ring;
+	struct fscc_ring_state tx_ring;
 
 	WDFDPC oframe_dpc;
 	WDFDPC iframe_dpc;
@@ -122,8 +317,14 @@ typedef struct fscc_port {
 	WDFDPC process_read_dpc;
 	WDFDPC alls_dpc;
 	WDFDPC timestamp_dpc;
+	WDFDPC repeat_dpc;
 
-	WDFTIMER timer;
+	WDFWORKITEM rx_ring_work_item; /* Allocates the rx descriptors while PrepareHardware does the rest */
+	NTSTATUS rx_ring_status;
+
+	WDFTIMER timer; /* Only runs while there is work, see fscc_port_needs_timer */
+	WDFTIMER rx_poll_timer; /* Streaming DMA reads, see rx_poll_handler */
+	WDFTIMER pacer_timer; /* See fscc_pacer_ready */
 
 	WDFINTERRUPT interrupt;
 
@@ -143,6 +344,20 @@ typedef struct fscc_port {
 } FSCC_PORT;
 WDF_DECLARE_CONTEXT_TYPE(FSCC_PORT);
 
+typedef struct fscc_file {
+	WDFFILEOBJECT file_object;
+	LIST_ENTRY match_entry; /* In port->rx_matches while match is set */
+	struct fscc_rx_match match;
+	UINT32 tx_priority; /* Given to this handle's blocking writes */
+} FSCC_FILE;
+WDF_DECLARE_CONTEXT_TYPE(FSCC_FILE);
+
+typedef struct fscc_request {
+	UINT32 tx_priority;
+	ULONGLONG queued_time; /* Interrupt time it went into blocking_request_queue */
+} FSCC_REQUEST;
+WDF_DECLARE_CONTEXT_TYPE(FSCC_REQUEST);
+
 typedef LARGE_INTEGER fscc_timestamp;
 
 struct fscc_descriptor {
@@ -161,4 +376,5 @@ typedef struct dma_frame {
 	fscc_timestamp timestamp;
 	UINT32 data_size;
 	UINT32 desc_size;
+	UINT32 read_offset; /* Bytes already read from the front of buffer */
 } DMA_FRAME;
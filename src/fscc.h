@@ -71,6 +71,42 @@ THE SOFTWARE.
 #define FSCC_DISABLE_FORCE_FIFO CTL_CODE(FSCC_IOCTL_MAGIC, 0x81F, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #define FSCC_GET_FORCE_FIFO CTL_CODE(FSCC_IOCTL_MAGIC, 0x820, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+#define FSCC_GET_STATS CTL_CODE(FSCC_IOCTL_MAGIC, 0x824, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_REGISTER_TRANSACTION CTL_CODE(FSCC_IOCTL_MAGIC, 0x825, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_MAP_RX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x826, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+#define FSCC_UNMAP_RX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x827, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_WAIT_RX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x828, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_MAP_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x829, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+#define FSCC_UNMAP_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x82A, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_WAIT_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x82B, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_KICK_TX_RING CTL_CODE(FSCC_IOCTL_MAGIC, 0x82C, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_RX_POLL_INTERVAL CTL_CODE(FSCC_IOCTL_MAGIC, 0x82D, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_RX_POLL_INTERVAL CTL_CODE(FSCC_IOCTL_MAGIC, 0x82E, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TIMER_PERIOD CTL_CODE(FSCC_IOCTL_MAGIC, 0x82F, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_TIMER_PERIOD CTL_CODE(FSCC_IOCTL_MAGIC, 0x830, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_RX_MATCH CTL_CODE(FSCC_IOCTL_MAGIC, 0x834, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_CLEAR_RX_MATCH CTL_CODE(FSCC_IOCTL_MAGIC, 0x835, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_RX_MATCH CTL_CODE(FSCC_IOCTL_MAGIC, 0x836, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TX_PRIORITY CTL_CODE(FSCC_IOCTL_MAGIC, 0x837, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_TX_PRIORITY CTL_CODE(FSCC_IOCTL_MAGIC, 0x838, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TX_PACING CTL_CODE(FSCC_IOCTL_MAGIC, 0x839, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_TX_PACING CTL_CODE(FSCC_IOCTL_MAGIC, 0x83A, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_RX_FILTER CTL_CODE(FSCC_IOCTL_MAGIC, 0x83B, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_CLEAR_RX_FILTER CTL_CODE(FSCC_IOCTL_MAGIC, 0x83C, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_GET_RX_FILTER CTL_CODE(FSCC_IOCTL_MAGIC, 0x83D, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define FSCC_SET_TX_REPEAT CTL_CODE(FSCC_IOCTL_MAGIC, 0x83E, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FSCC_CLEAR_TX_REPEAT CTL_CODE(FSCC_IOCTL_MAGIC, 0x83F, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 
 //#define FSCC_RESET_DMA CTL_CODE(FSCC_IOCTL_MAGIC, 0x823, METHOD_BUFFERED, FILE_ANY_ACCESS) //NYI
 
@@ -79,6 +115,15 @@ THE SOFTWARE.
 
 enum transmit_modifiers { XF=0, XREP=1, TXT=2, TXEXT=4 };
 
+enum register_op_type {
+	FSCC_REGISTER_READ=0, /* value = register */
+	FSCC_REGISTER_WRITE=1, /* register = value */
+	FSCC_REGISTER_MODIFY=2, /* register = (register & ~mask) | (value & mask) */
+	FSCC_REGISTER_WAIT=3 /* Wait for (register & mask) == (value & mask) */
+};
+
+#define FSCC_MAX_REGISTER_OPS 64
+
 DRIVER_INITIALIZE DriverEntry;
 EVT_WDF_DRIVER_UNLOAD  DriverUnload;
 
@@ -27,6 +27,12 @@ THE SOFTWARE.
 #include "debug.h"
 #include "utils.h"
 
+#include "ring.h"
+#include "match.h"
+#include "pacer.h"
+#include "rxfilter.h"
+#include "repeat.h"
+
 #include <ntddser.h>
 #include <ntstrsafe.h>
 
@@ -50,49 +56,64 @@ void FsccProcessRead(WDFDPC Dpc)
 	UINT32 bytes_ready;
 	
 	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
+
+	/* Data goes to the rx ring instead of read requests while it's mapped */
+	if (fscc_ring_fill_rx(port))
+		return;
+
 	streaming = fscc_io_is_streaming(port);
-	WdfSpinLockAcquire(port->board_rx_spinlock);
-	frame_ready = fscc_user_next_read_size(port, &bytes_ready);
-	WdfSpinLockRelease(port->board_rx_spinlock);
-	if (bytes_ready == 0) return;
-	if (!streaming && !frame_ready) return;
-	
-	status = WdfIoQueueRetrieveNextRequest(port->read_queue2, &request);
-	if (!NT_SUCCESS(status)) {
-		if (status != STATUS_NO_MORE_ENTRIES) {
-			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
-			"WdfIoQueueRetrieveNextRequest failed %!STATUS!",
-			status);
+
+	/* Hand out everything that is ready while there are reads to take it */
+	while (1) {
+		WdfSpinLockAcquire(port->board_rx_spinlock);
+		fscc_filter_frames(port);
+		frame_ready = fscc_user_next_read_size(port, &bytes_ready);
+		WdfSpinLockRelease(port->board_rx_spinlock);
+		if (bytes_ready == 0) return;
+		if (!streaming && !frame_ready) return;
+		
+		if (!streaming && port->rx_match_count)
+			status = fscc_match_next_request(port, &request);
+		else
+			status = WdfIoQueueRetrieveNextRequest(port->read_queue2, &request);
+
+		if (!NT_SUCCESS(status)) {
+			if (status != STATUS_NO_MORE_ENTRIES) {
+				TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+				"WdfIoQueueRetrieveNextRequest failed %!STATUS!",
+				status);
+			}
+
+			return;
 		}
 
-		return;
-	}
 
+		WDF_REQUEST_PARAMETERS_INIT(&params);
+		WdfRequestGetParameters(request, &params);
+		length = (unsigned)params.Parameters.Read.Length;
 
-	WDF_REQUEST_PARAMETERS_INIT(&params);
-	WdfRequestGetParameters(request, &params);
-	length = (unsigned)params.Parameters.Read.Length;
+		status = WdfRequestRetrieveOutputBuffer(request, length,
+		(PVOID*)&data_buffer, NULL);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+			"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+			WdfRequestComplete(request, status);
+			return;
+		}
+		
+		if (streaming) status = fscc_user_read_stream(port, data_buffer, length, &read_count);
+		else status = fscc_user_read_frame(port, data_buffer, length, &read_count);
 
-	status = WdfRequestRetrieveOutputBuffer(request, length,
-	(PVOID*)&data_buffer, NULL);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
-		"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
-		WdfRequestComplete(request, status);
-		return;
-	}
-	
-	if (streaming) status = fscc_user_read_stream(port, data_buffer, length, &read_count);
-	else status = fscc_user_read_frame(port, data_buffer, length, &read_count);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+			"fscc_port_{frame,stream}_read failed %!STATUS!", status);
+			WdfRequestComplete(request, status);
+			return;
+		}
 
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
-		"fscc_port_{frame,stream}_read failed %!STATUS!", status);
-		WdfRequestComplete(request, status);
-		return;
+		WdfRequestCompleteWithInformation(request, status, read_count);
 	}
-
-	WdfRequestCompleteWithInformation(request, status, read_count);
 }
 
 struct dma_frame *fscc_io_create_frame(struct fscc_port *port, UINT32 size_of_buffer)
@@ -136,6 +157,7 @@ struct dma_frame *fscc_io_create_frame(struct fscc_port *port, UINT32 size_of_bu
 	RtlZeroMemory(frame->buffer, frame->data_size);
 	
 	clear_timestamp(&frame->timestamp);
+	frame->read_offset = 0;
 	
 	return frame;
 }
@@ -324,6 +346,7 @@ NTSTATUS fscc_io_reset_rx(struct fscc_port *port) {
 	{
 		port->rx_descriptors[i]->desc->control = DESC_HI_BIT;
 		port->rx_descriptors[i]->desc->data_count = port->rx_descriptors[i]->data_size;
+		port->rx_descriptors[i]->read_offset = 0;
 		clear_timestamp(&port->rx_descriptors[i]->timestamp);
 	}
 	port->user_rx_desc = 0;
@@ -411,6 +434,36 @@ NTSTATUS fscc_io_purge_tx(struct fscc_port *port)
 	return STATUS_SUCCESS;
 }
 
+/*
+	Points the hardware back at the start of the descriptors after the port
+	returns to D0. Like the purges, the data in them is dropped, but reads and
+	writes waiting in the queues stay there. Writes waiting for their frame to
+	be sent are cancelled because it never will be.
+*/
+NTSTATUS fscc_io_resume(struct fscc_port *port)
+{
+	return_val_if_untrue(port, 0);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	fscc_io_reset_rx(port);
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+	fscc_io_reset_tx(port);
+	WdfSpinLockRelease(port->board_tx_spinlock);
+
+	if(fscc_port_uses_dma(port)) {
+		fscc_port_set_register(port, 2, DMA_TX_BASE_OFFSET, port->tx_descriptors[0]->desc_physical_address);
+		fscc_port_set_register(port, 2, DMA_RX_BASE_OFFSET, port->rx_descriptors[0]->desc_physical_address);
+		fscc_dma_execute_GO_R(port);
+	}
+
+	WdfIoQueuePurgeSynchronously(port->write_queue2);
+	WdfIoQueueStart(port->write_queue2);
+
+	return STATUS_SUCCESS;
+}
+
 BOOLEAN fscc_dma_is_rx_running(struct fscc_port *port)
 {
 	UINT32 dstar_value = 0;
@@ -771,6 +824,11 @@ int fscc_user_write_frame(struct fscc_port *port, char *buf, UINT32 data_length,
 	
 	*out_length = 0;
 	WdfSpinLockAcquire(port->board_tx_spinlock);
+	if (port->tx_repeat) {
+		/* The card isn't using the tx descriptors, see repeat.c */
+		WdfSpinLockRelease(port->board_tx_spinlock);
+		return STATUS_INVALID_DEVICE_STATE;
+	}
 	for(i = 0; i < port->memory.tx_num; i++) {
 		if((port->tx_descriptors[port->user_tx_desc]->desc->control&DESC_CSTOP_BIT)!=DESC_CSTOP_BIT) {
 			status = STATUS_BUFFER_TOO_SMALL;
@@ -809,6 +867,64 @@ int fscc_user_write_frame(struct fscc_port *port, char *buf, UINT32 data_length,
 	return status;
 }
 
+/*
+	Copies up to length bytes from the start of the next frame without
+	reading it. Called with board_rx_spinlock held and a frame ready.
+*/
+UINT32 fscc_user_peek_frame(struct fscc_port *port, unsigned char *buf, UINT32 length)
+{
+	struct dma_frame *frame = 0;
+	UINT32 i, cur_desc, control, count;
+	UINT32 copied = 0, gathered = 0;
+
+	cur_desc = port->user_rx_desc;
+	for (i = 0; i < port->memory.rx_num && copied < length; i++) {
+		frame = port->rx_descriptors[cur_desc];
+		control = frame->desc->control;
+
+		count = frame->desc->data_count;
+		if ((control & DESC_FE_BIT) && (control & DESC_CSTOP_BIT))
+			count = (control & DMA_MAX_LENGTH) - gathered;
+		gathered += count;
+
+		count = min(count, length - copied);
+		RtlCopyMemory(buf + copied, frame->buffer, count);
+		copied += count;
+
+		if (control & DESC_FE_BIT)
+			break;
+
+		cur_desc++;
+		if (cur_desc == port->memory.rx_num)
+			cur_desc = 0;
+	}
+
+	return copied;
+}
+
+/* Throws away the next frame. Called with board_rx_spinlock held and a frame ready. */
+void fscc_user_discard_frame(struct fscc_port *port)
+{
+	struct dma_frame *frame = 0;
+	UINT32 i, control;
+
+	for (i = 0; i < port->memory.rx_num; i++) {
+		frame = port->rx_descriptors[port->user_rx_desc];
+		control = frame->desc->control;
+
+		clear_timestamp(&frame->timestamp);
+		frame->read_offset = 0;
+		frame->desc->control = DESC_HI_BIT;
+
+		port->user_rx_desc++;
+		if (port->user_rx_desc == port->memory.rx_num)
+			port->user_rx_desc = 0;
+
+		if ((control & DESC_FE_BIT) && (control & DESC_CSTOP_BIT))
+			break;
+	}
+}
+
 int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
 {
 	UINT32 i;
@@ -820,6 +936,7 @@ int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, U
 	UINT32 filled_frame_size = 0;
 	UINT32 buffer_requirement = 0;
 	UINT32 control = 0;
+	UINT32 frame_descs = 0;
 	
 	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
 	
@@ -858,7 +975,7 @@ int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, U
 			real_move_size = planned_move_size;
 		
 		if(real_move_size)
-			RtlCopyMemory(buf + *out_length, port->rx_descriptors[port->user_rx_desc]->buffer, real_move_size);
+			RtlCopyMemory(buf + *out_length, port->rx_descriptors[port->user_rx_desc]->buffer + port->rx_descriptors[port->user_rx_desc]->read_offset, real_move_size);
 		
 		if(planned_move_size > bytes_in_descs) 
 			bytes_in_descs = 0;
@@ -867,6 +984,7 @@ int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, U
 		total_valid_data -= real_move_size;
 		filled_frame_size += real_move_size;
 		*out_length += real_move_size;
+		frame_descs++;
 		
 		if(bytes_in_descs == 0 && port->append_timestamp) {
 			if(timestamp_is_empty(&port->rx_descriptors[port->user_rx_desc]->timestamp))
@@ -875,6 +993,7 @@ int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, U
 			*out_length += sizeof(fscc_timestamp);
 		}
 		clear_timestamp(&port->rx_descriptors[port->user_rx_desc]->timestamp);
+		port->rx_descriptors[port->user_rx_desc]->read_offset = 0;
 		port->rx_descriptors[port->user_rx_desc]->desc->control = DESC_HI_BIT;
 		
 		port->user_rx_desc++;
@@ -882,7 +1001,11 @@ int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, U
 			port->user_rx_desc = 0;
 		
 		if(bytes_in_descs == 0) {
-			if(!port->rx_multiple)
+			fscc_io_count_rx_frame(port, control & DMA_MAX_LENGTH, frame_descs);
+			frame_descs = 0;
+
+			/* With matches set the next frame may belong to another handle */
+			if(!port->rx_multiple || port->rx_match_count)
 				break;
 			frame_ready = fscc_user_next_read_size(port, &bytes_in_descs);
 			if(!frame_ready) 
@@ -905,53 +1028,6 @@ int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, U
 	return STATUS_SUCCESS;
 }
 
-int fscc_user_read_stream(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
-{
-	size_t i;
-	UINT32 receive_length = 0;
-	UINT32 control;
-	
-	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
-	
-	*out_length = 0;
-	WdfSpinLockAcquire(port->board_rx_spinlock);
-	for(i = 0; i < port->memory.rx_num; i++) {	
-		control = port->rx_descriptors[port->user_rx_desc]->desc->control;
-		
-		// If not CSTOP && not FE, then break
-		if(!(control&DESC_FE_BIT) && !(control&DESC_CSTOP_BIT))
-			break;
-		
-		receive_length = min(port->rx_descriptors[port->user_rx_desc]->desc->data_count, buf_length - *out_length);
-		
-		RtlCopyMemory(buf + *out_length, port->rx_descriptors[port->user_rx_desc]->buffer, receive_length);
-		*out_length += receive_length;
-		
-		if(receive_length == port->rx_descriptors[port->user_rx_desc]->desc->data_count) {
-			port->rx_descriptors[port->user_rx_desc]->desc->data_count = port->rx_descriptors[port->user_rx_desc]->data_size;
-			clear_timestamp(&port->rx_descriptors[port->user_rx_desc]->timestamp);
-			if(i%2) port->rx_descriptors[port->user_rx_desc]->desc->control = DESC_HI_BIT;
-			else port->rx_descriptors[port->user_rx_desc]->desc->control = 0;
-		}
-		else {
-			int remaining = port->rx_descriptors[port->user_rx_desc]->desc->data_count - receive_length;
-			// Moving data to the front of the descriptor.
-			RtlMoveMemory(port->rx_descriptors[port->user_rx_desc]->buffer, 
-			port->rx_descriptors[port->user_rx_desc]->buffer+receive_length, 
-			remaining);
-			port->rx_descriptors[port->user_rx_desc]->desc->data_count = remaining;
-			break;
-		}
-		
-		port->user_rx_desc++;
-		if(port->user_rx_desc == port->memory.rx_num) 
-			port->user_rx_desc = 0;
-	}
-	WdfSpinLockRelease(port->board_rx_spinlock);
-	
-	return STATUS_SUCCESS;
-}
-
 unsigned fscc_io_transmit_frame(struct fscc_port *port)
 {
 	int result;
@@ -1057,6 +1133,11 @@ VOID FsccEvtIoRead(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length)
 		return;
 	}
 
+	if (fscc_ring_rx_mapped(port)) {
+		WdfRequestComplete(Request, STATUS_INVALID_DEVICE_STATE);
+		return;
+	}
+
 	status = WdfRequestForwardToIoQueue(Request, port->read_queue2);
 	if (!NT_SUCCESS(status)) {
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
@@ -1066,6 +1147,8 @@ VOID FsccEvtIoRead(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length)
 	}
 
 	WdfDpcEnqueue(port->process_read_dpc);
+	fscc_port_start_rx_poll(port);
+	fscc_port_start_timer(port);
 }
 
 VOID FsccEvtIoWrite(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length)
@@ -1082,12 +1165,21 @@ VOID FsccEvtIoWrite(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length)
 		return;
 	}
 	
+	if (fscc_ring_tx_mapped(port) || fscc_repeat_running(port)) {
+		WdfRequestComplete(Request, STATUS_INVALID_DEVICE_STATE);
+		return;
+	}
+	
 	if(Length > (port->memory.tx_size * port->memory.tx_num)) {
 		WdfRequestComplete(Request, STATUS_BUFFER_TOO_SMALL);
 		return;
 	}
 	
-	if (port->blocking_write) {
+	/* Paced writes wait their turn the same way blocking writes wait for room */
+	if (port->blocking_write || fscc_pacer_enabled(port)) {
+		WdfObjectGet_FSCC_REQUEST(Request)->tx_priority = fscc_port_get_tx_priority(port, WdfRequestGetFileObject(Request));
+		WdfObjectGet_FSCC_REQUEST(Request)->queued_time = KeQueryInterruptTime();
+
 		status = WdfRequestForwardToIoQueue(Request, port->blocking_request_queue);
 		if (!NT_SUCCESS(status)) {
 			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, 
@@ -1096,6 +1188,7 @@ VOID FsccEvtIoWrite(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length)
 			return;
 		}
 		WdfDpcEnqueue(port->request_dpc);
+		fscc_port_start_timer(port);
 		return;
 	}
 	
@@ -1105,7 +1198,7 @@ VOID FsccEvtIoWrite(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length)
 	}
 	
 	/* Checks to make sure there is a clock present. */
-	if (port->ignore_timeout == FALSE && fscc_port_timed_out(port)) {
+	if (port->ignore_timeout == FALSE && fscc_port_clock_timed_out(port)) {
 		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
 		"device stalled (wrong clock mode?)");
 		WdfRequestComplete(Request, STATUS_IO_TIMEOUT);
@@ -44,12 +44,17 @@ unsigned fscc_io_transmit_frame(struct fscc_port *port);
 void fscc_io_execute_transmit(struct fscc_port *port, unsigned dma);
 
 NTSTATUS fscc_io_initialize(struct fscc_port *port);
+struct dma_frame *fscc_io_create_frame(struct fscc_port *port, UINT32 size_of_buffer);
+void fscc_io_destroy_frame(struct dma_frame *frame);
+void fscc_io_link_desc(struct dma_frame **descs, size_t number_of_buffers);
 NTSTATUS fscc_io_create_rx(struct fscc_port *port, UINT32 number_of_buffers, UINT32 size_of_buffers);
 NTSTATUS fscc_io_create_tx(struct fscc_port *port, UINT32 number_of_buffers, UINT32 size_of_buffers);
 void fscc_io_destroy_rx(struct fscc_port *port);
 void fscc_io_destroy_tx(struct fscc_port *port);
 NTSTATUS fscc_io_purge_tx(struct fscc_port *port);
 NTSTATUS fscc_io_purge_rx(struct fscc_port *port);
+NTSTATUS fscc_io_resume(struct fscc_port *port);
+void fscc_io_count_rx_frame(struct fscc_port *port, UINT32 size, UINT32 descriptors);
 
 NTSTATUS fscc_io_execute_RRES(struct fscc_port *port);
 NTSTATUS fscc_io_execute_TRES(struct fscc_port *port);
@@ -76,4 +81,6 @@ int fscc_user_read_stream(struct fscc_port *port, char *buf, UINT32 buf_length,
 int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32*out_length);
 int fscc_user_write_frame(struct fscc_port *port, char *buf, UINT32 data_length, UINT32*out_length);
 unsigned fscc_user_next_read_size(struct fscc_port *port, UINT32*bytes);
+UINT32 fscc_user_peek_frame(struct fscc_port *port, unsigned char *buf, UINT32 length);
+void fscc_user_discard_frame(struct fscc_port *port);
 #endif
\ No newline at end of file
@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include "port.h" /* struct fscc_port */
 #include "utils.h" /* port_exists */
 #include "debug.h"
+#include "ring.h"
 
 #if defined(EVENT_TRACING)
 #include "isr.tmh"
@@ -46,6 +47,20 @@ BOOLEAN fscc_isr(WDFINTERRUPT Interrupt, ULONG MessageID)
 
 	port = WdfObjectGet_FSCC_PORT(WdfInterruptGetDevice(Interrupt));
 
+	InterlockedIncrement64(&port->isr_calls);
+
+	/*
+		Every port on a card shares the vector, and there is no card level
+		status to check, so each port's ISR has to be read. A port with
+		every interrupt masked can't be the one that interrupted though.
+		The default IMR only masks the modem status interrupts, so this
+		only saves the read on ports set up to mask everything.
+	*/
+	if ((port->register_storage.IMR & ALL_INTERRUPTS) == ALL_INTERRUPTS) {
+		InterlockedIncrement64(&port->isr_reads_skipped);
+		return handled;
+	}
+
 	isr_value = fscc_port_get_register(port, 0, ISR_OFFSET);
 
 	if (!isr_value)
@@ -53,7 +68,14 @@ BOOLEAN fscc_isr(WDFINTERRUPT Interrupt, ULONG MessageID)
 
 	handled = TRUE;
 
+	InterlockedIncrement64(&port->isr_handled);
+	InterlockedIncrement64(&port->isr_cpu[fscc_port_stats_cpu()]);
+
 	port->last_isr_value |= isr_value;
+
+	/* Data moving means there is a clock */
+	if (isr_value & (RFS | RFT | RFE | TFT | ALLS))
+		fscc_port_set_clock_present(port, TRUE);
 	
 	using_dma = fscc_port_uses_dma(port);
 	// TODO 
@@ -61,7 +83,7 @@ BOOLEAN fscc_isr(WDFINTERRUPT Interrupt, ULONG MessageID)
 	// framing mode and transparent mode, no DR_HI.
 	// This creates a problem in transparent mode with DMA - there's no
 	// mechanism to alert the waiting read request that new data has arrived.
-	// This can be worked around by always using RLC with transparent mode.
+	// rx_poll_handler checks for it while a read is waiting instead.
 	if (using_dma) {
 		if (isr_value & RFE)
 			WdfDpcEnqueue(port->timestamp_dpc);
@@ -77,6 +99,14 @@ BOOLEAN fscc_isr(WDFINTERRUPT Interrupt, ULONG MessageID)
 			WdfDpcEnqueue(port->oframe_dpc);
 	}
 
+	/* Transmit buffers were freed, the FIFO case is handled by oframe_worker */
+	if (using_dma && port->blocking_write && (isr_value & (DT_FE | DT_STOP | ALLS)))
+		WdfDpcEnqueue(port->request_dpc);
+
+	/* The repeat loop's descriptors have to be given back before it comes around */
+	if (using_dma && port->tx_repeat && (isr_value & (DT_HI | DT_FE | DT_STOP)))
+		WdfDpcEnqueue(port->repeat_dpc);
+
 	// TODO error handling for RDO, RFO, TDU, etc?
 	
 	if (isr_value & ALLS)
@@ -100,6 +130,7 @@ void isr_alert_worker(WDFDPC Dpc)
 	WDFREQUEST prevTagRequest = NULL;
 
 	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
 	
 	isr_value = port->last_isr_value;
 	
@@ -205,6 +236,7 @@ void timestamp_worker(WDFDPC Dpc)
 {
 	struct fscc_port *port = 0;
 	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
 	
 	if(!fscc_port_uses_dma(port)) return;
 	
@@ -216,6 +248,7 @@ void iframe_worker(WDFDPC Dpc)
 	struct fscc_port *port = 0;
 
 	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
 
 	return_if_untrue(port);
 	if(fscc_port_uses_dma(port)) return;
@@ -228,10 +261,14 @@ void oframe_worker(WDFDPC Dpc)
 	struct fscc_port *port = 0;
 
 	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
 
 	return_if_untrue(port);
 	if(fscc_port_uses_dma(port)) return;
-	fscc_io_transmit_frame(port);
+
+	/* Moving data into the FIFO frees up transmit buffers */
+	if (fscc_io_transmit_frame(port) && port->blocking_write)
+		WdfDpcEnqueue(port->request_dpc);
 }
 
 void alls_worker(WDFDPC Dpc)
@@ -243,6 +280,10 @@ void alls_worker(WDFDPC Dpc)
 	unsigned length = 0, clear_queue = 1;
 
 	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
+
+	/* Transmit buffers have been freed up */
+	fscc_ring_drain_tx(port);
 	
 	if (port->wait_on_write) {
 		do {
@@ -256,57 +297,77 @@ void alls_worker(WDFDPC Dpc)
 	}
 }
 
-void request_worker(WDFDPC Dpc)
+VOID timer_handler(WDFTIMER Timer)
 {
 	struct fscc_port *port = 0;
-	char *data_buffer = NULL;
-	UINT32 write_count = 0;
-	NTSTATUS status = STATUS_SUCCESS;
-	WDFREQUEST Request = NULL, tagRequest = NULL, prevTagRequest = NULL;
-	WDF_REQUEST_PARAMETERS params;
-	UINT32 Length;
 
-	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	port = WdfObjectGet_FSCC_PORT(WdfTimerGetParentObject(Timer));
 
-	WDF_REQUEST_PARAMETERS_INIT(&params);
-	status = WdfIoQueueFindRequest(port->blocking_request_queue, prevTagRequest, NULL, &params, &tagRequest);
-	if (prevTagRequest) WdfObjectDereference(prevTagRequest);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "WdfIoQueueFindRequest failed %!STATUS!", status);
-		return;
-	}
-	Length = (UINT32)params.Parameters.Write.Length;
-	
-	if(fscc_user_get_tx_space(port) < Length) 
-		return;
+	InterlockedIncrement64(&port->timer_wakeups);
+
+	/* The period can be far shorter than the time a check is good for, and
+	   a port without a clock reads STAR many times per check */
+	if (port->ignore_timeout == FALSE && fscc_port_clock_stale(port))
+		fscc_port_timed_out(port);
+
+	fscc_ring_drain_tx(port);
+
+	/* In case streaming was turned on with a read already waiting */
+	fscc_port_start_rx_poll(port);
 	
-	status = WdfIoQueueRetrieveFoundRequest(port->blocking_request_queue, tagRequest, &Request);
-	WdfObjectDereference(tagRequest);
-	if (!NT_SUCCESS(status)) return;
-
-	status = WdfRequestRetrieveInputBuffer(Request, Length, (PVOID *)&data_buffer, NULL);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
-		WdfRequestComplete(Request, status);
-		return;
-	}
-	// TODO can I pass the request to wait_on_write queue here?
-	status = fscc_user_write_frame(port, data_buffer, Length, &write_count);
+	if(fscc_port_uses_dma(port)) 
+		WdfDpcEnqueue(port->process_read_dpc);
+	else 
+		WdfDpcEnqueue(port->iframe_dpc);
+
+	if (!WDF_IO_QUEUE_IDLE(WdfIoQueueGetState(port->blocking_request_queue, NULL, NULL)))
+		WdfDpcEnqueue(port->request_dpc);
 
-	WdfRequestCompleteWithInformation(Request, status, write_count);
-	if(!fscc_port_uses_dma(port))
-		WdfDpcEnqueue(port->oframe_dpc);
+	/* Stops here if there is nothing left to do */
+	InterlockedExchange(&port->timer_armed, 0);
+	fscc_port_start_timer(port);
 }
 
-VOID timer_handler(WDFTIMER Timer)
+/*
+	Checks for streaming DMA data every rx_poll_interval while something is
+	waiting for it, instead of leaving it to the next timer_handler tick. The
+	latency recorded is how long the data could have been sitting there,
+	the time since a poll last found nothing.
+*/
+VOID rx_poll_handler(WDFTIMER Timer)
 {
 	struct fscc_port *port = 0;
+	ULONGLONG now = 0;
+	LONG64 latency = 0;
+	UINT32 bytes_ready = 0;
 
 	port = WdfObjectGet_FSCC_PORT(WdfTimerGetParentObject(Timer));
-	
-	if(fscc_port_uses_dma(port)) 
+
+	now = KeQueryInterruptTime();
+	InterlockedIncrement64(&port->rx_polls);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	fscc_user_next_read_size(port, &bytes_ready);
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	if (bytes_ready) {
+		if (port->rx_poll_empty_time) {
+			latency = (LONG64)(now - port->rx_poll_empty_time) / 10;
+
+			InterlockedIncrement64(&port->rx_poll_notifications);
+			InterlockedAdd64(&port->rx_poll_latency_total, latency);
+			if (latency > port->rx_poll_latency_max)
+				port->rx_poll_latency_max = latency;
+
+			port->rx_poll_empty_time = 0;
+		}
+
 		WdfDpcEnqueue(port->process_read_dpc);
-	else 
-		WdfDpcEnqueue(port->iframe_dpc);
-	WdfDpcEnqueue(port->request_dpc);
+	}
+	else {
+		port->rx_poll_empty_time = now;
+	}
+
+	InterlockedExchange(&port->rx_poll_armed, 0);
+	fscc_port_start_rx_poll(port);
 }
@@ -40,5 +40,6 @@ EVT_WDF_DPC alls_worker;
 EVT_WDF_DPC timestamp_worker;
 
 EVT_WDF_TIMER timer_handler;
+EVT_WDF_TIMER rx_poll_handler;
 
 #endif
\ No newline at end of file
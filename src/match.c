@@ -0,0 +1,238 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "match.h"
+#include "port.h"
+#include "utils.h"
+#include "io.h"
+
+#if defined(EVENT_TRACING)
+#include "match.tmh"
+#endif
+
+/*
+	Lets several handles share a port's received frames. A handle with a
+	match only gets the frames whose leading bytes match it, for example an
+	HDLC address. Handles without one get the frames no match claimed. Each
+	frame is looked at once in FsccProcessRead, and copied straight into the
+	read request of the handle it belongs to.
+
+	A frame waits in the rx descriptors until the handle it belongs to reads
+	it, so each of those handles should keep a read pending. A frame nothing
+	that is open would ever read is dropped and counted in rx_frames_unclaimed.
+	Matches are kept on port->rx_matches under board_rx_spinlock.
+*/
+
+static BOOLEAN fscc_match_frame(struct fscc_rx_match *match, unsigned char *data, UINT32 length)
+{
+	UINT32 i;
+
+	if (length < match->length)
+		return FALSE;
+
+	for (i = 0; i < match->length; i++) {
+		if ((data[i] ^ match->value[i]) & match->mask[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* The first handle to set a matching match gets the frame */
+static WDFFILEOBJECT fscc_match_find(struct fscc_port *port, unsigned char *data, UINT32 length)
+{
+	PLIST_ENTRY entry = 0;
+	struct fscc_file *file = 0;
+
+	for (entry = port->rx_matches.Flink; entry != &port->rx_matches; entry = entry->Flink) {
+		file = CONTAINING_RECORD(entry, struct fscc_file, match_entry);
+
+		if (fscc_match_frame(&file->match, data, length))
+			return file->file_object;
+	}
+
+	return 0;
+}
+
+/* Oldest read from a handle without a match */
+static NTSTATUS fscc_match_retrieve_unmatched(struct fscc_port *port, WDFREQUEST *request)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	WDFREQUEST previous = NULL, found = NULL;
+	WDFFILEOBJECT file_object = 0;
+
+	while (1) {
+		status = WdfIoQueueFindRequest(port->read_queue2, previous, NULL, NULL, &found);
+
+		if (previous)
+			WdfObjectDereference(previous);
+
+		previous = NULL;
+
+		if (status == STATUS_NOT_FOUND)
+			continue; /* previous was canceled, start over */
+
+		if (!NT_SUCCESS(status))
+			return status;
+
+		file_object = WdfRequestGetFileObject(found);
+		if (file_object && !IsListEmpty(&WdfObjectGet_FSCC_FILE(file_object)->match_entry)) {
+			previous = found;
+			continue;
+		}
+
+		status = WdfIoQueueRetrieveFoundRequest(port->read_queue2, found, request);
+		WdfObjectDereference(found);
+
+		if (status == STATUS_NOT_FOUND)
+			continue; /* Canceled after we found it */
+
+		return status;
+	}
+}
+
+void fscc_match_init(WDFFILEOBJECT FileObject)
+{
+	struct fscc_file *file = 0;
+
+	file = WdfObjectGet_FSCC_FILE(FileObject);
+
+	file->file_object = FileObject;
+	InitializeListHead(&file->match_entry);
+	RtlZeroMemory(&file->match, sizeof(file->match));
+}
+
+NTSTATUS fscc_match_set(struct fscc_port *port, WDFFILEOBJECT FileObject, struct fscc_rx_match *match)
+{
+	struct fscc_file *file = 0;
+
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+	return_val_if_untrue(FileObject, STATUS_INVALID_PARAMETER);
+
+	if (match->length == 0 || match->length > FSCC_RX_MATCH_BYTES)
+		return STATUS_INVALID_PARAMETER;
+
+	file = WdfObjectGet_FSCC_FILE(FileObject);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+
+	file->match = *match;
+
+	if (IsListEmpty(&file->match_entry)) {
+		InsertTailList(&port->rx_matches, &file->match_entry);
+		port->rx_match_count++;
+	}
+
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "RX match set (%i handles)", port->rx_match_count);
+
+	/* Frames already waiting may belong to this handle */
+	WdfDpcEnqueue(port->process_read_dpc);
+
+	return STATUS_SUCCESS;
+}
+
+void fscc_match_clear(struct fscc_port *port, WDFFILEOBJECT FileObject)
+{
+	struct fscc_file *file = 0;
+
+	return_if_untrue(port);
+	return_if_untrue(FileObject);
+
+	file = WdfObjectGet_FSCC_FILE(FileObject);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+
+	if (IsListEmpty(&file->match_entry)) {
+		WdfSpinLockRelease(port->board_rx_spinlock);
+		return;
+	}
+
+	RemoveEntryList(&file->match_entry);
+	InitializeListHead(&file->match_entry);
+	RtlZeroMemory(&file->match, sizeof(file->match));
+	port->rx_match_count--;
+
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "RX match cleared (%i handles)", port->rx_match_count);
+
+	WdfDpcEnqueue(port->process_read_dpc);
+}
+
+void fscc_match_get(struct fscc_port *port, WDFFILEOBJECT FileObject, struct fscc_rx_match *match)
+{
+	return_if_untrue(port);
+
+	RtlZeroMemory(match, sizeof(*match));
+
+	if (!FileObject)
+		return;
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	*match = WdfObjectGet_FSCC_FILE(FileObject)->match;
+	WdfSpinLockRelease(port->board_rx_spinlock);
+}
+
+/*
+	Picks the read request the next frame belongs to. Returns
+	STATUS_NO_MORE_ENTRIES when there is no frame or its handle has no read
+	pending. Only used for frames, streaming data has no leading bytes.
+*/
+NTSTATUS fscc_match_next_request(struct fscc_port *port, WDFREQUEST *request)
+{
+	NTSTATUS status = STATUS_NO_MORE_ENTRIES;
+	unsigned char data[FSCC_RX_MATCH_BYTES];
+	WDFFILEOBJECT file_object = 0;
+	UINT32 bytes = 0, length = 0;
+
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+
+	while (fscc_user_next_read_size(port, &bytes)) {
+		/* The status bytes aren't part of the frame's data */
+		length = min(sizeof(data), (bytes > 2) ? bytes - 2 : 0);
+		length = fscc_user_peek_frame(port, data, length);
+
+		file_object = fscc_match_find(port, data, length);
+		if (file_object) {
+			status = WdfIoQueueRetrieveRequestByFileObject(port->read_queue2, file_object, request);
+			break;
+		}
+
+		if (port->open_counter > port->rx_match_count) {
+			status = fscc_match_retrieve_unmatched(port, request);
+			break;
+		}
+
+		fscc_user_discard_frame(port);
+		port->rx_frames_unclaimed++;
+	}
+
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	return status;
+}
@@ -0,0 +1,40 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FSCC_MATCH_H
+#define FSCC_MATCH_H
+
+#include <ntddk.h>
+#include <wdf.h>
+
+#include "defines.h"
+#include "Trace.h"
+
+void fscc_match_init(WDFFILEOBJECT FileObject);
+NTSTATUS fscc_match_set(struct fscc_port *port, WDFFILEOBJECT FileObject, struct fscc_rx_match *match);
+void fscc_match_clear(struct fscc_port *port, WDFFILEOBJECT FileObject);
+void fscc_match_get(struct fscc_port *port, WDFFILEOBJECT FileObject, struct fscc_rx_match *match);
+NTSTATUS fscc_match_next_request(struct fscc_port *port, WDFREQUEST *request);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "pacer.h"
+#include "port.h"
+#include "utils.h"
+#include "io.h"
+#include "ring.h"
+
+#if defined(EVENT_TRACING)
+#include "pacer.tmh"
+#endif
+
+/*
+	Token bucket in front of the tx descriptors. A frame is only written
+	into them once the bucket holds enough bytes for it and gap has passed
+	since the last frame. Until then it waits in blocking_request_queue or
+	the tx ring, and pacer_timer runs request_worker and the ring drain again
+	when it can go.
+
+	Tokens are kept in bytes times interrupt time units (100 ns) so the
+	refill needs no division. A frame larger than the burst only has to
+	wait for a full bucket, and the bucket goes negative by the difference.
+*/
+
+#define TICKS_PER_SECOND 10000000
+
+static LONG64 fscc_pacer_capacity(struct fscc_port *port)
+{
+	return (LONG64)port->tx_pacing.burst * TICKS_PER_SECOND;
+}
+
+BOOLEAN fscc_pacer_enabled(struct fscc_port *port)
+{
+	return_val_if_untrue(port, FALSE);
+
+	return (port->tx_pacing.bytes_per_second || port->tx_pacing.gap) ? TRUE : FALSE;
+}
+
+NTSTATUS fscc_pacer_set(struct fscc_port *port, struct fscc_tx_pacing *pacing)
+{
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+
+	if (pacing->bytes_per_second && pacing->burst == 0)
+		return STATUS_INVALID_PARAMETER;
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+	"TX pacing = %u bytes/s, burst %u, gap %u us",
+	pacing->bytes_per_second, pacing->burst, pacing->gap);
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+
+	port->tx_pacing = *pacing;
+	port->pacer_tokens = fscc_pacer_capacity(port);
+	port->pacer_time = KeQueryInterruptTime();
+	port->pacer_last_frame = 0;
+
+	WdfSpinLockRelease(port->board_tx_spinlock);
+
+	/* Writes that were waiting on the old settings */
+	WdfDpcEnqueue(port->request_dpc);
+
+	return STATUS_SUCCESS;
+}
+
+void fscc_pacer_get(struct fscc_port *port, struct fscc_tx_pacing *pacing)
+{
+	return_if_untrue(port);
+
+	*pacing = port->tx_pacing;
+}
+
+/*
+	Whether a frame of length bytes can be written now. If not, pacer_timer
+	is armed for when it can.
+*/
+BOOLEAN fscc_pacer_ready(struct fscc_port *port, UINT32 length)
+{
+	ULONGLONG now = 0, elapsed = 0, wait = 0, next = 0;
+	LONG64 capacity = 0, needed = 0;
+	UINT32 rate = 0;
+
+	return_val_if_untrue(port, TRUE);
+
+	if (!fscc_pacer_enabled(port))
+		return TRUE;
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+
+	now = KeQueryInterruptTime();
+	rate = port->tx_pacing.bytes_per_second;
+
+	if (rate) {
+		capacity = fscc_pacer_capacity(port);
+		elapsed = now - port->pacer_time;
+
+		if (elapsed >= (ULONGLONG)capacity / rate)
+			port->pacer_tokens = capacity;
+		else
+			port->pacer_tokens = min(port->pacer_tokens + (LONG64)(elapsed * rate), capacity);
+
+		needed = min((LONG64)length * TICKS_PER_SECOND, capacity);
+		if (port->pacer_tokens < needed)
+			wait = (needed - port->pacer_tokens + rate - 1) / rate;
+	}
+
+	port->pacer_time = now;
+
+	if (port->tx_pacing.gap && port->pacer_last_frame) {
+		next = port->pacer_last_frame + (ULONGLONG)port->tx_pacing.gap * 10;
+		if (next > now)
+			wait = max(wait, next - now);
+	}
+
+	WdfSpinLockRelease(port->board_tx_spinlock);
+
+	if (wait == 0)
+		return TRUE;
+
+	if (port->pacer_timer && !InterlockedExchange(&port->pacer_armed, 1))
+		WdfTimerStart(port->pacer_timer, -(LONGLONG)wait); /* Relative, in 100 ns */
+
+	return FALSE;
+}
+
+/* Takes a written frame out of the bucket */
+void fscc_pacer_charge(struct fscc_port *port, UINT32 length)
+{
+	return_if_untrue(port);
+
+	if (!fscc_pacer_enabled(port))
+		return;
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+
+	if (port->tx_pacing.bytes_per_second)
+		port->pacer_tokens -= (LONG64)length * TICKS_PER_SECOND;
+
+	port->pacer_last_frame = KeQueryInterruptTime();
+
+	WdfSpinLockRelease(port->board_tx_spinlock);
+}
+
+VOID fscc_pacer_handler(WDFTIMER Timer)
+{
+	struct fscc_port *port = 0;
+
+	port = WdfObjectGet_FSCC_PORT(WdfTimerGetParentObject(Timer));
+
+	InterlockedExchange(&port->pacer_armed, 0);
+
+	WdfDpcEnqueue(port->request_dpc);
+	fscc_ring_drain_tx(port);
+}
@@ -0,0 +1,42 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FSCC_PACER_H
+#define FSCC_PACER_H
+
+#include <ntddk.h>
+#include <wdf.h>
+
+#include "defines.h"
+#include "Trace.h"
+
+EVT_WDF_TIMER fscc_pacer_handler;
+
+BOOLEAN fscc_pacer_enabled(struct fscc_port *port);
+NTSTATUS fscc_pacer_set(struct fscc_port *port, struct fscc_tx_pacing *pacing);
+void fscc_pacer_get(struct fscc_port *port, struct fscc_tx_pacing *pacing);
+BOOLEAN fscc_pacer_ready(struct fscc_port *port, UINT32 length);
+void fscc_pacer_charge(struct fscc_port *port, UINT32 length);
+
+#endif
@@ -28,6 +28,13 @@ THE SOFTWARE.
 #include "driver.h"
 #include "debug.h"
 #include "io.h"
+#include "ring.h"
+#include "match.h"
+#include "pacer.h"
+#include "defaults.h"
+#include "rxfilter.h"
+#include "repeat.h"
+#include "snapshot.h"
 
 #include <ntddser.h>
 #include <ntstrsafe.h>
@@ -38,18 +45,21 @@ THE SOFTWARE.
 #endif
 
 #define NUM_CLOCK_BYTES 20
-#define TIMER_DELAY_MS 250
+#define MIN_TIMER_PERIOD 100 /* Microseconds */
+#define REGISTER_WAIT_READS 100 /* For all the waits in a transaction together */
 
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL FsccEvtIoDeviceControl;
 EVT_WDF_DEVICE_FILE_CREATE FsccDeviceFileCreate;
 EVT_WDF_FILE_CLOSE FsccFileClose;
+EVT_WDF_FILE_CLEANUP FsccFileCleanup;
 EVT_WDF_DEVICE_PREPARE_HARDWARE FsccEvtDevicePrepareHardware;
 EVT_WDF_DEVICE_RELEASE_HARDWARE FsccEvtDeviceReleaseHardware;
+EVT_WDF_DEVICE_D0_ENTRY FsccEvtDeviceD0Entry;
+EVT_WDF_DEVICE_D0_EXIT FsccEvtDeviceD0Exit;
+EVT_WDF_WORKITEM fscc_port_create_rx_worker;
 
 NTSTATUS fscc_port_get_port_num(struct fscc_port *port, unsigned *port_num);
 NTSTATUS fscc_port_set_port_num(struct fscc_port *port, unsigned value);
-NTSTATUS fscc_port_get_default_memory(struct fscc_port *port, struct fscc_memory *memory);
-NTSTATUS fscc_port_get_default_registers(struct fscc_port *port, struct fscc_registers *regs);
 NTSTATUS fscc_port_set_friendly_name(_In_ WDFDEVICE Device, unsigned portnum);
 
 #pragma warning( disable: 4267 )
@@ -62,6 +72,7 @@ IN PWDFDEVICE_INIT DeviceInit)
 	WDF_OBJECT_ATTRIBUTES attributes;
 	WDFDEVICE device;
 	WDF_IO_QUEUE_CONFIG queue_config;
+	WDF_OBJECT_ATTRIBUTES queueAttributes;
 
 	WCHAR device_name_buffer[20];
 	UNICODE_STRING device_name;
@@ -80,7 +91,13 @@ IN PWDFDEVICE_INIT DeviceInit)
 	WDF_DPC_CONFIG dpcConfig;
 	WDF_OBJECT_ATTRIBUTES dpcAttributes;
 
+	WDF_WORKITEM_CONFIG workitemConfig;
+	WDF_OBJECT_ATTRIBUTES workitemAttributes;
+	ULONGLONG start_time;
+
 	WDF_FILEOBJECT_CONFIG deviceConfig;
+	WDF_OBJECT_ATTRIBUTES fileAttributes;
+	WDF_OBJECT_ATTRIBUTES requestAttributes;
 
 	static int instance = 0;
 	int last_port_num = -1;
@@ -106,14 +123,19 @@ IN PWDFDEVICE_INIT DeviceInit)
 	WDF_FILEOBJECT_CONFIG_INIT(&deviceConfig,
 	FsccDeviceFileCreate,
 	FsccFileClose,
-	WDF_NO_EVENT_CALLBACK // No cleanup callback
+	FsccFileCleanup
 	);
 
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&fileAttributes, FSCC_FILE);
+
 	WdfDeviceInitSetFileObjectConfig(DeviceInit,
 	&deviceConfig,
-	WDF_NO_OBJECT_ATTRIBUTES
+	&fileAttributes
 	);    
 
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&requestAttributes, FSCC_REQUEST);
+	WdfDeviceInitSetRequestAttributes(DeviceInit, &requestAttributes);
+
 	RtlInitEmptyUnicodeString(&device_name, device_name_buffer,
 	sizeof(device_name_buffer));
 	status = RtlUnicodeStringPrintf(&device_name, L"\\Device\\FSCC%i",
@@ -148,6 +170,8 @@ IN PWDFDEVICE_INIT DeviceInit)
 	WDF_PNPPOWER_EVENT_CALLBACKS_INIT(&pnpPowerCallbacks);
 	pnpPowerCallbacks.EvtDevicePrepareHardware = FsccEvtDevicePrepareHardware;
 	pnpPowerCallbacks.EvtDeviceReleaseHardware = FsccEvtDeviceReleaseHardware;
+	pnpPowerCallbacks.EvtDeviceD0Entry = FsccEvtDeviceD0Entry;
+	pnpPowerCallbacks.EvtDeviceD0Exit = FsccEvtDeviceD0Exit;
 	WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit, &pnpPowerCallbacks);
 
 	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, FSCC_PORT);
@@ -163,6 +187,9 @@ IN PWDFDEVICE_INIT DeviceInit)
 
 	port->device = device;
 	port->open_counter = 0;
+	InitializeListHead(&port->rx_matches);
+	port->rx_filter_saved_RAR = -1;
+	port->rx_filter_saved_RAMR = -1;
 
 
 	WDF_INTERRUPT_CONFIG_INIT(&interruptConfig, fscc_isr, NULL);
@@ -181,8 +208,13 @@ IN PWDFDEVICE_INIT DeviceInit)
 	WDF_IO_QUEUE_CONFIG_INIT(&queue_config, WdfIoQueueDispatchSequential);
 	queue_config.EvtIoDeviceControl = FsccEvtIoDeviceControl;
 
+	/* FSCC_SET_TX_REPEAT and FSCC_CLEAR_TX_REPEAT create and free common
+	   buffers, which can only be done at PASSIVE_LEVEL */
+	WDF_OBJECT_ATTRIBUTES_INIT(&queueAttributes);
+	queueAttributes.ExecutionLevel = WdfExecutionLevelPassive;
+
 	status = WdfIoQueueCreate(port->device, &queue_config,
-	WDF_NO_OBJECT_ATTRIBUTES, &port->ioctl_queue);
+	&queueAttributes, &port->ioctl_queue);
 	if(!NT_SUCCESS(status)) {
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
 		"WdfIoQueueCreate failed %!STATUS!", status);
@@ -278,6 +310,40 @@ IN PWDFDEVICE_INIT DeviceInit)
 		return 0;
 	}
 
+
+	WDF_IO_QUEUE_CONFIG_INIT(&queue_config, WdfIoQueueDispatchManual);
+	queue_config.EvtIoCanceledOnQueue = fscc_ring_canceled;
+
+	status = WdfIoQueueCreate(port->device, &queue_config,
+	WDF_NO_OBJECT_ATTRIBUTES, &port->ring_queue);
+	if(!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfIoQueueCreate failed %!STATUS!", status);
+		return 0;
+	}
+
+
+	WDF_IO_QUEUE_CONFIG_INIT(&queue_config, WdfIoQueueDispatchManual);
+
+	status = WdfIoQueueCreate(port->device, &queue_config,
+	WDF_NO_OBJECT_ATTRIBUTES, &port->rx_ring.wait_queue);
+	if(!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfIoQueueCreate failed %!STATUS!", status);
+		return 0;
+	}
+
+
+	WDF_IO_QUEUE_CONFIG_INIT(&queue_config, WdfIoQueueDispatchManual);
+
+	status = WdfIoQueueCreate(port->device, &queue_config,
+	WDF_NO_OBJECT_ATTRIBUTES, &port->tx_ring.wait_queue);
+	if(!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfIoQueueCreate failed %!STATUS!", status);
+		return 0;
+	}
+
 	//
 	// In addition to setting NoDisplayInUI in DeviceCaps, we
 	// have to do the following to hide the device. Following call
@@ -386,6 +452,14 @@ IN PWDFDEVICE_INIT DeviceInit)
 		return 0;
 	}
 
+	status = WdfSpinLockCreate(&attributes, &port->ring_spinlock);
+	if (!NT_SUCCESS(status)) {
+		WdfObjectDelete(port->device);
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfSpinLockCreate failed %!STATUS!", status);
+		return 0;
+	}
+
 	WDF_DPC_CONFIG_INIT(&dpcConfig, &oframe_worker);
 	dpcConfig.AutomaticSerialization = TRUE;
 
@@ -484,6 +558,39 @@ IN PWDFDEVICE_INIT DeviceInit)
 		return 0;
 	}
 
+	WDF_DPC_CONFIG_INIT(&dpcConfig, &fscc_repeat_worker);
+	dpcConfig.AutomaticSerialization = TRUE;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&dpcAttributes);
+	dpcAttributes.ParentObject = port->device;
+
+	status = WdfDpcCreate(&dpcConfig, &dpcAttributes, &port->repeat_dpc);
+	if (!NT_SUCCESS(status)) {
+		WdfObjectDelete(port->device);
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfDpcCreate failed %!STATUS!", status);
+		return 0;
+	}
+
+	WDF_WORKITEM_CONFIG_INIT(&workitemConfig, &fscc_port_create_rx_worker);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&workitemAttributes);
+	workitemAttributes.ParentObject = port->device;
+
+	status = WdfWorkItemCreate(&workitemConfig, &workitemAttributes, &port->rx_ring_work_item);
+	if (!NT_SUCCESS(status)) {
+		WdfObjectDelete(port->device);
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfWorkItemCreate failed %!STATUS!", status);
+		return 0;
+	}
+
+	start_time = KeQueryInterruptTime();
+	fscc_defaults_load(port->device, &port->defaults);
+	port->init_defaults_time = (KeQueryInterruptTime() - start_time) / 10;
+
+	fscc_port_set_affinity(port);
+
 	return port;
 }
 
@@ -498,12 +605,16 @@ WDFCMRESLIST ResourcesRaw, WDFCMRESLIST ResourcesTranslated)
 	struct fscc_memory memory;
 	struct fscc_port *port = 0;
 	struct clock_data_fscc default_fscc_clock;
+	ULONGLONG start_time;
+	ULONGLONG step_time;
 	int i;
 
 	UNREFERENCED_PARAMETER(ResourcesRaw);
 
 	port = WdfObjectGet_FSCC_PORT(Device);
 
+	start_time = KeQueryInterruptTime();
+
 	status = fscc_card_init(&port->card, ResourcesTranslated, Device);
 	if (!NT_SUCCESS(status)) {
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
@@ -549,22 +660,21 @@ WDFCMRESLIST ResourcesRaw, WDFCMRESLIST ResourcesTranslated)
 	fscc_port_set_wait_on_write(port, DEFAULT_WAIT_ON_WRITE_VALUE);
 	fscc_port_set_blocking_write(port, DEFAULT_BLOCKING_WRITE_VALUE);
 	fscc_port_set_force_fifo(port, DEFAULT_FORCE_FIFO_VALUE);
+	fscc_port_set_rx_poll_interval(port, DEFAULT_RX_POLL_INTERVAL_VALUE);
+	fscc_port_set_timer_period(port, DEFAULT_TIMER_PERIOD_VALUE);
 	
-	memory.tx_num = DEFAULT_BUFFER_TX_NUM;
-	memory.rx_num = DEFAULT_BUFFER_RX_NUM;
-	memory.tx_size = DEFAULT_BUFFER_TX_SIZE;
-	memory.rx_size = DEFAULT_BUFFER_RX_SIZE;
-	fscc_port_get_default_memory(port, &memory);
-	status = fscc_io_create_rx(port, memory.rx_num, memory.rx_size);
-	if (!NT_SUCCESS(status)) {
-		fscc_io_destroy_rx(port);
-		fscc_io_destroy_tx(port);
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
-		"fscc_card_init build_rx failed %!STATUS!", status);
-		return status;
-	}
+	/* The rx descriptors are the slowest step and nothing else here needs
+	   them until DMA is enabled, so they are allocated on a worker thread
+	   while the tx descriptors, registers and clock are set up on this one. */
+	WdfWorkItemEnqueue(port->rx_ring_work_item);
+
+	memory.tx_num = port->defaults.values[FSCC_DEFAULT_TX_NUM];
+	memory.tx_size = port->defaults.values[FSCC_DEFAULT_TX_SIZE];
+	step_time = KeQueryInterruptTime();
 	status = fscc_io_create_tx(port, memory.tx_num, memory.tx_size);
+	port->init_tx_ring_time = (KeQueryInterruptTime() - step_time) / 10;
 	if (!NT_SUCCESS(status)) {
+		WdfWorkItemFlush(port->rx_ring_work_item);
 		fscc_io_destroy_tx(port);
 		fscc_io_destroy_rx(port);
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
@@ -574,41 +684,55 @@ WDFCMRESLIST ResourcesRaw, WDFCMRESLIST ResourcesTranslated)
 	
 
 	FSCC_REGISTERS_INIT(port->register_storage);
-	port->register_storage.FIFOT = DEFAULT_FIFOT_VALUE;
-	port->register_storage.CCR0 = DEFAULT_CCR0_VALUE;
-	port->register_storage.CCR1 = DEFAULT_CCR1_VALUE;
-	port->register_storage.CCR2 = DEFAULT_CCR2_VALUE;
-	port->register_storage.BGR = DEFAULT_BGR_VALUE;
-	port->register_storage.SSR = DEFAULT_SSR_VALUE;
-	port->register_storage.SMR = DEFAULT_SMR_VALUE;
-	port->register_storage.TSR = DEFAULT_TSR_VALUE;
-	port->register_storage.TMR = DEFAULT_TMR_VALUE;
-	port->register_storage.RAR = DEFAULT_RAR_VALUE;
-	port->register_storage.RAMR = DEFAULT_RAMR_VALUE;
-	port->register_storage.PPR = DEFAULT_PPR_VALUE;
-	port->register_storage.TCR = DEFAULT_TCR_VALUE;
-	port->register_storage.IMR = DEFAULT_IMR_VALUE;
-	port->register_storage.DPLLR = DEFAULT_DPLLR_VALUE;
-	port->register_storage.FCR = DEFAULT_FCR_VALUE;
-	fscc_port_get_default_registers(port, &port->register_storage);
+	port->register_storage.FIFOT = port->defaults.values[FSCC_DEFAULT_FIFOT];
+	port->register_storage.CCR0 = port->defaults.values[FSCC_DEFAULT_CCR0];
+	port->register_storage.CCR1 = port->defaults.values[FSCC_DEFAULT_CCR1];
+	port->register_storage.CCR2 = port->defaults.values[FSCC_DEFAULT_CCR2];
+	port->register_storage.BGR = port->defaults.values[FSCC_DEFAULT_BGR];
+	port->register_storage.SSR = port->defaults.values[FSCC_DEFAULT_SSR];
+	port->register_storage.SMR = port->defaults.values[FSCC_DEFAULT_SMR];
+	port->register_storage.TSR = port->defaults.values[FSCC_DEFAULT_TSR];
+	port->register_storage.TMR = port->defaults.values[FSCC_DEFAULT_TMR];
+	port->register_storage.RAR = port->defaults.values[FSCC_DEFAULT_RAR];
+	port->register_storage.RAMR = port->defaults.values[FSCC_DEFAULT_RAMR];
+	port->register_storage.PPR = port->defaults.values[FSCC_DEFAULT_PPR];
+	port->register_storage.TCR = port->defaults.values[FSCC_DEFAULT_TCR];
+	port->register_storage.IMR = port->defaults.values[FSCC_DEFAULT_IMR];
+	port->register_storage.DPLLR = port->defaults.values[FSCC_DEFAULT_DPLLR];
+	port->register_storage.FCR = port->defaults.values[FSCC_DEFAULT_FCR];
+	step_time = KeQueryInterruptTime();
 	fscc_port_set_registers(port, &port->register_storage);
+	fscc_filter_restart(port);
+	port->init_registers_time = (KeQueryInterruptTime() - step_time) / 10;
 	
 	port->rx_frame_size = 0;
 	port->last_isr_value = 0;
 
 	default_fscc_clock.frequency = 18432000;
 	for (i = 0; i < 20; i++) default_fscc_clock.clock_bits[i] = clock_bits[i];
+	step_time = KeQueryInterruptTime();
 	fscc_port_set_clock_bits(port, &default_fscc_clock);
+	port->init_clock_time = (KeQueryInterruptTime() - step_time) / 10;
+
+	WdfWorkItemFlush(port->rx_ring_work_item);
+	if (!NT_SUCCESS(port->rx_ring_status)) {
+		fscc_io_destroy_rx(port);
+		fscc_io_destroy_tx(port);
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"fscc_card_init build_rx failed %!STATUS!", port->rx_ring_status);
+		return port->rx_ring_status;
+	}
 	
+	step_time = KeQueryInterruptTime();
 	if(fscc_port_uses_dma(port)) 
 		fscc_dma_port_enable(port);
 	
 	fscc_io_purge_rx(port);
 	fscc_io_purge_tx(port);
+	port->init_purge_time = (KeQueryInterruptTime() - step_time) / 10;
 	
 	WDF_TIMER_CONFIG_INIT(&timerConfig, timer_handler);
-	timerConfig.Period = TIMER_DELAY_MS;
-	timerConfig.TolerableDelay = TIMER_DELAY_MS;
+	timerConfig.UseHighResolutionTimer = WdfTrue;
 
 	WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
 	timerAttributes.ParentObject = port->device;
@@ -619,11 +743,61 @@ WDFCMRESLIST ResourcesRaw, WDFCMRESLIST ResourcesTranslated)
 		return status;
 	}
 
-	WdfTimerStart(port->timer, WDF_ABS_TIMEOUT_IN_MS(TIMER_DELAY_MS));
+	port->timer_armed = 0;
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, rx_poll_handler);
+	timerConfig.UseHighResolutionTimer = WdfTrue;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
+	timerAttributes.ParentObject = port->device;
+	status = WdfTimerCreate(&timerConfig, &timerAttributes, &port->rx_poll_timer);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfTimerCreate failed %!STATUS!", status);
+		return status;
+	}
+
+	port->rx_poll_armed = 0;
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, fscc_pacer_handler);
+	timerConfig.UseHighResolutionTimer = WdfTrue;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
+	timerAttributes.ParentObject = port->device;
+	status = WdfTimerCreate(&timerConfig, &timerAttributes, &port->pacer_timer);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfTimerCreate failed %!STATUS!", status);
+		return status;
+	}
+
+	port->pacer_armed = 0;
+
+	port->init_total_time = (KeQueryInterruptTime() - start_time) / 10;
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+	"Started in %I64u us (rx %I64u, tx %I64u, registers %I64u, clock %I64u, purge %I64u)",
+	port->init_total_time, port->init_rx_ring_time, port->init_tx_ring_time,
+	port->init_registers_time, port->init_clock_time, port->init_purge_time);
 
 	return STATUS_SUCCESS;
 }
 
+/* Allocates the rx descriptors for FsccEvtDevicePrepareHardware */
+VOID fscc_port_create_rx_worker(WDFWORKITEM WorkItem)
+{
+	struct fscc_port *port = 0;
+	ULONGLONG start_time;
+
+	port = WdfObjectGet_FSCC_PORT(WdfWorkItemGetParentObject(WorkItem));
+
+	start_time = KeQueryInterruptTime();
+	port->rx_ring_status = fscc_io_create_rx(port,
+	port->defaults.values[FSCC_DEFAULT_RX_NUM],
+	port->defaults.values[FSCC_DEFAULT_RX_SIZE]);
+	port->init_rx_ring_time = (KeQueryInterruptTime() - start_time) / 10;
+}
+
 NTSTATUS FsccEvtDeviceReleaseHardware(WDFDEVICE Device,
 WDFCMRESLIST ResourcesTranslated)
 {
@@ -632,14 +806,159 @@ WDFCMRESLIST ResourcesTranslated)
 
 	port = WdfObjectGet_FSCC_PORT(Device);
 
+	/* Both timers read the rx descriptors */
+	if (port->timer)
+		WdfTimerStop(port->timer, TRUE);
+
+	if (port->rx_poll_timer)
+		WdfTimerStop(port->rx_poll_timer, TRUE);
+
+	/* Drains the tx ring into the tx descriptors */
+	if (port->pacer_timer)
+		WdfTimerStop(port->pacer_timer, TRUE);
+
 	fscc_io_destroy_tx(port);
 	fscc_io_destroy_rx(port);
+	fscc_repeat_destroy(port);
 
 	status = fscc_card_delete(&port->card, ResourcesTranslated);
 
 	return status;
 }
 
+/*
+	The card loses its registers, clock generator and DMA setup when it
+	leaves D0, but everything else, the descriptors and settings like
+	append_status included, stays in memory. The registers that can be set
+	and the clock bits are saved here as a snapshot (see snapshot.c) and
+	written back in one pass by FsccEvtDeviceD0Entry. Leaving for good
+	(D3Final) saves nothing, the next start sets the port up from the
+	defaults again.
+*/
+NTSTATUS FsccEvtDeviceD0Exit(WDFDEVICE Device, WDF_POWER_DEVICE_STATE TargetState)
+{
+	struct fscc_port *port = 0;
+	struct fscc_registers regs;
+	struct clock_data_fscc clock_data;
+
+	port = WdfObjectGet_FSCC_PORT(Device);
+
+	if (TargetState == WdfPowerDeviceD3Final)
+		return STATUS_SUCCESS;
+
+	/* All of the timers touch the hardware */
+	if (port->timer)
+		WdfTimerStop(port->timer, TRUE);
+
+	if (port->rx_poll_timer)
+		WdfTimerStop(port->rx_poll_timer, TRUE);
+
+	if (port->pacer_timer)
+		WdfTimerStop(port->pacer_timer, TRUE);
+
+	InterlockedExchange(&port->timer_armed, 0);
+	InterlockedExchange(&port->rx_poll_armed, 0);
+	InterlockedExchange(&port->pacer_armed, 0);
+
+	/* The interrupt is already off, but DPCs it or the timers queued can
+	   still start DMA again */
+	WdfDpcCancel(port->oframe_dpc, TRUE);
+	WdfDpcCancel(port->iframe_dpc, TRUE);
+	WdfDpcCancel(port->isr_alert_dpc, TRUE);
+	WdfDpcCancel(port->request_dpc, TRUE);
+	WdfDpcCancel(port->process_read_dpc, TRUE);
+	WdfDpcCancel(port->alls_dpc, TRUE);
+	WdfDpcCancel(port->timestamp_dpc, TRUE);
+	WdfDpcCancel(port->repeat_dpc, TRUE);
+
+	FSCC_REGISTERS_INIT(regs);
+	regs.FIFOT = FSCC_UPDATE_VALUE;
+	regs.CCR0 = FSCC_UPDATE_VALUE;
+	regs.CCR1 = FSCC_UPDATE_VALUE;
+	regs.CCR2 = FSCC_UPDATE_VALUE;
+	regs.BGR = FSCC_UPDATE_VALUE;
+	regs.SSR = FSCC_UPDATE_VALUE;
+	regs.SMR = FSCC_UPDATE_VALUE;
+	regs.TSR = FSCC_UPDATE_VALUE;
+	regs.TMR = FSCC_UPDATE_VALUE;
+	regs.RAR = FSCC_UPDATE_VALUE;
+	regs.RAMR = FSCC_UPDATE_VALUE;
+	regs.PPR = FSCC_UPDATE_VALUE;
+	regs.TCR = FSCC_UPDATE_VALUE;
+	regs.IMR = FSCC_UPDATE_VALUE;
+	regs.DPLLR = FSCC_UPDATE_VALUE;
+	regs.FCR = FSCC_UPDATE_VALUE;
+	fscc_port_get_registers(port, &regs);
+
+	WdfSpinLockAcquire(port->board_settings_spinlock);
+	clock_data = port->clock_data;
+	WdfSpinLockRelease(port->board_settings_spinlock);
+
+	port->power_snapshot_length = fscc_snapshot_serialize(&regs, &clock_data, port->power_snapshot);
+
+	if (fscc_port_uses_dma(port))
+		fscc_dma_port_disable(port);
+
+	port->power_saved = TRUE;
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+	"Saved port state for D%d", TargetState - WdfPowerDeviceD0);
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS FsccEvtDeviceD0Entry(WDFDEVICE Device, WDF_POWER_DEVICE_STATE PreviousState)
+{
+	struct fscc_port *port = 0;
+	struct fscc_registers regs;
+	struct clock_data_fscc clock_data;
+	ULONGLONG start_time;
+
+	UNREFERENCED_PARAMETER(PreviousState);
+
+	port = WdfObjectGet_FSCC_PORT(Device);
+
+	/* FsccEvtDevicePrepareHardware has just set everything up */
+	if (!port->power_saved)
+		return STATUS_SUCCESS;
+
+	start_time = KeQueryInterruptTime();
+
+	/* The cache holds what was written before, not what the card has now */
+	FSCC_REGISTERS_INIT(port->register_storage);
+
+	if (fscc_snapshot_parse(port->power_snapshot, port->power_snapshot_length, &regs, &clock_data) >= 0) {
+		fscc_port_set_registers(port, &regs);
+		fscc_port_set_clock_bits(port, &clock_data);
+	}
+	else {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "Saved port state isn't readable");
+	}
+
+	if (fscc_port_uses_dma(port))
+		fscc_dma_port_enable(port);
+
+	fscc_io_resume(port);
+	fscc_repeat_resume(port);
+
+	port->power_saved = FALSE;
+	port->init_resume_time = (KeQueryInterruptTime() - start_time) / 10;
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+	"Restored port state in %I64u us", port->init_resume_time);
+
+	if (!WDF_IO_QUEUE_IDLE(WdfIoQueueGetState(port->blocking_request_queue, NULL, NULL)))
+		WdfDpcEnqueue(port->request_dpc);
+
+	if (!fscc_port_uses_dma(port))
+		WdfDpcEnqueue(port->oframe_dpc);
+
+	fscc_port_start_timer(port);
+	fscc_port_start_rx_poll(port);
+
+	return STATUS_SUCCESS;
+}
+
 VOID FsccDeviceFileCreate(
 IN  WDFDEVICE Device,
 IN  WDFREQUEST Request,
@@ -648,10 +967,10 @@ IN  WDFFILEOBJECT FileObject
 {
 	struct fscc_port *port = 0;
 
-	UNREFERENCED_PARAMETER(FileObject);
-
 	port = WdfObjectGet_FSCC_PORT(Device);
 
+	fscc_match_init(FileObject);
+
 	WdfSpinLockAcquire(port->board_settings_spinlock);
 
 	if (fscc_port_using_async(port)) {
@@ -679,6 +998,18 @@ IN  WDFFILEOBJECT FileObject
 	WdfRequestComplete(Request, STATUS_SUCCESS);
 }
 
+VOID FsccFileCleanup(
+IN  WDFFILEOBJECT FileObject
+)
+{
+	struct fscc_port *port = 0;
+
+	port = WdfObjectGet_FSCC_PORT(WdfFileObjectGetDevice(FileObject));
+
+	fscc_ring_cleanup(port, FileObject);
+	fscc_match_clear(port, FileObject);
+}
+
 VOID FsccFileClose(
 IN  WDFFILEOBJECT FileObject
 )
@@ -777,6 +1108,8 @@ IN ULONG IoControlCode)
 		break;
 
 	case FSCC_PURGE_TX:
+		fscc_repeat_clear(port);
+
 		status = fscc_io_purge_tx(port);
 		if (!NT_SUCCESS(status)) {
 			TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
@@ -981,6 +1314,34 @@ IN ULONG IoControlCode)
 		fscc_port_set_wait_on_write(port, FALSE);
 		break;
 
+	case FSCC_MAP_RX_RING:
+		fscc_ring_map_rx(port, Request);
+		return;
+
+	case FSCC_UNMAP_RX_RING:
+		status = fscc_ring_unmap_rx(port);
+		break;
+
+	case FSCC_WAIT_RX_RING:
+		fscc_ring_wait_rx(port, Request);
+		return;
+
+	case FSCC_MAP_TX_RING:
+		fscc_ring_map_tx(port, Request);
+		return;
+
+	case FSCC_UNMAP_TX_RING:
+		status = fscc_ring_unmap_tx(port);
+		break;
+
+	case FSCC_WAIT_TX_RING:
+		fscc_ring_wait_tx(port, Request);
+		return;
+
+	case FSCC_KICK_TX_RING:
+		fscc_ring_drain_tx(port);
+		break;
+
 	case FSCC_TRACK_INTERRUPTS:
 		status = WdfRequestForwardToIoQueue(Request, port->isr_queue);
 		if (!NT_SUCCESS(status)) {
@@ -1022,83 +1383,531 @@ IN ULONG IoControlCode)
 		status = fscc_port_set_force_fifo(port, FALSE);
 		break;
 
-	case FSCC_GET_FORCE_FIFO: {
-			BOOLEAN *force_fifo = 0;
+	case FSCC_SET_TIMER_PERIOD: {
+			UINT32 *period = 0;
+
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*period), (PVOID *)&period, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			status = fscc_port_set_timer_period(port, *period);
+		}
+
+		break;
+
+	case FSCC_GET_TIMER_PERIOD: {
+			UINT32 *period = 0;
 
 			status = WdfRequestRetrieveOutputBuffer(Request,
-			sizeof(*force_fifo), (PVOID *)&force_fifo,
-			NULL);
+			sizeof(*period), (PVOID *)&period, NULL);
 			if (!NT_SUCCESS(status)) {
 				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
 				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
 				break;
 			}
 
-			*force_fifo = fscc_port_get_force_fifo(port);
+			*period = fscc_port_get_timer_period(port);
 
-			bytes_returned = sizeof(*force_fifo);
+			bytes_returned = sizeof(*period);
 		}
+
 		break;
-	default:
-		status = STATUS_NOT_SUPPORTED;
-		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
-		"Unknown DeviceIoControl 0x%x", IoControlCode);
-		break;
-	}
 
-	WdfRequestCompleteWithInformation(Request, status, bytes_returned);
-}
+	case FSCC_SET_RX_POLL_INTERVAL: {
+			UINT32 *interval = 0;
 
-UINT32 fscc_port_get_register(struct fscc_port *port, unsigned bar,
-unsigned register_offset)
-{
-	unsigned offset = 0;
-	UINT32 value = 0;
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*interval), (PVOID *)&interval, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
 
-	offset = port_offset(port, bar, register_offset);
-	value = fscc_card_get_register(&port->card, bar, offset);
+			status = fscc_port_set_rx_poll_interval(port, *interval);
+			if (!NT_SUCCESS(status))
+				break;
 
-	return value;
-}
+			fscc_port_start_rx_poll(port);
+		}
 
-/* Basic check to see if the CE bit is set. */
-unsigned fscc_port_timed_out(struct fscc_port *port)
-{
-	UINT32 star_value = 0;
-	unsigned i = 0;
+		break;
 
-	return_val_if_untrue(port, 0);
+	case FSCC_GET_RX_POLL_INTERVAL: {
+			UINT32 *interval = 0;
 
-	for (i = 0; i < DEFAULT_TIMEOUT_VALUE; i++) {
-		star_value = fscc_port_get_register(port, 0, STAR_OFFSET);
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*interval), (PVOID *)&interval, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
 
-		if ((star_value & CE_BIT) == 0)
-		return 0;
-	}
+			*interval = fscc_port_get_rx_poll_interval(port);
 
-	return 1;
-}
+			bytes_returned = sizeof(*interval);
+		}
 
-NTSTATUS fscc_port_set_register(struct fscc_port *port, unsigned bar,
-unsigned register_offset, UINT32 value)
-{
-	unsigned offset = 0;
-	return_val_if_untrue(port, 0);
+		break;
 
-	offset = port_offset(port, bar, register_offset);
+	case FSCC_SET_RX_MATCH: {
+			struct fscc_rx_match *match = 0;
 
-	/* Checks to make sure there is a clock present. */
-	if (register_offset == CMDR_OFFSET && port->ignore_timeout == FALSE
-			&& fscc_port_timed_out(port)) {
-		return STATUS_IO_TIMEOUT;
-	}
-	// TODO Maybe remove this?
-	if((register_offset == DMACCR_OFFSET) && fscc_port_uses_dma(port) && bar == 2) value |= 0x03000000;
-	else if((register_offset == DMACCR_OFFSET) && !fscc_port_uses_dma(port) && bar == 2) value &= ~0x03000000;
-	fscc_card_set_register(&port->card, bar, offset, value);
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*match), (PVOID *)&match, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
 
-	if (bar == 0) {
-		display_register(bar, register_offset,
+			status = fscc_match_set(port, WdfRequestGetFileObject(Request), match);
+		}
+
+		break;
+
+	case FSCC_CLEAR_RX_MATCH:
+		fscc_match_clear(port, WdfRequestGetFileObject(Request));
+		break;
+
+	case FSCC_GET_RX_MATCH: {
+			struct fscc_rx_match *match = 0;
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*match), (PVOID *)&match, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			fscc_match_get(port, WdfRequestGetFileObject(Request), match);
+
+			bytes_returned = sizeof(*match);
+		}
+
+		break;
+
+	case FSCC_SET_TX_PRIORITY: {
+			UINT32 *priority = 0;
+
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*priority), (PVOID *)&priority, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			status = fscc_port_set_tx_priority(port, WdfRequestGetFileObject(Request), *priority);
+		}
+
+		break;
+
+	case FSCC_GET_TX_PRIORITY: {
+			UINT32 *priority = 0;
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*priority), (PVOID *)&priority, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			*priority = fscc_port_get_tx_priority(port, WdfRequestGetFileObject(Request));
+
+			bytes_returned = sizeof(*priority);
+		}
+
+		break;
+
+	case FSCC_SET_TX_PACING: {
+			struct fscc_tx_pacing *pacing = 0;
+
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*pacing), (PVOID *)&pacing, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			status = fscc_pacer_set(port, pacing);
+		}
+
+		break;
+
+	case FSCC_GET_TX_PACING: {
+			struct fscc_tx_pacing *pacing = 0;
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*pacing), (PVOID *)&pacing, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			fscc_pacer_get(port, pacing);
+
+			bytes_returned = sizeof(*pacing);
+		}
+
+		break;
+
+	case FSCC_SET_RX_FILTER: {
+			struct fscc_rx_filter *filter = 0;
+
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*filter), (PVOID *)&filter, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			status = fscc_filter_set(port, filter);
+		}
+
+		break;
+
+	case FSCC_CLEAR_RX_FILTER:
+		fscc_filter_clear(port);
+		break;
+
+	case FSCC_GET_RX_FILTER: {
+			struct fscc_rx_filter *filter = 0;
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*filter), (PVOID *)&filter, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			fscc_filter_get(port, filter);
+
+			bytes_returned = sizeof(*filter);
+		}
+
+		break;
+
+	case FSCC_SET_TX_REPEAT: {
+			unsigned char *frames = 0;
+			size_t length = 0;
+
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(UINT32), (PVOID *)&frames, &length);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			if (length > MAXULONG) {
+				status = STATUS_INVALID_PARAMETER;
+				break;
+			}
+
+			status = fscc_repeat_set(port, frames, (UINT32)length);
+		}
+
+		break;
+
+	case FSCC_CLEAR_TX_REPEAT:
+		fscc_repeat_clear(port);
+		break;
+
+	case FSCC_GET_FORCE_FIFO: {
+			BOOLEAN *force_fifo = 0;
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*force_fifo), (PVOID *)&force_fifo,
+			NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			*force_fifo = fscc_port_get_force_fifo(port);
+
+			bytes_returned = sizeof(*force_fifo);
+		}
+
+		break;
+
+	case FSCC_GET_STATS: {
+			struct fscc_stats *stats = 0;
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(*stats), (PVOID *)&stats, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			fscc_port_get_stats(port, stats);
+
+			bytes_returned = sizeof(*stats);
+		}
+
+		break;
+
+	case FSCC_REGISTER_TRANSACTION: {
+			struct fscc_register_op *input_ops = 0;
+			struct fscc_register_op *output_ops = 0;
+			size_t length = 0;
+
+			status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(*input_ops), (PVOID *)&input_ops, &length);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveInputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			if (length % sizeof(*input_ops) ||
+				length / sizeof(*input_ops) > FSCC_MAX_REGISTER_OPS) {
+				status = STATUS_INVALID_PARAMETER;
+				break;
+			}
+
+			status = WdfRequestRetrieveOutputBuffer(Request,
+			length, (PVOID *)&output_ops, NULL);
+			if (!NT_SUCCESS(status)) {
+				TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+				"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+				break;
+			}
+
+			if (output_ops != input_ops)
+				RtlCopyMemory(output_ops, input_ops, length);
+
+			WdfSpinLockAcquire(port->board_settings_spinlock);
+			status = fscc_port_execute_register_ops(port, output_ops,
+			(unsigned)(length / sizeof(*output_ops)));
+			WdfSpinLockRelease(port->board_settings_spinlock);
+
+			if (!NT_SUCCESS(status))
+				break;
+
+			bytes_returned = length;
+		}
+		break;
+	default:
+		status = STATUS_NOT_SUPPORTED;
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+		"Unknown DeviceIoControl 0x%x", IoControlCode);
+		break;
+	}
+
+	WdfRequestCompleteWithInformation(Request, status, bytes_returned);
+}
+
+UINT32 fscc_port_get_register(struct fscc_port *port, unsigned bar,
+unsigned register_offset)
+{
+	enum register_class reg_class = REGISTER_VOLATILE;
+	fscc_register *cached = 0;
+	unsigned offset = 0;
+	UINT32 value = 0;
+
+	reg_class = register_cache_class(bar, register_offset);
+
+	if (reg_class != REGISTER_VOLATILE) {
+		cached = &((fscc_register *)&port->register_storage)[register_offset / 4];
+
+		if (*cached >= 0) {
+			InterlockedIncrement64(&port->mmio_reads_avoided);
+			return (UINT32)*cached;
+		}
+	}
+
+	offset = port_offset(port, bar, register_offset);
+	value = fscc_card_get_register(&port->card, bar, offset);
+
+	if (cached)
+		*cached = value;
+
+	return value;
+}
+
+/* Writes a bar 2 register the way fscc_port_set_registers does */
+static NTSTATUS fscc_port_set_register_op(struct fscc_port *port, unsigned bar,
+unsigned offset, UINT32 value)
+{
+	if (bar != 2)
+		return fscc_port_set_register(port, bar, offset, value);
+
+	if (offset == FCR_OFFSET)
+		return fscc_port_set_register(port, 2, FCR_OFFSET, value & 0x3fffffff);
+
+	// Special condition for 'master reset' bit, which only exists on the first port.
+	if (value & 0x10000)
+		fscc_card_set_register(&port->card, 2, DMACCR_OFFSET, 0x10000);
+
+	return fscc_port_set_register(port, 2, DMACCR_OFFSET, value & 0xfffeffff);
+}
+
+/*
+	Runs each operation in order, stopping at the first one that fails. Read,
+	modify and wait operations return the register value in op->value. The
+	caller should hold board_settings_spinlock.
+*/
+NTSTATUS fscc_port_execute_register_ops(struct fscc_port *port,
+struct fscc_register_op *ops, unsigned count)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	UINT32 value = 0;
+	unsigned wait_reads = REGISTER_WAIT_READS;
+	unsigned matched = 0;
+	unsigned i = 0;
+
+	return_val_if_untrue(port, STATUS_INVALID_PARAMETER);
+	return_val_if_untrue(ops, STATUS_INVALID_PARAMETER);
+
+	/* Check everything first so a bad operation doesn't leave a half done
+	   transaction behind */
+	for (i = 0; i < count; i++) {
+		if (!is_valid_register_op(&ops[i])) {
+			TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+			"Invalid register operation %d (bar %d, offset 0x%x, type %d)",
+			i, ops[i].bar, ops[i].offset, ops[i].type);
+			return STATUS_INVALID_PARAMETER;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		struct fscc_register_op *op = &ops[i];
+
+		switch (op->type) {
+		case FSCC_REGISTER_READ:
+			op->value = fscc_port_get_register(port, op->bar, op->offset);
+			break;
+
+		case FSCC_REGISTER_WRITE:
+			status = fscc_port_set_register_op(port, op->bar, op->offset, op->value);
+			break;
+
+		case FSCC_REGISTER_MODIFY:
+			value = fscc_port_get_register(port, op->bar, op->offset);
+			value = (value & ~op->mask) | (op->value & op->mask);
+
+			status = fscc_port_set_register_op(port, op->bar, op->offset, value);
+			op->value = value;
+			break;
+
+		case FSCC_REGISTER_WAIT:
+			/* Past the cache, which would never change */
+			matched = 0;
+			while (wait_reads && !matched) {
+				value = fscc_card_get_register(&port->card, op->bar,
+				port_offset(port, op->bar, op->offset));
+				wait_reads--;
+
+				matched = ((value & op->mask) == (op->value & op->mask));
+			}
+
+			if (!matched)
+				status = STATUS_IO_TIMEOUT;
+
+			op->value = value;
+			break;
+		}
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+			"Register operation %d failed %!STATUS!", i, status);
+			return status;
+		}
+	}
+
+	return STATUS_SUCCESS;
+}
+
+void fscc_port_get_stats(struct fscc_port *port, struct fscc_stats *stats)
+{
+	unsigned i;
+
+	return_if_untrue(port);
+	return_if_untrue(stats);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	stats->rx_frames = port->rx_frames;
+	stats->rx_descriptors_used = port->rx_descriptors_used;
+	RtlCopyMemory(stats->rx_frame_sizes, port->rx_frame_sizes, sizeof(stats->rx_frame_sizes));
+	stats->rx_frames_unclaimed = port->rx_frames_unclaimed;
+
+	RtlCopyMemory(stats->tx_priority_frames, port->tx_priority_frames, sizeof(stats->tx_priority_frames));
+	RtlCopyMemory(stats->tx_priority_latency_total, port->tx_priority_latency_total, sizeof(stats->tx_priority_latency_total));
+	RtlCopyMemory(stats->tx_priority_latency_max, port->tx_priority_latency_max, sizeof(stats->tx_priority_latency_max));
+	fscc_port_get_tx_priority_queued(port, stats->tx_priority_queued);
+
+	stats->isr_calls = (UINT64)port->isr_calls;
+	stats->isr_handled = (UINT64)port->isr_handled;
+	stats->isr_reads_skipped = (UINT64)port->isr_reads_skipped;
+
+	for (i = 0; i < FSCC_STATS_CPUS; i++) {
+		stats->isr_cpu[i] = (UINT64)port->isr_cpu[i];
+		stats->dpc_cpu[i] = (UINT64)port->dpc_cpu[i];
+	}
+
+	stats->init_defaults_time = port->init_defaults_time;
+	stats->init_rx_ring_time = port->init_rx_ring_time;
+	stats->init_tx_ring_time = port->init_tx_ring_time;
+	stats->init_registers_time = port->init_registers_time;
+	stats->init_clock_time = port->init_clock_time;
+	stats->init_purge_time = port->init_purge_time;
+	stats->init_total_time = port->init_total_time;
+	stats->init_resume_time = port->init_resume_time;
+	stats->rx_frames_filtered = port->rx_frames_filtered;
+	stats->tx_repeats = port->tx_repeats;
+	stats->tx_repeat_stalls = port->tx_repeat_stalls;
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	fscc_port_get_rx_size_hint(port, stats);
+
+	stats->mmio_reads_avoided = (UINT64)port->mmio_reads_avoided;
+	stats->rx_polls = (UINT64)port->rx_polls;
+	stats->rx_poll_notifications = (UINT64)port->rx_poll_notifications;
+	stats->rx_poll_latency_total = (UINT64)port->rx_poll_latency_total;
+	stats->rx_poll_latency_max = (UINT64)port->rx_poll_latency_max;
+	stats->timer_wakeups = (UINT64)port->timer_wakeups;
+}
+
+NTSTATUS fscc_port_set_register(struct fscc_port *port, unsigned bar,
+unsigned register_offset, UINT32 value)
+{
+	unsigned offset = 0;
+	return_val_if_untrue(port, 0);
+
+	offset = port_offset(port, bar, register_offset);
+
+	/* Checks to make sure there is a clock present. */
+	if (register_offset == CMDR_OFFSET && port->ignore_timeout == FALSE
+			&& fscc_port_clock_timed_out(port)) {
+		return STATUS_IO_TIMEOUT;
+	}
+
+	/* The clock source may have changed */
+	if (bar == 0 && register_offset == CCR0_OFFSET)
+		fscc_port_set_clock_present(port, FALSE);
+	// TODO Maybe remove this?
+	if((register_offset == DMACCR_OFFSET) && fscc_port_uses_dma(port) && bar == 2) value |= 0x03000000;
+	else if((register_offset == DMACCR_OFFSET) && !fscc_port_uses_dma(port) && bar == 2) value &= ~0x03000000;
+	fscc_card_set_register(&port->card, bar, offset, value);
+
+	if (bar == 0) {
+		display_register(bar, register_offset,
 		(UINT32)((fscc_register *)&port->register_storage)[register_offset / 4],
 		value);
 
@@ -1380,6 +2189,105 @@ BOOLEAN fscc_port_get_blocking_write(struct fscc_port *port)
 	return port->blocking_write;
 }
 
+NTSTATUS fscc_port_set_timer_period(struct fscc_port *port, UINT32 period)
+{
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+
+	if (period < MIN_TIMER_PERIOD)
+		return STATUS_INVALID_PARAMETER;
+
+	if (port->timer_period != period) {
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+		"Timer Period %i => %i",
+		port->timer_period, period);
+	}
+	else {
+		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE,
+		"Timer Period = %i", period);
+	}
+
+	port->timer_period = period;
+
+	return STATUS_SUCCESS;
+}
+
+UINT32 fscc_port_get_timer_period(struct fscc_port *port)
+{
+	return_val_if_untrue(port, 0);
+
+	return port->timer_period;
+}
+
+NTSTATUS fscc_port_set_rx_poll_interval(struct fscc_port *port, UINT32 interval)
+{
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+
+	/* 0 turns polling off */
+	if (interval != 0 && interval < MIN_TIMER_PERIOD)
+		return STATUS_INVALID_PARAMETER;
+
+	if (port->rx_poll_interval != interval) {
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+		"RX Poll Interval %i => %i",
+		port->rx_poll_interval, interval);
+	}
+	else {
+		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE,
+		"RX Poll Interval = %i", interval);
+	}
+
+	port->rx_poll_interval = interval;
+
+	return STATUS_SUCCESS;
+}
+
+UINT32 fscc_port_get_rx_poll_interval(struct fscc_port *port)
+{
+	return_val_if_untrue(port, 0);
+
+	return port->rx_poll_interval;
+}
+
+/*
+	There is no interrupt for streaming data arriving by DMA (DR_HI never
+	fires), so something has to check the descriptors while a read or rx
+	ring is waiting for it.
+*/
+BOOLEAN fscc_port_needs_rx_poll(struct fscc_port *port)
+{
+	ULONG pending = 0;
+
+	return_val_if_untrue(port, FALSE);
+
+	if (port->rx_poll_interval == 0 || !fscc_port_uses_dma(port) ||
+		!fscc_io_is_streaming(port))
+		return FALSE;
+
+	if (fscc_ring_rx_mapped(port))
+		return TRUE;
+
+	WdfIoQueueGetState(port->read_queue2, &pending, NULL);
+
+	return (pending) ? TRUE : FALSE;
+}
+
+/* Arms rx_poll_timer if it's needed and not already armed */
+void fscc_port_start_rx_poll(struct fscc_port *port)
+{
+	return_if_untrue(port);
+
+	if (!port->rx_poll_timer || !fscc_port_needs_rx_poll(port))
+		return;
+
+	if (InterlockedExchange(&port->rx_poll_armed, 1))
+		return;
+
+	if (!port->rx_poll_empty_time)
+		port->rx_poll_empty_time = KeQueryInterruptTime();
+
+	WdfTimerStart(port->rx_poll_timer, WDF_REL_TIMEOUT_IN_US(port->rx_poll_interval));
+}
+
 /* Returns -EINVAL if you set an incorrect transmit modifier */
 NTSTATUS fscc_port_set_tx_modifiers(struct fscc_port *port, int value)
 {
@@ -1423,20 +2331,11 @@ unsigned fscc_port_get_tx_modifiers(struct fscc_port *port)
 	return port->tx_modifiers;
 }
 
-#define STRB_BASE 0x00000008
-#define DTA_BASE 0x00000001
-#define CLK_BASE 0x00000002
+/* Doesn't allocate, so this is safe to call at DISPATCH_LEVEL */
 void fscc_port_set_clock_bits(struct fscc_port *port, struct clock_data_fscc *clock_data)
 {
 	UINT32 orig_fcr_value = 0;
-	UINT32 new_fcr_value = 0;
-	int j = 0; // Must be signed because we are going backwards through the array
-	int i = 0; // Must be signed because we are going backwards through the array
-	unsigned strb_value = STRB_BASE;
-	unsigned dta_value = DTA_BASE;
-	unsigned clk_value = CLK_BASE;
-	UINT32 *data = 0;
-	unsigned data_index = 0;
+	unsigned num_words = 0;
 
 	return_if_untrue(port);
 
@@ -1457,54 +2356,33 @@ void fscc_port_set_clock_bits(struct fscc_port *port, struct clock_data_fscc *cl
 	}
 #endif
 
-
-	data = (UINT32 *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(UINT32) * 323, 'stiB');
-
-	if (data == NULL) {
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
-		"ExAllocatePoolWithTag failed");
-		return;
-	}
-
-	if (port->channel == 1) {
-		strb_value <<= 0x08;
-		dta_value <<= 0x08;
-		clk_value <<= 0x08;
-	}
-
 	WdfSpinLockAcquire(port->board_settings_spinlock);
 
-	orig_fcr_value = fscc_card_get_register(&port->card, 2, FCR_OFFSET);
+	port->clock_data = *clock_data;
 
-	data[data_index++] = new_fcr_value = orig_fcr_value & 0xfffff0f0;
+	orig_fcr_value = fscc_card_get_register(&port->card, 2, FCR_OFFSET);
 
-	for (i = 19; i >= 0; i--) {
-		for (j = 7; j >= 0; j--) {
-			int bit = ((clock_data->clock_bits[i] >> j) & 1);
+	num_words = encode_clock_bits(clock_data->clock_bits, port->channel,
+								  orig_fcr_value, port->clock_bits_words);
 
-			if (bit)
-			new_fcr_value |= dta_value; /* Set data bit */
-			else
-			new_fcr_value &= ~dta_value; /* Clear clock bit */
+	fscc_port_set_register_rep(port, 2, FCR_OFFSET,
+							   (char *)port->clock_bits_words, num_words * 4);
 
-			data[data_index++] = new_fcr_value |= clk_value; /* Set clock bit */
-			data[data_index++] = new_fcr_value &= ~clk_value; /* Clear clock bit */
-		}
+#ifdef VERIFY_CLOCK_BITS
+	/* The last word written puts FCR back the way it was */
+	if (num_words != CLOCK_BITS_WORDS ||
+		fscc_card_get_register(&port->card, 2, FCR_OFFSET) != orig_fcr_value) {
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+			"Clock bits verify failed: %d words, FCR 0x%08x, expected 0x%08x",
+			num_words, fscc_card_get_register(&port->card, 2, FCR_OFFSET),
+			orig_fcr_value);
 	}
-
-	new_fcr_value = orig_fcr_value & 0xfffff0f0;
-
-	new_fcr_value |= strb_value; /* Set strobe bit */
-	new_fcr_value &= ~clk_value; /* Clear clock bit */
-
-	data[data_index++] = new_fcr_value;
-	data[data_index++] = orig_fcr_value;
-
-	fscc_port_set_register_rep(port, 2, FCR_OFFSET, (char *)data, data_index * 4);
+#endif
 
 	WdfSpinLockRelease(port->board_settings_spinlock);
+
+	fscc_port_set_clock_present(port, FALSE);
 	// save clock rate here.
-	ExFreePoolWithTag(data, 'stiB');
 }
 
 unsigned fscc_port_using_async(struct fscc_port *port)
@@ -1525,11 +2403,6 @@ unsigned fscc_port_using_async(struct fscc_port *port)
 	return 0;
 }
 
-void fscc_port_reset_timer(struct fscc_port *port)
-{
-	WdfTimerStart(port->timer, WDF_ABS_TIMEOUT_IN_MS(TIMER_DELAY_MS));
-}
-
 NTSTATUS fscc_port_get_port_num(struct fscc_port *port, unsigned *port_num)
 {
 	NTSTATUS status;
@@ -1614,203 +2487,34 @@ BOOLEAN fscc_port_get_force_fifo(struct fscc_port *port)
 	return port->force_fifo;
 }
 
-NTSTATUS fscc_port_get_default_memory(struct fscc_port *port, struct fscc_memory *memory)
+/* Per handle, see fscc_port_next_blocking_write */
+NTSTATUS fscc_port_set_tx_priority(struct fscc_port *port, WDFFILEOBJECT FileObject, UINT32 value)
 {
-	NTSTATUS status;
-	WDFKEY devkey;
-	UNICODE_STRING key_str;
-	ULONG value;
-	
-	status = WdfDeviceOpenRegistryKey(port->device, PLUGPLAY_REGKEY_DEVICE,
-	STANDARD_RIGHTS_ALL,
-	WDF_NO_OBJECT_ATTRIBUTES, &devkey);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
-		"WdfDeviceOpenRegistryKey failed %!STATUS!", status);
-		return status;
-	}
-	
-	RtlInitUnicodeString(&key_str, L"TxNum");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_BUFFER_TX_NUM;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	memory->tx_num = (unsigned)value;
+	struct fscc_file *file = 0;
 
-	RtlInitUnicodeString(&key_str, L"RxNum");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_BUFFER_RX_NUM;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	memory->rx_num = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"TxSize");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_BUFFER_TX_SIZE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	memory->tx_size = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"RxSize");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_BUFFER_RX_SIZE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	memory->rx_size = (unsigned)value;
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+	return_val_if_untrue(FileObject, STATUS_INVALID_PARAMETER);
 
-	WdfRegistryClose(devkey);
+	if (value >= FSCC_TX_PRIORITIES)
+		return STATUS_INVALID_PARAMETER;
 
-	return STATUS_SUCCESS;
-}
+	file = WdfObjectGet_FSCC_FILE(FileObject);
 
-NTSTATUS fscc_port_get_default_registers(struct fscc_port *port, struct fscc_registers *regs)
-{
-	NTSTATUS status;
-	WDFKEY devkey;
-	UNICODE_STRING key_str;
-	ULONG value;
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "TX priority %i => %i", file->tx_priority, value);
 
-	status = WdfDeviceOpenRegistryKey(port->device, PLUGPLAY_REGKEY_DEVICE, STANDARD_RIGHTS_ALL, WDF_NO_OBJECT_ATTRIBUTES, &devkey);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "WdfDeviceOpenRegistryKey failed %!STATUS!", status);
-		return status;
-	}
-
-	RtlInitUnicodeString(&key_str, L"FIFOT");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_FIFOT_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->FIFOT = (unsigned)value;
+	file->tx_priority = value;
 
-	RtlInitUnicodeString(&key_str, L"CCR0");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_CCR0_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->CCR0 = (unsigned)value;
+	return STATUS_SUCCESS;
+}
 
-	RtlInitUnicodeString(&key_str, L"CCR1");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_CCR1_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->CCR1 = (unsigned)value;
+UINT32 fscc_port_get_tx_priority(struct fscc_port *port, WDFFILEOBJECT FileObject)
+{
+	return_val_if_untrue(port, 0);
 
-	RtlInitUnicodeString(&key_str, L"CCR2");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_CCR2_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->CCR2 = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"BGR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_BGR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->BGR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"SSR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_SSR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->SSR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"SMR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_SMR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->SMR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"TSR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_TSR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->TSR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"TMR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_TMR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->TMR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"RAR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_RAR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->RAR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"RAMR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_RAMR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->RAMR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"PPR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_PPR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->PPR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"TCR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_TCR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->TCR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"IMR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_IMR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->IMR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"DPLLR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_DPLLR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->DPLLR = (unsigned)value;
-	
-	RtlInitUnicodeString(&key_str, L"FCR");
-	status = WdfRegistryQueryULong(devkey, &key_str, &value);
-	if (!NT_SUCCESS(status)) {
-		value = DEFAULT_FCR_VALUE;
-		status = WdfRegistryAssignULong(devkey, &key_str, value);
-	}
-	regs->FCR = (unsigned)value;
-	
-	WdfRegistryClose(devkey);
+	if (!FileObject)
+		return 0;
 
-	return STATUS_SUCCESS;
+	return WdfObjectGet_FSCC_FILE(FileObject)->tx_priority;
 }
 
 #define FRIENDLYNAME_SIZE 256
@@ -85,6 +85,8 @@ THE SOFTWARE.
 #define DR_FE 0x00001000
 #define DT_HI 0x00000800
 #define DR_HI 0x00000400
+#define ALL_INTERRUPTS (RFS | RFT | RFE | RFO | RDO | RFL | TIN | DR_HI | DT_HI | \
+		DR_FE | DT_FE | DR_STOP | DT_STOP | TFT | ALLS | TDU | CTSS | DSRC | CDC | CTSA)
 
 #define CE_BIT 0x00040000
 
@@ -130,9 +132,32 @@ BOOLEAN fscc_port_get_wait_on_write(struct fscc_port *port);
 NTSTATUS fscc_port_set_force_fifo(struct fscc_port *port, BOOLEAN force_fifo);
 BOOLEAN fscc_port_get_force_fifo(struct fscc_port *port);
 
+NTSTATUS fscc_port_set_tx_priority(struct fscc_port *port, WDFFILEOBJECT FileObject, UINT32 priority);
+UINT32 fscc_port_get_tx_priority(struct fscc_port *port, WDFFILEOBJECT FileObject);
+NTSTATUS fscc_port_next_blocking_write(struct fscc_port *port, WDFREQUEST *found, UINT32 *length);
+void fscc_port_get_tx_priority_queued(struct fscc_port *port, UINT32 *queued);
+
+void fscc_port_set_affinity(struct fscc_port *port);
+unsigned fscc_port_stats_cpu(void);
+void fscc_port_count_dpc(struct fscc_port *port);
+void fscc_port_get_stats(struct fscc_port *port, struct fscc_stats *stats);
+void fscc_port_get_rx_size_hint(struct fscc_port *port, struct fscc_stats *stats);
+NTSTATUS fscc_port_execute_register_ops(struct fscc_port *port,
+struct fscc_register_op *ops, unsigned count);
+
 void fscc_port_set_blocking_write(struct fscc_port *port, BOOLEAN blocking);
 BOOLEAN fscc_port_get_blocking_write(struct fscc_port *port);
 
+NTSTATUS fscc_port_set_timer_period(struct fscc_port *port, UINT32 period);
+UINT32 fscc_port_get_timer_period(struct fscc_port *port);
+BOOLEAN fscc_port_needs_timer(struct fscc_port *port);
+void fscc_port_start_timer(struct fscc_port *port);
+
+NTSTATUS fscc_port_set_rx_poll_interval(struct fscc_port *port, UINT32 interval);
+UINT32 fscc_port_get_rx_poll_interval(struct fscc_port *port);
+BOOLEAN fscc_port_needs_rx_poll(struct fscc_port *port);
+void fscc_port_start_rx_poll(struct fscc_port *port);
+
 NTSTATUS fscc_port_set_tx_modifiers(struct fscc_port *port, int value);
 unsigned fscc_port_get_tx_modifiers(struct fscc_port *port);
 
@@ -140,6 +165,8 @@ void fscc_port_set_clock_bits(struct fscc_port *port, struct clock_data_fscc *cl
 
 unsigned fscc_port_using_async(struct fscc_port *port);
 unsigned fscc_port_timed_out(struct fscc_port *port);
-void fscc_port_reset_timer(struct fscc_port *port);
+unsigned fscc_port_clock_timed_out(struct fscc_port *port);
+BOOLEAN fscc_port_clock_stale(struct fscc_port *port);
+void fscc_port_set_clock_present(struct fscc_port *port, BOOLEAN value);
 
 #endif
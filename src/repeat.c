@@ -0,0 +1,440 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "repeat.h"
+#include "port.h"
+#include "utils.h"
+#include "io.h"
+#include "ring.h"
+
+#if defined(EVENT_TRACING)
+#include "repeat.tmh"
+#endif
+
+/*
+	Sends a list of frames over and over without the application writing
+	them again. The frames are put in their own descriptors of up to TxSize
+	bytes, as many as each frame needs, and the last descriptor points back
+	at the first so the card goes around the loop on its own.
+
+	The card sets CSTOP in each descriptor it sends and stops when it gets
+	to one that still has it, so fscc_repeat_worker sets the control words
+	back after they are sent. Nothing is copied, and the loop holds at least
+	two copies of the frames (more for short ones) so the worker has a whole
+	copy's time to run before the card comes around again. If the card
+	still gets there first, the worker starts it again where it stopped and
+	counts it in tx_repeat_stalls.
+
+	New frames are put in a second loop, and the last descriptor of each copy
+	in the old loop is pointed at it. Whichever copy the card is sending, it
+	finishes it and moves to the new frames, so a repetition is never a mix
+	of the two. The old loop is freed by the next set or clear once the card
+	has left it, because common buffers can only be freed at PASSIVE_LEVEL.
+	Sets and clears come from FsccEvtIoDeviceControl, whose queue runs at
+	PASSIVE_LEVEL for this (see fscc_port_new).
+*/
+
+#define FSCC_REPEAT_LAP_BYTES 8192 /* Minimum bytes in the loop */
+#define FSCC_REPEAT_MAX_COPIES 64
+
+/*
+	Works out the descriptors one copy of frames needs. frames is a list of
+	records, each a UINT32 length followed by that many bytes of frame. Each
+	frame starts a new descriptor and takes as many as it needs of at most
+	buffer_size bytes. controls, counts and offsets (where in frames each
+	descriptor's data starts) can be NULL to only count them.
+
+	Returns the number of descriptors, 0 if frames isn't a valid list.
+*/
+UINT32 fscc_repeat_layout(const unsigned char *frames, UINT32 length, UINT32 buffer_size,
+	UINT32 *controls, UINT32 *counts, UINT32 *offsets, UINT32 *bytes)
+{
+	UINT32 offset = 0, descriptors = 0, total = 0;
+	UINT32 frame_length, sent, count;
+
+	if (buffer_size == 0)
+		return 0;
+
+	while (offset < length) {
+		if (length - offset < sizeof(frame_length))
+			return 0;
+
+		RtlCopyMemory(&frame_length, frames + offset, sizeof(frame_length));
+		offset += sizeof(frame_length);
+
+		if (frame_length == 0 || frame_length > DMA_MAX_LENGTH || frame_length > length - offset)
+			return 0;
+
+		for (sent = 0; sent < frame_length; sent += count) {
+			count = min(buffer_size, frame_length - sent);
+
+			if (controls) {
+				/* Like fscc_user_write_frame, the first holds the frame's length */
+				controls[descriptors] = (sent == 0) ? (DESC_FE_BIT | frame_length) : count;
+				counts[descriptors] = count;
+				offsets[descriptors] = offset + sent;
+			}
+
+			descriptors++;
+		}
+
+		offset += frame_length;
+		total += frame_length;
+	}
+
+	/* One interrupt per copy is enough to keep up */
+	if (controls && descriptors)
+		controls[descriptors - 1] |= DESC_HI_BIT;
+
+	if (bytes)
+		*bytes = total;
+
+	return descriptors;
+}
+
+static void fscc_repeat_free(struct fscc_repeat_loop *loop)
+{
+	UINT32 i;
+
+	if (!loop)
+		return;
+
+	if (loop->descriptors) {
+		for (i = 0; i < loop->count; i++) {
+			if (loop->descriptors[i])
+				fscc_io_destroy_frame(loop->descriptors[i]);
+		}
+
+		ExFreePoolWithTag(loop->descriptors, 'CSED');
+	}
+
+	if (loop->controls)
+		ExFreePoolWithTag(loop->controls, 'CSED');
+
+	ExFreePoolWithTag(loop, 'CSED');
+}
+
+static NTSTATUS fscc_repeat_build(struct fscc_port *port, const unsigned char *frames,
+	UINT32 length, struct fscc_repeat_loop **out)
+{
+	struct fscc_repeat_loop *loop = 0;
+	struct dma_frame *frame = 0;
+	UINT32 *counts = 0, *offsets = 0;
+	UINT32 copy_length, copies, bytes, i, j;
+
+	*out = 0;
+
+	copy_length = fscc_repeat_layout(frames, length, port->memory.tx_size, NULL, NULL, NULL, &bytes);
+	if (copy_length == 0)
+		return STATUS_INVALID_PARAMETER;
+
+	copies = (FSCC_REPEAT_LAP_BYTES + bytes - 1) / bytes;
+	copies = max(copies, 2);
+	copies = min(copies, FSCC_REPEAT_MAX_COPIES);
+
+	if (copy_length > MAXULONG / sizeof(UINT32) / copies)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	loop = (struct fscc_repeat_loop *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(*loop), 'CSED');
+	if (loop == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	loop->count = copy_length * copies;
+	loop->copy_length = copy_length;
+	loop->next = 0;
+
+	loop->descriptors = (struct dma_frame **)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(struct dma_frame *) * loop->count, 'CSED');
+	loop->controls = (UINT32 *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(UINT32) * loop->count, 'CSED');
+	counts = (UINT32 *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(UINT32) * copy_length * 2, 'CSED');
+	if (!loop->descriptors || !loop->controls || !counts) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "ExAllocatePool2 for %d repeat descriptors failed!", loop->count);
+		if (counts)
+			ExFreePoolWithTag(counts, 'CSED');
+		fscc_repeat_free(loop);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	offsets = counts + copy_length;
+	fscc_repeat_layout(frames, length, port->memory.tx_size, loop->controls, counts, offsets, NULL);
+
+	for (i = 0; i < loop->count; i++) {
+		j = i % copy_length;
+
+		frame = fscc_io_create_frame(port, counts[j]);
+		if (!frame) {
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "Failed to create repeat frame at %d!", i);
+			ExFreePoolWithTag(counts, 'CSED');
+			fscc_repeat_free(loop);
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		RtlCopyMemory(frame->buffer, frames + offsets[j], counts[j]);
+		frame->desc->data_count = counts[j];
+
+		loop->controls[i] = loop->controls[j];
+		frame->desc->control = loop->controls[i];
+
+		loop->descriptors[i] = frame;
+	}
+
+	ExFreePoolWithTag(counts, 'CSED');
+
+	fscc_io_link_desc(loop->descriptors, loop->count);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+	"Built repeat loop of %d bytes, %d copies of %d descriptors", bytes, copies, copy_length);
+
+	*out = loop;
+
+	return STATUS_SUCCESS;
+}
+
+/* Starts the card at the next descriptor of loop. Called with board_tx_spinlock held. */
+static void fscc_repeat_start(struct fscc_port *port, struct fscc_repeat_loop *loop)
+{
+	fscc_port_set_register(port, 2, DMA_TX_BASE_OFFSET, loop->descriptors[loop->next]->desc_physical_address);
+
+	/* Not fscc_io_execute_transmit, XREP would only send the first frame */
+	fscc_dma_execute_GO_T(port);
+}
+
+/*
+	Stops the card and starts it again at the beginning of loop with every
+	descriptor given back. Called with board_tx_spinlock held.
+*/
+static void fscc_repeat_restart(struct fscc_port *port, struct fscc_repeat_loop *loop)
+{
+	UINT32 i;
+
+	fscc_dma_execute_STOP_T(port);
+	fscc_dma_execute_RST_T(port);
+
+	for (i = 0; i < loop->count; i++)
+		loop->descriptors[i]->desc->control = loop->controls[i];
+
+	loop->next = 0;
+
+	fscc_repeat_start(port, loop);
+}
+
+/* Gives the card back the descriptors it has sent. Called with board_tx_spinlock held. */
+static void fscc_repeat_rearm(struct fscc_port *port, struct fscc_repeat_loop *loop)
+{
+	struct dma_frame *frame = 0;
+	UINT32 i;
+
+	for (i = 0; i < loop->count; i++) {
+		frame = loop->descriptors[loop->next];
+		if (!(frame->desc->control & DESC_CSTOP_BIT))
+			break;
+
+		frame->desc->control = loop->controls[loop->next];
+
+		loop->next++;
+		if (loop->next % loop->copy_length == 0)
+			port->tx_repeats++;
+		if (loop->next == loop->count)
+			loop->next = 0;
+	}
+}
+
+void fscc_repeat_worker(WDFDPC Dpc)
+{
+	struct fscc_port *port = 0;
+	struct fscc_repeat_loop *loop = 0;
+
+	port = WdfObjectGet_FSCC_PORT(WdfDpcGetParentObject(Dpc));
+	fscc_port_count_dpc(port);
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+
+	loop = port->tx_repeat;
+	if (!loop) {
+		WdfSpinLockRelease(port->board_tx_spinlock);
+		return;
+	}
+
+	/* Until the card takes the new frames it may still go around the old loop */
+	fscc_repeat_rearm(port, loop);
+
+	if (port->tx_repeat_next && (port->tx_repeat_next->descriptors[0]->desc->control & DESC_CSTOP_BIT)) {
+		port->tx_repeat_old = loop;
+		port->tx_repeat = loop = port->tx_repeat_next;
+		port->tx_repeat_next = 0;
+
+		fscc_repeat_rearm(port, loop);
+	}
+
+	if (!fscc_dma_is_tx_running(port)) {
+		port->tx_repeat_stalls++;
+		fscc_repeat_start(port, loop);
+	}
+
+	WdfSpinLockRelease(port->board_tx_spinlock);
+}
+
+BOOLEAN fscc_repeat_running(struct fscc_port *port)
+{
+	return port->tx_repeat != 0;
+}
+
+NTSTATUS fscc_repeat_set(struct fscc_port *port, const unsigned char *frames, UINT32 length)
+{
+	struct fscc_repeat_loop *loop = 0;
+	struct fscc_repeat_loop *old = 0;
+	BOOLEAN first = FALSE;
+	NTSTATUS status;
+	UINT32 i;
+
+	return_val_if_untrue(port, STATUS_INVALID_PARAMETER);
+
+	if (!fscc_port_uses_dma(port))
+		return STATUS_NOT_SUPPORTED;
+
+	if (fscc_ring_tx_mapped(port))
+		return STATUS_INVALID_DEVICE_STATE;
+
+	/* No more than the tx descriptors could hold, each copy is that much again */
+	if (length > port->memory.tx_size * port->memory.tx_num)
+		return STATUS_INVALID_PARAMETER;
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+	if (port->tx_repeat_next) {
+		WdfSpinLockRelease(port->board_tx_spinlock);
+		return STATUS_DEVICE_BUSY;
+	}
+	old = port->tx_repeat_old;
+	port->tx_repeat_old = 0;
+	WdfSpinLockRelease(port->board_tx_spinlock);
+
+	fscc_repeat_free(old);
+
+	status = fscc_repeat_build(port, frames, length, &loop);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+		"fscc_repeat_build failed %!STATUS!", status);
+		return status;
+	}
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+	if (port->tx_repeat_next) {
+		/* Another set got here first */
+		WdfSpinLockRelease(port->board_tx_spinlock);
+		fscc_repeat_free(loop);
+		return STATUS_DEVICE_BUSY;
+	}
+
+	if (!port->tx_repeat) {
+		/* Nothing else can be written while it runs */
+		port->tx_repeat = loop;
+		first = TRUE;
+	}
+	else {
+		for (i = port->tx_repeat->copy_length - 1; i < port->tx_repeat->count; i += port->tx_repeat->copy_length)
+			port->tx_repeat->descriptors[i]->desc->next_descriptor = loop->descriptors[0]->desc_physical_address;
+
+		port->tx_repeat_next = loop;
+
+		/* If the card stopped part way through a copy it finishes that first */
+		WdfDpcEnqueue(port->repeat_dpc);
+	}
+	WdfSpinLockRelease(port->board_tx_spinlock);
+
+	if (first) {
+		/* Frames already written are dropped, like FSCC_PURGE */
+		fscc_io_purge_tx(port);
+
+		/* fscc_repeat_worker may have started it while the purge stopped the card */
+		WdfSpinLockAcquire(port->board_tx_spinlock);
+		if (port->tx_repeat == loop)
+			fscc_repeat_restart(port, loop);
+		WdfSpinLockRelease(port->board_tx_spinlock);
+	}
+
+	return STATUS_SUCCESS;
+}
+
+/* Stops sending the frames and gives the card back the tx descriptors */
+void fscc_repeat_clear(struct fscc_port *port)
+{
+	struct fscc_repeat_loop *loops[3];
+	UINT32 i;
+
+	return_if_untrue(port);
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+	loops[0] = port->tx_repeat;
+	loops[1] = port->tx_repeat_next;
+	loops[2] = port->tx_repeat_old;
+	port->tx_repeat = 0;
+	port->tx_repeat_next = 0;
+	port->tx_repeat_old = 0;
+	WdfSpinLockRelease(port->board_tx_spinlock);
+
+	if (!loops[0] && !loops[2])
+		return;
+
+	/* The card has to be off the loop before it is freed */
+	fscc_io_purge_tx(port);
+
+	for (i = 0; i < sizeof(loops) / sizeof(loops[0]); i++)
+		fscc_repeat_free(loops[i]);
+}
+
+/*
+	Starts the loop again from the beginning after fscc_io_resume pointed
+	the card at the tx descriptors. A set that hadn't been taken yet is.
+*/
+void fscc_repeat_resume(struct fscc_port *port)
+{
+	return_if_untrue(port);
+
+	WdfSpinLockAcquire(port->board_tx_spinlock);
+
+	if (port->tx_repeat_next) {
+		/* tx_repeat_old is always empty while a set is waiting */
+		port->tx_repeat_old = port->tx_repeat;
+		port->tx_repeat = port->tx_repeat_next;
+		port->tx_repeat_next = 0;
+	}
+
+	if (port->tx_repeat && fscc_port_uses_dma(port))
+		fscc_repeat_restart(port, port->tx_repeat);
+
+	WdfSpinLockRelease(port->board_tx_spinlock);
+}
+
+/* Frees the loops once the card has stopped for good */
+void fscc_repeat_destroy(struct fscc_port *port)
+{
+	return_if_untrue(port);
+
+	fscc_repeat_free(port->tx_repeat);
+	fscc_repeat_free(port->tx_repeat_next);
+	fscc_repeat_free(port->tx_repeat_old);
+
+	port->tx_repeat = 0;
+	port->tx_repeat_next = 0;
+	port->tx_repeat_old = 0;
+}
@@ -0,0 +1,44 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FSCC_REPEAT_H
+#define FSCC_REPEAT_H
+
+#include <ntddk.h>
+#include <wdf.h>
+
+#include "defines.h"
+#include "Trace.h"
+
+EVT_WDF_DPC fscc_repeat_worker;
+
+BOOLEAN fscc_repeat_running(struct fscc_port *port);
+NTSTATUS fscc_repeat_set(struct fscc_port *port, const unsigned char *frames, UINT32 length);
+void fscc_repeat_clear(struct fscc_port *port);
+void fscc_repeat_resume(struct fscc_port *port);
+void fscc_repeat_destroy(struct fscc_port *port);
+UINT32 fscc_repeat_layout(const unsigned char *frames, UINT32 length, UINT32 buffer_size,
+	UINT32 *controls, UINT32 *counts, UINT32 *offsets, UINT32 *bytes);
+
+#endif
@@ -0,0 +1,449 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "ring.h"
+#include "port.h"
+#include "utils.h"
+#include "io.h"
+#include "pacer.h"
+#include "rxfilter.h"
+#include "repeat.h"
+
+#if defined(EVENT_TRACING)
+#include "ring.tmh"
+#endif
+
+/*
+	A ring lets an application move data without a ReadFile or WriteFile per
+	frame. The application allocates the ring and passes it in with
+	FSCC_MAP_RX_RING or FSCC_MAP_TX_RING. That request stays pending, which
+	keeps the memory locked and mapped, until the matching unmap, CancelIo or
+	the handle is closed.
+
+	The producer is the only writer of head and the consumer the only writer
+	of tail. Both count bytes and are allowed to wrap, so head - tail is the
+	number of bytes in use. For rx the driver produces and each record holds
+	what a ReadFile would have returned. For tx the application produces and
+	each record is one frame. A record that doesn't fit before the end of the
+	ring is preceded by an FSCC_RING_PAD record filling the rest of it.
+
+	Everything in the ring can be written by the application, so the driver
+	keeps its own copy of size and the index it owns, and checks the other
+	index and every tx record before using them.
+*/
+
+static void fscc_ring_clear(struct fscc_ring_state *state)
+{
+	state->ring = 0;
+	state->request = 0;
+	state->file = 0;
+	state->size = 0;
+	state->index = 0;
+}
+
+static void fscc_ring_complete_waiters(struct fscc_ring_state *state, NTSTATUS status)
+{
+	WDFREQUEST request;
+
+	while (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(state->wait_queue, &request)))
+		WdfRequestComplete(request, status);
+}
+
+/* Must hold ring_spinlock */
+static WDFREQUEST fscc_ring_stop(struct fscc_ring_state *state)
+{
+	WDFREQUEST request = state->request;
+
+	fscc_ring_clear(state);
+	fscc_ring_complete_waiters(state, STATUS_CANCELLED);
+
+	return request;
+}
+
+static void fscc_ring_map(struct fscc_port *port, struct fscc_ring_state *state,
+WDFREQUEST Request, UINT32 min_size)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	struct fscc_ring *ring = 0;
+	size_t length = 0;
+	UINT32 size = 0;
+
+	status = WdfRequestRetrieveOutputBuffer(Request, sizeof(*ring),
+	(PVOID *)&ring, &length);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+		"WdfRequestRetrieveOutputBuffer failed %!STATUS!", status);
+		WdfRequestComplete(Request, status);
+		return;
+	}
+
+	size = ring->size;
+
+	if (size == 0 || (size & (size - 1)) || size > length - sizeof(*ring) ||
+		size < min_size) {
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+		"Invalid ring size %d (buffer %d, minimum %d)", size,
+		(unsigned)length, min_size);
+		WdfRequestComplete(Request, STATUS_INVALID_PARAMETER);
+		return;
+	}
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	if (state->ring) {
+		WdfSpinLockRelease(port->ring_spinlock);
+		WdfRequestComplete(Request, STATUS_DEVICE_BUSY);
+		return;
+	}
+
+	status = WdfRequestForwardToIoQueue(Request, port->ring_queue);
+	if (!NT_SUCCESS(status)) {
+		WdfSpinLockRelease(port->ring_spinlock);
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfRequestForwardToIoQueue failed %!STATUS!", status);
+		WdfRequestComplete(Request, status);
+		return;
+	}
+
+	ring->head = 0;
+	ring->tail = 0;
+
+	state->ring = ring;
+	state->request = Request;
+	state->file = WdfRequestGetFileObject(Request);
+	state->size = size;
+	state->index = 0;
+
+	WdfSpinLockRelease(port->ring_spinlock);
+}
+
+static NTSTATUS fscc_ring_unmap(struct fscc_port *port, struct fscc_ring_state *state)
+{
+	WDFREQUEST request = 0;
+	WDFREQUEST found = 0;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+	request = fscc_ring_stop(state);
+	WdfSpinLockRelease(port->ring_spinlock);
+
+	if (!request)
+		return STATUS_INVALID_DEVICE_STATE;
+
+	/* Fails if the request is already being canceled, which is fine */
+	status = WdfIoQueueRetrieveFoundRequest(port->ring_queue, request, &found);
+	if (NT_SUCCESS(status))
+		WdfRequestComplete(found, STATUS_SUCCESS);
+
+	return STATUS_SUCCESS;
+}
+
+/* Completes Request now if ready is set, otherwise once the waiters are woken */
+static void fscc_ring_wait(struct fscc_port *port, struct fscc_ring_state *state,
+WDFREQUEST Request, BOOLEAN ready)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+
+	if (!state->ring) {
+		WdfSpinLockRelease(port->ring_spinlock);
+		WdfRequestComplete(Request, STATUS_INVALID_DEVICE_STATE);
+		return;
+	}
+
+	if (ready) {
+		WdfSpinLockRelease(port->ring_spinlock);
+		WdfRequestComplete(Request, STATUS_SUCCESS);
+		return;
+	}
+
+	/* Forwarded while holding the lock so an update can't be missed */
+	status = WdfRequestForwardToIoQueue(Request, state->wait_queue);
+
+	WdfSpinLockRelease(port->ring_spinlock);
+
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+		"WdfRequestForwardToIoQueue failed %!STATUS!", status);
+		WdfRequestComplete(Request, status);
+	}
+}
+
+/* The rx ring has to be able to hold the largest possible read */
+void fscc_ring_map_rx(struct fscc_port *port, WDFREQUEST Request)
+{
+	UINT32 largest_read = 0;
+
+	largest_read = port->memory.rx_num * port->memory.rx_size + sizeof(fscc_timestamp);
+
+	fscc_ring_map(port, &port->rx_ring, Request,
+	sizeof(struct fscc_ring_record) + FSCC_RING_ALIGN(largest_read));
+
+	/* Move anything that arrived before the ring was mapped */
+	WdfDpcEnqueue(port->process_read_dpc);
+	fscc_port_start_rx_poll(port);
+	fscc_port_start_timer(port);
+}
+
+void fscc_ring_map_tx(struct fscc_port *port, WDFREQUEST Request)
+{
+	/* Nothing can be written while frames are being repeated */
+	if (fscc_repeat_running(port)) {
+		WdfRequestComplete(Request, STATUS_INVALID_DEVICE_STATE);
+		return;
+	}
+
+	fscc_ring_map(port, &port->tx_ring, Request,
+	sizeof(struct fscc_ring_record) * 2);
+
+	fscc_port_start_timer(port);
+}
+
+NTSTATUS fscc_ring_unmap_rx(struct fscc_port *port)
+{
+	return fscc_ring_unmap(port, &port->rx_ring);
+}
+
+NTSTATUS fscc_ring_unmap_tx(struct fscc_port *port)
+{
+	return fscc_ring_unmap(port, &port->tx_ring);
+}
+
+/* Waits for the rx ring to have data in it */
+void fscc_ring_wait_rx(struct fscc_port *port, WDFREQUEST Request)
+{
+	struct fscc_ring_state *state = &port->rx_ring;
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	fscc_ring_wait(port, state, Request,
+	state->ring && state->ring->tail != state->index);
+}
+
+/* Waits for every frame in the tx ring to be handed to the hardware */
+void fscc_ring_wait_tx(struct fscc_port *port, WDFREQUEST Request)
+{
+	struct fscc_ring_state *state = &port->tx_ring;
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	fscc_ring_wait(port, state, Request,
+	state->ring && state->ring->head == state->index);
+}
+
+BOOLEAN fscc_ring_rx_mapped(struct fscc_port *port)
+{
+	return (port->rx_ring.ring) ? TRUE : FALSE;
+}
+
+BOOLEAN fscc_ring_tx_mapped(struct fscc_port *port)
+{
+	return (port->tx_ring.ring) ? TRUE : FALSE;
+}
+
+/*
+	Moves as much received data as fits into the rx ring. Returns 0 if there
+	isn't a ring mapped, in which case reads are handled the normal way.
+*/
+unsigned fscc_ring_fill_rx(struct fscc_port *port)
+{
+	struct fscc_ring_state *state = &port->rx_ring;
+	struct fscc_ring_record *record = 0;
+	unsigned char *data = 0;
+	UINT32 frame_ready = 0, bytes_ready = 0, streaming = 0;
+	UINT32 used = 0, room = 0, needed = 0;
+	UINT32 read_count = 0;
+	UINT32 orig_head = 0;
+	int status = STATUS_SUCCESS;
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	if (!state->ring) {
+		WdfSpinLockRelease(port->ring_spinlock);
+		return 0;
+	}
+
+	data = FSCC_RING_DATA(state->ring);
+	orig_head = state->index;
+	streaming = fscc_io_is_streaming(port);
+
+	while (1) {
+		WdfSpinLockAcquire(port->board_rx_spinlock);
+		fscc_filter_frames(port);
+		frame_ready = fscc_user_next_read_size(port, &bytes_ready);
+		WdfSpinLockRelease(port->board_rx_spinlock);
+
+		if (bytes_ready == 0 || (!streaming && !frame_ready))
+			break;
+
+		used = state->index - state->ring->tail;
+		KeMemoryBarrier();
+
+		if (used > state->size) {
+			TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+			"Invalid rx ring tail 0x%x (head 0x%x)", state->ring->tail, state->index);
+			break;
+		}
+
+		needed = (streaming) ? 1 : bytes_ready + sizeof(fscc_timestamp);
+
+		record = fscc_ring_reserve(data, state->size, &state->index, used,
+		needed, &room);
+		if (!record)
+			break;
+
+		if (streaming)
+			status = fscc_user_read_stream(port, (char *)(record + 1), room, &read_count);
+		else
+			status = fscc_user_read_frame(port, (char *)(record + 1), room, &read_count);
+
+		if (!NT_SUCCESS(status) || read_count == 0)
+			break;
+
+		fscc_ring_commit(record, &state->index, read_count);
+	}
+
+	if (state->index != orig_head) {
+		/* The records have to be visible before the new head */
+		KeMemoryBarrier();
+		state->ring->head = state->index;
+
+		fscc_ring_complete_waiters(state, STATUS_SUCCESS);
+	}
+
+	WdfSpinLockRelease(port->ring_spinlock);
+
+	return 1;
+}
+
+/*
+	Hands as many frames from the tx ring to the hardware as there is room
+	for. Called from the doorbell IOCTL, the timer and once a transmit
+	finishes, so frames left behind for lack of room are picked up later.
+*/
+void fscc_ring_drain_tx(struct fscc_port *port)
+{
+	struct fscc_ring_state *state = &port->tx_ring;
+	struct fscc_ring_record *record = 0;
+	unsigned char *data = 0;
+	UINT32 head = 0, length = 0;
+	UINT32 write_count = 0;
+	UINT32 orig_tail = 0;
+	int status = STATUS_SUCCESS;
+	int result = 0;
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	if (!state->ring) {
+		WdfSpinLockRelease(port->ring_spinlock);
+		return;
+	}
+
+	data = FSCC_RING_DATA(state->ring);
+	orig_tail = state->index;
+
+	while (1) {
+		head = state->ring->head;
+		KeMemoryBarrier();
+
+		/* The length is copied once so the application can't change it under us */
+		result = fscc_ring_next(data, state->size, head, &state->index,
+		&record, &length);
+		if (result == 0)
+			break;
+
+		if (result < 0 || length > port->memory.tx_size * port->memory.tx_num) {
+			TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE,
+			"Invalid tx ring record at 0x%x (head 0x%x)", state->index, head);
+			break;
+		}
+
+		if (fscc_user_get_tx_space(port) < length || !fscc_pacer_ready(port, length))
+			break;
+
+		if (port->ignore_timeout == FALSE && fscc_port_clock_timed_out(port))
+			break;
+
+		status = fscc_user_write_frame(port, (char *)(record + 1), length, &write_count);
+		if (!NT_SUCCESS(status))
+			break;
+
+		fscc_pacer_charge(port, length);
+
+		state->index += FSCC_RING_RECORD_SIZE(length);
+	}
+
+	if (state->index != orig_tail) {
+		/* Done with the records before the space is given back */
+		KeMemoryBarrier();
+		state->ring->tail = state->index;
+
+		if (state->index == head)
+			fscc_ring_complete_waiters(state, STATUS_SUCCESS);
+
+		if (!fscc_port_uses_dma(port))
+			WdfDpcEnqueue(port->oframe_dpc);
+	}
+
+	WdfSpinLockRelease(port->ring_spinlock);
+}
+
+/* Called for a mapped ring that was canceled with CancelIo */
+VOID fscc_ring_canceled(IN WDFQUEUE Queue, IN WDFREQUEST Request)
+{
+	struct fscc_port *port = 0;
+
+	port = WdfObjectGet_FSCC_PORT(WdfIoQueueGetDevice(Queue));
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	if (port->rx_ring.request == Request)
+		fscc_ring_stop(&port->rx_ring);
+
+	if (port->tx_ring.request == Request)
+		fscc_ring_stop(&port->tx_ring);
+
+	WdfSpinLockRelease(port->ring_spinlock);
+
+	WdfRequestComplete(Request, STATUS_CANCELLED);
+}
+
+/* Unmaps any rings the closing handle owns */
+void fscc_ring_cleanup(struct fscc_port *port, WDFFILEOBJECT FileObject)
+{
+	WDFREQUEST request = 0;
+
+	WdfSpinLockAcquire(port->ring_spinlock);
+
+	if (port->rx_ring.ring && port->rx_ring.file == FileObject)
+		fscc_ring_stop(&port->rx_ring);
+
+	if (port->tx_ring.ring && port->tx_ring.file == FileObject)
+		fscc_ring_stop(&port->tx_ring);
+
+	WdfSpinLockRelease(port->ring_spinlock);
+
+	while (NT_SUCCESS(WdfIoQueueRetrieveRequestByFileObject(port->ring_queue,
+		FileObject, &request)))
+		WdfRequestComplete(request, STATUS_CANCELLED);
+}
@@ -0,0 +1,49 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FSCC_RING_H
+#define FSCC_RING_H
+
+#include <ntddk.h>
+#include <wdf.h>
+
+#include "defines.h"
+#include "Trace.h"
+
+EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE fscc_ring_canceled;
+
+void fscc_ring_map_rx(struct fscc_port *port, WDFREQUEST Request);
+NTSTATUS fscc_ring_unmap_rx(struct fscc_port *port);
+void fscc_ring_wait_rx(struct fscc_port *port, WDFREQUEST Request);
+unsigned fscc_ring_fill_rx(struct fscc_port *port);
+BOOLEAN fscc_ring_rx_mapped(struct fscc_port *port);
+
+void fscc_ring_map_tx(struct fscc_port *port, WDFREQUEST Request);
+NTSTATUS fscc_ring_unmap_tx(struct fscc_port *port);
+void fscc_ring_wait_tx(struct fscc_port *port, WDFREQUEST Request);
+void fscc_ring_drain_tx(struct fscc_port *port);
+BOOLEAN fscc_ring_tx_mapped(struct fscc_port *port);
+void fscc_ring_cleanup(struct fscc_port *port, WDFFILEOBJECT FileObject);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FSCC_RINGLAYOUT_H
+#define FSCC_RINGLAYOUT_H
+
+/*
+	The layout of the rings shared with applications (see ring.c) and the
+	index arithmetic both sides of one use. It only needs UINT32, so it
+	builds in the driver, in applications and in the host tests in tools/.
+
+	head and tail count bytes and wrap, so head - tail is the number of bytes
+	in use. Neither side issues the memory barriers: the producer has to make
+	a record visible before the head that covers it, and the consumer has to
+	read head before the records it covers.
+*/
+
+/* Shared with the application, see ring.c */
+struct fscc_ring {
+	UINT32 size; /* Bytes of records after this header, a power of two */
+	volatile UINT32 head; /* Only written by the producer */
+	volatile UINT32 tail; /* Only written by the consumer */
+	UINT32 reserved;
+};
+
+struct fscc_ring_record {
+	UINT32 length; /* Bytes of data after this record */
+	UINT32 flags;
+};
+
+#define FSCC_RING_PAD 0x1 /* Skip to the start of the ring */
+#define FSCC_RING_ALIGN(n) (((n) + 7) & ~7)
+#define FSCC_RING_DATA(ring) ((unsigned char *)(ring) + sizeof(struct fscc_ring))
+#define FSCC_RING_RECORD_SIZE(n) (sizeof(struct fscc_ring_record) + FSCC_RING_ALIGN(n))
+
+/*
+	Producer side. Returns where a record with at least needed bytes of data
+	can go, with the bytes of data it has room for in *room, or 0 if the ring
+	is too full. A record that wouldn't fit before the end of the ring gets a
+	pad record in front of it, which moves *head even if there turns out not
+	to be room. used is *head - tail, which the caller has checked isn't more
+	than size.
+*/
+static __inline struct fscc_ring_record *fscc_ring_reserve(unsigned char *data,
+UINT32 size, UINT32 *head, UINT32 used, UINT32 needed, UINT32 *room)
+{
+	struct fscc_ring_record *record = 0;
+	UINT32 offset = *head & (size - 1);
+	UINT32 contiguous = size - offset;
+
+	if (contiguous < sizeof(*record) + needed) {
+		if (size - used < contiguous)
+			return 0;
+
+		record = (struct fscc_ring_record *)(data + offset);
+		record->length = contiguous - sizeof(*record);
+		record->flags = FSCC_RING_PAD;
+
+		*head += contiguous;
+		used += contiguous;
+		offset = 0;
+		contiguous = size;
+	}
+
+	*room = (size - used < contiguous) ? size - used : contiguous;
+	if (*room < sizeof(*record) + needed)
+		return 0;
+
+	*room -= sizeof(*record);
+
+	return (struct fscc_ring_record *)(data + offset);
+}
+
+/* Producer side. Fills in a record from fscc_ring_reserve and moves *head past it. */
+static __inline void fscc_ring_commit(struct fscc_ring_record *record, UINT32 *head,
+UINT32 length)
+{
+	record->length = length;
+	record->flags = 0;
+
+	*head += FSCC_RING_RECORD_SIZE(length);
+}
+
+/*
+	Consumer side. Finds the next record with data, moving *tail past a pad
+	record in front of it. Returns 1 with the record in *record and its
+	length, read once, in *length. Returns 0 if the ring is empty, and -1 if
+	head or a record can't be right, which only happens if the other side
+	broke the ring. The caller moves *tail on by FSCC_RING_RECORD_SIZE(*length)
+	once it is done with the record.
+*/
+static __inline int fscc_ring_next(unsigned char *data, UINT32 size, UINT32 head,
+UINT32 *tail, struct fscc_ring_record **record, UINT32 *length)
+{
+	UINT32 available = 0, offset = 0, contiguous = 0;
+
+	while (1) {
+		available = head - *tail;
+		if (available == 0)
+			return 0;
+
+		if (available > size || available < sizeof(**record))
+			return -1;
+
+		offset = *tail & (size - 1);
+		contiguous = size - offset;
+
+		*record = (struct fscc_ring_record *)(data + offset);
+		*length = (*record)->length;
+
+		if (!((*record)->flags & FSCC_RING_PAD))
+			break;
+
+		if (available < contiguous)
+			return -1;
+
+		*tail += contiguous;
+	}
+
+	if (*length == 0 || *length > contiguous - sizeof(**record) ||
+		FSCC_RING_RECORD_SIZE(*length) > available)
+		return -1;
+
+	return 1;
+}
+
+#endif
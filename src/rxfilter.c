@@ -0,0 +1,233 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "rxfilter.h"
+#include "port.h"
+#include "utils.h"
+#include "io.h"
+
+#if defined(EVENT_TRACING)
+#include "rxfilter.tmh"
+#endif
+
+/*
+	Drops received frames whose first byte (the HDLC address) isn't one of
+	the accepted ones, for the whole port. The accepted addresses are a
+	256 bit bitmap, so checking a frame is one bit test.
+
+	If the accepted addresses are all the values of some bits with the rest
+	fixed, one address or a group like 0x40-0x4f, they are also written to
+	RAR and RAMR: RAR gets the address and RAMR the bits that may differ.
+	With address recognition turned on in CCR0 the card then drops the other
+	frames itself and they never take rx descriptors. Any other set, or the
+	card not recognizing addresses, is left to fscc_filter_frames, which
+	throws away rejected frames at the front of the rx descriptors before
+	anything reads them.
+*/
+
+BOOLEAN fscc_filter_accepts(const struct fscc_rx_filter *filter, unsigned char address)
+{
+	return (filter->addresses[address >> 3] >> (address & 7)) & 1;
+}
+
+/*
+	Finds the address and compared bits RAR and RAMR need for filter.
+	Returns FALSE if they can't express it.
+*/
+BOOLEAN fscc_filter_offload(const struct fscc_rx_filter *filter, unsigned char *address, unsigned char *mask)
+{
+	unsigned first = 0;
+	unsigned same = 0xff;
+	unsigned count = 0;
+	unsigned free_bits = 0;
+	unsigned i = 0;
+
+	for (i = 0; i < 256; i++) {
+		if (!fscc_filter_accepts(filter, (unsigned char)i))
+			continue;
+
+		if (count == 0)
+			first = i;
+
+		same &= ~(i ^ first);
+		count++;
+	}
+
+	for (i = 0; i < 8; i++) {
+		if (!(same & (1 << i)))
+			free_bits++;
+	}
+
+	/* Every address with the same fixed bits has to be accepted */
+	if (count == 0 || count != (1u << free_bits))
+		return FALSE;
+
+	*address = (unsigned char)first;
+	*mask = (unsigned char)same;
+
+	return TRUE;
+}
+
+/*
+	Writes filter to RAR and RAMR if they can hold it, saving what they had
+	the first time. Otherwise, or with no filter, puts the saved values back.
+*/
+static void fscc_filter_write_registers(struct fscc_port *port, const struct fscc_rx_filter *filter)
+{
+	unsigned char address = 0;
+	unsigned char mask = 0;
+	BOOLEAN offload = FALSE;
+
+	if (filter)
+		offload = fscc_filter_offload(filter, &address, &mask);
+
+	WdfSpinLockAcquire(port->board_settings_spinlock);
+
+	if (offload) {
+		if (port->rx_filter_saved_RAR < 0) {
+			port->rx_filter_saved_RAR = fscc_port_get_register(port, 0, RAR_OFFSET);
+			port->rx_filter_saved_RAMR = fscc_port_get_register(port, 0, RAMR_OFFSET);
+		}
+
+		fscc_port_set_register(port, 0, RAR_OFFSET, address);
+		fscc_port_set_register(port, 0, RAMR_OFFSET, (unsigned char)~mask);
+	}
+	else if (port->rx_filter_saved_RAR >= 0) {
+		fscc_port_set_register(port, 0, RAR_OFFSET, (UINT32)port->rx_filter_saved_RAR);
+		fscc_port_set_register(port, 0, RAMR_OFFSET, (UINT32)port->rx_filter_saved_RAMR);
+
+		port->rx_filter_saved_RAR = -1;
+		port->rx_filter_saved_RAMR = -1;
+	}
+
+	WdfSpinLockRelease(port->board_settings_spinlock);
+
+	if (offload) {
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+		"RX filter 0x%02x/0x%02x written to RAR/RAMR", address, mask);
+	}
+}
+
+NTSTATUS fscc_filter_set(struct fscc_port *port, struct fscc_rx_filter *filter)
+{
+	unsigned i = 0;
+
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+	return_val_if_untrue(filter, STATUS_INVALID_PARAMETER);
+
+	for (i = 0; i < FSCC_RX_FILTER_BYTES; i++) {
+		if (filter->addresses[i])
+			break;
+	}
+
+	/* Accepting nothing isn't a filter */
+	if (i == FSCC_RX_FILTER_BYTES)
+		return STATUS_INVALID_PARAMETER;
+
+	fscc_filter_write_registers(port, filter);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "RX filter set");
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	port->rx_filter = *filter;
+	port->rx_filter_enabled = TRUE;
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	/* Frames already waiting may be rejected now */
+	WdfDpcEnqueue(port->process_read_dpc);
+
+	return STATUS_SUCCESS;
+}
+
+void fscc_filter_clear(struct fscc_port *port)
+{
+	return_if_untrue(port);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	port->rx_filter_enabled = FALSE;
+	RtlZeroMemory(&port->rx_filter, sizeof(port->rx_filter));
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	fscc_filter_write_registers(port, NULL);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "RX filter cleared");
+}
+
+/*
+	Called after the port is started and RAR and RAMR have been written from
+	the defaults. The values saved before were replaced, so the defaults are
+	what a later clear puts back.
+*/
+void fscc_filter_restart(struct fscc_port *port)
+{
+	struct fscc_rx_filter filter;
+	BOOLEAN enabled = FALSE;
+
+	return_if_untrue(port);
+
+	WdfSpinLockAcquire(port->board_settings_spinlock);
+	port->rx_filter_saved_RAR = -1;
+	port->rx_filter_saved_RAMR = -1;
+	WdfSpinLockRelease(port->board_settings_spinlock);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	enabled = port->rx_filter_enabled;
+	filter = port->rx_filter;
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	if (enabled)
+		fscc_filter_write_registers(port, &filter);
+}
+
+void fscc_filter_get(struct fscc_port *port, struct fscc_rx_filter *filter)
+{
+	return_if_untrue(port);
+
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	*filter = port->rx_filter;
+	WdfSpinLockRelease(port->board_rx_spinlock);
+}
+
+/*
+	Throws away the rejected frames at the front of the rx descriptors.
+	Called with board_rx_spinlock held before looking for the next frame to
+	read.
+*/
+void fscc_filter_frames(struct fscc_port *port)
+{
+	UINT32 bytes_ready = 0;
+	unsigned char address = 0;
+
+	if (!port->rx_filter_enabled)
+		return;
+
+	while (fscc_user_next_read_size(port, &bytes_ready)) {
+		if (fscc_user_peek_frame(port, &address, 1) == 1 &&
+			fscc_filter_accepts(&port->rx_filter, address))
+			return;
+
+		fscc_user_discard_frame(port);
+		port->rx_frames_filtered++;
+	}
+}
@@ -0,0 +1,74 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+#include "io.h"
+#include "port.h"
+#include "utils.h"
+
+#define RX_SIZE_HINT_PERCENT 90
+#define MIN_RX_SIZE_HINT 64
+#define MAX_RX_SIZE_HINT 4096 /* Well under the FIFO size, see config.h */
+#define MIN_RX_NUM_HINT 16
+
+/* Sizes include the status bytes, since those take up descriptor space too */
+void fscc_io_count_rx_frame(struct fscc_port *port, UINT32 size, UINT32 descriptors)
+{
+	unsigned bucket = 0;
+
+	while (bucket < FSCC_RX_FRAME_SIZE_BUCKETS - 1 && size > (16u << bucket))
+		bucket++;
+
+	port->rx_frame_sizes[bucket]++;
+	port->rx_frames++;
+	port->rx_descriptors_used += descriptors;
+}
+
+/*
+	Suggests the smallest rx buffer size that holds RX_SIZE_HINT_PERCENT of
+	the frames seen so far in a single descriptor, and enough buffers to keep
+	the same total rx memory, but never fewer than MIN_RX_NUM_HINT so large
+	buffers can't leave room for only a few frames. Memory only changes when
+	the port is next started, see fscc_defaults_load.
+*/
+void fscc_port_get_rx_size_hint(struct fscc_port *port, struct fscc_stats *stats)
+{
+	UINT64 target = 0;
+	UINT64 seen = 0;
+	UINT32 size = port->memory.rx_size;
+	unsigned i = 0;
+
+	if (stats->rx_frames) {
+		target = (stats->rx_frames * RX_SIZE_HINT_PERCENT + 99) / 100;
+
+		for (i = 0; i < FSCC_RX_FRAME_SIZE_BUCKETS - 1; i++) {
+			seen += stats->rx_frame_sizes[i];
+			if (seen >= target)
+				break;
+		}
+
+		size = min(max(16u << i, MIN_RX_SIZE_HINT), MAX_RX_SIZE_HINT);
+	}
+
+	stats->rx_size_hint = size;
+	stats->rx_num_hint = max((port->memory.rx_num * port->memory.rx_size) / size, MIN_RX_NUM_HINT);
+}
@@ -0,0 +1,137 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "snapshot.h"
+#include "utils.h"
+
+#if defined(EVENT_TRACING)
+#include "snapshot.tmh"
+#endif
+
+/*
+	What FsccEvtDeviceD0Exit saves for FsccEvtDeviceD0Entry to write back:
+	the registers that were read and the clock generator bits. It is kept
+	as a byte layout rather than the structs so it means the same thing to
+	any build and can be checked before anything is written to the card.
+
+	The snapshot is little endian UINT32s:
+		magic, version, count, {register, value}[count], frequency,
+		clock_bits[20]
+	register is the index of the register in struct fscc_registers.
+	Registers that weren't read aren't stored, and come back as unset.
+*/
+
+#define SNAPSHOT_MAGIC 0x53435346 /* "FSCS" */
+#define SNAPSHOT_VERSION 1
+
+static ULONG get_le32(const UCHAR *p)
+{
+	return (ULONG)p[0] | ((ULONG)p[1] << 8) | ((ULONG)p[2] << 16) | ((ULONG)p[3] << 24);
+}
+
+static void put_le32(UCHAR *p, ULONG value)
+{
+	p[0] = (UCHAR)value;
+	p[1] = (UCHAR)(value >> 8);
+	p[2] = (UCHAR)(value >> 16);
+	p[3] = (UCHAR)(value >> 24);
+}
+
+/*
+	Returns the number of registers read into regs, or -1 if blob isn't a
+	snapshot this driver can read. Nothing is changed in that case.
+*/
+int fscc_snapshot_parse(const UCHAR *blob, ULONG length, struct fscc_registers *regs, struct clock_data_fscc *clock_data)
+{
+	fscc_register *values = (fscc_register *)regs;
+	ULONG count = 0;
+	ULONG index = 0;
+	ULONG i = 0;
+	const UCHAR *clock = 0;
+
+	return_val_if_untrue(blob, -1);
+	return_val_if_untrue(regs, -1);
+	return_val_if_untrue(clock_data, -1);
+
+	if (length < (FSCC_SNAPSHOT_HEADER_WORDS + FSCC_SNAPSHOT_CLOCK_WORDS) * 4)
+		return -1;
+
+	if (get_le32(blob) != SNAPSHOT_MAGIC || get_le32(blob + 4) != SNAPSHOT_VERSION)
+		return -1;
+
+	count = get_le32(blob + 8);
+	if (count > FSCC_SNAPSHOT_REGISTERS ||
+		length < (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count + FSCC_SNAPSHOT_CLOCK_WORDS) * 4)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		if (get_le32(blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * i) * 4) >= FSCC_SNAPSHOT_REGISTERS)
+			return -1;
+	}
+
+	FSCC_REGISTERS_INIT(*regs);
+
+	for (i = 0; i < count; i++) {
+		index = get_le32(blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * i) * 4);
+		values[index] = get_le32(blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * i + 1) * 4);
+	}
+
+	clock = blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count) * 4;
+	clock_data->frequency = get_le32(clock);
+	RtlCopyMemory(clock_data->clock_bits, clock + 4, sizeof(clock_data->clock_bits));
+
+	return (int)count;
+}
+
+/* blob has to hold FSCC_SNAPSHOT_SIZE bytes. Returns the bytes used. */
+ULONG fscc_snapshot_serialize(const struct fscc_registers *regs, const struct clock_data_fscc *clock_data, UCHAR *blob)
+{
+	const fscc_register *values = (const fscc_register *)regs;
+	ULONG count = 0;
+	ULONG i = 0;
+	UCHAR *clock = 0;
+
+	return_val_if_untrue(regs, 0);
+	return_val_if_untrue(clock_data, 0);
+	return_val_if_untrue(blob, 0);
+
+	for (i = 0; i < FSCC_SNAPSHOT_REGISTERS; i++) {
+		if (values[i] < 0)
+			continue;
+
+		put_le32(blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count) * 4, i);
+		put_le32(blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count + 1) * 4, (ULONG)values[i]);
+		count++;
+	}
+
+	put_le32(blob, SNAPSHOT_MAGIC);
+	put_le32(blob + 4, SNAPSHOT_VERSION);
+	put_le32(blob + 8, count);
+
+	clock = blob + (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count) * 4;
+	put_le32(clock, (ULONG)clock_data->frequency);
+	RtlCopyMemory(clock + 4, clock_data->clock_bits, sizeof(clock_data->clock_bits));
+
+	return (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count + FSCC_SNAPSHOT_CLOCK_WORDS) * 4;
+}
@@ -0,0 +1,79 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+
+#include "io.h"
+#include "port.h"
+#include "utils.h"
+
+/*
+	A read that ends part way through a descriptor leaves the rest of the data
+	where it is and moves the descriptor's read_offset forward, so small reads
+	don't have to shift the remaining data each time.
+*/
+int fscc_user_read_stream(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	size_t i;
+	UINT32 receive_length = 0;
+	UINT32 control;
+	struct dma_frame *frame = 0;
+	
+	return_val_if_untrue(port, STATUS_UNSUCCESSFUL);
+	
+	*out_length = 0;
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	for(i = 0; i < port->memory.rx_num; i++) {	
+		frame = port->rx_descriptors[port->user_rx_desc];
+		control = frame->desc->control;
+		
+		// If not CSTOP && not FE, then break
+		if(!(control&DESC_FE_BIT) && !(control&DESC_CSTOP_BIT))
+			break;
+		
+		receive_length = min(frame->desc->data_count, buf_length - *out_length);
+		
+		RtlCopyMemory(buf + *out_length, frame->buffer + frame->read_offset, receive_length);
+		*out_length += receive_length;
+		
+		if(receive_length == frame->desc->data_count) {
+			frame->desc->data_count = frame->data_size;
+			frame->read_offset = 0;
+			clear_timestamp(&frame->timestamp);
+			if(i%2) frame->desc->control = DESC_HI_BIT;
+			else frame->desc->control = 0;
+		}
+		else {
+			// data_count is what's left to read, starting at read_offset.
+			frame->read_offset += receive_length;
+			frame->desc->data_count -= receive_length;
+			break;
+		}
+		
+		port->user_rx_desc++;
+		if(port->user_rx_desc == port->memory.rx_num) 
+			port->user_rx_desc = 0;
+	}
+	WdfSpinLockRelease(port->board_rx_spinlock);
+	
+	return STATUS_SUCCESS;
+}
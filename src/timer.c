@@ -0,0 +1,125 @@
+/*
+Copyright 2023 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy 
+of this software and associated documentation files (the "Software"), to deal 
+in the Software without restriction, including without limitation the rights 
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in 
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+THE SOFTWARE.
+*/
+
+
+#include "port.h"
+#include "utils.h"
+#include "ring.h"
+
+#define CLOCK_PRESENT_TIMEOUT_MS 500
+
+/* Basic check to see if the CE bit is set. */
+unsigned fscc_port_timed_out(struct fscc_port *port)
+{
+	UINT32 star_value = 0;
+	unsigned i = 0;
+
+	return_val_if_untrue(port, 0);
+
+	for (i = 0; i < DEFAULT_TIMEOUT_VALUE; i++) {
+		star_value = fscc_port_get_register(port, 0, STAR_OFFSET);
+
+		if ((star_value & CE_BIT) == 0) {
+			fscc_port_set_clock_present(port, TRUE);
+			return 0;
+		}
+	}
+
+	fscc_port_set_clock_present(port, FALSE);
+
+	return 1;
+}
+
+/*
+	Same as fscc_port_timed_out but uses the result of the last check if the
+	clock was present within CLOCK_PRESENT_TIMEOUT_MS. The timer and the
+	transmit and receive interrupts keep that result up to date, so the
+	transmit path doesn't normally need to read STAR.
+*/
+unsigned fscc_port_clock_timed_out(struct fscc_port *port)
+{
+	return_val_if_untrue(port, 0);
+
+	if (port->clock_present && !fscc_port_clock_stale(port)) {
+		InterlockedIncrement64(&port->mmio_reads_avoided);
+		return 0;
+	}
+
+	return fscc_port_timed_out(port);
+}
+
+/* Whether the last clock check is older than CLOCK_PRESENT_TIMEOUT_MS */
+BOOLEAN fscc_port_clock_stale(struct fscc_port *port)
+{
+	ULONGLONG age = KeQueryInterruptTime() - port->clock_present_time;
+
+	return age >= (ULONGLONG)CLOCK_PRESENT_TIMEOUT_MS * 10000;
+}
+
+/* Safe to call from the ISR */
+void fscc_port_set_clock_present(struct fscc_port *port, BOOLEAN value)
+{
+	port->clock_present_time = KeQueryInterruptTime();
+	port->clock_present = value;
+}
+
+/*
+	The timer only picks up things no interrupt will: reads and blocking
+	writes that are waiting, rings, and a partial frame sitting in the rx
+	FIFO. Idle ports don't run it at all.
+*/
+BOOLEAN fscc_port_needs_timer(struct fscc_port *port)
+{
+	ULONG pending = 0;
+
+	return_val_if_untrue(port, FALSE);
+
+	if (fscc_ring_rx_mapped(port) || fscc_ring_tx_mapped(port))
+		return TRUE;
+
+	WdfIoQueueGetState(port->read_queue2, &pending, NULL);
+	if (pending)
+		return TRUE;
+
+	WdfIoQueueGetState(port->blocking_request_queue, &pending, NULL);
+	if (pending)
+		return TRUE;
+
+	if (!fscc_port_uses_dma(port) && port->rx_bytes_in_frame)
+		return TRUE;
+
+	return FALSE;
+}
+
+/* Arms the timer if there is work for it and it isn't already armed */
+void fscc_port_start_timer(struct fscc_port *port)
+{
+	return_if_untrue(port);
+
+	if (!port->timer || !fscc_port_needs_timer(port))
+		return;
+
+	if (InterlockedExchange(&port->timer_armed, 1))
+		return;
+
+	WdfTimerStart(port->timer, WDF_REL_TIMEOUT_IN_US(port->timer_period));
+}
@@ -48,6 +48,52 @@ int timestamp_is_empty(fscc_timestamp *timestamp){
 	return 0;
 }
 
+/* FCR lines used to program each channel's clock generator */
+static const struct {
+	UINT32 strobe;
+	UINT32 data;
+	UINT32 clock;
+} clock_bits_lines[2] = {
+	{ 0x00000008, 0x00000001, 0x00000002 },
+	{ 0x00000800, 0x00000100, 0x00000200 },
+};
+
+/* Clears the clock generator lines for both channels */
+#define CLOCK_BITS_FCR_MASK 0xfffff0f0
+
+/*
+	Builds the sequence of FCR values that shifts clock_bits (20 bytes, last
+	byte and most significant bit first) into the clock generator and then
+	restores fcr. words must hold CLOCK_BITS_WORDS values. Returns the number
+	of words used.
+*/
+unsigned encode_clock_bits(const unsigned char *clock_bits, unsigned channel,
+						   UINT32 fcr, UINT32 *words)
+{
+	UINT32 base = fcr & CLOCK_BITS_FCR_MASK;
+	UINT32 data_line = clock_bits_lines[channel & 1].data;
+	UINT32 clock_line = clock_bits_lines[channel & 1].clock;
+	unsigned count = 0;
+	int i = 0; // Must be signed because we are going backwards through the array
+	int j = 0;
+
+	words[count++] = base;
+
+	for (i = 19; i >= 0; i--) {
+		for (j = 7; j >= 0; j--) {
+			UINT32 value = ((clock_bits[i] >> j) & 1) ? (base | data_line) : base;
+
+			words[count++] = value | clock_line;
+			words[count++] = value;
+		}
+	}
+
+	words[count++] = base | clock_bits_lines[channel & 1].strobe;
+	words[count++] = fcr;
+
+	return count;
+}
+
 unsigned port_offset(struct fscc_port *port, unsigned bar, unsigned offset)
 {
 	switch (bar) {
@@ -89,3 +135,73 @@ unsigned is_read_only_register(unsigned offset)
 
 	return 0;
 }
+
+/*
+	FCR isn't cached because serialfc writes to it as well, and the status,
+	FIFO count and DMA registers change underneath us.
+*/
+enum register_class register_cache_class(unsigned bar, unsigned offset)
+{
+	if (bar != 0)
+		return REGISTER_VOLATILE;
+
+	switch (offset) {
+	case VSTR_OFFSET:
+		return REGISTER_STATIC;
+
+	case CCR0_OFFSET:
+	case CCR1_OFFSET:
+	case CCR2_OFFSET:
+	case IMR_OFFSET:
+		return REGISTER_CACHED;
+	}
+
+	return REGISTER_VOLATILE;
+}
+
+/*
+	Register transactions get the same bar 2 registers fscc_port_set_registers
+	does. The DMA base registers would let the card write anywhere, and the
+	rest belong to the other channel. ISR clears when it is read and the
+	FIFOs hold the data, so reading them would take both from fscc_isr and
+	the read path.
+*/
+unsigned is_valid_register_op(const struct fscc_register_op *op)
+{
+	if (op->offset % 4)
+		return 0;
+
+	switch (op->bar) {
+	case 0:
+		if (op->offset > MAX_OFFSET)
+			return 0;
+
+		switch (op->offset) {
+		case FIFO_OFFSET:
+		case BC_FIFO_L_OFFSET:
+		case ISR_OFFSET:
+			return 0;
+		}
+		break;
+
+	case 2:
+		if (op->offset != FCR_OFFSET && op->offset != DMACCR_OFFSET)
+			return 0;
+		break;
+
+	default:
+		return 0;
+	}
+
+	switch (op->type) {
+	case FSCC_REGISTER_READ:
+	case FSCC_REGISTER_WAIT:
+		return 1;
+
+	case FSCC_REGISTER_WRITE:
+	case FSCC_REGISTER_MODIFY:
+		return (op->bar == 0 && is_read_only_register(op->offset)) ? 0 : 1;
+	}
+
+	return 0;
+}
@@ -52,7 +52,18 @@ THE SOFTWARE.
 
 UINT32 chars_to_u32(const char *data);
 unsigned is_read_only_register(unsigned offset);
+
+enum register_class {
+	REGISTER_VOLATILE, /* Changed by the hardware, always read */
+	REGISTER_STATIC, /* Never changes, read once */
+	REGISTER_CACHED /* Only changed by the driver, served from register_storage */
+};
+
+enum register_class register_cache_class(unsigned bar, unsigned offset);
+unsigned is_valid_register_op(const struct fscc_register_op *op);
 unsigned port_offset(struct fscc_port *port, unsigned bar, unsigned offset);
+unsigned encode_clock_bits(const unsigned char *clock_bits, unsigned channel,
+						   UINT32 fcr, UINT32 *words);
 
 #define set_timestamp(x) KeQuerySystemTime(x)
 void clear_timestamp(fscc_timestamp *timestamp);
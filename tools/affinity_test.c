@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "port.h"
+#include "config.h"
+
+/*
+	Host tests for src/affinity.c, which points each port's interrupt at
+	the processors in InterruptAffinity and its DPCs at DpcProcessor.
+
+	Left at their defaults neither is changed. InterruptAffinity has to
+	become the interrupt's processor set, and DpcProcessor the target of
+	every one of the port's DPCs, unless it isn't a processor. DPCs have to
+	be counted on the processor they ran on, with processors past the end
+	of the stats counted in the last entry.
+
+	Last, four cards of four ports are run for a second of simulated time
+	on eight processors with the defaults, with DpcProcessor spread over
+	the processors, with each card's InterruptAffinity on its own processor
+	and with both. Each interrupt runs the ISR and then queues the port's
+	DPC, which only runs once however many interrupts queued it. The load
+	on the busiest processor, the DPC work done and the time DPCs waited
+	are printed for each, and the DPCs counted by fscc_port_count_dpc have
+	to match the processors the simulation ran them on.
+
+	Built from the driver's own affinity.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/affinity_test.c src/affinity.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define CPUS 8
+#define CARDS 4
+#define PORTS_PER_CARD 4
+#define PORTS (CARDS * PORTS_PER_CARD)
+#define DPCS_PER_PORT 8
+#define NO_TARGET -1
+
+#define RUN_US 1000000
+#define INTERRUPTS_PER_SECOND 8000 /* A port */
+#define ISR_US 2
+#define DPC_US 20 /* For each interrupt the DPC picks up */
+#define MAX_WAITING 4096
+
+struct dpc_run {
+	unsigned port;
+	UINT64 queued; /* When it was queued, us */
+	UINT32 left; /* Work left, us */
+	BOOLEAN started;
+};
+
+struct cpu {
+	unsigned isrs[MAX_WAITING]; /* Ports, oldest first */
+	unsigned isr_head, isr_count;
+	UINT32 isr_left;
+	struct dpc_run dpcs[MAX_WAITING];
+	unsigned dpc_head, dpc_count;
+	UINT64 busy, dpc_runs;
+};
+
+struct result {
+	double max_busy, done, wait_mean, wait_max;
+	unsigned used;
+};
+
+static struct fscc_port ports[PORTS];
+static KAFFINITY interrupt_mask[PORTS];
+static int dpc_target[PORTS * DPCS_PER_PORT + 1];
+static unsigned policies_set, targets_set;
+static ULONG current_cpu;
+
+static struct cpu cpus[CPUS];
+static int dpc_waiting[PORTS]; /* Index of the port's queued run, or -1 */
+
+static WDFDPC dpc_handle(unsigned port, unsigned dpc)
+{
+	return (WDFDPC)(size_t)(port * DPCS_PER_PORT + dpc + 1);
+}
+
+void WdfInterruptSetPolicy(WDFINTERRUPT Interrupt, WDF_INTERRUPT_POLICY Policy, WDF_INTERRUPT_PRIORITY Priority, KAFFINITY TargetProcessorSet)
+{
+	check(Policy == WdfIrqPolicySpecifiedProcessors);
+	check(Priority == WdfIrqPriorityUndefined);
+
+	interrupt_mask[(size_t)Interrupt - 1] = TargetProcessorSet;
+	policies_set++;
+}
+
+NTSTATUS KeGetProcessorNumberFromIndex(ULONG ProcIndex, PPROCESSOR_NUMBER ProcNumber)
+{
+	if (ProcIndex >= CPUS)
+		return STATUS_INVALID_PARAMETER;
+
+	ProcNumber->Group = 0;
+	ProcNumber->Number = (UCHAR)ProcIndex;
+	ProcNumber->Reserved = 0;
+
+	return STATUS_SUCCESS;
+}
+
+PKDPC WdfDpcWdmGetDpc(WDFDPC Dpc)
+{
+	return (PKDPC)Dpc;
+}
+
+NTSTATUS KeSetTargetProcessorDpcEx(PKDPC Dpc, PPROCESSOR_NUMBER ProcNumber)
+{
+	dpc_target[(size_t)Dpc] = ProcNumber->Number;
+	targets_set++;
+
+	return STATUS_SUCCESS;
+}
+
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber)
+{
+	return current_cpu;
+}
+
+static void setup(void)
+{
+	unsigned i;
+
+	memset(ports, 0, sizeof(ports));
+	memset(interrupt_mask, 0, sizeof(interrupt_mask));
+	policies_set = targets_set = 0;
+
+	for (i = 0; i < PORTS * DPCS_PER_PORT + 1; i++)
+		dpc_target[i] = NO_TARGET;
+
+	for (i = 0; i < PORTS; i++) {
+		ports[i].interrupt = (WDFINTERRUPT)(size_t)(i + 1);
+		ports[i].oframe_dpc = dpc_handle(i, 0);
+		ports[i].iframe_dpc = dpc_handle(i, 1);
+		ports[i].isr_alert_dpc = dpc_handle(i, 2);
+		ports[i].request_dpc = dpc_handle(i, 3);
+		ports[i].process_read_dpc = dpc_handle(i, 4);
+		ports[i].alls_dpc = dpc_handle(i, 5);
+		ports[i].timestamp_dpc = dpc_handle(i, 6);
+		ports[i].repeat_dpc = dpc_handle(i, 7);
+
+		ports[i].defaults.values[FSCC_DEFAULT_INTERRUPT_AFFINITY] = DEFAULT_INTERRUPT_AFFINITY_VALUE;
+		ports[i].defaults.values[FSCC_DEFAULT_DPC_PROCESSOR] = DEFAULT_DPC_PROCESSOR_VALUE;
+	}
+}
+
+static BOOLEAN all_targeted(unsigned port, int cpu)
+{
+	unsigned i;
+
+	for (i = 0; i < DPCS_PER_PORT; i++) {
+		if (dpc_target[(size_t)dpc_handle(port, i)] != cpu)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void test_defaults(void)
+{
+	setup();
+
+	fscc_port_set_affinity(&ports[0]);
+
+	check(policies_set == 0 && targets_set == 0);
+	check(all_targeted(0, NO_TARGET));
+}
+
+static void test_interrupt_affinity(void)
+{
+	setup();
+
+	ports[1].defaults.values[FSCC_DEFAULT_INTERRUPT_AFFINITY] = 0x0c;
+	fscc_port_set_affinity(&ports[1]);
+
+	check(policies_set == 1 && interrupt_mask[1] == 0x0c);
+	check(targets_set == 0);
+}
+
+static void test_dpc_processor(void)
+{
+	setup();
+
+	ports[2].defaults.values[FSCC_DEFAULT_DPC_PROCESSOR] = 3;
+	fscc_port_set_affinity(&ports[2]);
+
+	check(policies_set == 0);
+	check(targets_set == DPCS_PER_PORT);
+	check(all_targeted(2, 3));
+	check(all_targeted(1, NO_TARGET) && all_targeted(3, NO_TARGET));
+
+	/* Not a processor, left where it was */
+	setup();
+
+	ports[2].defaults.values[FSCC_DEFAULT_DPC_PROCESSOR] = CPUS;
+	fscc_port_set_affinity(&ports[2]);
+
+	check(targets_set == 0);
+}
+
+static void test_counts(void)
+{
+	setup();
+
+	current_cpu = 5;
+	check(fscc_port_stats_cpu() == 5);
+	fscc_port_count_dpc(&ports[0]);
+	fscc_port_count_dpc(&ports[0]);
+	check(ports[0].dpc_cpu[5] == 2);
+
+	current_cpu = FSCC_STATS_CPUS + 10;
+	check(fscc_port_stats_cpu() == FSCC_STATS_CPUS - 1);
+	fscc_port_count_dpc(&ports[0]);
+	check(ports[0].dpc_cpu[FSCC_STATS_CPUS - 1] == 1);
+}
+
+/* The lowest processor in the set, and processor 0 when Windows decides */
+static unsigned interrupt_cpu(unsigned port)
+{
+	unsigned cpu;
+
+	for (cpu = 0; cpu < CPUS; cpu++) {
+		if (interrupt_mask[port] & ((KAFFINITY)1 << cpu))
+			return cpu;
+	}
+
+	return 0;
+}
+
+/* fscc_isr queues isr_alert_dpc on every interrupt, so that's the one followed */
+static unsigned dpc_cpu(unsigned port, unsigned isr_cpu)
+{
+	int target = dpc_target[(size_t)ports[port].isr_alert_dpc];
+
+	return target == NO_TARGET ? isr_cpu : (unsigned)target;
+}
+
+/* Anywhere up to twice the average gap */
+static UINT64 next_interrupt(UINT64 now)
+{
+	return now + 1 + (UINT64)rand() % (2 * 1000000 / INTERRUPTS_PER_SECOND);
+}
+
+/* Queues the port's DPC, or adds to the run already waiting */
+static void queue_dpc(unsigned port, unsigned cpu_index, UINT64 now)
+{
+	struct cpu *cpu = &cpus[cpu_index];
+	struct dpc_run *run;
+
+	if (dpc_waiting[port] >= 0) {
+		cpu->dpcs[dpc_waiting[port]].left += DPC_US;
+		return;
+	}
+
+	check(cpu->dpc_count < MAX_WAITING);
+
+	run = &cpu->dpcs[(cpu->dpc_head + cpu->dpc_count++) % MAX_WAITING];
+	run->port = port;
+	run->queued = now;
+	run->left = DPC_US;
+	run->started = FALSE;
+
+	dpc_waiting[port] = (int)(run - cpu->dpcs);
+}
+
+/* One microsecond on a processor, ISRs ahead of DPCs */
+static void run_cpu(unsigned cpu_index, UINT64 now, UINT64 *dpc_done, double *wait_total,
+	UINT64 *waits, UINT64 *wait_max)
+{
+	struct cpu *cpu = &cpus[cpu_index];
+	struct dpc_run *run;
+	unsigned port;
+
+	if (cpu->isr_count) {
+		cpu->busy++;
+
+		if (--cpu->isr_left == 0) {
+			port = cpu->isrs[cpu->isr_head];
+			cpu->isr_head = (cpu->isr_head + 1) % MAX_WAITING;
+			cpu->isr_count--;
+			cpu->isr_left = ISR_US;
+
+			queue_dpc(port, dpc_cpu(port, cpu_index), now);
+		}
+
+		return;
+	}
+
+	if (!cpu->dpc_count)
+		return;
+
+	run = &cpu->dpcs[cpu->dpc_head];
+
+	if (!run->started) {
+		/* Interrupts from here on queue it again */
+		run->started = TRUE;
+		dpc_waiting[run->port] = -1;
+
+		current_cpu = cpu_index;
+		fscc_port_count_dpc(&ports[run->port]);
+		cpu->dpc_runs++;
+
+		*wait_total += (double)(now - run->queued);
+		*wait_max = max(*wait_max, now - run->queued);
+		(*waits)++;
+	}
+
+	cpu->busy++;
+	(*dpc_done)++;
+
+	if (--run->left == 0) {
+		cpu->dpc_head = (cpu->dpc_head + 1) % MAX_WAITING;
+		cpu->dpc_count--;
+	}
+}
+
+static void simulate(ULONG (*affinity)(unsigned port), ULONG (*dpc_processor)(unsigned port),
+	struct result *result)
+{
+	UINT64 next[PORTS];
+	UINT64 now, offered = 0, dpc_done = 0, waits = 0, wait_max = 0;
+	UINT64 counted;
+	double wait_total = 0;
+	unsigned i, c, cpu;
+
+	setup();
+	memset(cpus, 0, sizeof(cpus));
+	srand(1);
+
+	for (i = 0; i < PORTS; i++) {
+		ports[i].defaults.values[FSCC_DEFAULT_INTERRUPT_AFFINITY] = affinity(i);
+		ports[i].defaults.values[FSCC_DEFAULT_DPC_PROCESSOR] = dpc_processor(i);
+		fscc_port_set_affinity(&ports[i]);
+
+		dpc_waiting[i] = -1;
+		next[i] = next_interrupt(0);
+	}
+
+	for (c = 0; c < CPUS; c++)
+		cpus[c].isr_left = ISR_US;
+
+	for (now = 0; now < RUN_US; now++) {
+		for (i = 0; i < PORTS; i++) {
+			if (now < next[i])
+				continue;
+
+			cpu = interrupt_cpu(i);
+			check(cpus[cpu].isr_count < MAX_WAITING);
+			cpus[cpu].isrs[(cpus[cpu].isr_head + cpus[cpu].isr_count++) % MAX_WAITING] = i;
+
+			offered += DPC_US;
+			next[i] = next_interrupt(now);
+		}
+
+		for (c = 0; c < CPUS; c++)
+			run_cpu(c, now, &dpc_done, &wait_total, &waits, &wait_max);
+	}
+
+	memset(result, 0, sizeof(*result));
+
+	for (c = 0; c < CPUS; c++) {
+		result->max_busy = max(result->max_busy, 100.0 * cpus[c].busy / RUN_US);
+		result->used += cpus[c].busy > 0;
+
+		/* What FSCC_GET_STATS would show, added up over the ports */
+		counted = 0;
+		for (i = 0; i < PORTS; i++)
+			counted += ports[i].dpc_cpu[c];
+
+		check(counted == cpus[c].dpc_runs);
+	}
+
+	result->done = 100.0 * dpc_done / offered;
+	result->wait_mean = waits ? wait_total / waits : 0;
+	result->wait_max = (double)wait_max;
+}
+
+static ULONG default_affinity(unsigned port)
+{
+	return DEFAULT_INTERRUPT_AFFINITY_VALUE;
+}
+
+static ULONG default_dpc_processor(unsigned port)
+{
+	return DEFAULT_DPC_PROCESSOR_VALUE;
+}
+
+/* Ports on a card share the line, so they share an affinity too */
+static ULONG card_affinity(unsigned port)
+{
+	return 1u << (port / PORTS_PER_CARD % CPUS);
+}
+
+static ULONG spread_dpc_processor(unsigned port)
+{
+	return port % CPUS;
+}
+
+static void model(void)
+{
+	struct {
+		const char *name;
+		ULONG (*affinity)(unsigned port);
+		ULONG (*dpc_processor)(unsigned port);
+	} setups[] = {
+		{ "defaults", default_affinity, default_dpc_processor },
+		{ "DpcProcessor", default_affinity, spread_dpc_processor },
+		{ "InterruptAffinity", card_affinity, default_dpc_processor },
+		{ "both", card_affinity, spread_dpc_processor },
+	};
+	struct result results[sizeof(setups) / sizeof(setups[0])];
+	unsigned i;
+
+	printf("%u ports on %u processors, %u interrupts/s a port, %u us ISR, %u us DPC:\n",
+		PORTS, CPUS, INTERRUPTS_PER_SECOND, ISR_US, DPC_US);
+	printf("%-18s %8s %8s %10s %12s %12s\n", "setup", "busiest", "used", "DPC done",
+		"DPC wait us", "max wait us");
+
+	for (i = 0; i < sizeof(setups) / sizeof(setups[0]); i++) {
+		simulate(setups[i].affinity, setups[i].dpc_processor, &results[i]);
+
+		printf("%-18s %7.1f%% %8u %9.1f%% %12.1f %12.0f\n", setups[i].name,
+			results[i].max_busy, results[i].used, results[i].done,
+			results[i].wait_mean, results[i].wait_max);
+	}
+
+	/* Everything on one processor can't keep up */
+	check(results[0].used == 1 && results[0].max_busy > 99.9 && results[0].done < 50);
+
+	/* Spreading the DPCs does, and both together use every processor */
+	check(results[1].used == CPUS && results[1].done > 98);
+	check(results[2].used == CARDS && results[2].done > 98);
+	check(results[3].used == CPUS && results[3].done > 98);
+	check(results[3].max_busy < results[1].max_busy && results[3].max_busy < results[2].max_busy);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_defaults();
+	test_interrupt_affinity();
+	test_dpc_processor();
+	test_counts();
+	model();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All affinity tests passed\n");
+
+	return EXIT_SUCCESS;
+}
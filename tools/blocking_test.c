@@ -0,0 +1,862 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "isr.h"
+#include "port.h"
+#include "io.h"
+#include "pacer.h"
+#include "config.h"
+
+/*
+	Host tests for src/blocking.c, which writes the blocking writes waiting
+	in blocking_request_queue once there is room for them, highest
+	FSCC_SET_TX_PRIORITY first.
+
+	Each pass has to write every waiting write that fits, highest priority
+	and then oldest first, stop at the first one that doesn't, skip writes
+	canceled along the way, even while the scan holds them, and complete the
+	ones with a bad buffer. Then a card sending at a fixed line rate is fed
+	by a writer that keeps a number of blocking writes waiting, and the
+	frames a second are printed against the old worker, which once the
+	transmit buffers had filled waited for the next timer tick to fill them
+	again. Last, short urgent writes are mixed into a saturated bulk queue,
+	and the time they wait to be written and to be sent is printed with and
+	without a higher priority.
+
+	Built from the driver's own blocking.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/blocking_test.c src/blocking.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define REQUEST_DPC ((WDFDPC)1)
+#define OFRAME_DPC ((WDFDPC)2)
+#define MAX_QUEUED 1024
+#define MAX_FRAME 4096
+#define TX_TOTAL (DEFAULT_BUFFER_TX_NUM * DEFAULT_BUFFER_TX_SIZE)
+
+struct fake_request {
+	struct fscc_request context;
+	UINT32 sequence, length;
+	int references;
+	BOOLEAN queued, completed;
+	BOOLEAN cancel, bad_buffer, write_fails; /* What happens when the worker gets to it */
+	BOOLEAN cancel_held; /* Canceled while a scan of the queue holds it */
+	BOOLEAN urgent;
+	NTSTATUS status;
+	ULONG_PTR information;
+};
+
+struct tx_frame {
+	UINT32 length;
+	BOOLEAN urgent;
+	ULONGLONG queued; /* When its write was queued */
+};
+
+static struct fscc_port port;
+static struct fake_request requests[MAX_QUEUED];
+static struct fake_request *queue[MAX_QUEUED]; /* Oldest first */
+static unsigned queue_count;
+static UINT32 next_sequence;
+static struct fake_request *writing;
+static char frame_data[MAX_FRAME];
+static UINT32 order[MAX_QUEUED]; /* Sequence numbers, as they were written */
+static unsigned order_count;
+
+/* Nanoseconds */
+static ULONGLONG now;
+
+/* What the transmit buffers hold, oldest first */
+static struct tx_frame tx_frames[MAX_QUEUED];
+static unsigned tx_head, tx_count;
+static UINT32 tx_used;
+
+/* How long urgent writes waited to be written and to be sent */
+static double urgent_written_total, urgent_sent_total;
+static ULONGLONG urgent_written_max, urgent_sent_max;
+static unsigned urgent_written, urgent_sent;
+
+static BOOLEAN pacer_open;
+static UINT64 paced_bytes;
+static unsigned passes, oframe_kicks, completions;
+
+ULONGLONG KeQueryInterruptTime(void)
+{
+	return now / 100;
+}
+
+WDFOBJECT WdfDpcGetParentObject(WDFDPC Dpc)
+{
+	check(Dpc == REQUEST_DPC);
+
+	return (WDFOBJECT)&port;
+}
+
+FSCC_PORT *WdfObjectGet_FSCC_PORT(WDFOBJECT handle)
+{
+	return (FSCC_PORT *)handle;
+}
+
+FSCC_REQUEST *WdfObjectGet_FSCC_REQUEST(WDFOBJECT handle)
+{
+	return &((struct fake_request *)handle)->context;
+}
+
+void fscc_port_count_dpc(struct fscc_port *port)
+{
+	passes++;
+}
+
+BOOLEAN fscc_port_uses_dma(struct fscc_port *port)
+{
+	return port->has_dma;
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	check(Dpc == OFRAME_DPC);
+	oframe_kicks++;
+
+	return TRUE;
+}
+
+static struct fake_request *enqueue(UINT32 length, UINT32 priority)
+{
+	struct fake_request *request = &requests[next_sequence % MAX_QUEUED];
+
+	check(queue_count < MAX_QUEUED);
+	check(!request->queued && request->references == 0);
+
+	memset(request, 0, sizeof(*request));
+	request->sequence = next_sequence++;
+	request->length = length;
+	request->queued = TRUE;
+	request->context.tx_priority = priority;
+	request->context.queued_time = KeQueryInterruptTime();
+
+	queue[queue_count++] = request;
+
+	return request;
+}
+
+static int position(struct fake_request *request)
+{
+	unsigned i;
+
+	for (i = 0; i < queue_count; i++) {
+		if (queue[i] == request)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+static void dequeue(struct fake_request *request)
+{
+	int i = position(request);
+
+	check(i >= 0);
+
+	memmove(&queue[i], &queue[i + 1], (queue_count - i - 1) * sizeof(queue[0]));
+	queue_count--;
+	request->queued = FALSE;
+}
+
+NTSTATUS WdfIoQueueFindRequest(WDFQUEUE Queue, WDFREQUEST TagRequest, WDFFILEOBJECT FileObject, PWDF_REQUEST_PARAMETERS Parameters, WDFREQUEST *OutRequest)
+{
+	struct fake_request *tag = (struct fake_request *)TagRequest;
+	int next = 0;
+
+	check(Queue == port.blocking_request_queue);
+	check(FileObject == NULL);
+
+	if (tag) {
+		check(tag->references > 0);
+
+		/* Gone from the queue, the caller still holds its reference */
+		if (tag->cancel_held) {
+			tag->cancel_held = FALSE;
+			dequeue(tag);
+			tag->completed = TRUE;
+			tag->status = STATUS_CANCELLED;
+			completions++;
+			return STATUS_NOT_FOUND;
+		}
+
+		next = position(tag) + 1;
+		check(next > 0);
+	}
+
+	if (next >= (int)queue_count)
+		return STATUS_NO_MORE_ENTRIES;
+
+	queue[next]->references++;
+	*OutRequest = (WDFREQUEST)queue[next];
+
+	if (Parameters)
+		Parameters->Parameters.Write.Length = queue[next]->length;
+
+	return STATUS_SUCCESS;
+}
+
+void WdfObjectDereference(WDFOBJECT Handle)
+{
+	struct fake_request *request = (struct fake_request *)Handle;
+
+	check(request->references > 0);
+	request->references--;
+}
+
+static void complete(struct fake_request *request, NTSTATUS status, ULONG_PTR information)
+{
+	check(!request->queued && !request->completed);
+	check(request->references == 0);
+
+	request->completed = TRUE;
+	request->status = status;
+	request->information = information;
+	completions++;
+}
+
+void WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+	complete((struct fake_request *)Request, Status, 0);
+}
+
+void WdfRequestCompleteWithInformation(WDFREQUEST Request, NTSTATUS Status, ULONG_PTR Information)
+{
+	complete((struct fake_request *)Request, Status, Information);
+}
+
+NTSTATUS WdfIoQueueRetrieveFoundRequest(WDFQUEUE Queue, WDFREQUEST FoundRequest, WDFREQUEST *OutRequest)
+{
+	struct fake_request *request = (struct fake_request *)FoundRequest;
+
+	check(Queue == port.blocking_request_queue);
+	check(request->references > 0);
+
+	dequeue(request);
+
+	/* Canceled between being found and being retrieved */
+	if (request->cancel) {
+		request->completed = TRUE;
+		request->status = STATUS_CANCELLED;
+		completions++;
+		return STATUS_NOT_FOUND;
+	}
+
+	*OutRequest = FoundRequest;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestRetrieveInputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+	struct fake_request *request = (struct fake_request *)Request;
+
+	check(MinimumRequiredSize == request->length);
+
+	if (request->bad_buffer)
+		return STATUS_BUFFER_TOO_SMALL;
+
+	writing = request;
+	*Buffer = frame_data;
+
+	return STATUS_SUCCESS;
+}
+
+size_t fscc_user_get_tx_space(struct fscc_port *port)
+{
+	return TX_TOTAL - tx_used;
+}
+
+BOOLEAN fscc_pacer_ready(struct fscc_port *port, UINT32 length)
+{
+	return pacer_open;
+}
+
+void fscc_pacer_charge(struct fscc_port *port, UINT32 length)
+{
+	paced_bytes += length;
+}
+
+/* A write still waiting that should have gone before this one */
+static BOOLEAN passed_over(struct fake_request *request)
+{
+	unsigned i;
+
+	for (i = 0; i < queue_count; i++) {
+		if (queue[i]->context.tx_priority > request->context.tx_priority)
+			return TRUE;
+		if (queue[i]->context.tx_priority == request->context.tx_priority &&
+			queue[i]->sequence < request->sequence)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+int fscc_user_write_frame(struct fscc_port *port, char *buf, UINT32 data_length, UINT32 *out_length)
+{
+	struct tx_frame *frame = &tx_frames[(tx_head + tx_count++) % MAX_QUEUED];
+	ULONGLONG waited = 0;
+
+	check(buf == frame_data && writing);
+	check(data_length == writing->length);
+	check(data_length <= fscc_user_get_tx_space(port));
+	check(!passed_over(writing));
+
+	*out_length = 0;
+	if (writing->write_fails) {
+		writing = 0;
+		return STATUS_INVALID_DEVICE_STATE;
+	}
+
+	order[order_count++ % MAX_QUEUED] = writing->sequence;
+
+	if (writing->urgent) {
+		waited = now - writing->context.queued_time * 100;
+		urgent_written_total += waited;
+		urgent_written_max = max(urgent_written_max, waited);
+		urgent_written++;
+	}
+
+	frame->length = data_length;
+	frame->urgent = writing->urgent;
+	frame->queued = writing->context.queued_time * 100;
+	writing = 0;
+
+	tx_used += data_length;
+	*out_length = data_length;
+
+	return STATUS_SUCCESS;
+}
+
+static void setup(void)
+{
+	memset(&port, 0, sizeof(port));
+	port.blocking_request_queue = (WDFQUEUE)&queue;
+	port.oframe_dpc = OFRAME_DPC;
+	port.has_dma = TRUE;
+
+	memset(requests, 0, sizeof(requests));
+	queue_count = 0;
+	next_sequence = 0;
+	order_count = 0;
+	tx_head = tx_count = 0;
+	tx_used = 0;
+	now = 0;
+
+	pacer_open = TRUE;
+	paced_bytes = 0;
+	passes = oframe_kicks = completions = 0;
+}
+
+static BOOLEAN written(struct fake_request *request)
+{
+	return request->completed && request->status == STATUS_SUCCESS &&
+		request->information == request->length;
+}
+
+static BOOLEAN references_balanced(void)
+{
+	unsigned i;
+
+	for (i = 0; i < MAX_QUEUED; i++) {
+		if (requests[i].references)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void test_pass(void)
+{
+	struct fake_request *r[5];
+	unsigned i;
+
+	setup();
+
+	for (i = 0; i < 5; i++)
+		r[i] = enqueue(300, 0);
+
+	/* Only three fit */
+	tx_used = TX_TOTAL - 1000;
+	request_worker(REQUEST_DPC);
+	check(written(r[0]) && written(r[1]) && written(r[2]));
+	check(r[3]->queued && r[4]->queued && queue_count == 2);
+	check(paced_bytes == 900);
+	check(references_balanced());
+
+	/* The rest once the card has sent what it had */
+	tx_used = 0;
+	request_worker(REQUEST_DPC);
+	check(written(r[3]) && written(r[4]) && queue_count == 0);
+	check(completions == 5 && passes == 2);
+
+	/* Nothing waiting */
+	request_worker(REQUEST_DPC);
+	check(completions == 5 && passes == 3);
+
+	/* The DMA engine picks the frames up by itself */
+	check(oframe_kicks == 0);
+	check(references_balanced());
+}
+
+static void test_no_passing(void)
+{
+	struct fake_request *large, *small;
+
+	setup();
+
+	large = enqueue(800, 0);
+	small = enqueue(100, 0);
+
+	/* The small one would fit, but it can't go first */
+	tx_used = TX_TOTAL - 500;
+	request_worker(REQUEST_DPC);
+	check(large->queued && small->queued && completions == 0);
+	check(paced_bytes == 0);
+
+	tx_used = TX_TOTAL - 900;
+	request_worker(REQUEST_DPC);
+	check(written(large) && written(small));
+	check(references_balanced());
+}
+
+static void test_failures(void)
+{
+	struct fake_request *r[4];
+	unsigned i;
+
+	setup();
+
+	for (i = 0; i < 4; i++)
+		r[i] = enqueue(100, 0);
+
+	r[1]->cancel = TRUE;
+	r[2]->bad_buffer = TRUE;
+
+	request_worker(REQUEST_DPC);
+
+	/* Neither stops the writes behind it */
+	check(written(r[0]) && written(r[3]));
+	check(r[1]->completed && r[1]->status == STATUS_CANCELLED);
+	check(r[2]->completed && r[2]->status == STATUS_BUFFER_TOO_SMALL);
+	check(paced_bytes == 200 && tx_used == 200);
+	check(references_balanced());
+}
+
+/* A write the card refused isn't paced or timed */
+static void test_write_failure(void)
+{
+	struct fake_request *r[3];
+	unsigned i;
+
+	setup();
+
+	for (i = 0; i < 3; i++)
+		r[i] = enqueue(100, 1);
+
+	r[1]->write_fails = TRUE;
+	now = 1000000;
+
+	request_worker(REQUEST_DPC);
+
+	check(written(r[0]) && written(r[2]));
+	check(r[1]->completed && r[1]->status == STATUS_INVALID_DEVICE_STATE);
+	check(r[1]->information == 0);
+	check(paced_bytes == 200 && tx_used == 200);
+	check(port.tx_priority_frames[1] == 2);
+	check(port.tx_priority_latency_total[1] == 2 * 1000);
+	check(references_balanced());
+
+	/* Nor does it kick the FIFO on its own */
+	setup();
+	port.has_dma = FALSE;
+
+	enqueue(100, 0)->write_fails = TRUE;
+	request_worker(REQUEST_DPC);
+	check(completions == 1 && oframe_kicks == 0 && paced_bytes == 0);
+}
+
+static void test_pacer(void)
+{
+	struct fake_request *request;
+
+	setup();
+
+	request = enqueue(100, 0);
+
+	pacer_open = FALSE;
+	request_worker(REQUEST_DPC);
+	check(request->queued && completions == 0);
+	check(references_balanced());
+
+	pacer_open = TRUE;
+	request_worker(REQUEST_DPC);
+	check(written(request));
+}
+
+static void test_fifo(void)
+{
+	setup();
+	port.has_dma = FALSE;
+
+	/* oframe_worker moves the frames into the FIFO, once a pass */
+	request_worker(REQUEST_DPC);
+	check(oframe_kicks == 0);
+
+	enqueue(100, 0);
+	enqueue(100, 0);
+	request_worker(REQUEST_DPC);
+	check(completions == 2 && oframe_kicks == 1);
+}
+
+static void test_latency(void)
+{
+	setup();
+
+	now = 1000000;
+	enqueue(100, 2);
+	enqueue(100, 2);
+	now = 3000000;
+	enqueue(100, 0);
+	now = 6000000;
+	request_worker(REQUEST_DPC);
+
+	/* Microseconds */
+	check(port.tx_priority_frames[2] == 2 && port.tx_priority_frames[0] == 1);
+	check(port.tx_priority_latency_total[2] == 10000);
+	check(port.tx_priority_latency_max[2] == 5000);
+	check(port.tx_priority_latency_total[0] == 3000);
+}
+
+static void test_priority(void)
+{
+	static const UINT32 priorities[] = { 0, 1, 3, 2, 3, 0 };
+	static const UINT32 expected[] = { 2, 4, 3, 1, 0, 5 };
+	unsigned i;
+
+	setup();
+
+	for (i = 0; i < 6; i++)
+		enqueue(100, priorities[i]);
+
+	request_worker(REQUEST_DPC);
+	check(completions == 6 && order_count == 6);
+	for (i = 0; i < 6; i++)
+		check(order[i] == expected[i]);
+	check(references_balanced());
+}
+
+/* A high priority write that doesn't fit holds back everything below it */
+static void test_priority_no_passing(void)
+{
+	struct fake_request *bulk, *urgent;
+
+	setup();
+
+	bulk = enqueue(100, 0);
+	urgent = enqueue(800, 3);
+
+	tx_used = TX_TOTAL - 500;
+	request_worker(REQUEST_DPC);
+	check(bulk->queued && urgent->queued && completions == 0);
+
+	tx_used = TX_TOTAL - 900;
+	request_worker(REQUEST_DPC);
+	check(written(urgent) && written(bulk));
+	check(order[0] == urgent->sequence);
+	check(references_balanced());
+}
+
+/* The scan starts over without leaking the write it had picked */
+static void test_cancel_held(void)
+{
+	struct fake_request *r[4];
+	unsigned i;
+
+	for (i = 0; i < 4; i++) {
+		setup();
+
+		r[0] = enqueue(100, 1);
+		r[1] = enqueue(100, 0);
+		r[2] = enqueue(100, 2);
+		r[3] = enqueue(100, 0);
+		r[i]->cancel_held = TRUE;
+
+		request_worker(REQUEST_DPC);
+
+		check(completions == 4);
+		check(r[i]->status == STATUS_CANCELLED);
+		check(queue_count == 0);
+		check(references_balanced());
+	}
+}
+
+static void test_queued(void)
+{
+	UINT32 queued[FSCC_TX_PRIORITIES];
+	struct fake_request *r;
+
+	setup();
+
+	enqueue(100, 0);
+	r = enqueue(100, 3);
+	enqueue(100, 3);
+	enqueue(100, 1);
+
+	fscc_port_get_tx_priority_queued(&port, queued);
+	check(queued[0] == 1 && queued[1] == 1 && queued[2] == 0 && queued[3] == 2);
+	check(references_balanced());
+
+	/* Counted again from the start */
+	r->cancel_held = TRUE;
+	fscc_port_get_tx_priority_queued(&port, queued);
+	check(queued[0] == 1 && queued[1] == 1 && queued[2] == 0 && queued[3] == 1);
+	check(references_balanced());
+}
+
+/*
+	request_worker before it looped: one write a run, and only run from the
+	timer. It also kept the reference to a write that didn't fit, which is
+	left out here.
+*/
+static void old_request_worker(void)
+{
+	WDFREQUEST found = NULL, request = NULL;
+	UINT32 length = 0, write_count = 0;
+	char *data_buffer = NULL;
+	NTSTATUS status;
+
+	if (!NT_SUCCESS(fscc_port_next_blocking_write(&port, &found, &length)))
+		return;
+
+	if (fscc_user_get_tx_space(&port) < length) {
+		WdfObjectDereference(found);
+		return;
+	}
+
+	status = WdfIoQueueRetrieveFoundRequest(port.blocking_request_queue, found, &request);
+	WdfObjectDereference(found);
+	if (!NT_SUCCESS(status))
+		return;
+
+	status = WdfRequestRetrieveInputBuffer(request, length, (PVOID *)&data_buffer, NULL);
+	if (!NT_SUCCESS(status)) {
+		WdfRequestComplete(request, status);
+		return;
+	}
+
+	status = fscc_user_write_frame(&port, data_buffer, length, &write_count);
+	WdfRequestCompleteWithInformation(request, status, write_count);
+}
+
+static void run_worker(BOOLEAN old)
+{
+	if (old)
+		old_request_worker();
+	else
+		request_worker(REQUEST_DPC);
+}
+
+/* FsccEvtIoWrite queues request_dpc for every blocking write, then and now */
+static void writer(BOOLEAN old, UINT32 frame_size, unsigned depth)
+{
+	while (queue_count < depth) {
+		enqueue(frame_size, 0);
+		run_worker(old);
+	}
+}
+
+/*
+	The card sends the frames in its transmit buffers one after another at
+	bits_per_second, and each one sent frees its buffers and, with DMA,
+	raises DT_FE. The writer sends another blocking write as soon as one
+	completes, so depth of them are always waiting. If urgent_every isn't 0
+	a 64 byte urgent write at urgent_priority is also queued about that
+	often. Returns the frames sent.
+*/
+static UINT64 simulate(BOOLEAN old, UINT32 frame_size, double bits_per_second, UINT32 period, unsigned depth,
+	ULONGLONG end, ULONGLONG urgent_every, UINT32 urgent_priority)
+{
+	ULONGLONG next_tick = (ULONGLONG)period * 1000, send_done = 0, waited;
+	ULONGLONG next_urgent = urgent_every ? urgent_every : end;
+	struct tx_frame sending = { 0 };
+	UINT64 sent = 0;
+
+	setup();
+	writer(old, frame_size, depth);
+
+	while (now < end) {
+		if (!sending.length && tx_count) {
+			sending = tx_frames[tx_head];
+			tx_head = (tx_head + 1) % MAX_QUEUED;
+			tx_count--;
+			send_done = now + (ULONGLONG)(sending.length * 8 * 1e9 / bits_per_second);
+		}
+
+		if (next_urgent < next_tick && (!sending.length || next_urgent < send_done)) {
+			now = next_urgent;
+			next_urgent += urgent_every / 2 + (ULONGLONG)rand() % urgent_every;
+
+			/* FsccEvtIoWrite queues request_dpc */
+			enqueue(64, urgent_priority)->urgent = TRUE;
+			run_worker(old);
+		}
+		else if (sending.length && send_done <= next_tick) {
+			now = send_done;
+			tx_used -= sending.length;
+			sent++;
+
+			if (sending.urgent) {
+				waited = now - sending.queued;
+				urgent_sent_total += waited;
+				urgent_sent_max = max(urgent_sent_max, waited);
+				urgent_sent++;
+			}
+
+			sending.length = 0;
+
+			/* DT_FE queues request_dpc, the old driver waited for the timer */
+			if (!old)
+				request_worker(REQUEST_DPC);
+		}
+		else {
+			now = next_tick;
+			next_tick += (ULONGLONG)period * 1000;
+			run_worker(old);
+		}
+
+		writer(old, frame_size, depth);
+	}
+
+	check(references_balanced());
+
+	return sent;
+}
+
+static void test_throughput(void)
+{
+	static const UINT32 frame_sizes[] = { 64, 1024, MAX_FRAME };
+	static const double rates[] = { 2e6, 50e6 };
+	static const UINT32 periods[] = { DEFAULT_TIMER_PERIOD_VALUE, 1000 };
+	const ULONGLONG end = 10000000000ull;
+	const unsigned depth = 16;
+	double line, new_rate, old_rate;
+	UINT64 old_sent;
+	unsigned i, j, k;
+
+	printf("Blocking writes a second with %u waiting, over %.0f s:\n", depth, end / 1e9);
+	printf("%6s %10s %8s %12s %12s %12s\n", "frame", "Mbit/s", "period", "line", "new", "old");
+
+	for (i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++) {
+		for (j = 0; j < sizeof(rates) / sizeof(rates[0]); j++) {
+			for (k = 0; k < sizeof(periods) / sizeof(periods[0]); k++) {
+				line = rates[j] / 8 / frame_sizes[i];
+				new_rate = simulate(FALSE, frame_sizes[i], rates[j], periods[k], depth, end, 0, 0) * 1e9 / end;
+				old_sent = simulate(TRUE, frame_sizes[i], rates[j], periods[k], depth, end, 0, 0);
+				old_rate = old_sent * 1e9 / end;
+
+				/* The line never waits on the driver */
+				check(new_rate > line * 0.99);
+				check(new_rate >= old_rate);
+
+				/* It used to get at most a buffer full a tick */
+				check(old_sent <= (TX_TOTAL / frame_sizes[i] + depth) * (end / ((ULONGLONG)periods[k] * 1000) + 1));
+
+				printf("%6u %10.0f %8u %12.0f %12.0f %12.0f\n", frame_sizes[i],
+					rates[j] / 1e6, periods[k], line, new_rate, old_rate);
+			}
+		}
+	}
+}
+
+/*
+	A bulk writer keeps 64 writes waiting, with the line always busy, and a
+	64 byte urgent write comes along every 20 ms or so. The priority only
+	gets it ahead of the waiting writes, it still waits behind whatever is
+	in the transmit buffers already.
+*/
+static void test_urgent(void)
+{
+	static const UINT32 frame_sizes[] = { 256, 1024, MAX_FRAME };
+	static const double rates[] = { 2e6, 50e6 };
+	const ULONGLONG end = 10000000000ull;
+	const ULONGLONG every = 20000000;
+	const unsigned depth = 64;
+	double written_ms[2], sent_ms[2], written_max[2];
+	unsigned i, j, priority;
+
+	printf("Urgent writes among %u waiting bulk writes, ms waited:\n", depth);
+	printf("%6s %8s %32s %32s\n", "", "", "top priority", "bulk priority");
+	printf("%6s %8s %10s %10s %10s %10s %10s %10s\n", "bulk", "Mbit/s",
+		"written", "max", "sent", "written", "max", "sent");
+
+	for (i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++) {
+		for (j = 0; j < sizeof(rates) / sizeof(rates[0]); j++) {
+			for (priority = 0; priority < 2; priority++) {
+				urgent_written_total = urgent_sent_total = 0;
+				urgent_written_max = urgent_sent_max = 0;
+				urgent_written = urgent_sent = 0;
+
+				simulate(FALSE, frame_sizes[i], rates[j], DEFAULT_TIMER_PERIOD_VALUE, depth,
+					end, every, priority ? FSCC_TX_PRIORITIES - 1 : 0);
+
+				check(urgent_written > end / every / 2 && urgent_sent > 0);
+
+				written_ms[priority] = urgent_written_total / urgent_written / 1e6;
+				written_max[priority] = urgent_written_max / 1e6;
+				sent_ms[priority] = urgent_sent_total / urgent_sent / 1e6;
+			}
+
+			/* With the top priority nothing queued is ahead of it */
+			check(written_max[1] * 1e6 <= MAX_FRAME * 8 * 1e9 / rates[j] + 1000);
+			check(written_ms[1] < written_ms[0]);
+			check(sent_ms[1] < sent_ms[0]);
+
+			printf("%6u %8.0f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", frame_sizes[i],
+				rates[j] / 1e6, written_ms[1], written_max[1], sent_ms[1],
+				written_ms[0], written_max[0], sent_ms[0]);
+		}
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_pass();
+	test_no_passing();
+	test_failures();
+	test_write_failure();
+	test_pacer();
+	test_fifo();
+	test_latency();
+	test_priority();
+	test_priority_no_passing();
+	test_cancel_held();
+	test_queued();
+	test_throughput();
+	test_urgent();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All blocking write tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calculate-clock-bits.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+/*
+	Calculates the clock bits for one or more frequencies.
+
+	Frequencies can be given on the command line or, if there aren't any, read
+	from stdin one per line as '<frequency> [ppm]'. Each result is printed on
+	its own line, in the same order as the input:
+
+	<frequency> <ppm> <status> <actual frequency> <clock bits in hex>
+
+	A status of 0 means the clock bits are valid. Anything else is the error
+	number from the ICS30703 calculation and the clock bits are all zero.
+
+	Linux: cc -O2 -Ilib/raw tools/clock_bits.c lib/raw/calculate-clock-bits.c -lm -lpthread
+	Windows: cl /Ilib\raw tools\clock_bits.c lib\raw\calculate-clock-bits.c
+*/
+
+#define DEFAULT_PPM 10
+
+static double seconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)count.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-p ppm] [-t threads] [frequency ...]\n", name);
+	printf("       %s -b [number of frequencies]\n", name);
+}
+
+/* Solves a spread of frequencies from 20 KHz to 50 MHz on one thread and
+   then on every core, and prints how many solves per second each managed. */
+static int benchmark(size_t count, unsigned long ppm)
+{
+	clock_request_fscc *requests;
+	unsigned threads[2] = {1, 0};
+	double start, elapsed;
+	size_t i, j;
+	int failures = 0;
+
+	requests = calloc(count, sizeof(*requests));
+	if (!requests) {
+		fprintf(stderr, "Unable to allocate %lu requests\n", (unsigned long)count);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		for (j = 0; j < count; j++) {
+			requests[j].frequency = 20000 + (unsigned long)((50000000.0 - 20000) * j / count);
+			requests[j].ppm = ppm;
+		}
+
+		start = seconds();
+		failures = calculate_clock_bits_fscc_batch(requests, count, threads[i]);
+		elapsed = seconds() - start;
+
+		printf("threads=%s frequencies=%lu failures=%d seconds=%.3f solves_per_second=%.0f\n",
+			   threads[i] ? "1" : "all", (unsigned long)count, failures, elapsed, count / elapsed);
+	}
+
+	free(requests);
+
+	return EXIT_SUCCESS;
+}
+
+static void print_result(const clock_request_fscc *request)
+{
+	int i;
+
+	printf("%lu %lu %d %lu ", request->frequency, request->ppm, request->status,
+		   request->clock_data.frequency);
+
+	for (i = 0; i < 20; i++)
+		printf("%02x", request->clock_data.clock_bits[i]);
+
+	printf("\n");
+}
+
+static int add_request(clock_request_fscc **requests, size_t *count, size_t *size,
+					   unsigned long frequency, unsigned long ppm)
+{
+	if (*count == *size) {
+		clock_request_fscc *resized;
+		size_t new_size = *size ? *size * 2 : 64;
+
+		resized = realloc(*requests, new_size * sizeof(**requests));
+		if (!resized) {
+			fprintf(stderr, "Unable to allocate %lu requests\n", (unsigned long)new_size);
+			return 0;
+		}
+
+		*requests = resized;
+		*size = new_size;
+	}
+
+	memset(&(*requests)[*count], 0, sizeof(**requests));
+	(*requests)[*count].frequency = frequency;
+	(*requests)[*count].ppm = ppm;
+	(*count)++;
+
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	clock_request_fscc *requests = NULL;
+	size_t count = 0, size = 0;
+	unsigned long ppm = DEFAULT_PPM;
+	unsigned long frequency, line_ppm;
+	unsigned threads = 0;
+	char line[256];
+	size_t i;
+	int failures;
+	int arg;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++) {
+		if (strcmp(argv[arg], "-b") == 0) {
+			count = (arg + 1 < argc) ? strtoul(argv[arg + 1], NULL, 10) : 0;
+			return benchmark(count ? count : 10000, ppm);
+		}
+		else if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+			ppm = strtoul(argv[++arg], NULL, 10);
+		}
+		else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			threads = strtoul(argv[++arg], NULL, 10);
+		}
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (arg < argc) {
+		for (; arg < argc; arg++) {
+			if (!add_request(&requests, &count, &size, strtoul(argv[arg], NULL, 10), ppm))
+				goto fail;
+		}
+	}
+	else {
+		while (fgets(line, sizeof(line), stdin)) {
+			line_ppm = ppm;
+
+			if (sscanf(line, "%lu %lu", &frequency, &line_ppm) < 1)
+				continue;
+
+			if (!add_request(&requests, &count, &size, frequency, line_ppm))
+				goto fail;
+		}
+	}
+
+	failures = calculate_clock_bits_fscc_batch(requests, count, threads);
+
+	for (i = 0; i < count; i++)
+		print_result(&requests[i]);
+
+	free(requests);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+
+fail:
+	free(requests);
+
+	return EXIT_FAILURE;
+}
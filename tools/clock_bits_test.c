@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "utils.h"
+
+/*
+	Host tests for encode_clock_bits in src/utils.c, which builds the FCR
+	writes that shift a port's clock bits into its clock generator.
+
+	The clock bits for a sweep of frequencies come from the solver in
+	lib/raw. For each of them, on both channels and with random FCR values,
+	the encoder has to give exactly the words the loop it replaced in
+	fscc_port_set_clock_bits did, and the words have to read back as the
+	same 20 bytes when decoded like the clock generator does. Last, both are
+	timed.
+
+	Built from the driver's own utils.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/clock_bits_test.c src/utils.c lib/raw/calculate-clock-bits.c -lm -lpthread && ./a.out
+*/
+
+/* From lib/raw/calculate-clock-bits.h, which can't be included next to the
+   driver's struct clock_data_fscc */
+struct clock_request_fscc {
+	unsigned long frequency;
+	unsigned long ppm;
+	struct clock_data_fscc clock_data;
+	int status;
+};
+
+int calculate_clock_bits_fscc_batch(struct clock_request_fscc *requests, size_t count, unsigned threads);
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define FREQUENCIES 2000
+#define MIN_FREQUENCY 20000.0
+#define MAX_FREQUENCY 200000000.0
+
+/* fscc_port_set_clock_bits before it used encode_clock_bits */
+#define STRB_BASE 0x00000008
+#define DTA_BASE 0x00000001
+#define CLK_BASE 0x00000002
+static unsigned old_encode(const unsigned char *clock_bits, unsigned channel, UINT32 orig_fcr_value, UINT32 *data)
+{
+	UINT32 new_fcr_value = 0;
+	int j = 0;
+	int i = 0;
+	unsigned strb_value = STRB_BASE;
+	unsigned dta_value = DTA_BASE;
+	unsigned clk_value = CLK_BASE;
+	unsigned data_index = 0;
+
+	if (channel == 1) {
+		strb_value <<= 0x08;
+		dta_value <<= 0x08;
+		clk_value <<= 0x08;
+	}
+
+	data[data_index++] = new_fcr_value = orig_fcr_value & 0xfffff0f0;
+
+	for (i = 19; i >= 0; i--) {
+		for (j = 7; j >= 0; j--) {
+			int bit = ((clock_bits[i] >> j) & 1);
+
+			if (bit)
+				new_fcr_value |= dta_value;
+			else
+				new_fcr_value &= ~dta_value;
+
+			data[data_index++] = new_fcr_value |= clk_value;
+			data[data_index++] = new_fcr_value &= ~clk_value;
+		}
+	}
+
+	new_fcr_value = orig_fcr_value & 0xfffff0f0;
+
+	new_fcr_value |= strb_value;
+	new_fcr_value &= ~clk_value;
+
+	data[data_index++] = new_fcr_value;
+	data[data_index++] = orig_fcr_value;
+
+	return data_index;
+}
+
+/*
+	Reads the words like the clock generator: the data line is sampled on
+	each rising edge of the clock line, and the strobe latches the bits.
+	Returns FALSE if anything but those lines changes, or the other
+	channel's lines move.
+*/
+static BOOLEAN decode(const UINT32 *words, unsigned count, unsigned channel, UINT32 fcr, unsigned char *clock_bits)
+{
+	unsigned shift = channel ? 8 : 0;
+	UINT32 lines = 0xf << shift;
+	UINT32 previous = fcr & 0xfffff0f0;
+	unsigned bits = 0;
+	unsigned i;
+
+	memset(clock_bits, 0, 20);
+
+	if (count != CLOCK_BITS_WORDS || words[0] != previous || words[count - 1] != fcr)
+		return FALSE;
+
+	for (i = 1; i < count - 1; i++) {
+		if ((words[i] & ~lines) != (fcr & 0xfffff0f0 & ~lines))
+			return FALSE;
+
+		if (((words[i] >> shift) & 2) && !((previous >> shift) & 2)) {
+			if (bits == 160)
+				return FALSE;
+
+			/* Last byte and most significant bit first */
+			clock_bits[19 - bits / 8] |= ((words[i] >> shift) & 1) << (7 - bits % 8);
+			bits++;
+		}
+
+		previous = words[i];
+	}
+
+	/* The strobe is the last word before FCR goes back, with the clock low */
+	return bits == 160 && ((words[count - 2] >> shift) & 0xa) == 0x8;
+}
+
+static UINT32 random_value(void)
+{
+	return ((UINT32)rand() << 16) ^ (UINT32)rand();
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+	static struct clock_request_fscc requests[FREQUENCIES];
+	UINT32 words[CLOCK_BITS_WORDS], old_words[CLOCK_BITS_WORDS];
+	unsigned char decoded[20];
+	UINT32 fcr = 0, sum = 0;
+	unsigned count, solved = 0;
+	unsigned i, j, channel;
+	double start, new_time, old_time;
+
+	srand(1);
+
+	for (i = 0; i < FREQUENCIES; i++) {
+		requests[i].frequency = (unsigned long)(MIN_FREQUENCY * pow(MAX_FREQUENCY / MIN_FREQUENCY, (double)i / FREQUENCIES));
+		requests[i].ppm = 10;
+	}
+
+	calculate_clock_bits_fscc_batch(requests, FREQUENCIES, 0);
+
+	for (i = 0; i < FREQUENCIES; i++) {
+		if (requests[i].status != 0)
+			continue;
+
+		solved++;
+
+		for (channel = 0; channel < 2; channel++) {
+			for (j = 0; j < 8; j++) {
+				fcr = (j == 0) ? 0 : (j == 1) ? 0xffffffff : random_value();
+
+				count = encode_clock_bits(requests[i].clock_data.clock_bits, channel, fcr, words);
+				check(count == CLOCK_BITS_WORDS);
+				check(old_encode(requests[i].clock_data.clock_bits, channel, fcr, old_words) == count);
+				check(memcmp(words, old_words, sizeof(words)) == 0);
+
+				check(decode(words, count, channel, fcr, decoded));
+				check(memcmp(decoded, requests[i].clock_data.clock_bits, 20) == 0);
+			}
+		}
+	}
+
+	check(solved > FREQUENCIES / 2);
+
+	/* Random bytes too, the solver only ever gives some bit patterns */
+	for (i = 0; i < 100000; i++) {
+		unsigned char clock_bits[20];
+
+		for (j = 0; j < 20; j++)
+			clock_bits[j] = (unsigned char)rand();
+
+		channel = rand() % 2;
+		fcr = random_value();
+
+		count = encode_clock_bits(clock_bits, channel, fcr, words);
+		check(old_encode(clock_bits, channel, fcr, old_words) == count);
+		check(memcmp(words, old_words, sizeof(words)) == 0);
+		check(decode(words, count, channel, fcr, decoded) && memcmp(decoded, clock_bits, 20) == 0);
+	}
+
+	start = seconds();
+	for (i = 0; i < 1000000; i++)
+		sum += encode_clock_bits(requests[i % FREQUENCIES].clock_data.clock_bits, i & 1, i, words) + words[i % CLOCK_BITS_WORDS];
+	new_time = seconds() - start;
+
+	start = seconds();
+	for (i = 0; i < 1000000; i++)
+		sum += old_encode(requests[i % FREQUENCIES].clock_data.clock_bits, i & 1, i, old_words) + old_words[i % CLOCK_BITS_WORDS];
+	old_time = seconds() - start;
+
+	printf("%u frequencies solved, encode_clock_bits %.1f ns, old loop %.1f ns (%u)\n",
+		solved, new_time * 1000, old_time * 1000, sum & 1);
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All clock bits tests passed\n");
+
+	return EXIT_SUCCESS;
+}
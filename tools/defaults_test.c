@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "defaults.h"
+#include "config.h"
+
+/*
+	Host tests for the saved copy of the registry defaults in src/defaults.c.
+	The copy is written out and read back with random values, and broken or
+	short copies have to be turned down. fscc_defaults_load then runs
+	against a registry kept in memory, to check the copy is only used while
+	Device Parameters hasn't changed since it was made.
+
+	Built from the driver's own defaults.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/defaults_test.c src/defaults.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+/* Device Parameters and its Defaults subkey */
+static const wchar_t *names[FSCC_DEFAULTS_COUNT] = {
+	L"TxNum", L"RxNum", L"TxSize", L"RxSize", L"InterruptAffinity",
+	L"DpcProcessor", L"FIFOT", L"CCR0", L"CCR1", L"CCR2", L"BGR", L"SSR",
+	L"SMR", L"TSR", L"TMR", L"RAR", L"RAMR", L"PPR", L"TCR", L"IMR",
+	L"DPLLR", L"FCR",
+};
+
+static struct {
+	ULONG values[FSCC_DEFAULTS_COUNT];
+	BOOLEAN present[FSCC_DEFAULTS_COUNT];
+	LONGLONG write_time;
+	UCHAR blob[FSCC_DEFAULTS_BLOB_SIZE * 2];
+	ULONG blob_length;
+	int value_reads;
+	int blob_writes;
+} registry;
+
+#define DEVICE_KEY ((WDFKEY)1)
+#define DEFAULTS_KEY ((WDFKEY)2)
+
+static int find_value(PCUNICODE_STRING name)
+{
+	int i;
+
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++) {
+		if (wcscmp((const wchar_t *)name->Buffer, names[i]) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+void RtlInitUnicodeString(PUNICODE_STRING destination, PCWSTR source)
+{
+	destination->Buffer = (PWSTR)source;
+	destination->Length = (USHORT)(wcslen(source) * sizeof(WCHAR));
+	destination->MaximumLength = destination->Length;
+}
+
+NTSTATUS WdfDeviceOpenRegistryKey(WDFDEVICE Device, ULONG DeviceInstanceKeyType, ACCESS_MASK DesiredAccess, PWDF_OBJECT_ATTRIBUTES KeyAttributes, WDFKEY *Key)
+{
+	*Key = DEVICE_KEY;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRegistryCreateKey(WDFKEY ParentKey, PCUNICODE_STRING KeyName, ACCESS_MASK DesiredAccess, ULONG CreateOptions, PULONG CreateDisposition, PWDF_OBJECT_ATTRIBUTES KeyAttributes, WDFKEY *Key)
+{
+	*Key = DEFAULTS_KEY;
+	return STATUS_SUCCESS;
+}
+
+HANDLE WdfRegistryWdmGetHandle(WDFKEY Key)
+{
+	return (HANDLE)Key;
+}
+
+NTSTATUS ZwQueryKey(HANDLE key, KEY_INFORMATION_CLASS info_class, PVOID info, ULONG length, PULONG result_length)
+{
+	KEY_BASIC_INFORMATION *basic = (KEY_BASIC_INFORMATION *)info;
+
+	check(key == (HANDLE)DEVICE_KEY);
+
+	basic->LastWriteTime.QuadPart = registry.write_time;
+	*result_length = sizeof(*basic);
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRegistryQueryValue(WDFKEY Key, PCUNICODE_STRING ValueName, ULONG ValueLength, PVOID Value, PULONG ValueLengthQueried, PULONG ValueType)
+{
+	check(Key == DEFAULTS_KEY);
+
+	if (registry.blob_length == 0)
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+
+	if (registry.blob_length > ValueLength)
+		return STATUS_BUFFER_OVERFLOW;
+
+	memcpy(Value, registry.blob, registry.blob_length);
+	*ValueLengthQueried = registry.blob_length;
+	*ValueType = REG_BINARY;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRegistryAssignValue(WDFKEY Key, PCUNICODE_STRING ValueName, ULONG ValueType, ULONG ValueLength, PVOID Value)
+{
+	check(Key == DEFAULTS_KEY);
+	check(ValueType == REG_BINARY);
+	check(ValueLength <= sizeof(registry.blob));
+
+	memcpy(registry.blob, Value, ValueLength);
+	registry.blob_length = ValueLength;
+	registry.blob_writes++;
+
+	/* Writing in the subkey leaves the parent's time alone */
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRegistryQueryULong(WDFKEY Key, PCUNICODE_STRING ValueName, PULONG Value)
+{
+	int i = find_value(ValueName);
+
+	check(Key == DEVICE_KEY);
+	check(i >= 0);
+
+	registry.value_reads++;
+
+	if (i < 0 || !registry.present[i])
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+
+	*Value = registry.values[i];
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRegistryAssignULong(WDFKEY Key, PCUNICODE_STRING ValueName, ULONG Value)
+{
+	int i = find_value(ValueName);
+
+	check(Key == DEVICE_KEY);
+	check(i >= 0);
+
+	if (i < 0)
+		return STATUS_INVALID_PARAMETER;
+
+	registry.values[i] = Value;
+	registry.present[i] = TRUE;
+	registry.write_time++;
+
+	return STATUS_SUCCESS;
+}
+
+void WdfRegistryClose(WDFKEY Key)
+{
+}
+
+static ULONG random_value(void)
+{
+	return ((ULONG)rand() << 16) ^ (ULONG)rand();
+}
+
+static void test_round_trip(void)
+{
+	struct fscc_defaults defaults, parsed;
+	LARGE_INTEGER write_time, parsed_time;
+	UCHAR blob[FSCC_DEFAULTS_BLOB_SIZE];
+	ULONG length = 0;
+	int i, j;
+
+	for (i = 0; i < 10000; i++) {
+		for (j = 0; j < FSCC_DEFAULTS_COUNT; j++)
+			defaults.values[j] = random_value();
+
+		write_time.QuadPart = (LONGLONG)(((ULONGLONG)random_value() << 32) | random_value());
+
+		length = fscc_defaults_serialize(&defaults, write_time, blob);
+		check(length == FSCC_DEFAULTS_BLOB_SIZE);
+
+		memset(&parsed, 0, sizeof(parsed));
+		parsed_time.QuadPart = 0;
+
+		check(fscc_defaults_parse(blob, length, &parsed, &parsed_time) == FSCC_DEFAULTS_COUNT);
+		check(memcmp(&parsed, &defaults, sizeof(defaults)) == 0);
+		check(parsed_time.QuadPart == write_time.QuadPart);
+	}
+
+	/* The copy is little endian whatever the host is */
+	check(memcmp(blob, "FSCD", 4) == 0);
+	check(blob[4] == 1 && blob[5] == 0 && blob[6] == 0 && blob[7] == 0);
+	check(blob[8] == FSCC_DEFAULTS_COUNT && blob[9] == 0);
+}
+
+static void test_bad_copies(void)
+{
+	struct fscc_defaults defaults, parsed;
+	LARGE_INTEGER write_time, parsed_time;
+	UCHAR blob[FSCC_DEFAULTS_BLOB_SIZE];
+	ULONG length = 0;
+	ULONG i;
+
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++)
+		defaults.values[i] = i + 1;
+
+	write_time.QuadPart = 1234;
+	length = fscc_defaults_serialize(&defaults, write_time, blob);
+
+	/* Every shorter length cuts off values the header says are there */
+	for (i = 0; i < length; i++)
+		check(fscc_defaults_parse(blob, i, &parsed, &parsed_time) == -1);
+
+	/* Wrong magic, version, or more values than there are */
+	for (i = 0; i < 12; i++) {
+		blob[i] ^= 0x40;
+		check(fscc_defaults_parse(blob, length, &parsed, &parsed_time) == -1);
+		blob[i] ^= 0x40;
+	}
+
+	check(fscc_defaults_parse(NULL, length, &parsed, &parsed_time) == -1);
+	check(fscc_defaults_parse(blob, length, NULL, &parsed_time) == -1);
+	check(fscc_defaults_parse(blob, length, &parsed, NULL) == -1);
+}
+
+static void test_other_versions(void)
+{
+	struct fscc_defaults defaults, parsed;
+	LARGE_INTEGER write_time, parsed_time;
+	UCHAR blob[FSCC_DEFAULTS_BLOB_SIZE * 2];
+	ULONG length = 0;
+	ULONG i;
+
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++)
+		defaults.values[i] = i + 1;
+
+	write_time.QuadPart = 1234;
+	length = fscc_defaults_serialize(&defaults, write_time, blob);
+
+	/* An older driver's copy has fewer values, the rest are left alone */
+	blob[8] = 10;
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++)
+		parsed.values[i] = 0xffffffff;
+
+	check(fscc_defaults_parse(blob, (FSCC_DEFAULTS_HEADER_WORDS + 10) * 4, &parsed, &parsed_time) == 10);
+	check(memcmp(parsed.values, defaults.values, 10 * 4) == 0);
+	check(parsed.values[10] == 0xffffffff && parsed.values[FSCC_DEFAULTS_COUNT - 1] == 0xffffffff);
+
+	/* A newer driver's has more, only the ones this driver knows are read */
+	blob[8] = FSCC_DEFAULTS_COUNT + 8;
+	memset(blob + length, 0x5a, 8 * 4);
+
+	check(fscc_defaults_parse(blob, length + 8 * 4, &parsed, &parsed_time) == FSCC_DEFAULTS_COUNT);
+	check(memcmp(&parsed, &defaults, sizeof(defaults)) == 0);
+}
+
+static void test_load(void)
+{
+	struct fscc_defaults defaults;
+	int i;
+
+	memset(&registry, 0, sizeof(registry));
+	registry.write_time = 100;
+
+	/* Nothing in the registry, everything gets the driver defaults */
+	check(fscc_defaults_load(NULL, &defaults) == STATUS_SUCCESS);
+	check(registry.value_reads == FSCC_DEFAULTS_COUNT);
+	check(registry.blob_writes == 1);
+	check(defaults.values[FSCC_DEFAULT_TX_NUM] == DEFAULT_BUFFER_TX_NUM);
+	check(defaults.values[FSCC_DEFAULT_CCR0] == DEFAULT_CCR0_VALUE);
+	check(defaults.values[FSCC_DEFAULT_FCR] == DEFAULT_FCR_VALUE);
+
+	for (i = 0; i < FSCC_DEFAULTS_COUNT; i++)
+		check(registry.present[i] && registry.values[i] == defaults.values[i]);
+
+	/* Nothing changed, the copy is used */
+	registry.value_reads = 0;
+	memset(&defaults, 0, sizeof(defaults));
+
+	check(fscc_defaults_load(NULL, &defaults) == STATUS_SUCCESS);
+	check(registry.value_reads == 0);
+	check(registry.blob_writes == 1);
+	check(defaults.values[FSCC_DEFAULT_CCR0] == DEFAULT_CCR0_VALUE);
+
+	/* Someone edited a value, everything is read again */
+	registry.values[FSCC_DEFAULT_RX_SIZE] = 4096;
+	registry.write_time++;
+	registry.value_reads = 0;
+
+	check(fscc_defaults_load(NULL, &defaults) == STATUS_SUCCESS);
+	check(registry.value_reads == FSCC_DEFAULTS_COUNT);
+	check(registry.blob_writes == 2);
+	check(defaults.values[FSCC_DEFAULT_RX_SIZE] == 4096);
+
+	registry.value_reads = 0;
+	memset(&defaults, 0, sizeof(defaults));
+
+	check(fscc_defaults_load(NULL, &defaults) == STATUS_SUCCESS);
+	check(registry.value_reads == 0);
+	check(defaults.values[FSCC_DEFAULT_RX_SIZE] == 4096);
+
+	/* A copy from an older driver only needs the values it doesn't have */
+	registry.blob[8] = 10;
+	registry.blob_length = (FSCC_DEFAULTS_HEADER_WORDS + 10) * 4;
+	registry.value_reads = 0;
+
+	check(fscc_defaults_load(NULL, &defaults) == STATUS_SUCCESS);
+	check(registry.value_reads == FSCC_DEFAULTS_COUNT - 10);
+	check(registry.blob_length == FSCC_DEFAULTS_BLOB_SIZE);
+	check(defaults.values[FSCC_DEFAULT_RX_SIZE] == 4096);
+	check(defaults.values[FSCC_DEFAULT_FCR] == DEFAULT_FCR_VALUE);
+
+	/* A broken copy is the same as none */
+	registry.blob[0] = 0;
+	registry.value_reads = 0;
+
+	check(fscc_defaults_load(NULL, &defaults) == STATUS_SUCCESS);
+	check(registry.value_reads == FSCC_DEFAULTS_COUNT);
+	check(defaults.values[FSCC_DEFAULT_RX_SIZE] == 4096);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_round_trip();
+	test_bad_copies();
+	test_other_versions();
+	test_load();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All defaults tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,3 @@
+/* The driver includes trace.h as Trace.h, which only works where case doesn't matter */
+
+#include "../../src/trace.h"
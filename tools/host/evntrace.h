@@ -0,0 +1,14 @@
+/*
+	See ntddk.h. Without EVENT_TRACING the driver calls TraceEvents (see
+	debug.h), which goes nowhere here.
+*/
+
+#pragma once
+
+#include <ntddk.h>
+
+typedef ULONG64 TRACEHANDLE;
+
+static __inline VOID TraceEvents(IN TRACEHANDLE TraceEventsLevel, IN ULONG TraceEventsFlag, IN PCCHAR DebugMessage, ...)
+{
+}
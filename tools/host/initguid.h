@@ -0,0 +1,5 @@
+/* See ntddk.h. The GUIDs are only used when the driver registers its interface */
+
+#pragma once
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
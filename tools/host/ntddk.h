@@ -0,0 +1,155 @@
+/*
+	Just enough of the WDK to compile the driver's headers and its pure
+	helpers on another OS, for the host tests in tools/. Nothing here is
+	meant to behave like the kernel, the tests define the few functions
+	they call.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <wchar.h>
+
+typedef void VOID, *PVOID;
+typedef void *HANDLE;
+typedef char CHAR, *PCHAR, *PCCHAR;
+typedef unsigned char UCHAR, BOOLEAN;
+typedef unsigned short USHORT, UINT16, WCHAR, *PWSTR;
+typedef const wchar_t *PCWSTR;
+typedef unsigned int UINT32, *PUINT32;
+/* LONG and ULONG are 32 bits on Windows, unlike long on most other 64 bit systems */
+typedef int LONG;
+typedef unsigned int ULONG, *PULONG;
+typedef long long INT64, LONGLONG, LONG64;
+typedef unsigned long long UINT64, ULONGLONG, ULONG64, ULONG_PTR, SIZE_T;
+typedef LONG NTSTATUS;
+typedef ULONG ACCESS_MASK, KAFFINITY;
+
+typedef union {
+	struct {
+		ULONG LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER, PHYSICAL_ADDRESS;
+
+typedef struct {
+	USHORT Length;
+	USHORT MaximumLength;
+	PWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+typedef const UNICODE_STRING *PCUNICODE_STRING;
+
+typedef struct _LIST_ENTRY {
+	struct _LIST_ENTRY *Flink, *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct {
+	USHORT Group;
+	UCHAR Number;
+	UCHAR Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+typedef struct _KDPC KDPC, *PKDPC;
+
+typedef struct _DRIVER_OBJECT DRIVER_OBJECT, *PDRIVER_OBJECT;
+
+typedef struct {
+	LARGE_INTEGER LastWriteTime;
+	ULONG TitleIndex;
+	ULONG NameLength;
+	WCHAR Name[1];
+} KEY_BASIC_INFORMATION;
+
+typedef enum {
+	KeyBasicInformation
+} KEY_INFORMATION_CLASS;
+
+typedef NTSTATUS DRIVER_INITIALIZE(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath);
+
+#define IN
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+#define TRUE 1
+#define FALSE 0
+
+#define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+#define STATUS_BUFFER_OVERFLOW ((NTSTATUS)0x80000005L)
+#define STATUS_NO_MORE_ENTRIES ((NTSTATUS)0x8000001AL)
+#define STATUS_DEVICE_BUSY ((NTSTATUS)0x80000011L)
+#define STATUS_UNSUCCESSFUL ((NTSTATUS)0xC0000001L)
+#define STATUS_BUFFER_TOO_SMALL ((NTSTATUS)0xC0000023L)
+#define STATUS_INVALID_PARAMETER ((NTSTATUS)0xC000000DL)
+#define STATUS_OBJECT_NAME_NOT_FOUND ((NTSTATUS)0xC0000034L)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+#define STATUS_IO_TIMEOUT ((NTSTATUS)0xC00000B5L)
+#define STATUS_NOT_SUPPORTED ((NTSTATUS)0xC00000BBL)
+#define STATUS_NOT_FOUND ((NTSTATUS)0xC0000225L)
+#define STATUS_CANCELLED ((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_DEVICE_STATE ((NTSTATUS)0xC0000184L)
+#define NT_SUCCESS(status) (((NTSTATUS)(status)) >= 0)
+
+#define KEY_READ 0x20019
+#define KEY_WRITE 0x20006
+#define PLUGPLAY_REGKEY_DEVICE 1
+#define REG_NONE 0
+#define REG_BINARY 3
+#define REG_OPTION_NON_VOLATILE 0
+#define POOL_FLAG_NON_PAGED 0x40
+#define MAXULONG 0xffffffff
+
+#define KdPrint(args)
+#define C_ASSERT(e) typedef char __C_ASSERT__[(e) ? 1 : -1]
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define RtlCopyMemory(d, s, n) memcpy((d), (s), (n))
+#define RtlZeroMemory(d, n) memset((d), 0, (n))
+#define KeMemoryBarrier() __sync_synchronize()
+#define InterlockedExchange(target, value) __sync_lock_test_and_set((target), (value))
+#define InterlockedIncrement64(addend) __sync_add_and_fetch((addend), 1)
+#define InterlockedAdd64(addend, value) __sync_add_and_fetch((addend), (value))
+#define CONTAINING_RECORD(address, type, field) ((type *)((char *)(address) - offsetof(type, field)))
+
+/* Inline in the WDK too */
+static __inline void InitializeListHead(PLIST_ENTRY ListHead)
+{
+	ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+static __inline BOOLEAN IsListEmpty(const LIST_ENTRY *ListHead)
+{
+	return ListHead->Flink == ListHead;
+}
+
+static __inline BOOLEAN RemoveEntryList(PLIST_ENTRY Entry)
+{
+	PLIST_ENTRY flink = Entry->Flink, blink = Entry->Blink;
+
+	blink->Flink = flink;
+	flink->Blink = blink;
+
+	return flink == blink;
+}
+
+static __inline void InsertTailList(PLIST_ENTRY ListHead, PLIST_ENTRY Entry)
+{
+	Entry->Flink = ListHead;
+	Entry->Blink = ListHead->Blink;
+	ListHead->Blink->Flink = Entry;
+	ListHead->Blink = Entry;
+}
+
+ULONGLONG KeQueryInterruptTime(void);
+void KeQuerySystemTime(PLARGE_INTEGER CurrentTime);
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber);
+NTSTATUS KeGetProcessorNumberFromIndex(ULONG ProcIndex, PPROCESSOR_NUMBER ProcNumber);
+NTSTATUS KeSetTargetProcessorDpcEx(PKDPC Dpc, PPROCESSOR_NUMBER ProcNumber);
+ULONG DbgPrint(const char *Format, ...);
+PVOID ExAllocatePool2(ULONG64 flags, SIZE_T size, ULONG tag);
+void ExFreePoolWithTag(PVOID p, ULONG tag);
+ULONG READ_REGISTER_ULONG(volatile ULONG *Register);
+void WRITE_REGISTER_ULONG(volatile ULONG *Register, ULONG Value);
+ULONG READ_PORT_ULONG(PULONG Port);
+void WRITE_PORT_ULONG(PULONG Port, ULONG Value);
+void RtlInitUnicodeString(PUNICODE_STRING destination, PCWSTR source);
+NTSTATUS ZwQueryKey(HANDLE key, KEY_INFORMATION_CLASS info_class, PVOID info, ULONG length, PULONG result_length);
@@ -0,0 +1,3 @@
+/* See ntddk.h */
+
+#pragma once
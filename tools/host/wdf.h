@@ -0,0 +1,135 @@
+/* See ntddk.h */
+
+#pragma once
+
+#include <ntddk.h>
+
+typedef void *WDFOBJECT;
+typedef struct WDFDRIVER__ *WDFDRIVER;
+typedef struct WDFDEVICE__ *WDFDEVICE;
+typedef struct WDFQUEUE__ *WDFQUEUE;
+typedef struct WDFREQUEST__ *WDFREQUEST;
+typedef struct WDFFILEOBJECT__ *WDFFILEOBJECT;
+typedef struct WDFSPINLOCK__ *WDFSPINLOCK;
+typedef struct WDFDPC__ *WDFDPC;
+typedef struct WDFTIMER__ *WDFTIMER;
+typedef struct WDFWORKITEM__ *WDFWORKITEM;
+typedef struct WDFINTERRUPT__ *WDFINTERRUPT;
+typedef struct WDFDMAENABLER__ *WDFDMAENABLER;
+typedef struct WDFCOMMONBUFFER__ *WDFCOMMONBUFFER;
+typedef struct WDFCMRESLIST__ *WDFCMRESLIST;
+typedef struct WDFKEY__ *WDFKEY;
+typedef struct WDFDEVICE_INIT *PWDFDEVICE_INIT;
+
+typedef struct {
+	ULONG Size;
+} WDF_OBJECT_ATTRIBUTES, *PWDF_OBJECT_ATTRIBUTES;
+
+typedef enum {
+	WdfPowerDeviceD0 = 1
+} WDF_POWER_DEVICE_STATE;
+
+typedef struct {
+	ULONG Size;
+	union {
+		struct {
+			size_t Length;
+		} Read;
+		struct {
+			size_t Length;
+		} Write;
+	} Parameters;
+} WDF_REQUEST_PARAMETERS, *PWDF_REQUEST_PARAMETERS;
+
+typedef enum {
+	WdfDmaProfilePacket = 1
+} WDF_DMA_PROFILE;
+
+typedef struct {
+	ULONG Size;
+	WDF_DMA_PROFILE Profile;
+	size_t MaximumLength;
+} WDF_DMA_ENABLER_CONFIG, *PWDF_DMA_ENABLER_CONFIG;
+
+typedef enum {
+	WdfIrqPolicySpecifiedProcessors = 4
+} WDF_INTERRUPT_POLICY;
+
+typedef enum {
+	WdfIrqPriorityUndefined = 0
+} WDF_INTERRUPT_PRIORITY;
+
+typedef enum {
+	WdfIoQueueNoRequests = 4,
+	WdfIoQueueDriverNoRequests = 8
+} WDF_IO_QUEUE_STATE;
+
+#define WDF_NO_OBJECT_ATTRIBUTES NULL
+#define FILE_LONG_ALIGNMENT 3
+
+#define WDF_REQUEST_PARAMETERS_INIT(params) \
+	(memset((params), 0, sizeof(*(params))), (params)->Size = sizeof(*(params)))
+#define WDF_DMA_ENABLER_CONFIG_INIT(config, profile, maximum_length) \
+	(memset((config), 0, sizeof(*(config))), (config)->Size = sizeof(*(config)), \
+	(config)->Profile = (profile), (config)->MaximumLength = (maximum_length))
+
+#define WDF_REL_TIMEOUT_IN_US(us) (-((LONGLONG)(us) * 10))
+#define WDF_IO_QUEUE_IDLE(state) (((state) & (WdfIoQueueNoRequests | WdfIoQueueDriverNoRequests)) == (WdfIoQueueNoRequests | WdfIoQueueDriverNoRequests))
+#define WDF_DECLARE_CONTEXT_TYPE(type) type *WdfObjectGet_##type(WDFOBJECT handle)
+
+typedef BOOLEAN EVT_WDF_INTERRUPT_ISR(WDFINTERRUPT Interrupt, ULONG MessageID);
+typedef void EVT_WDF_DPC(WDFDPC Dpc);
+typedef void EVT_WDF_TIMER(WDFTIMER Timer);
+typedef NTSTATUS EVT_WDF_DRIVER_DEVICE_ADD(WDFDRIVER Driver, PWDFDEVICE_INIT DeviceInit);
+typedef void EVT_WDF_DRIVER_UNLOAD(WDFDRIVER Driver);
+typedef void EVT_WDF_OBJECT_CONTEXT_CLEANUP(WDFOBJECT Object);
+typedef void EVT_WDF_IO_QUEUE_IO_DEFAULT(WDFQUEUE Queue, WDFREQUEST Request);
+typedef void EVT_WDF_IO_QUEUE_IO_READ(WDFQUEUE Queue, WDFREQUEST Request, size_t Length);
+typedef void EVT_WDF_IO_QUEUE_IO_WRITE(WDFQUEUE Queue, WDFREQUEST Request, size_t Length);
+typedef void EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL(WDFQUEUE Queue, WDFREQUEST Request, size_t OutputBufferLength, size_t InputBufferLength, ULONG IoControlCode);
+typedef void EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE(WDFQUEUE Queue, WDFREQUEST Request);
+typedef NTSTATUS EVT_WDF_DEVICE_PREPARE_HARDWARE(WDFDEVICE Device, WDFCMRESLIST ResourcesRaw, WDFCMRESLIST ResourcesTranslated);
+typedef NTSTATUS EVT_WDF_DEVICE_RELEASE_HARDWARE(WDFDEVICE Device, WDFCMRESLIST ResourcesTranslated);
+typedef NTSTATUS EVT_WDF_DEVICE_D0_ENTRY(WDFDEVICE Device, WDF_POWER_DEVICE_STATE PreviousState);
+typedef NTSTATUS EVT_WDF_DEVICE_D0_EXIT(WDFDEVICE Device, WDF_POWER_DEVICE_STATE TargetState);
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock);
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock);
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc);
+WDFOBJECT WdfDpcGetParentObject(WDFDPC Dpc);
+PKDPC WdfDpcWdmGetDpc(WDFDPC Dpc);
+void WdfObjectDereference(WDFOBJECT Handle);
+void WdfObjectDelete(WDFOBJECT Object);
+void WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status);
+void WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters);
+void WdfRequestCompleteWithInformation(WDFREQUEST Request, NTSTATUS Status, ULONG_PTR Information);
+NTSTATUS WdfRequestRetrieveInputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length);
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length);
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue);
+WDFFILEOBJECT WdfRequestGetFileObject(WDFREQUEST Request);
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest);
+NTSTATUS WdfIoQueueFindRequest(WDFQUEUE Queue, WDFREQUEST TagRequest, WDFFILEOBJECT FileObject, PWDF_REQUEST_PARAMETERS Parameters, WDFREQUEST *OutRequest);
+NTSTATUS WdfIoQueueRetrieveFoundRequest(WDFQUEUE Queue, WDFREQUEST FoundRequest, WDFREQUEST *OutRequest);
+NTSTATUS WdfIoQueueRetrieveRequestByFileObject(WDFQUEUE Queue, WDFFILEOBJECT FileObject, WDFREQUEST *OutRequest);
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue);
+void WdfIoQueuePurgeSynchronously(WDFQUEUE Queue);
+void WdfIoQueueStart(WDFQUEUE Queue);
+WDF_IO_QUEUE_STATE WdfIoQueueGetState(WDFQUEUE Queue, PULONG QueueRequests, PULONG DriverRequests);
+BOOLEAN WdfTimerStart(WDFTIMER Timer, LONGLONG DueTime);
+WDFOBJECT WdfTimerGetParentObject(WDFTIMER Timer);
+WDFDEVICE WdfInterruptGetDevice(WDFINTERRUPT Interrupt);
+void WdfInterruptSetPolicy(WDFINTERRUPT Interrupt, WDF_INTERRUPT_POLICY Policy, WDF_INTERRUPT_PRIORITY Priority, KAFFINITY TargetProcessorSet);
+void WdfDeviceSetAlignmentRequirement(WDFDEVICE Device, ULONG AlignmentRequirement);
+NTSTATUS WdfDmaEnablerCreate(WDFDEVICE Device, PWDF_DMA_ENABLER_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes, WDFDMAENABLER *DmaEnablerHandle);
+NTSTATUS WdfCommonBufferCreate(WDFDMAENABLER DmaEnabler, size_t Length, PWDF_OBJECT_ATTRIBUTES Attributes, WDFCOMMONBUFFER *CommonBuffer);
+PVOID WdfCommonBufferGetAlignedVirtualAddress(WDFCOMMONBUFFER CommonBuffer);
+PHYSICAL_ADDRESS WdfCommonBufferGetAlignedLogicalAddress(WDFCOMMONBUFFER CommonBuffer);
+size_t WdfCommonBufferGetLength(WDFCOMMONBUFFER CommonBuffer);
+NTSTATUS WdfDeviceOpenRegistryKey(WDFDEVICE Device, ULONG DeviceInstanceKeyType, ACCESS_MASK DesiredAccess, PWDF_OBJECT_ATTRIBUTES KeyAttributes, WDFKEY *Key);
+NTSTATUS WdfRegistryCreateKey(WDFKEY ParentKey, PCUNICODE_STRING KeyName, ACCESS_MASK DesiredAccess, ULONG CreateOptions, PULONG CreateDisposition, PWDF_OBJECT_ATTRIBUTES KeyAttributes, WDFKEY *Key);
+HANDLE WdfRegistryWdmGetHandle(WDFKEY Key);
+NTSTATUS WdfRegistryQueryValue(WDFKEY Key, PCUNICODE_STRING ValueName, ULONG ValueLength, PVOID Value, PULONG ValueLengthQueried, PULONG ValueType);
+NTSTATUS WdfRegistryAssignValue(WDFKEY Key, PCUNICODE_STRING ValueName, ULONG ValueType, ULONG ValueLength, PVOID Value);
+NTSTATUS WdfRegistryQueryULong(WDFKEY Key, PCUNICODE_STRING ValueName, PULONG Value);
+NTSTATUS WdfRegistryAssignULong(WDFKEY Key, PCUNICODE_STRING ValueName, ULONG Value);
+void WdfRegistryClose(WDFKEY Key);
@@ -0,0 +1,879 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <fscc.h>
+#endif
+
+/*
+	Keeps a number of overlapped reads and writes outstanding on a port that
+	is wired for loopback and reports what the driver sustained as JSON.
+
+	Each frame starts with its sequence number and the rest is a pattern
+	made from it, so lost, short and corrupt frames can be counted. In
+	stream mode the same frames are checked as they come back in pieces.
+	Latency is from submitting a write until the read holding the end of
+	that frame completes.
+
+	The port is put in transparent mode for stream mode and HDLC for frame
+	mode, and blocking write and force FIFO are set as needed. All three are
+	put back when the run ends. Append status and append timestamp need to be
+	off.
+
+	Without _WIN32 the port is replaced by a simulation of the driver's
+	loopback behavior (blocking writes, frame and stream reads, a fixed line
+	rate) running on a virtual clock, so the scheduler and statistics can be
+	checked anywhere.
+
+	Linux: cc -O2 tools/io_bench.c -o io_bench
+	Windows: cl /Ilib\raw tools\io_bench.c
+*/
+
+#define DEFAULT_SECONDS 10
+#define DEFAULT_DEPTH 4
+#define DEFAULT_FRAME_SIZE 256
+#define DEFAULT_LINE_RATE 10000000 /* Bits per second, simulation only */
+#define SIM_TX_CAPACITY (200 * 256) /* Default DEFAULT_BUFFER_TX_NUM * SIZE */
+#define MAX_DEPTH 256
+#define HEADER_SIZE 4
+
+enum op_type { OP_READ, OP_WRITE };
+
+struct op {
+#ifdef _WIN32
+	OVERLAPPED ol; /* First so a completion can be mapped back to its op */
+#endif
+	enum op_type type;
+	unsigned char *buffer;
+	unsigned length; /* Bytes asked for */
+	unsigned result; /* Bytes transferred */
+	unsigned long error;
+	struct op *next;
+};
+
+/* A frame that was written and hasn't been read back yet */
+struct expected_frame {
+	unsigned seq;
+	unsigned length;
+	unsigned received; /* Stream mode, bytes checked so far */
+	int bad;
+	int failed; /* The write didn't go through */
+	double submitted;
+};
+
+struct options {
+	unsigned port_num;
+	double seconds;
+	unsigned read_depth;
+	unsigned write_depth;
+	unsigned min_size;
+	unsigned max_size;
+	int stream;
+	int fifo;
+	double line_rate;
+};
+
+struct stats {
+	unsigned long long frames_written;
+	unsigned long long bytes_written;
+	unsigned long long frames_read;
+	unsigned long long bytes_read;
+	unsigned long long write_errors;
+	unsigned long long read_errors;
+	unsigned long long lost_frames;
+	unsigned long long bad_frames;
+	double *latency; /* Microseconds */
+	size_t latency_count;
+	size_t latency_size;
+};
+
+struct expected_queue {
+	struct expected_frame *frames;
+	size_t head; /* Indexes grow forever, masked by size - 1 */
+	size_t tail;
+	size_t size; /* Power of two */
+};
+
+static unsigned char pattern(unsigned seq, unsigned i)
+{
+	if (i < HEADER_SIZE)
+		return (unsigned char)(seq >> (i * 8));
+
+	return (unsigned char)(seq * 131 + i * 7);
+}
+
+static unsigned random_next(unsigned *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static struct expected_frame *expected_push(struct expected_queue *q)
+{
+	if (q->tail - q->head == q->size) {
+		struct expected_frame *resized;
+		size_t new_size = q->size ? q->size * 2 : 1024;
+		size_t i;
+
+		resized = malloc(new_size * sizeof(*resized));
+		if (!resized)
+			return NULL;
+
+		for (i = q->head; i != q->tail; i++)
+			resized[i & (new_size - 1)] = q->frames[i & (q->size - 1)];
+
+		free(q->frames);
+		q->frames = resized;
+		q->size = new_size;
+	}
+
+	return &q->frames[q->tail++ & (q->size - 1)];
+}
+
+static struct expected_frame *expected_head(struct expected_queue *q)
+{
+	if (q->head == q->tail)
+		return NULL;
+
+	return &q->frames[q->head & (q->size - 1)];
+}
+
+static struct expected_frame *expected_find(struct expected_queue *q, unsigned seq)
+{
+	size_t i;
+
+	for (i = q->head; i != q->tail; i++) {
+		if (q->frames[i & (q->size - 1)].seq == seq)
+			return &q->frames[i & (q->size - 1)];
+	}
+
+	return NULL;
+}
+
+static void add_latency(struct stats *stats, double microseconds)
+{
+	if (stats->latency_count == stats->latency_size) {
+		double *resized;
+		size_t new_size = stats->latency_size ? stats->latency_size * 2 : 4096;
+
+		resized = realloc(stats->latency, new_size * sizeof(*resized));
+		if (!resized)
+			return;
+
+		stats->latency = resized;
+		stats->latency_size = new_size;
+	}
+
+	stats->latency[stats->latency_count++] = microseconds;
+}
+
+#ifdef _WIN32
+
+struct port {
+	HANDLE h;
+	HANDLE iocp;
+	INT64 ccr0;
+	unsigned force_fifo;
+	unsigned blocking_write;
+};
+
+static double port_now(struct port *port)
+{
+	LARGE_INTEGER count, frequency;
+
+	(void)port;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)count.QuadPart / (double)frequency.QuadPart;
+}
+
+/* Waits for the IOCTL without it showing up on the completion port */
+static BOOL port_ioctl(struct port *port, DWORD code, void *in, DWORD in_length,
+					   void *out, DWORD out_length)
+{
+	OVERLAPPED ol;
+	DWORD tmp;
+	BOOL result;
+
+	memset(&ol, 0, sizeof(ol));
+	ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	ol.hEvent = (HANDLE)((ULONG_PTR)ol.hEvent | 1);
+
+	result = DeviceIoControl(port->h, code, in, in_length, out, out_length, &tmp, &ol);
+	if (!result && GetLastError() == ERROR_IO_PENDING)
+		result = GetOverlappedResult(port->h, &ol, &tmp, TRUE);
+
+	CloseHandle((HANDLE)((ULONG_PTR)ol.hEvent & ~(ULONG_PTR)1));
+
+	return result;
+}
+
+static void port_set_ccr0(struct port *port, INT64 value)
+{
+	struct fscc_registers regs;
+
+	FSCC_REGISTERS_INIT(regs);
+	regs.CCR0 = value;
+
+	port_ioctl(port, FSCC_SET_REGISTERS, &regs, sizeof(regs), NULL, 0);
+}
+
+static int port_open(struct port *port, const struct options *options)
+{
+	struct fscc_registers regs;
+	char name[32];
+
+	sprintf(name, "\\\\.\\FSCC%u", options->port_num);
+
+	port->h = CreateFile(name, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+						 OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+	if (port->h == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "%s: CreateFile failed with %lu\n", name, GetLastError());
+		return 0;
+	}
+
+	port->iocp = CreateIoCompletionPort(port->h, NULL, 0, 1);
+	if (!port->iocp) {
+		fprintf(stderr, "CreateIoCompletionPort failed with %lu\n", GetLastError());
+		CloseHandle(port->h);
+		return 0;
+	}
+
+	FSCC_REGISTERS_INIT(regs);
+	regs.CCR0 = FSCC_UPDATE_VALUE;
+	port_ioctl(port, FSCC_GET_REGISTERS, &regs, sizeof(regs), &regs, sizeof(regs));
+	port->ccr0 = regs.CCR0;
+
+	port->force_fifo = 0;
+	port->blocking_write = 0;
+	port_ioctl(port, FSCC_GET_FORCE_FIFO, NULL, 0, &port->force_fifo, sizeof(port->force_fifo));
+	port_ioctl(port, FSCC_GET_BLOCKING_WRITE, NULL, 0, &port->blocking_write, sizeof(port->blocking_write));
+
+	/* Transparent or HDLC */
+	port_set_ccr0(port, (port->ccr0 & ~0x3) | (options->stream ? 0x2 : 0x0));
+	port_ioctl(port, options->fifo ? FSCC_ENABLE_FORCE_FIFO : FSCC_DISABLE_FORCE_FIFO, NULL, 0, NULL, 0);
+	port_ioctl(port, FSCC_ENABLE_BLOCKING_WRITE, NULL, 0, NULL, 0);
+
+	port_ioctl(port, FSCC_PURGE_TX, NULL, 0, NULL, 0);
+	port_ioctl(port, FSCC_PURGE_RX, NULL, 0, NULL, 0);
+
+	return 1;
+}
+
+static void port_close(struct port *port)
+{
+	port_set_ccr0(port, port->ccr0);
+	port_ioctl(port, (port->force_fifo & 0xff) ? FSCC_ENABLE_FORCE_FIFO : FSCC_DISABLE_FORCE_FIFO, NULL, 0, NULL, 0);
+	port_ioctl(port, (port->blocking_write & 0xff) ? FSCC_ENABLE_BLOCKING_WRITE : FSCC_DISABLE_BLOCKING_WRITE, NULL, 0, NULL, 0);
+
+	CloseHandle(port->iocp);
+	CloseHandle(port->h);
+}
+
+static void port_submit(struct port *port, struct op *op)
+{
+	BOOL result;
+
+	memset(&op->ol, 0, sizeof(op->ol));
+	op->result = 0;
+	op->error = 0;
+
+	if (op->type == OP_WRITE)
+		result = WriteFile(port->h, op->buffer, op->length, NULL, &op->ol);
+	else
+		result = ReadFile(port->h, op->buffer, op->length, NULL, &op->ol);
+
+	if (!result && GetLastError() != ERROR_IO_PENDING) {
+		op->error = GetLastError();
+		PostQueuedCompletionStatus(port->iocp, 0, 0, &op->ol);
+	}
+}
+
+static void port_cancel(struct port *port)
+{
+	CancelIo(port->h);
+}
+
+/* Returns 0 if nothing completed before deadline */
+static int port_wait(struct port *port, double deadline, struct op **op)
+{
+	OVERLAPPED *ol = NULL;
+	ULONG_PTR key;
+	DWORD bytes = 0;
+	DWORD timeout;
+	double remaining;
+	BOOL result;
+
+	remaining = deadline - port_now(port);
+	timeout = (remaining > 0) ? (DWORD)(remaining * 1000) + 1 : 0;
+
+	result = GetQueuedCompletionStatus(port->iocp, &bytes, &key, &ol, timeout);
+	if (!ol)
+		return 0;
+
+	*op = (struct op *)ol;
+	(*op)->result = bytes;
+
+	if (!result && !(*op)->error)
+		(*op)->error = GetLastError();
+
+	return 1;
+}
+
+#else
+
+struct sim_frame {
+	unsigned char *data;
+	unsigned length;
+	unsigned offset; /* Bytes already read in stream mode */
+	double arrival; /* When the last byte is on the receive side */
+	struct sim_frame *next;
+};
+
+/*
+	A loopback port as the driver presents it. Writes wait for transmit
+	memory like blocking writes do, frames go out back to back at the line
+	rate, and a read gets one whole frame or, in stream mode, whatever bytes
+	have arrived.
+*/
+struct port {
+	double now;
+	double line_rate; /* Bytes per second */
+	double line_free; /* When the last queued frame finishes */
+	unsigned tx_space;
+	int stream;
+	struct op *writes; /* Waiting for transmit memory */
+	struct op *reads;
+	struct op *done;
+	struct sim_frame *wire; /* In arrival order */
+	struct sim_frame *received;
+};
+
+static void op_append(struct op **list, struct op *op)
+{
+	op->next = NULL;
+
+	while (*list)
+		list = &(*list)->next;
+
+	*list = op;
+}
+
+static void frame_append(struct sim_frame **list, struct sim_frame *frame)
+{
+	frame->next = NULL;
+
+	while (*list)
+		list = &(*list)->next;
+
+	*list = frame;
+}
+
+static double port_now(struct port *port)
+{
+	return port->now;
+}
+
+static int port_open(struct port *port, const struct options *options)
+{
+	memset(port, 0, sizeof(*port));
+
+	port->line_rate = options->line_rate / 8;
+	port->tx_space = SIM_TX_CAPACITY;
+	port->stream = options->stream;
+
+	return 1;
+}
+
+static void port_close(struct port *port)
+{
+	struct sim_frame *frame;
+
+	while (port->wire) {
+		frame = port->wire;
+		port->wire = frame->next;
+		free(frame->data);
+		free(frame);
+	}
+
+	while (port->received) {
+		frame = port->received;
+		port->received = frame->next;
+		free(frame->data);
+		free(frame);
+	}
+}
+
+static void port_submit(struct port *port, struct op *op)
+{
+	op->result = 0;
+	op->error = 0;
+
+	if (op->type == OP_WRITE) {
+		if (op->length > SIM_TX_CAPACITY) {
+			op->error = 1;
+			op_append(&port->done, op);
+			return;
+		}
+
+		op_append(&port->writes, op);
+	}
+	else {
+		op_append(&port->reads, op);
+	}
+}
+
+static void port_cancel(struct port *port)
+{
+	struct op *op;
+
+	while ((op = port->writes)) {
+		port->writes = op->next;
+		op->error = 1;
+		op_append(&port->done, op);
+	}
+
+	while ((op = port->reads)) {
+		port->reads = op->next;
+		op->error = 1;
+		op_append(&port->done, op);
+	}
+}
+
+/* Does everything that can happen at port->now */
+static void port_run(struct port *port)
+{
+	struct sim_frame *frame;
+	struct op *op;
+	unsigned count;
+
+	while (port->wire && port->wire->arrival <= port->now) {
+		frame = port->wire;
+		port->wire = frame->next;
+		port->tx_space += frame->length;
+		frame_append(&port->received, frame);
+	}
+
+	while ((op = port->writes) && op->length <= port->tx_space) {
+		frame = malloc(sizeof(*frame));
+		if (!frame)
+			break;
+
+		frame->data = malloc(op->length);
+		if (!frame->data) {
+			free(frame);
+			break;
+		}
+
+		memcpy(frame->data, op->buffer, op->length);
+		frame->length = op->length;
+		frame->offset = 0;
+
+		if (port->line_free < port->now)
+			port->line_free = port->now;
+
+		port->line_free += op->length / port->line_rate;
+		frame->arrival = port->line_free;
+		frame_append(&port->wire, frame);
+
+		port->tx_space -= op->length;
+		port->writes = op->next;
+		op->result = op->length;
+		op_append(&port->done, op);
+	}
+
+	while ((op = port->reads) && (frame = port->received)) {
+		port->reads = op->next;
+
+		if (port->stream) {
+			count = frame->length - frame->offset;
+			if (count > op->length)
+				count = op->length;
+
+			memcpy(op->buffer, frame->data + frame->offset, count);
+			frame->offset += count;
+			op->result = count;
+		}
+		else if (frame->length > op->length) {
+			op->error = 1;
+			frame->offset = frame->length;
+		}
+		else {
+			memcpy(op->buffer, frame->data, frame->length);
+			frame->offset = frame->length;
+			op->result = frame->length;
+		}
+
+		if (frame->offset == frame->length) {
+			port->received = frame->next;
+			free(frame->data);
+			free(frame);
+		}
+
+		op_append(&port->done, op);
+	}
+}
+
+static int port_wait(struct port *port, double deadline, struct op **op)
+{
+	while (1) {
+		port_run(port);
+
+		if (port->done) {
+			*op = port->done;
+			port->done = (*op)->next;
+			return 1;
+		}
+
+		/* Nothing can happen until the next frame arrives */
+		if (!port->wire || port->wire->arrival > deadline) {
+			if (port->now < deadline)
+				port->now = deadline;
+			return 0;
+		}
+
+		port->now = port->wire->arrival;
+	}
+}
+
+#endif
+
+static void check_frame(struct expected_queue *q, struct stats *stats,
+						const unsigned char *data, unsigned length, double now)
+{
+	struct expected_frame *frame, *match;
+	unsigned seq = 0;
+	unsigned i;
+
+	if (length < HEADER_SIZE) {
+		stats->bad_frames++;
+		return;
+	}
+
+	for (i = 0; i < HEADER_SIZE; i++)
+		seq |= (unsigned)data[i] << (i * 8);
+
+	match = expected_find(q, seq);
+	if (!match) {
+		stats->bad_frames++;
+		return;
+	}
+
+	/* Anything written before this frame isn't coming */
+	while ((frame = expected_head(q)) != match) {
+		if (!frame->failed)
+			stats->lost_frames++;
+		q->head++;
+	}
+
+	q->head++;
+
+	if (length != match->length) {
+		stats->bad_frames++;
+		return;
+	}
+
+	for (i = HEADER_SIZE; i < length; i++) {
+		if (data[i] != pattern(seq, i)) {
+			stats->bad_frames++;
+			return;
+		}
+	}
+
+	stats->frames_read++;
+	add_latency(stats, (now - match->submitted) * 1e6);
+}
+
+/* Stream reads can end anywhere, so walk the frames in the order written */
+static void check_stream(struct expected_queue *q, struct stats *stats,
+						 const unsigned char *data, unsigned length, double now)
+{
+	struct expected_frame *frame;
+	unsigned i = 0;
+
+	while (i < length) {
+		frame = expected_head(q);
+		if (!frame) {
+			stats->bad_frames++;
+			return;
+		}
+
+		if (frame->failed) {
+			q->head++;
+			continue;
+		}
+
+		for (; i < length && frame->received < frame->length; i++, frame->received++) {
+			if (data[i] != pattern(frame->seq, frame->received))
+				frame->bad = 1;
+		}
+
+		if (frame->received == frame->length) {
+			if (frame->bad) {
+				stats->bad_frames++;
+			}
+			else {
+				stats->frames_read++;
+				add_latency(stats, (now - frame->submitted) * 1e6);
+			}
+
+			q->head++;
+		}
+	}
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile(const struct stats *stats, double p)
+{
+	if (!stats->latency_count)
+		return 0;
+
+	return stats->latency[(size_t)(p * (stats->latency_count - 1) + 0.5)];
+}
+
+static void print_json(const struct options *options, const struct stats *stats, double elapsed)
+{
+	qsort(stats->latency, stats->latency_count, sizeof(*stats->latency), compare_double);
+
+	printf("{\n");
+	printf("  \"mode\": \"%s\",\n", options->stream ? "stream" : "frame");
+	printf("  \"transfer\": \"%s\",\n", options->fifo ? "fifo" : "dma");
+#ifndef _WIN32
+	printf("  \"simulated\": true,\n");
+	printf("  \"line_rate\": %.0f,\n", options->line_rate);
+#endif
+	printf("  \"seconds\": %.3f,\n", elapsed);
+	printf("  \"read_depth\": %u,\n", options->read_depth);
+	printf("  \"write_depth\": %u,\n", options->write_depth);
+	printf("  \"frame_size\": {\"min\": %u, \"max\": %u},\n", options->min_size, options->max_size);
+	printf("  \"frames_written\": %llu,\n", stats->frames_written);
+	printf("  \"bytes_written\": %llu,\n", stats->bytes_written);
+	printf("  \"frames_read\": %llu,\n", stats->frames_read);
+	printf("  \"bytes_read\": %llu,\n", stats->bytes_read);
+	printf("  \"frames_per_second\": %.1f,\n", elapsed > 0 ? stats->frames_read / elapsed : 0);
+	printf("  \"bytes_per_second\": %.1f,\n", elapsed > 0 ? stats->bytes_read / elapsed : 0);
+	printf("  \"latency_us\": {\"samples\": %lu, \"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+		   "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f},\n",
+		   (unsigned long)stats->latency_count, percentile(stats, 0), percentile(stats, 0.5),
+		   percentile(stats, 0.9), percentile(stats, 0.99), percentile(stats, 0.999),
+		   percentile(stats, 1));
+	printf("  \"errors\": {\"write\": %llu, \"read\": %llu, \"lost_frames\": %llu, \"bad_frames\": %llu}\n",
+		   stats->write_errors, stats->read_errors, stats->lost_frames, stats->bad_frames);
+	printf("}\n");
+}
+
+/* Fills in a new frame for a write and queues it */
+static int submit(struct port *port, struct op *op, const struct options *options,
+				  struct expected_queue *expected, unsigned *seq, unsigned *random_state)
+{
+	struct expected_frame *frame;
+	unsigned length, i;
+
+	if (op->type == OP_READ) {
+		op->length = options->max_size;
+		port_submit(port, op);
+		return 1;
+	}
+
+	length = options->min_size;
+	if (options->max_size > options->min_size)
+		length += random_next(random_state) % (options->max_size - options->min_size + 1);
+
+	frame = expected_push(expected);
+	if (!frame) {
+		fprintf(stderr, "Unable to allocate frames\n");
+		return 0;
+	}
+
+	memset(frame, 0, sizeof(*frame));
+	frame->seq = (*seq)++;
+	frame->length = length;
+	frame->submitted = port_now(port);
+
+	for (i = 0; i < length; i++)
+		op->buffer[i] = pattern(frame->seq, i);
+
+	op->length = length;
+	port_submit(port, op);
+
+	return 1;
+}
+
+static void complete(struct op *op, const struct options *options,
+					 struct expected_queue *expected, struct stats *stats, double now)
+{
+	struct expected_frame *frame;
+	unsigned seq = 0, i;
+
+	if (op->type == OP_WRITE) {
+		if (!op->error) {
+			stats->frames_written++;
+			stats->bytes_written += op->result;
+			return;
+		}
+
+		stats->write_errors++;
+
+		for (i = 0; i < HEADER_SIZE; i++)
+			seq |= (unsigned)op->buffer[i] << (i * 8);
+
+		frame = expected_find(expected, seq);
+		if (frame)
+			frame->failed = 1;
+	}
+	else if (op->error) {
+		stats->read_errors++;
+	}
+	else {
+		stats->bytes_read += op->result;
+
+		if (options->stream)
+			check_stream(expected, stats, op->buffer, op->result, now);
+		else
+			check_frame(expected, stats, op->buffer, op->result, now);
+	}
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-t seconds] [-r read depth] [-w write depth] [-s min[:max]]\n", name);
+	printf("       %*s [-m frame|stream] [-f] [-b line rate] [port number]\n", (int)strlen(name), "");
+}
+
+int main(int argc, char *argv[])
+{
+	struct options options;
+	struct stats stats;
+	struct expected_queue expected;
+	struct port port;
+	struct op ops[MAX_DEPTH * 2];
+	struct op *op;
+	unsigned random_state = 1;
+	unsigned seq = 0, outstanding = 0, count, i;
+	double start, deadline, now;
+	int arg;
+
+	memset(&options, 0, sizeof(options));
+	options.seconds = DEFAULT_SECONDS;
+	options.read_depth = DEFAULT_DEPTH;
+	options.write_depth = DEFAULT_DEPTH;
+	options.min_size = DEFAULT_FRAME_SIZE;
+	options.max_size = DEFAULT_FRAME_SIZE;
+	options.line_rate = DEFAULT_LINE_RATE;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++) {
+		if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			options.seconds = atof(argv[++arg]);
+		}
+		else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+			options.read_depth = strtoul(argv[++arg], NULL, 10);
+		}
+		else if (strcmp(argv[arg], "-w") == 0 && arg + 1 < argc) {
+			options.write_depth = strtoul(argv[++arg], NULL, 10);
+		}
+		else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+			arg++;
+			if (sscanf(argv[arg], "%u:%u", &options.min_size, &options.max_size) == 1)
+				options.max_size = options.min_size;
+		}
+		else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+			options.stream = (strcmp(argv[++arg], "stream") == 0);
+		}
+		else if (strcmp(argv[arg], "-f") == 0) {
+			options.fifo = 1;
+		}
+		else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+			options.line_rate = atof(argv[++arg]);
+		}
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (arg < argc)
+		options.port_num = strtoul(argv[arg], NULL, 10);
+
+	if (options.read_depth < 1 || options.read_depth > MAX_DEPTH ||
+		options.write_depth < 1 || options.write_depth > MAX_DEPTH ||
+		options.min_size < HEADER_SIZE || options.max_size < options.min_size ||
+		options.line_rate <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	memset(&expected, 0, sizeof(expected));
+	memset(ops, 0, sizeof(ops));
+
+	count = options.read_depth + options.write_depth;
+
+	for (i = 0; i < count; i++) {
+		ops[i].type = (i < options.read_depth) ? OP_READ : OP_WRITE;
+		ops[i].buffer = malloc(options.max_size);
+		if (!ops[i].buffer) {
+			fprintf(stderr, "Unable to allocate buffers\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!port_open(&port, &options))
+		return EXIT_FAILURE;
+
+	start = port_now(&port);
+	deadline = start + options.seconds;
+	now = start;
+
+	for (i = 0; i < count; i++) {
+		if (!submit(&port, &ops[i], &options, &expected, &seq, &random_state))
+			break;
+		outstanding++;
+	}
+
+	/* Every completion is handled and the op sent straight back out */
+	while (outstanding == count && (now = port_now(&port)) < deadline) {
+		if (!port_wait(&port, deadline, &op))
+			continue;
+
+		outstanding--;
+		now = port_now(&port);
+
+		complete(op, &options, &expected, &stats, now);
+
+		if (submit(&port, op, &options, &expected, &seq, &random_state))
+			outstanding++;
+	}
+
+	/* What is still in flight isn't counted */
+	port_cancel(&port);
+
+	while (outstanding && port_wait(&port, port_now(&port) + 1, &op))
+		outstanding--;
+
+	port_close(&port);
+
+	print_json(&options, &stats, now - start);
+
+	for (i = 0; i < count; i++)
+		free(ops[i].buffer);
+
+	free(expected.frames);
+	free(stats.latency);
+
+	return (stats.read_errors || stats.write_errors || stats.lost_frames || stats.bad_frames) ?
+		   EXIT_FAILURE : EXIT_SUCCESS;
+}
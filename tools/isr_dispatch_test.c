@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "isr.h"
+#include "io.h"
+#include "port.h"
+#include "ring.h"
+#include "config.h"
+
+/*
+	Host tests for how src/isr.c shares a card's interrupt between its
+	ports, and a model of what that costs in register reads.
+
+	Every port on a card connects fscc_isr to the same vector, and the card
+	has no status register that says which port interrupted, so each call
+	reads its port's ISR. Reading ISR clears it, like on the card. A port
+	with every interrupt masked in IMR has to skip the read, any other port
+	has to read it and claim the interrupt only if a bit was set.
+
+	Last, cards with 1, 2 and 4 ports are run with every port busy, with one
+	busy port and the rest idle, and with one busy port and the rest fully
+	masked. The ISR reads an interrupt are printed for a line interrupt,
+	where the handlers are called in turn until one claims it, and for a
+	walk of every handler. A card level status register would need one.
+	The default IMR of 0x0f000000 only masks the modem status interrupts,
+	so an idle port left at it is still read on every interrupt.
+
+	Built from the driver's own isr.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/isr_dispatch_test.c src/isr.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define MAX_PORTS 4
+#define INTERRUPTS 1000000
+
+enum setup { ALL_BUSY, ONE_BUSY, ONE_BUSY_REST_MASKED };
+
+static const char *setup_names[] = {
+	"all busy",
+	"one busy",
+	"one busy, rest masked",
+};
+
+static struct fscc_port ports[MAX_PORTS];
+static UINT32 pending[MAX_PORTS]; /* What each port's ISR would read */
+static UINT64 isr_reads;
+static unsigned dpcs;
+
+static unsigned port_index(struct fscc_port *port)
+{
+	return (unsigned)(port - ports);
+}
+
+static WDFINTERRUPT interrupt(unsigned index)
+{
+	return (WDFINTERRUPT)(size_t)(index + 1);
+}
+
+UINT32 fscc_port_get_register(struct fscc_port *port, unsigned bar, unsigned register_offset)
+{
+	UINT32 value = pending[port_index(port)];
+
+	check(bar == 0 && register_offset == ISR_OFFSET);
+
+	pending[port_index(port)] = 0;
+	isr_reads++;
+
+	return value;
+}
+
+WDFDEVICE WdfInterruptGetDevice(WDFINTERRUPT Interrupt)
+{
+	return (WDFDEVICE)Interrupt;
+}
+
+FSCC_PORT *WdfObjectGet_FSCC_PORT(WDFOBJECT handle)
+{
+	return &ports[(size_t)handle - 1];
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	dpcs++;
+	return TRUE;
+}
+
+void fscc_port_set_clock_present(struct fscc_port *port, BOOLEAN value)
+{
+}
+
+BOOLEAN fscc_port_uses_dma(struct fscc_port *port)
+{
+	return port->has_dma;
+}
+
+unsigned fscc_port_stats_cpu(void)
+{
+	return 0;
+}
+
+/* The DPCs in isr.c, none of which the ISR calls */
+ULONGLONG KeQueryInterruptTime(void)
+{
+	return 0;
+}
+
+WDFOBJECT WdfDpcGetParentObject(WDFDPC Dpc)
+{
+	return NULL;
+}
+
+WDFOBJECT WdfTimerGetParentObject(WDFTIMER Timer)
+{
+	return NULL;
+}
+
+NTSTATUS WdfIoQueueFindRequest(WDFQUEUE Queue, WDFREQUEST TagRequest, WDFFILEOBJECT FileObject, PWDF_REQUEST_PARAMETERS Parameters, WDFREQUEST *OutRequest)
+{
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+WDF_IO_QUEUE_STATE WdfIoQueueGetState(WDFQUEUE Queue, PULONG QueueRequests, PULONG DriverRequests)
+{
+	return 0;
+}
+
+NTSTATUS WdfIoQueueRetrieveFoundRequest(WDFQUEUE Queue, WDFREQUEST FoundRequest, WDFREQUEST *OutRequest)
+{
+	return STATUS_NOT_FOUND;
+}
+
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest)
+{
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+void WdfObjectDereference(WDFOBJECT Handle)
+{
+}
+
+void WdfRequestCompleteWithInformation(WDFREQUEST Request, NTSTATUS Status, ULONG_PTR Information)
+{
+}
+
+void WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters)
+{
+}
+
+NTSTATUS WdfRequestRetrieveInputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+	return STATUS_BUFFER_TOO_SMALL;
+}
+
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+	return STATUS_BUFFER_TOO_SMALL;
+}
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+}
+
+void fscc_dma_apply_timestamps(struct fscc_port *port)
+{
+}
+
+int fscc_fifo_read_data(struct fscc_port *port)
+{
+	return 0;
+}
+
+unsigned fscc_io_transmit_frame(struct fscc_port *port)
+{
+	return 0;
+}
+
+BOOLEAN fscc_port_clock_stale(struct fscc_port *port)
+{
+	return FALSE;
+}
+
+void fscc_port_count_dpc(struct fscc_port *port)
+{
+}
+
+void fscc_port_start_rx_poll(struct fscc_port *port)
+{
+}
+
+void fscc_port_start_timer(struct fscc_port *port)
+{
+}
+
+unsigned fscc_port_timed_out(struct fscc_port *port)
+{
+	return 0;
+}
+
+void fscc_ring_drain_tx(struct fscc_port *port)
+{
+}
+
+unsigned fscc_user_next_read_size(struct fscc_port *port, UINT32 *bytes)
+{
+	return 0;
+}
+
+static void setup(unsigned count, enum setup setup)
+{
+	unsigned i;
+
+	memset(ports, 0, sizeof(ports));
+	memset(pending, 0, sizeof(pending));
+	isr_reads = 0;
+	dpcs = 0;
+
+	for (i = 0; i < count; i++) {
+		ports[i].register_storage.IMR = DEFAULT_IMR_VALUE;
+
+		if (setup == ONE_BUSY_REST_MASKED && i != count - 1)
+			ports[i].register_storage.IMR = ALL_INTERRUPTS;
+	}
+}
+
+/* The card only raises the line for interrupts IMR lets through */
+static void raise(unsigned index, UINT32 bits)
+{
+	pending[index] |= bits & ~ports[index].register_storage.IMR;
+}
+
+/*
+	Calls each port's fscc_isr in the order they connected. A line
+	interrupt stops at the first one to claim it, otherwise every one is
+	called. Returns the ports that claimed it.
+*/
+static unsigned dispatch(unsigned count, BOOLEAN all)
+{
+	unsigned claimed = 0;
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		if (fscc_isr(interrupt(i), 0)) {
+			claimed++;
+
+			if (!all)
+				break;
+		}
+	}
+
+	return claimed;
+}
+
+static void test_masked(void)
+{
+	setup(1, ALL_BUSY);
+
+	/* Default IMR, nothing pending, read and not claimed */
+	check(!fscc_isr(interrupt(0), 0));
+	check(isr_reads == 1 && ports[0].isr_calls == 1);
+	check(ports[0].isr_handled == 0 && ports[0].isr_reads_skipped == 0);
+
+	/* Everything masked, not read at all */
+	ports[0].register_storage.IMR = ALL_INTERRUPTS;
+	check(!fscc_isr(interrupt(0), 0));
+	check(isr_reads == 1 && ports[0].isr_reads_skipped == 1);
+
+	/* One interrupt left unmasked is enough to need the read */
+	ports[0].register_storage.IMR = ALL_INTERRUPTS & ~RFE;
+	raise(0, RFE | CDC);
+	check(pending[0] == RFE);
+	check(fscc_isr(interrupt(0), 0));
+	check(isr_reads == 2 && ports[0].isr_handled == 1);
+	check(ports[0].last_isr_value == RFE);
+	check(dpcs > 0);
+
+	/* Reading cleared it */
+	check(!fscc_isr(interrupt(0), 0));
+	check(isr_reads == 3 && ports[0].isr_handled == 1);
+}
+
+static void test_shared(void)
+{
+	unsigned i;
+
+	/* Only the port that interrupted claims it, each port is read once */
+	setup(MAX_PORTS, ALL_BUSY);
+	raise(2, RFS);
+	check(dispatch(MAX_PORTS, TRUE) == 1);
+	check(isr_reads == MAX_PORTS);
+	for (i = 0; i < MAX_PORTS; i++) {
+		check(ports[i].isr_calls == 1);
+		check(ports[i].isr_handled == (i == 2));
+	}
+
+	/* A line interrupt stops at the port that claims it */
+	raise(1, RFS);
+	isr_reads = 0;
+	check(dispatch(MAX_PORTS, FALSE) == 1);
+	check(isr_reads == 2 && ports[3].isr_calls == 1);
+
+	/* Two ports at once can both claim it */
+	raise(0, TFT);
+	raise(3, RFE);
+	check(dispatch(MAX_PORTS, TRUE) == 2);
+
+	/* Masked ports are passed over without a read */
+	setup(MAX_PORTS, ONE_BUSY_REST_MASKED);
+	raise(MAX_PORTS - 1, RFS);
+	check(dispatch(MAX_PORTS, TRUE) == 1);
+	check(isr_reads == 1);
+	check(ports[0].isr_reads_skipped == 1 && ports[MAX_PORTS - 1].isr_handled == 1);
+}
+
+/* Returns the ISR reads an interrupt */
+static double run(unsigned count, enum setup setup_kind, BOOLEAN all)
+{
+	UINT64 handled = 0;
+	unsigned i, busy;
+
+	setup(count, setup_kind);
+	srand(1);
+
+	for (i = 0; i < INTERRUPTS; i++) {
+		/* The busy port in the other setups connected last, the worst case */
+		busy = setup_kind == ALL_BUSY ? (unsigned)rand() % count : count - 1;
+
+		raise(busy, RFE);
+		check(dispatch(count, all) == 1);
+	}
+
+	for (i = 0; i < count; i++)
+		handled += ports[i].isr_handled;
+
+	check(handled == INTERRUPTS);
+
+	return (double)isr_reads / INTERRUPTS;
+}
+
+static void model(void)
+{
+	double line, every;
+	unsigned counts[] = { 1, 2, 4 };
+	unsigned c, s;
+
+	printf("ISR reads an interrupt, %u interrupts a run:\n", INTERRUPTS);
+	printf("%5s  %-24s %8s %8s %8s\n", "ports", "setup", "line", "every", "card");
+
+	for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		for (s = ALL_BUSY; s <= ONE_BUSY_REST_MASKED; s++) {
+			if (counts[c] == 1 && s != ALL_BUSY)
+				continue;
+
+			line = run(counts[c], (enum setup)s, FALSE);
+			every = run(counts[c], (enum setup)s, TRUE);
+
+			/* Idle ports at the default IMR are still read every time */
+			if (s == ONE_BUSY) {
+				check(line == counts[c]);
+				check(every == counts[c]);
+			}
+
+			/* Only fully masked ones get out of it */
+			if (s == ONE_BUSY_REST_MASKED) {
+				check(line == 1);
+				check(every == 1);
+			}
+
+			if (s == ALL_BUSY) {
+				check(every == counts[c]);
+				check(line > (counts[c] + 1) / 2.0 - 0.01 && line < (counts[c] + 1) / 2.0 + 0.01);
+			}
+
+			printf("%5u  %-24s %8.2f %8.2f %8.2f\n", counts[c], setup_names[s], line, every, 1.0);
+		}
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_masked();
+	test_shared();
+	model();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All ISR dispatch tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+#include "port.h"
+#include "card.h"
+
+/*
+	Host tests for register_cache_class in src/utils.c, which decides the
+	registers fscc_port_get_register serves from register_storage instead of
+	reading them from the card.
+
+	Every register the card itself changes has to be volatile. Then random
+	reads and writes go through a copy of the cache in fscc_port_get_register
+	and fscc_port_set_register, against a fake BAR 0 the hardware keeps
+	changing, and every read has to give what the BAR holds. Last, the reads
+	the driver's hot paths make are run with and without the cache, and the
+	MMIO reads saved are printed.
+
+	Built from the driver's own utils.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/register_cache_test.c src/utils.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define REGISTERS (MAX_OFFSET / 4 + 1)
+
+/* A PCIe read round trip, roughly, for the estimate at the end */
+#define MMIO_READ_NS 1000
+
+static volatile UINT32 bar0[REGISTERS];
+static struct fscc_registers register_storage;
+static unsigned mmio_reads, mmio_reads_avoided;
+static volatile UINT32 sink;
+
+/* What the card changes by itself, the rest only change when written */
+static BOOLEAN is_hardware_register(unsigned offset)
+{
+	switch (offset) {
+	case FIFO_OFFSET:
+	case BC_FIFO_L_OFFSET:
+	case FIFO_BC_OFFSET:
+	case FIFO_FC_OFFSET:
+	case CMDR_OFFSET:
+	case STAR_OFFSET:
+	case ISR_OFFSET:
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void hardware_tick(void)
+{
+	unsigned offset;
+
+	for (offset = 0; offset <= MAX_OFFSET; offset += 4) {
+		if (is_hardware_register(offset) && rand() % 2)
+			bar0[offset / 4] = ((UINT32)rand() << 16) ^ (UINT32)rand();
+	}
+}
+
+static UINT32 mmio_read(unsigned offset)
+{
+	mmio_reads++;
+
+	return bar0[offset / 4];
+}
+
+/* fscc_port_get_register for bar 0 */
+static UINT32 get_register(unsigned offset, BOOLEAN use_cache)
+{
+	fscc_register *cached = 0;
+	UINT32 value = 0;
+
+	if (use_cache && register_cache_class(0, offset) != REGISTER_VOLATILE) {
+		cached = &((fscc_register *)&register_storage)[offset / 4];
+
+		if (*cached >= 0) {
+			mmio_reads_avoided++;
+			return (UINT32)*cached;
+		}
+	}
+
+	value = mmio_read(offset);
+
+	if (cached)
+		*cached = value;
+
+	return value;
+}
+
+/* fscc_port_set_register for bar 0 */
+static void set_register(unsigned offset, UINT32 value)
+{
+	bar0[offset / 4] = value;
+	((fscc_register *)&register_storage)[offset / 4] = value;
+}
+
+static void reset(void)
+{
+	unsigned i;
+
+	FSCC_REGISTERS_INIT(register_storage);
+
+	for (i = 0; i < REGISTERS; i++)
+		bar0[i] = ((UINT32)rand() << 16) ^ (UINT32)rand();
+
+	mmio_reads = 0;
+	mmio_reads_avoided = 0;
+}
+
+static void test_classes(void)
+{
+	unsigned offset;
+
+	for (offset = 0; offset <= MAX_OFFSET; offset += 4) {
+		enum register_class reg_class = register_cache_class(0, offset);
+
+		if (is_hardware_register(offset)) {
+			check(reg_class == REGISTER_VOLATILE);
+		}
+
+		/* The cache is indexed by offset, so it has to stay inside BAR 0 */
+		if (reg_class != REGISTER_VOLATILE) {
+			check(offset / 4 < sizeof(register_storage) / sizeof(fscc_register));
+		}
+	}
+
+	check(register_cache_class(0, VSTR_OFFSET) == REGISTER_STATIC);
+	check(register_cache_class(0, CCR0_OFFSET) == REGISTER_CACHED);
+	check(register_cache_class(0, CCR1_OFFSET) == REGISTER_CACHED);
+	check(register_cache_class(0, CCR2_OFFSET) == REGISTER_CACHED);
+	check(register_cache_class(0, IMR_OFFSET) == REGISTER_CACHED);
+
+	/* serialfc writes FCR, and the rest of bar 2 is DMA state */
+	for (offset = 0; offset <= DSTAR_OFFSET; offset += 4)
+		check(register_cache_class(2, offset) == REGISTER_VOLATILE);
+
+	check(register_cache_class(1, VSTR_OFFSET) == REGISTER_VOLATILE);
+}
+
+static void test_coherence(void)
+{
+	unsigned i, offset, reads;
+
+	reset();
+
+	/* Nothing is known until it is read or written */
+	reads = mmio_reads;
+	get_register(IMR_OFFSET, TRUE);
+	check(mmio_reads == reads + 1);
+	get_register(IMR_OFFSET, TRUE);
+	check(mmio_reads == reads + 1);
+
+	set_register(CCR0_OFFSET, 0x12345678);
+	check(get_register(CCR0_OFFSET, TRUE) == 0x12345678);
+	check(mmio_reads == reads + 1);
+
+	for (i = 0; i < 1000000; i++) {
+		offset = (rand() % REGISTERS) * 4;
+
+		switch (rand() % 3) {
+		case 0:
+			hardware_tick();
+			break;
+
+		case 1:
+			if (!is_read_only_register(offset) && !is_hardware_register(offset))
+				set_register(offset, ((UINT32)rand() << 16) ^ (UINT32)rand());
+			break;
+
+		case 2:
+			check(get_register(offset, TRUE) == bar0[offset / 4]);
+			break;
+		}
+	}
+
+	/* Sanity check that the cache was used at all */
+	check(mmio_reads_avoided > 10000);
+}
+
+/*
+	The reads made by the hot paths: fscc_port_get_FREV, _PREV and _PDEV on
+	open, fscc_io_get_TFCNT and _TXCNT for each FIFO write, STAR for the
+	clock check and the CCR and IMR reads in the settings and ISR paths.
+*/
+static const unsigned hot_reads[] = {
+	VSTR_OFFSET, VSTR_OFFSET, VSTR_OFFSET,
+	FIFO_FC_OFFSET, FIFO_BC_OFFSET,
+	STAR_OFFSET,
+	CCR0_OFFSET, CCR1_OFFSET, CCR2_OFFSET, IMR_OFFSET,
+};
+
+static double run_hot_paths(BOOLEAN use_cache, unsigned *reads)
+{
+	struct timespec start, end;
+	UINT32 sum = 0;
+	unsigned i, j;
+
+	reset();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < 1000000; i++) {
+		for (j = 0; j < sizeof(hot_reads) / sizeof(hot_reads[0]); j++)
+			sum += get_register(hot_reads[j], use_cache);
+
+		if (i % 64 == 0)
+			hardware_tick();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sink = sum;
+	*reads = mmio_reads;
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void test_hot_paths(void)
+{
+	unsigned cached_reads = 0, uncached_reads = 0;
+	double cached_time, uncached_time;
+
+	uncached_time = run_hot_paths(FALSE, &uncached_reads);
+	cached_time = run_hot_paths(TRUE, &cached_reads);
+
+	check(cached_reads + mmio_reads_avoided == uncached_reads);
+
+	/* Three of the ten are volatile */
+	check(cached_reads < uncached_reads * 31 / 100);
+
+	printf("Hot path reads: %u MMIO without the cache, %u with it (%.0f%% avoided), "
+		"%.1f ms vs %.1f ms here, about %.0f ms saved at %d ns a read\n",
+		uncached_reads, cached_reads, 100.0 * mmio_reads_avoided / uncached_reads,
+		uncached_time * 1000, cached_time * 1000,
+		(double)mmio_reads_avoided * MMIO_READ_NS / 1e6, MMIO_READ_NS);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_classes();
+	test_coherence();
+	test_hot_paths();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All register cache tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+#include "port.h"
+#include "card.h"
+
+/*
+	Host tests for is_valid_register_op in src/utils.c, which
+	FSCC_REGISTER_TRANSACTION uses to check every operation before running
+	any of them.
+
+	Every bar, offset and type near the registers, and some far from them,
+	are checked against a list of what each kind of operation may touch.
+	Last, checking a full transaction of FSCC_MAX_REGISTER_OPS operations is
+	timed.
+
+	Built from the driver's own utils.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/register_ops_test.c src/utils.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+struct allowed_register {
+	unsigned bar;
+	unsigned offset;
+	BOOLEAN writable;
+};
+
+/* FIFO, BC_FIFO_L and ISR are left out, see is_valid_register_op */
+static const struct allowed_register allowed[] = {
+	{ 0, FIFOT_OFFSET, TRUE },
+	{ 0, FIFO_BC_OFFSET, TRUE },
+	{ 0, FIFO_FC_OFFSET, TRUE },
+	{ 0, CMDR_OFFSET, TRUE },
+	{ 0, STAR_OFFSET, FALSE },
+	{ 0, CCR0_OFFSET, TRUE },
+	{ 0, CCR1_OFFSET, TRUE },
+	{ 0, CCR2_OFFSET, TRUE },
+	{ 0, BGR_OFFSET, TRUE },
+	{ 0, SSR_OFFSET, TRUE },
+	{ 0, SMR_OFFSET, TRUE },
+	{ 0, TSR_OFFSET, TRUE },
+	{ 0, TMR_OFFSET, TRUE },
+	{ 0, RAR_OFFSET, TRUE },
+	{ 0, RAMR_OFFSET, TRUE },
+	{ 0, PPR_OFFSET, TRUE },
+	{ 0, TCR_OFFSET, TRUE },
+	{ 0, VSTR_OFFSET, FALSE },
+	{ 0, IMR_OFFSET, TRUE },
+	{ 0, DPLLR_OFFSET, TRUE },
+	{ 2, FCR_OFFSET, TRUE },
+	{ 2, DMACCR_OFFSET, TRUE },
+};
+
+static BOOLEAN expected(const struct fscc_register_op *op)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(allowed) / sizeof(allowed[0]); i++) {
+		if (allowed[i].bar != op->bar || allowed[i].offset != op->offset)
+			continue;
+
+		switch (op->type) {
+		case FSCC_REGISTER_READ:
+		case FSCC_REGISTER_WAIT:
+			return TRUE;
+
+		case FSCC_REGISTER_WRITE:
+		case FSCC_REGISTER_MODIFY:
+			return allowed[i].writable;
+		}
+
+		return FALSE;
+	}
+
+	return FALSE;
+}
+
+static void test_exhaustive(void)
+{
+	static const UINT32 far_values[] = { 0x100, 0x1000, 0x7ffffffc, 0x80000000, 0xfffffffc, 0xffffffff };
+	struct fscc_register_op op;
+	unsigned bar, offset, type, i, valid = 0;
+
+	memset(&op, 0, sizeof(op));
+
+	for (bar = 0; bar < 4; bar++) {
+		for (offset = 0; offset < 0x100; offset++) {
+			for (type = 0; type < 6; type++) {
+				op.bar = bar;
+				op.offset = offset;
+				op.type = type;
+
+				check(!!is_valid_register_op(&op) == expected(&op));
+				valid += is_valid_register_op(&op) ? 1 : 0;
+			}
+		}
+	}
+
+	/* 20 bar 0 registers and 2 bar 2 ones for reads and waits, 18 and 2 for
+	   writes and modifies */
+	check(valid == (20 + 2) * 2 + (18 + 2) * 2);
+
+	for (i = 0; i < sizeof(far_values) / sizeof(far_values[0]); i++) {
+		op.bar = far_values[i];
+		op.offset = CCR0_OFFSET;
+		op.type = FSCC_REGISTER_READ;
+		check(!is_valid_register_op(&op));
+
+		op.bar = 0;
+		op.offset = far_values[i];
+		check(!is_valid_register_op(&op));
+
+		op.offset = CCR0_OFFSET;
+		op.type = far_values[i];
+		check(!is_valid_register_op(&op));
+	}
+
+	/* The mask and value never matter */
+	for (i = 0; i < 100000; i++) {
+		op.bar = (rand() % 2) * 2;
+		op.offset = (rand() % 0x60) & ~3;
+		op.type = rand() % 4;
+		op.mask = ((UINT32)rand() << 16) ^ (UINT32)rand();
+		op.value = ((UINT32)rand() << 16) ^ (UINT32)rand();
+
+		check(!!is_valid_register_op(&op) == expected(&op));
+	}
+}
+
+static void test_timing(void)
+{
+	struct fscc_register_op ops[FSCC_MAX_REGISTER_OPS];
+	struct timespec start, end;
+	unsigned i, j, valid = 0;
+	double elapsed;
+
+	/* A typical reconfiguration: modifies of the CCRs and a wait on STAR */
+	for (i = 0; i < FSCC_MAX_REGISTER_OPS; i++) {
+		static const UINT32 offsets[] = { CCR0_OFFSET, CCR1_OFFSET, CCR2_OFFSET, STAR_OFFSET };
+
+		ops[i].bar = 0;
+		ops[i].offset = offsets[i % 4];
+		ops[i].type = (i % 4 == 3) ? FSCC_REGISTER_WAIT : FSCC_REGISTER_MODIFY;
+		ops[i].mask = 0xff;
+		ops[i].value = i;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < 1000000; i++) {
+		ops[i % FSCC_MAX_REGISTER_OPS].value = i;
+
+		for (j = 0; j < FSCC_MAX_REGISTER_OPS; j++)
+			valid += is_valid_register_op(&ops[j]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	check(valid == 1000000u * FSCC_MAX_REGISTER_OPS);
+
+	printf("Checking a %d operation transaction takes %.1f ns, %.2f ns an operation\n",
+		FSCC_MAX_REGISTER_OPS, elapsed * 1000, elapsed * 1000 / FSCC_MAX_REGISTER_OPS);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_exhaustive();
+	test_timing();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All register operation tests passed\n");
+
+	return EXIT_SUCCESS;
+}
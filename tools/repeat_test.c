@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "repeat.h"
+#include "port.h"
+#include "io.h"
+
+/*
+	Host tests for FSCC_SET_TX_REPEAT in src/repeat.c. Random frame lists
+	are laid out in descriptors and put back together the way the card
+	reads them, and broken lists have to be turned down.
+
+	The loop itself then runs against a simulated card that follows the
+	descriptors, sets CSTOP in each one it sends and stops at one that
+	already has it. The lists are replaced and cleared at random while it
+	runs, and every repetition has to be one whole list, in order, with
+	nothing sent from a descriptor after it was freed.
+
+	Built from the driver's own repeat.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/repeat_test.c src/repeat.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define TX_LOCK ((WDFSPINLOCK)1)
+#define MAX_FRAMES 8
+#define MAX_FRAME_LENGTH 3000
+#define MAX_DESCRIPTORS (1 << 20)
+
+static struct fscc_port port;
+static BOOLEAN tx_held;
+static BOOLEAN dpc_queued;
+static long allocations;
+
+/*
+	Descriptor addresses are indexes in here, so the card can follow them.
+	They are handed out in a circle, so a freed one isn't used again soon.
+*/
+static struct dma_frame *descriptors[MAX_DESCRIPTORS];
+static UINT32 next_address = 0;
+
+static struct {
+	BOOLEAN running;
+	UINT32 address;
+} card;
+
+PVOID ExAllocatePool2(ULONG64 flags, SIZE_T size, ULONG tag)
+{
+	allocations++;
+	return calloc(1, size);
+}
+
+void ExFreePoolWithTag(PVOID p, ULONG tag)
+{
+	allocations--;
+	free(p);
+}
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	check(!tx_held);
+	tx_held = TRUE;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	check(tx_held);
+	tx_held = FALSE;
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	dpc_queued = TRUE;
+	return TRUE;
+}
+
+WDFOBJECT WdfDpcGetParentObject(WDFDPC Dpc)
+{
+	return NULL;
+}
+
+FSCC_PORT *WdfObjectGet_FSCC_PORT(WDFOBJECT handle)
+{
+	return &port;
+}
+
+void fscc_port_count_dpc(struct fscc_port *port)
+{
+}
+
+BOOLEAN fscc_port_uses_dma(struct fscc_port *port)
+{
+	return TRUE;
+}
+
+BOOLEAN fscc_ring_tx_mapped(struct fscc_port *port)
+{
+	return FALSE;
+}
+
+struct dma_frame *fscc_io_create_frame(struct fscc_port *port, UINT32 size_of_buffer)
+{
+	struct dma_frame *frame = 0;
+	UINT32 i;
+
+	for (i = 0; i < MAX_DESCRIPTORS; i++) {
+		next_address = (next_address + 1) % MAX_DESCRIPTORS;
+		if (next_address != 0 && descriptors[next_address] == 0)
+			break;
+	}
+
+	check(i < MAX_DESCRIPTORS);
+	if (i == MAX_DESCRIPTORS)
+		return 0;
+
+	frame = (struct dma_frame *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(*frame), 'CSED');
+	frame->desc = (struct fscc_descriptor *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(*frame->desc), 'CSED');
+	frame->buffer = (unsigned char *)ExAllocatePool2(POOL_FLAG_NON_PAGED, size_of_buffer, 'CSED');
+	frame->data_size = size_of_buffer;
+	frame->desc_physical_address = next_address;
+
+	descriptors[next_address] = frame;
+
+	return frame;
+}
+
+void fscc_io_destroy_frame(struct dma_frame *frame)
+{
+	descriptors[frame->desc_physical_address] = 0;
+
+	ExFreePoolWithTag(frame->buffer, 'CSED');
+	ExFreePoolWithTag((void *)frame->desc, 'CSED');
+	ExFreePoolWithTag(frame, 'CSED');
+}
+
+void fscc_io_link_desc(struct dma_frame **descs, size_t number_of_buffers)
+{
+	size_t i;
+
+	for (i = 0; i < number_of_buffers; i++)
+		descs[i]->desc->next_descriptor = descs[i < number_of_buffers - 1 ? i + 1 : 0]->desc_physical_address;
+}
+
+NTSTATUS fscc_port_set_register(struct fscc_port *port, unsigned bar, unsigned register_offset, UINT32 value)
+{
+	check(bar == 2 && register_offset == DMA_TX_BASE_OFFSET);
+	check(tx_held);
+	check(!card.running);
+
+	card.address = value;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS fscc_dma_execute_GO_T(struct fscc_port *port)
+{
+	card.running = TRUE;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS fscc_dma_execute_STOP_T(struct fscc_port *port)
+{
+	card.running = FALSE;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS fscc_dma_execute_RST_T(struct fscc_port *port)
+{
+	return STATUS_SUCCESS;
+}
+
+BOOLEAN fscc_dma_is_tx_running(struct fscc_port *port)
+{
+	return card.running;
+}
+
+NTSTATUS fscc_io_purge_tx(struct fscc_port *port)
+{
+	check(!tx_held);
+
+	card.running = FALSE;
+
+	return STATUS_SUCCESS;
+}
+
+/* Makes a frame list, each frame's first byte is id */
+static UINT32 make_list(unsigned char *list, unsigned id, unsigned frames, UINT32 max_length)
+{
+	UINT32 length = 0, frame_length, i, j;
+
+	for (i = 0; i < frames; i++) {
+		frame_length = 1 + rand() % max_length;
+
+		memcpy(list + length, &frame_length, sizeof(frame_length));
+		length += sizeof(frame_length);
+
+		list[length] = (unsigned char)id;
+		for (j = 1; j < frame_length; j++)
+			list[length + j] = (unsigned char)rand();
+
+		length += frame_length;
+	}
+
+	return length;
+}
+
+static void test_layout(void)
+{
+	static unsigned char list[MAX_FRAMES * (MAX_FRAME_LENGTH + 4)];
+	static UINT32 controls[MAX_FRAMES * MAX_FRAME_LENGTH], counts[MAX_FRAMES * MAX_FRAME_LENGTH], offsets[MAX_FRAMES * MAX_FRAME_LENGTH];
+	UINT32 buffer_size, length, frames, bytes, count, frame_length, have, position, total;
+	UINT32 zero = 0;
+	UINT32 i, j, n;
+
+	for (i = 0; i < 20000; i++) {
+		buffer_size = 4 * (1 + rand() % 128);
+		frames = 1 + rand() % MAX_FRAMES;
+		length = make_list(list, i, frames, MAX_FRAME_LENGTH);
+
+		count = fscc_repeat_layout(list, length, buffer_size, NULL, NULL, NULL, &bytes);
+		check(count > 0);
+		check(bytes == length - frames * 4);
+		check(fscc_repeat_layout(list, length, buffer_size, controls, counts, offsets, NULL) == count);
+
+		/* Put the frames back together like the card would */
+		n = 0;
+		have = 0;
+		frame_length = 0;
+		position = 0;
+		total = 0;
+
+		for (j = 0; j < count; j++) {
+			if (controls[j] & DESC_FE_BIT) {
+				check(have == frame_length);
+
+				memcpy(&frame_length, list + position, sizeof(frame_length));
+				check((controls[j] & DMA_MAX_LENGTH) == frame_length);
+
+				position += sizeof(frame_length);
+				have = 0;
+				n++;
+			}
+			else {
+				check((controls[j] & ~DESC_HI_BIT) == counts[j]);
+			}
+
+			check(counts[j] > 0 && counts[j] <= buffer_size);
+			check(offsets[j] == position);
+			check(((controls[j] & DESC_HI_BIT) != 0) == (j == count - 1));
+
+			position += counts[j];
+			have += counts[j];
+			total += counts[j];
+		}
+
+		check(have == frame_length);
+		check(n == frames);
+		check(position == length);
+		check(total == bytes);
+
+		/* A list cut short anywhere isn't valid */
+		check(fscc_repeat_layout(list, length - 1 - rand() % 4, buffer_size, NULL, NULL, NULL, NULL) == 0);
+	}
+
+	check(fscc_repeat_layout((unsigned char *)&zero, sizeof(zero), 256, NULL, NULL, NULL, NULL) == 0);
+	check(fscc_repeat_layout(list, length, 0, NULL, NULL, NULL, NULL) == 0);
+}
+
+/* What the card has sent, checked frame by frame */
+static struct {
+	unsigned char lists[2][MAX_FRAMES * (MAX_FRAME_LENGTH + 4)];
+	UINT32 lengths[2];
+	unsigned list; /* lists[list % 2] is the one being sent, the other is the one set next */
+	unsigned sets;
+	unsigned char frame[MAX_FRAME_LENGTH];
+	UINT32 frame_length;
+	UINT32 have;
+	UINT32 position; /* Where the next frame should be in the list being sent */
+	unsigned repetitions;
+	unsigned swaps;
+} sent;
+
+static void check_frame(void)
+{
+	const unsigned char *list = sent.lists[sent.list % 2];
+	UINT32 frame_length = 0;
+
+	/* A new list can only start where a repetition of the old one ends */
+	if (sent.position == 0 && sent.list + 1 < sent.sets && sent.frame[0] == (unsigned char)(sent.list + 1)) {
+		sent.list++;
+		sent.swaps++;
+		list = sent.lists[sent.list % 2];
+	}
+
+	memcpy(&frame_length, list + sent.position, sizeof(frame_length));
+	check(frame_length == sent.frame_length);
+	check(memcmp(sent.frame, list + sent.position + 4, sent.frame_length) == 0);
+
+	sent.position += 4 + frame_length;
+	if (sent.position >= sent.lengths[sent.list % 2]) {
+		sent.position = 0;
+		sent.repetitions++;
+	}
+}
+
+/* The card sends the descriptor it is at, or stops if it isn't its turn */
+static void card_step(void)
+{
+	struct dma_frame *frame = 0;
+	UINT32 control;
+
+	if (!card.running)
+		return;
+
+	frame = descriptors[card.address];
+	check(frame != 0);
+	if (!frame)
+		return;
+
+	control = frame->desc->control;
+	if (control & DESC_CSTOP_BIT) {
+		card.running = FALSE;
+		return;
+	}
+
+	if (control & DESC_FE_BIT) {
+		sent.frame_length = control & DMA_MAX_LENGTH;
+		sent.have = 0;
+	}
+
+	check(sent.have + frame->desc->data_count <= sent.frame_length);
+	memcpy(sent.frame + sent.have, frame->buffer, frame->desc->data_count);
+	sent.have += frame->desc->data_count;
+
+	if (sent.have == sent.frame_length)
+		check_frame();
+
+	frame->desc->control = control | DESC_CSTOP_BIT;
+	card.address = frame->desc->next_descriptor;
+}
+
+static NTSTATUS set_list(void)
+{
+	static unsigned char list[sizeof(sent.lists[0])];
+	UINT32 length;
+	NTSTATUS status;
+
+	length = make_list(list, sent.sets, 1 + rand() % 3, 600);
+
+	status = fscc_repeat_set(&port, list, length);
+	if (status == STATUS_SUCCESS) {
+		/* The card can still be on the one before, but not the one before that */
+		memcpy(sent.lists[sent.sets % 2], list, length);
+		sent.lengths[sent.sets++ % 2] = length;
+	}
+
+	return status;
+}
+
+static void test_loop(void)
+{
+	NTSTATUS status;
+	unsigned busy = 0;
+	UINT64 stalls = 0;
+	unsigned i, j;
+
+	memset(&port, 0, sizeof(port));
+	port.board_tx_spinlock = TX_LOCK;
+	port.memory.tx_num = 200;
+
+	for (i = 0; i < 40; i++) {
+		memset(&sent, 0, sizeof(sent));
+		memset(&card, 0, sizeof(card));
+		dpc_queued = FALSE;
+
+		port.memory.tx_size = 4 * (1 + rand() % 256);
+
+		check(set_list() == STATUS_SUCCESS);
+		check(card.running);
+
+		for (j = 0; j < 200000; j++) {
+			switch (rand() % 20) {
+			default: /* Mostly the card sending */
+				card_step();
+				break;
+
+			case 0:
+			case 1:
+			case 2: /* The interrupt after each copy, or the set's DPC */
+				dpc_queued = FALSE;
+				fscc_repeat_worker(NULL);
+				break;
+
+			case 3:
+				if (rand() % 64 == 0) {
+					status = set_list();
+					check(status == STATUS_SUCCESS || status == STATUS_DEVICE_BUSY);
+					if (status == STATUS_DEVICE_BUSY)
+						busy++;
+				}
+				break;
+			}
+		}
+
+		/* The last list set is sent too */
+		for (j = 0; j < 1000000 && sent.list + 1 < sent.sets; j++) {
+			card_step();
+
+			if (dpc_queued || !card.running) {
+				dpc_queued = FALSE;
+				fscc_repeat_worker(NULL);
+			}
+		}
+
+		check(sent.list + 1 == sent.sets);
+		check(sent.swaps == sent.sets - 1);
+		check(sent.repetitions > 0);
+		check(port.tx_repeats > 0);
+
+		fscc_repeat_clear(&port);
+		check(!card.running);
+		check(!fscc_repeat_running(&port));
+		check(allocations == 0);
+
+		stalls += port.tx_repeat_stalls;
+		port.tx_repeats = 0;
+		port.tx_repeat_stalls = 0;
+	}
+
+	/* Both kinds of set, and the card getting ahead of the worker, happened */
+	check(busy > 0);
+	check(stalls > 0);
+	check(!tx_held);
+}
+
+static void test_limits(void)
+{
+	static unsigned char list[256 * 200 + 1];
+	UINT32 frame_length;
+
+	memset(&port, 0, sizeof(port));
+	port.board_tx_spinlock = TX_LOCK;
+	port.memory.tx_size = 256;
+	port.memory.tx_num = 200;
+
+	/* No more than the tx descriptors could hold */
+	frame_length = sizeof(list) - 4;
+	memcpy(list, &frame_length, sizeof(frame_length));
+	check(fscc_repeat_set(&port, list, sizeof(list)) == STATUS_INVALID_PARAMETER);
+
+	frame_length = sizeof(list) - 5;
+	memcpy(list, &frame_length, sizeof(frame_length));
+	check(fscc_repeat_set(&port, list, sizeof(list) - 1) == STATUS_SUCCESS);
+
+	fscc_repeat_clear(&port);
+
+	check(allocations == 0);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_layout();
+	test_loop();
+	test_limits();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All TX repeat tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rxfilter.h"
+#include "port.h"
+
+/*
+	Host tests for the RX filter in src/rxfilter.c. Random address sets are
+	checked against a brute force search for the RAR/RAMR pair that matches
+	them, if there is one. Setting, changing, clearing and restarting a
+	filter then runs against fake registers, to check RAR and RAMR are only
+	touched under board_settings_spinlock and always get back the values
+	they had. Rejected frames at the front of the rx descriptors have to be
+	dropped and accepted ones kept. Last, fscc_filter_accepts and
+	fscc_filter_frames are timed and the frames a second each checks are
+	printed. fscc_filter_frames runs over the fake rx descriptors here, so
+	its rate includes them.
+
+	Built from the driver's own rxfilter.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/rx_filter_test.c src/rxfilter.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define SETTINGS_LOCK ((WDFSPINLOCK)1)
+#define RX_LOCK ((WDFSPINLOCK)2)
+
+#define BENCH_ADDRESSES 4096
+#define BENCH_ROUNDS 20000
+
+static struct fscc_port port;
+static BOOLEAN settings_held, rx_held;
+static UINT32 rar, ramr;
+static int register_writes;
+
+/* First bytes of the frames waiting in the rx descriptors */
+static unsigned char frames[64];
+static unsigned frame_count, next_frame;
+
+static BOOLEAN *lock_flag(WDFSPINLOCK SpinLock)
+{
+	return (SpinLock == SETTINGS_LOCK) ? &settings_held : &rx_held;
+}
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	check(!*lock_flag(SpinLock));
+	*lock_flag(SpinLock) = TRUE;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	check(*lock_flag(SpinLock));
+	*lock_flag(SpinLock) = FALSE;
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	return TRUE;
+}
+
+UINT32 fscc_port_get_register(struct fscc_port *port, unsigned bar, unsigned register_offset)
+{
+	check(bar == 0);
+	check(settings_held);
+
+	return (register_offset == RAR_OFFSET) ? rar : ramr;
+}
+
+NTSTATUS fscc_port_set_register(struct fscc_port *port, unsigned bar, unsigned register_offset, UINT32 value)
+{
+	check(bar == 0);
+	check(register_offset == RAR_OFFSET || register_offset == RAMR_OFFSET);
+	check(settings_held);
+
+	if (register_offset == RAR_OFFSET)
+		rar = value;
+	else
+		ramr = value;
+
+	register_writes++;
+
+	return STATUS_SUCCESS;
+}
+
+unsigned fscc_user_next_read_size(struct fscc_port *port, UINT32 *bytes)
+{
+	check(rx_held);
+
+	*bytes = (next_frame < frame_count) ? 1 : 0;
+
+	return next_frame < frame_count;
+}
+
+UINT32 fscc_user_peek_frame(struct fscc_port *port, unsigned char *buf, UINT32 length)
+{
+	check(next_frame < frame_count);
+
+	buf[0] = frames[next_frame];
+
+	return 1;
+}
+
+void fscc_user_discard_frame(struct fscc_port *port)
+{
+	check(next_frame < frame_count);
+
+	next_frame++;
+}
+
+static void add_address(struct fscc_rx_filter *filter, unsigned address)
+{
+	filter->addresses[address / 8] |= 1 << (address % 8);
+}
+
+static void add_group(struct fscc_rx_filter *filter, unsigned address, unsigned mask)
+{
+	unsigned i;
+
+	for (i = 0; i < 256; i++) {
+		if ((i & mask) == (address & mask))
+			add_address(filter, i);
+	}
+}
+
+static BOOLEAN is_group(const struct fscc_rx_filter *filter, unsigned address, unsigned mask)
+{
+	unsigned i;
+
+	for (i = 0; i < 256; i++) {
+		if (fscc_filter_accepts(filter, (unsigned char)i) != ((i & mask) == (address & mask)))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOLEAN any_group(const struct fscc_rx_filter *filter)
+{
+	unsigned first, mask;
+
+	for (first = 0; first < 256; first++) {
+		if (fscc_filter_accepts(filter, (unsigned char)first))
+			break;
+	}
+
+	if (first == 256)
+		return FALSE;
+
+	for (mask = 0; mask < 256; mask++) {
+		if (is_group(filter, first, mask))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void test_offload(void)
+{
+	struct fscc_rx_filter filter;
+	unsigned char address, mask;
+	unsigned i, j, k, lowest;
+	BOOLEAN offload;
+	int groups = 0;
+
+	for (i = 0; i < 20000; i++) {
+		memset(&filter, 0, sizeof(filter));
+
+		switch (i % 4) {
+		case 0: /* A few addresses anywhere */
+			for (j = rand() % 4; j < 4; j++)
+				add_address(&filter, rand() % 256);
+			break;
+
+		case 1: /* A group */
+			add_group(&filter, rand() % 256, rand() % 256);
+			break;
+
+		case 2: /* A group with one more or one less */
+			add_group(&filter, rand() % 256, rand() % 256);
+			k = rand() % 256;
+			filter.addresses[k / 8] ^= 1 << (k % 8);
+			break;
+
+		case 3: /* Anything */
+			for (j = 0; j < FSCC_RX_FILTER_BYTES; j++)
+				filter.addresses[j] = (unsigned char)rand();
+			break;
+		}
+
+		for (j = 0; j < 256; j++)
+			check(fscc_filter_accepts(&filter, (unsigned char)j) == ((filter.addresses[j / 8] >> (j % 8)) & 1));
+
+		offload = fscc_filter_offload(&filter, &address, &mask);
+		check(offload == any_group(&filter));
+
+		if (offload) {
+			for (lowest = 0; !fscc_filter_accepts(&filter, (unsigned char)lowest); lowest++)
+				;
+
+			check(is_group(&filter, address, mask));
+			check(address == lowest);
+			groups++;
+		}
+	}
+
+	/* Sanity check that the random sets weren't all one kind */
+	check(groups > 5000 && groups < 15000);
+
+	memset(&filter, 0, sizeof(filter));
+	check(!fscc_filter_offload(&filter, &address, &mask));
+
+	add_address(&filter, 0x7e);
+	check(fscc_filter_offload(&filter, &address, &mask) && address == 0x7e && mask == 0xff);
+
+	memset(&filter, 0xff, sizeof(filter));
+	check(fscc_filter_offload(&filter, &address, &mask) && address == 0 && mask == 0);
+}
+
+static void test_registers(void)
+{
+	struct fscc_rx_filter single, group, scattered, empty;
+
+	memset(&port, 0, sizeof(port));
+	port.board_settings_spinlock = SETTINGS_LOCK;
+	port.board_rx_spinlock = RX_LOCK;
+	port.rx_filter_saved_RAR = -1;
+	port.rx_filter_saved_RAMR = -1;
+
+	rar = 0x11;
+	ramr = 0x22;
+
+	memset(&single, 0, sizeof(single));
+	add_address(&single, 0x05);
+
+	memset(&group, 0, sizeof(group));
+	add_group(&group, 0x40, 0xf0);
+
+	memset(&scattered, 0, sizeof(scattered));
+	add_address(&scattered, 0x01);
+	add_address(&scattered, 0x80);
+	add_address(&scattered, 0x81);
+
+	memset(&empty, 0, sizeof(empty));
+	check(fscc_filter_set(&port, &empty) == STATUS_INVALID_PARAMETER);
+	check(!port.rx_filter_enabled);
+
+	check(fscc_filter_set(&port, &single) == STATUS_SUCCESS);
+	check(port.rx_filter_enabled);
+	check(rar == 0x05 && ramr == 0x00);
+
+	/* Changing it keeps the values from before the first one */
+	check(fscc_filter_set(&port, &group) == STATUS_SUCCESS);
+	check(rar == 0x40 && ramr == 0x0f);
+
+	/* RAR and RAMR can't hold this one, so they get their values back */
+	check(fscc_filter_set(&port, &scattered) == STATUS_SUCCESS);
+	check(rar == 0x11 && ramr == 0x22);
+
+	register_writes = 0;
+	fscc_filter_clear(&port);
+	check(register_writes == 0);
+	check(!port.rx_filter_enabled);
+
+	check(fscc_filter_set(&port, &group) == STATUS_SUCCESS);
+	check(rar == 0x40 && ramr == 0x0f);
+
+	/* Restarting the port writes the defaults, then the filter goes back on */
+	rar = 0x33;
+	ramr = 0x44;
+	fscc_filter_restart(&port);
+	check(rar == 0x40 && ramr == 0x0f);
+
+	fscc_filter_clear(&port);
+	check(rar == 0x33 && ramr == 0x44);
+
+	/* Without a filter a restart leaves them alone */
+	rar = 0x55;
+	register_writes = 0;
+	fscc_filter_restart(&port);
+	check(register_writes == 0);
+	check(rar == 0x55);
+
+	check(!settings_held && !rx_held);
+}
+
+static void test_frames(void)
+{
+	struct fscc_rx_filter filter;
+	unsigned i, j, expected;
+
+	memset(&filter, 0, sizeof(filter));
+	add_address(&filter, 0x10);
+	add_address(&filter, 0x20);
+
+	port.rx_filter_enabled = FALSE;
+	frame_count = 1;
+	next_frame = 0;
+	frames[0] = 0x30;
+
+	/* Nothing is dropped without a filter */
+	rx_held = TRUE;
+	fscc_filter_frames(&port);
+	rx_held = FALSE;
+	check(next_frame == 0);
+
+	check(fscc_filter_set(&port, &filter) == STATUS_SUCCESS);
+
+	for (i = 0; i < 1000; i++) {
+		frame_count = rand() % sizeof(frames);
+		next_frame = 0;
+
+		for (j = 0; j < frame_count; j++)
+			frames[j] = (rand() % 4) ? (unsigned char)rand() : ((rand() % 2) ? 0x10 : 0x20);
+
+		for (expected = 0; expected < frame_count; expected++) {
+			if (frames[expected] == 0x10 || frames[expected] == 0x20)
+				break;
+		}
+
+		port.rx_frames_filtered = 0;
+
+		rx_held = TRUE;
+		fscc_filter_frames(&port);
+		rx_held = FALSE;
+
+		check(next_frame == expected);
+		check(port.rx_frames_filtered == expected);
+	}
+
+	fscc_filter_clear(&port);
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void bench(void)
+{
+	static unsigned char addresses[BENCH_ADDRESSES];
+	struct fscc_rx_filter filter;
+	unsigned i, round, accepted = 0, expected = 0, dropped = 0;
+	double start, accepts_time, frames_time;
+
+	/* Too scattered for RAR and RAMR, so every frame is checked in software */
+	memset(&filter, 0, sizeof(filter));
+	add_address(&filter, 0x10);
+	add_address(&filter, 0x20);
+	add_address(&filter, 0x47);
+	add_address(&filter, 0xc3);
+
+	for (i = 0; i < BENCH_ADDRESSES; i++) {
+		addresses[i] = (unsigned char)rand();
+		expected += addresses[i] == 0x10 || addresses[i] == 0x20 ||
+			addresses[i] == 0x47 || addresses[i] == 0xc3;
+	}
+
+	start = seconds();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (i = 0; i < BENCH_ADDRESSES; i++)
+			accepted += fscc_filter_accepts(&filter, addresses[i]);
+	}
+	accepts_time = seconds() - start;
+
+	check(accepted == expected * BENCH_ROUNDS);
+
+	/* All but the last frame waiting are dropped */
+	check(fscc_filter_set(&port, &filter) == STATUS_SUCCESS);
+
+	for (i = 0; i < sizeof(frames) - 1; i++)
+		frames[i] = (unsigned char)(0x80 + i);
+	frames[sizeof(frames) - 1] = 0x47;
+	frame_count = sizeof(frames);
+
+	rx_held = TRUE;
+	start = seconds();
+	for (round = 0; round < BENCH_ROUNDS * 10; round++) {
+		next_frame = 0;
+		fscc_filter_frames(&port);
+		dropped += next_frame;
+	}
+	frames_time = seconds() - start;
+	rx_held = FALSE;
+
+	check(dropped == (sizeof(frames) - 1) * BENCH_ROUNDS * 10);
+
+	fscc_filter_clear(&port);
+
+	printf("fscc_filter_accepts: %.1f M frames/s\n",
+		(double)BENCH_ADDRESSES * BENCH_ROUNDS / accepts_time / 1e6);
+	printf("fscc_filter_frames:  %.1f M frames/s\n",
+		(double)sizeof(frames) * BENCH_ROUNDS * 10 / frames_time / 1e6);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_offload();
+	test_registers();
+	test_frames();
+	bench();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All RX filter tests passed\n");
+
+	return EXIT_SUCCESS;
+}
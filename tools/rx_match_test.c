@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "match.h"
+#include "port.h"
+#include "io.h"
+
+/*
+	Host tests for src/match.c, which hands each received frame to the read
+	of the handle whose FSCC_SET_RX_MATCH bytes it starts with.
+
+	Frames have to go to the first handle whose match they fit, frames no
+	match claims to the oldest read from a handle without one, and frames
+	nobody open would read have to be dropped and counted. A frame whose
+	handle has no read waiting must stay put, and reads canceled while the
+	unmatched reads are searched must not leak a reference. Last, the time
+	fscc_match_next_request takes a frame is printed for 1 to 256 handles
+	with one address each.
+
+	Built from the driver's own match.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/rx_match_test.c src/match.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define STATUS_BYTES 2
+#define MAX_FILES 256
+#define MAX_FRAMES 64
+#define MAX_REQUESTS 1024
+
+struct fake_request {
+	WDFFILEOBJECT file_object;
+	int references;
+};
+
+struct frame {
+	unsigned char data[16];
+	UINT32 length; /* With the status bytes */
+};
+
+/* Made to look like a second address byte, which must never be matched */
+static const unsigned char rx_status[STATUS_BYTES] = { 0x01, 0x00 };
+
+static struct fscc_port port;
+static FSCC_FILE files[MAX_FILES];
+
+/* read_queue2, oldest first */
+static struct fake_request *queue[MAX_REQUESTS];
+static unsigned queued;
+
+static struct frame frames[MAX_FRAMES];
+static unsigned frame_head, frame_count;
+
+static BOOLEAN lock_held;
+static unsigned dpcs;
+
+/* Makes the request at this position look canceled to the next search */
+static int cancel_at = -1;
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	UNREFERENCED_PARAMETER(SpinLock);
+	check(!lock_held);
+	lock_held = TRUE;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	UNREFERENCED_PARAMETER(SpinLock);
+	check(lock_held);
+	lock_held = FALSE;
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	UNREFERENCED_PARAMETER(Dpc);
+	dpcs++;
+
+	return TRUE;
+}
+
+FSCC_FILE *WdfObjectGet_FSCC_FILE(WDFOBJECT handle)
+{
+	return (FSCC_FILE *)handle;
+}
+
+void WdfObjectDereference(WDFOBJECT Handle)
+{
+	struct fake_request *request = (struct fake_request *)Handle;
+
+	check(request->references > 0);
+	request->references--;
+}
+
+WDFFILEOBJECT WdfRequestGetFileObject(WDFREQUEST Request)
+{
+	return ((struct fake_request *)Request)->file_object;
+}
+
+static void unqueue(unsigned i)
+{
+	memmove(&queue[i], &queue[i + 1], (queued - i - 1) * sizeof(queue[0]));
+	queued--;
+}
+
+static int position(WDFREQUEST Request)
+{
+	unsigned i;
+
+	for (i = 0; i < queued; i++) {
+		if ((WDFREQUEST)queue[i] == Request)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+NTSTATUS WdfIoQueueFindRequest(WDFQUEUE Queue, WDFREQUEST TagRequest, WDFFILEOBJECT FileObject, PWDF_REQUEST_PARAMETERS Parameters, WDFREQUEST *OutRequest)
+{
+	int next = 0;
+
+	UNREFERENCED_PARAMETER(Parameters);
+	check(Queue == port.read_queue2);
+	check(FileObject == NULL);
+	check(lock_held);
+
+	if (TagRequest) {
+		next = position(TagRequest);
+		if (next == cancel_at) {
+			cancel_at = -1;
+			unqueue((unsigned)next);
+			return STATUS_NOT_FOUND;
+		}
+		check(next >= 0);
+		next++;
+	}
+
+	if (next >= (int)queued)
+		return STATUS_NO_MORE_ENTRIES;
+
+	queue[next]->references++;
+	*OutRequest = (WDFREQUEST)queue[next];
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoQueueRetrieveFoundRequest(WDFQUEUE Queue, WDFREQUEST FoundRequest, WDFREQUEST *OutRequest)
+{
+	int i = position(FoundRequest);
+
+	check(Queue == port.read_queue2);
+
+	if (i < 0)
+		return STATUS_NOT_FOUND;
+
+	unqueue((unsigned)i);
+	*OutRequest = FoundRequest;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoQueueRetrieveRequestByFileObject(WDFQUEUE Queue, WDFFILEOBJECT FileObject, WDFREQUEST *OutRequest)
+{
+	unsigned i;
+
+	check(Queue == port.read_queue2);
+
+	for (i = 0; i < queued; i++) {
+		if (queue[i]->file_object == FileObject) {
+			*OutRequest = (WDFREQUEST)queue[i];
+			unqueue(i);
+			return STATUS_SUCCESS;
+		}
+	}
+
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+UINT32 fscc_user_next_read_size(struct fscc_port *port, UINT32 *bytes)
+{
+	UNREFERENCED_PARAMETER(port);
+	check(lock_held);
+
+	*bytes = frame_count ? frames[frame_head].length : 0;
+
+	return frame_count != 0;
+}
+
+UINT32 fscc_user_peek_frame(struct fscc_port *port, unsigned char *buf, UINT32 length)
+{
+	UNREFERENCED_PARAMETER(port);
+	check(frame_count);
+
+	length = min(length, frames[frame_head].length);
+	memcpy(buf, frames[frame_head].data, length);
+
+	return length;
+}
+
+void fscc_user_discard_frame(struct fscc_port *port)
+{
+	UNREFERENCED_PARAMETER(port);
+	check(frame_count);
+
+	frame_head = (frame_head + 1) % MAX_FRAMES;
+	frame_count--;
+}
+
+static void setup(unsigned open_files)
+{
+	unsigned i;
+
+	memset(&port, 0, sizeof(port));
+	port.read_queue2 = (WDFQUEUE)&queue;
+	InitializeListHead(&port.rx_matches);
+	port.open_counter = open_files;
+
+	for (i = 0; i < MAX_FILES; i++)
+		fscc_match_init((WDFFILEOBJECT)&files[i]);
+
+	queued = 0;
+	frame_head = frame_count = 0;
+}
+
+static void receive(const unsigned char *data, UINT32 length)
+{
+	struct frame *frame = &frames[(frame_head + frame_count++) % MAX_FRAMES];
+
+	memcpy(frame->data, data, length);
+	memcpy(frame->data + length, rx_status, STATUS_BYTES);
+	frame->length = length + STATUS_BYTES;
+}
+
+static void receive_address(unsigned char address)
+{
+	unsigned char data[4] = { address, 0x03, 0xaa, 0x55 };
+
+	receive(data, sizeof(data));
+}
+
+static void post_read(struct fake_request *request, unsigned file)
+{
+	request->file_object = (WDFFILEOBJECT)&files[file];
+	queue[queued++] = request;
+}
+
+static NTSTATUS set_address(unsigned file, unsigned char address, unsigned char mask)
+{
+	struct fscc_rx_match match;
+
+	memset(&match, 0, sizeof(match));
+	match.length = 1;
+	match.value[0] = address;
+	match.mask[0] = mask;
+
+	return fscc_match_set(&port, (WDFFILEOBJECT)&files[file], &match);
+}
+
+/* The handle the next frame went to, or -1 */
+static int next_file(void)
+{
+	WDFREQUEST request = 0;
+	NTSTATUS status;
+
+	status = fscc_match_next_request(&port, &request);
+	check(!lock_held);
+
+	if (!NT_SUCCESS(status)) {
+		check(status == STATUS_NO_MORE_ENTRIES);
+		return -1;
+	}
+
+	/* Like FsccProcessRead, which reads the frame into the request */
+	fscc_user_discard_frame(&port);
+
+	return (int)((FSCC_FILE *)WdfRequestGetFileObject(request) - files);
+}
+
+static void test_set(void)
+{
+	struct fscc_rx_match match;
+
+	setup(2);
+
+	memset(&match, 0, sizeof(match));
+	check(fscc_match_set(&port, (WDFFILEOBJECT)&files[0], &match) == STATUS_INVALID_PARAMETER);
+	match.length = FSCC_RX_MATCH_BYTES + 1;
+	check(fscc_match_set(&port, (WDFFILEOBJECT)&files[0], &match) == STATUS_INVALID_PARAMETER);
+	check(port.rx_match_count == 0);
+
+	dpcs = 0;
+	check(set_address(0, 0x10, 0xff) == STATUS_SUCCESS);
+	check(port.rx_match_count == 1 && dpcs == 1);
+
+	/* Setting it again replaces it */
+	check(set_address(0, 0x20, 0xff) == STATUS_SUCCESS);
+	check(port.rx_match_count == 1);
+	fscc_match_get(&port, (WDFFILEOBJECT)&files[0], &match);
+	check(match.length == 1 && match.value[0] == 0x20);
+
+	fscc_match_clear(&port, (WDFFILEOBJECT)&files[0]);
+	check(port.rx_match_count == 0 && IsListEmpty(&port.rx_matches));
+	fscc_match_get(&port, (WDFFILEOBJECT)&files[0], &match);
+	check(match.length == 0);
+
+	/* Clearing nothing does nothing */
+	dpcs = 0;
+	fscc_match_clear(&port, (WDFFILEOBJECT)&files[0]);
+	check(port.rx_match_count == 0 && dpcs == 0);
+}
+
+static void test_routing(void)
+{
+	struct fake_request reads[8];
+	unsigned char two[2] = { 0x30, 0x01 };
+
+	memset(reads, 0, sizeof(reads));
+	setup(4);
+
+	check(set_address(0, 0x10, 0xff) == STATUS_SUCCESS);
+	check(set_address(1, 0x20, 0xf0) == STATUS_SUCCESS);
+	check(set_address(2, 0x21, 0xff) == STATUS_SUCCESS); /* Behind 1, which also fits */
+
+	/* File 3 has no match, its read is first in the queue */
+	post_read(&reads[0], 3);
+	post_read(&reads[1], 0);
+	post_read(&reads[2], 1);
+	post_read(&reads[3], 2);
+
+	receive_address(0x21);
+	receive_address(0x10);
+	receive_address(0x99);
+	check(next_file() == 1);
+	check(next_file() == 0);
+	check(next_file() == 3);
+
+	/* File 2's match only wins once file 1's is gone */
+	fscc_match_clear(&port, (WDFFILEOBJECT)&files[1]);
+	receive_address(0x21);
+	check(next_file() == 2);
+
+	/* Too short to match without the status bytes, so it's unmatched */
+	post_read(&reads[4], 3);
+	memset(&files[0].match, 0, sizeof(files[0].match));
+	files[0].match.length = 2;
+	files[0].match.value[0] = 0x30;
+	files[0].match.value[1] = 0x01;
+	files[0].match.mask[0] = files[0].match.mask[1] = 0xff;
+	receive(two, 1);
+	check(next_file() == 3);
+
+	receive(two, 2);
+	post_read(&reads[5], 0);
+	check(next_file() == 0);
+
+	check(frame_count == 0 && port.rx_frames_unclaimed == 0);
+}
+
+static void test_waiting(void)
+{
+	struct fake_request reads[4];
+
+	memset(reads, 0, sizeof(reads));
+	setup(2);
+
+	check(set_address(0, 0x10, 0xff) == STATUS_SUCCESS);
+
+	/* File 0 has no read yet, so the frame waits for one */
+	post_read(&reads[0], 1);
+	receive_address(0x10);
+	check(next_file() == -1);
+	check(frame_count == 1 && queued == 1);
+
+	post_read(&reads[1], 0);
+	check(next_file() == 0);
+
+	/* Same for the unmatched handle */
+	receive_address(0x55);
+	check(next_file() == 1);
+	receive_address(0x55);
+	check(next_file() == -1);
+	check(frame_count == 1);
+
+	/* Once it closes, nobody would ever read that frame */
+	port.open_counter = 1;
+	receive_address(0x10);
+	post_read(&reads[2], 0);
+	check(next_file() == 0);
+	check(port.rx_frames_unclaimed == 1);
+	check(frame_count == 0);
+}
+
+static void test_cancel(void)
+{
+	struct fake_request reads[6];
+	unsigned i;
+
+	memset(reads, 0, sizeof(reads));
+	setup(3);
+
+	check(set_address(0, 0x10, 0xff) == STATUS_SUCCESS);
+	check(set_address(1, 0x20, 0xff) == STATUS_SUCCESS);
+
+	/* Reads from matched handles ahead of the unmatched one */
+	post_read(&reads[0], 0);
+	post_read(&reads[1], 1);
+	post_read(&reads[2], 0);
+	post_read(&reads[3], 2);
+
+	/* The second read is canceled while the search holds it */
+	cancel_at = 1;
+	receive_address(0x77);
+	check(next_file() == 2);
+	check(cancel_at == -1);
+
+	for (i = 0; i < 4; i++)
+		check(reads[i].references == 0);
+	check(queued == 2);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+	Every handle always has a read waiting, and frames are spread evenly
+	over their addresses, so on average half the matches are tried.
+*/
+static void benchmark(void)
+{
+	static const unsigned counts[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+	static struct fake_request reads[MAX_FILES];
+	const unsigned count = 2000000;
+	WDFREQUEST request = 0;
+	unsigned c, i, n;
+	double elapsed;
+
+	printf("%8s %12s %14s\n", "handles", "ns/frame", "frames/s");
+
+	for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		n = counts[c];
+		setup(n);
+
+		for (i = 0; i < n; i++)
+			set_address(i, (unsigned char)i, 0xff);
+
+		elapsed = seconds();
+		for (i = 0; i < count; i++) {
+			receive_address((unsigned char)(i % n));
+			post_read(&reads[i % n], i % n);
+
+			if (fscc_match_next_request(&port, &request) != STATUS_SUCCESS ||
+				request != (WDFREQUEST)&reads[i % n]) {
+				check(!"frame went to the wrong read");
+				break;
+			}
+
+			fscc_user_discard_frame(&port);
+		}
+		elapsed = seconds() - elapsed;
+
+		printf("%8u %12.1f %14.0f\n", n, elapsed * 1e9 / count, count / elapsed);
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_set();
+	test_routing();
+	test_waiting();
+	test_cancel();
+	benchmark();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All rx match tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ring.h"
+#include "port.h"
+#include "io.h"
+
+/*
+	Host tests for the rx ring in src/ring.c and src/ringlayout.h.
+
+	Mapping has to refuse rings that are the wrong size or already mapped.
+	Then fscc_ring_fill_rx runs on one thread, moving frames or a stream
+	from a fake card into the ring, while a reference consumer built on
+	fscc_ring_next reads them back on another. Every frame has to come out
+	once, whole and in order, across every wrap of the ring and of the 32
+	bit indices. A tail the application broke has to be left alone. Last,
+	the records a second the two threads get through are printed.
+
+	Built from the driver's own ring.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/rx_ring_test.c src/ring.c -lpthread && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define RING_LOCK ((WDFSPINLOCK)1)
+#define RX_LOCK ((WDFSPINLOCK)2)
+#define RING_QUEUE ((WDFQUEUE)1)
+#define WAIT_QUEUE ((WDFQUEUE)2)
+#define FILE_OBJECT ((WDFFILEOBJECT)1)
+
+#define MAX_FRAME 1024
+
+static struct fscc_port port;
+static BOOLEAN ring_held, rx_held;
+
+/* The request WdfRequestRetrieveOutputBuffer hands back the buffer of */
+static void *request_buffer;
+static size_t request_length;
+static NTSTATUS completed_status;
+static int completed;
+
+/* The fake card, only used by the producer thread */
+static BOOLEAN streaming;
+static UINT32 frames_left;
+static UINT32 card_frame, card_offset, card_length;
+
+static BOOLEAN *lock_flag(WDFSPINLOCK SpinLock)
+{
+	return (SpinLock == RING_LOCK) ? &ring_held : &rx_held;
+}
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	check(!*lock_flag(SpinLock));
+	*lock_flag(SpinLock) = TRUE;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	check(*lock_flag(SpinLock));
+	*lock_flag(SpinLock) = FALSE;
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	return TRUE;
+}
+
+void WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+	completed_status = Status;
+	completed++;
+}
+
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+	if (request_length < MinimumRequiredSize)
+		return STATUS_BUFFER_TOO_SMALL;
+
+	*Buffer = request_buffer;
+	*Length = request_length;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue)
+{
+	check(DestinationQueue == RING_QUEUE);
+
+	return STATUS_SUCCESS;
+}
+
+WDFFILEOBJECT WdfRequestGetFileObject(WDFREQUEST Request)
+{
+	return FILE_OBJECT;
+}
+
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest)
+{
+	check(Queue == WAIT_QUEUE);
+
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+NTSTATUS WdfIoQueueRetrieveFoundRequest(WDFQUEUE Queue, WDFREQUEST FoundRequest, WDFREQUEST *OutRequest)
+{
+	*OutRequest = FoundRequest;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoQueueRetrieveRequestByFileObject(WDFQUEUE Queue, WDFFILEOBJECT FileObject, WDFREQUEST *OutRequest)
+{
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue)
+{
+	return 0;
+}
+
+FSCC_PORT *WdfObjectGet_FSCC_PORT(WDFOBJECT handle)
+{
+	return &port;
+}
+
+void fscc_port_start_rx_poll(struct fscc_port *port)
+{
+}
+
+void fscc_port_start_timer(struct fscc_port *port)
+{
+}
+
+BOOLEAN fscc_repeat_running(struct fscc_port *port)
+{
+	return FALSE;
+}
+
+void fscc_filter_frames(struct fscc_port *port)
+{
+	check(rx_held);
+}
+
+unsigned fscc_io_is_streaming(struct fscc_port *port)
+{
+	return streaming;
+}
+
+/* Only the tx ring uses these */
+size_t fscc_user_get_tx_space(struct fscc_port *port)
+{
+	check(0);
+	return 0;
+}
+
+BOOLEAN fscc_pacer_ready(struct fscc_port *port, UINT32 length)
+{
+	check(0);
+	return FALSE;
+}
+
+void fscc_pacer_charge(struct fscc_port *port, UINT32 length)
+{
+	check(0);
+}
+
+unsigned fscc_port_clock_timed_out(struct fscc_port *port)
+{
+	check(0);
+	return 0;
+}
+
+BOOLEAN fscc_port_uses_dma(struct fscc_port *port)
+{
+	check(0);
+	return 0;
+}
+
+int fscc_user_write_frame(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	check(0);
+	return STATUS_UNSUCCESSFUL;
+}
+
+static unsigned char frame_byte(UINT32 frame, UINT32 i)
+{
+	return (unsigned char)((frame * 31 + i) * 2654435761u >> 11);
+}
+
+static UINT32 frame_length(UINT32 frame)
+{
+	/* Mostly short, sometimes up to MAX_FRAME */
+	UINT32 mix = frame * 2654435761u;
+
+	return 1 + ((mix >> 8) % ((mix & 0x30) ? 64 : MAX_FRAME));
+}
+
+static void next_card_frame(void)
+{
+	if (frames_left)
+		frames_left--;
+
+	card_frame++;
+	card_length = frame_length(card_frame);
+}
+
+unsigned fscc_user_next_read_size(struct fscc_port *port, UINT32 *bytes)
+{
+	check(rx_held);
+
+	if (!frames_left) {
+		*bytes = 0;
+		return 0;
+	}
+
+	*bytes = (streaming) ? card_length - card_offset : card_length;
+
+	return 1;
+}
+
+int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	UINT32 i;
+
+	*out_length = 0;
+
+	check(!streaming);
+	check(frames_left);
+
+	/* fscc_ring_fill_rx makes room for the timestamp too */
+	if (buf_length < card_length + sizeof(fscc_timestamp)) {
+		check(0);
+		return STATUS_BUFFER_TOO_SMALL;
+	}
+
+	for (i = 0; i < card_length; i++)
+		buf[i] = frame_byte(card_frame, i);
+
+	*out_length = card_length;
+	next_card_frame();
+
+	return STATUS_SUCCESS;
+}
+
+/* The stream is the frames one after another */
+int fscc_user_read_stream(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	check(streaming);
+
+	*out_length = 0;
+
+	while (*out_length < buf_length && frames_left) {
+		buf[(*out_length)++] = frame_byte(card_frame, card_offset++);
+
+		if (card_offset == card_length) {
+			card_offset = 0;
+			next_card_frame();
+		}
+	}
+
+	return STATUS_SUCCESS;
+}
+
+static void setup(void)
+{
+	memset(&port, 0, sizeof(port));
+	port.ring_spinlock = RING_LOCK;
+	port.board_rx_spinlock = RX_LOCK;
+	port.ring_queue = RING_QUEUE;
+	port.rx_ring.wait_queue = WAIT_QUEUE;
+	port.memory.rx_num = 4;
+	port.memory.rx_size = 256;
+}
+
+static struct fscc_ring *new_ring(UINT32 size)
+{
+	struct fscc_ring *ring = calloc(1, sizeof(*ring) + size);
+
+	ring->size = size;
+
+	return ring;
+}
+
+static void map(struct fscc_ring *ring, size_t length)
+{
+	request_buffer = ring;
+	request_length = length;
+	completed = 0;
+
+	fscc_ring_map_rx(&port, (WDFREQUEST)1);
+}
+
+static void test_map(void)
+{
+	/* 4 descriptors of 256 bytes, a timestamp and a record */
+	UINT32 smallest = 2048;
+	struct fscc_ring *ring = new_ring(smallest * 4);
+
+	setup();
+
+	ring->size = smallest - 8;
+	map(ring, sizeof(*ring) + smallest * 4);
+	check(completed == 1 && completed_status == STATUS_INVALID_PARAMETER);
+
+	ring->size = smallest / 2;
+	map(ring, sizeof(*ring) + smallest * 4);
+	check(completed == 1 && completed_status == STATUS_INVALID_PARAMETER);
+
+	ring->size = smallest * 4;
+	map(ring, sizeof(*ring) + smallest * 2);
+	check(completed == 1 && completed_status == STATUS_INVALID_PARAMETER);
+
+	ring->size = 0;
+	map(ring, sizeof(*ring) + smallest * 4);
+	check(completed == 1 && completed_status == STATUS_INVALID_PARAMETER);
+
+	map(ring, sizeof(*ring) - 1);
+	check(completed == 1 && completed_status == STATUS_BUFFER_TOO_SMALL);
+	check(!fscc_ring_rx_mapped(&port));
+
+	ring->size = smallest;
+	ring->head = 123;
+	ring->tail = 456;
+	map(ring, sizeof(*ring) + smallest);
+	check(completed == 0);
+	check(fscc_ring_rx_mapped(&port));
+	check(ring->head == 0 && ring->tail == 0);
+
+	map(ring, sizeof(*ring) + smallest);
+	check(completed == 1 && completed_status == STATUS_DEVICE_BUSY);
+
+	completed = 0;
+	check(fscc_ring_unmap_rx(&port) == STATUS_SUCCESS);
+	check(completed == 1 && completed_status == STATUS_SUCCESS);
+	check(!fscc_ring_rx_mapped(&port));
+	check(fscc_ring_unmap_rx(&port) == STATUS_INVALID_DEVICE_STATE);
+
+	/* Nothing to fill without a ring */
+	check(fscc_ring_fill_rx(&port) == 0);
+
+	check(!ring_held && !rx_held);
+
+	free(ring);
+}
+
+static void start_ring(struct fscc_ring *ring, UINT32 start)
+{
+	port.rx_ring.ring = ring;
+	port.rx_ring.size = ring->size;
+	port.rx_ring.index = start;
+	ring->head = start;
+	ring->tail = start;
+}
+
+static void test_broken_tail(void)
+{
+	struct fscc_ring *ring = new_ring(4096);
+	UINT32 head;
+
+	setup();
+	start_ring(ring, 0);
+
+	streaming = FALSE;
+	frames_left = 1000;
+	card_frame = 0;
+	card_length = frame_length(0);
+
+	check(fscc_ring_fill_rx(&port) == 1);
+	head = ring->head;
+	check(head != 0);
+
+	/* A tail past the head, or too far behind it, stops the driver */
+	ring->tail = head + 8;
+	check(fscc_ring_fill_rx(&port) == 1);
+	check(ring->head == head);
+
+	ring->tail = head - 4096 - 8;
+	check(fscc_ring_fill_rx(&port) == 1);
+	check(ring->head == head);
+
+	check(!ring_held && !rx_held);
+
+	free(ring);
+}
+
+/* Rings a producer broke, which fscc_ring_next has to refuse */
+static void test_broken_ring(void)
+{
+	struct fscc_ring *ring = new_ring(256);
+	unsigned char *data = FSCC_RING_DATA(ring);
+	struct fscc_ring_record *record = 0;
+	struct fscc_ring_record *first = (struct fscc_ring_record *)(data + 192);
+	UINT32 tail = 192, length = 0;
+
+	/* Fine: a pad record to the end, then 16 bytes at the start */
+	first->length = 64 - sizeof(*first);
+	first->flags = FSCC_RING_PAD;
+	((struct fscc_ring_record *)data)->length = 16;
+	((struct fscc_ring_record *)data)->flags = 0;
+	check(fscc_ring_next(data, 256, 192 + 64 + 24, &tail, &record, &length) == 1);
+	check(tail == 256 && record == (struct fscc_ring_record *)data && length == 16);
+
+	/* The same record without the whole of it covered by head */
+	tail = 192;
+	check(fscc_ring_next(data, 256, 192 + 64 + 16, &tail, &record, &length) == -1);
+
+	/* A pad record head doesn't get past */
+	tail = 192;
+	check(fscc_ring_next(data, 256, 192 + 32, &tail, &record, &length) == -1);
+	check(tail == 192);
+
+	/* Head ahead by more than the ring, or by less than a record */
+	tail = 0;
+	check(fscc_ring_next(data, 256, 257, &tail, &record, &length) == -1);
+	check(fscc_ring_next(data, 256, 4, &tail, &record, &length) == -1);
+	check(fscc_ring_next(data, 256, 0, &tail, &record, &length) == 0);
+
+	/* Empty records, and records running past the end */
+	first->flags = 0;
+	first->length = 0;
+	tail = 192;
+	check(fscc_ring_next(data, 256, 192 + 64, &tail, &record, &length) == -1);
+
+	first->length = 64 - sizeof(*first) + 1;
+	check(fscc_ring_next(data, 256, 192 + 64 + 8, &tail, &record, &length) == -1);
+
+	first->length = 64 - sizeof(*first);
+	check(fscc_ring_next(data, 256, 192 + 64, &tail, &record, &length) == 1);
+	check(tail == 192 && record == first && length == 56);
+
+	free(ring);
+}
+
+/* The reference consumer, what an application would do */
+struct consumer {
+	struct fscc_ring *ring;
+	UINT32 tail;
+	UINT32 frame; /* Next frame expected, and how far into it for a stream */
+	UINT32 offset;
+	UINT32 frames; /* Left to read */
+	UINT32 records;
+	UINT64 bytes;
+	BOOLEAN in_order;
+	BOOLEAN broken;
+	volatile BOOLEAN done;
+};
+
+static void start_consumer(struct consumer *consumer, struct fscc_ring *ring, UINT32 frames)
+{
+	memset(consumer, 0, sizeof(*consumer));
+	consumer->ring = ring;
+	consumer->tail = ring->tail;
+	consumer->frame = 1;
+	consumer->frames = frames;
+	consumer->in_order = TRUE;
+}
+
+/* Reads one record, returning what fscc_ring_next did */
+static int consume_record(struct consumer *consumer)
+{
+	struct fscc_ring *ring = consumer->ring;
+	struct fscc_ring_record *record = 0;
+	UINT32 head = 0, length = 0, i;
+	int result;
+
+	head = ring->head;
+	__sync_synchronize();
+
+	result = fscc_ring_next(FSCC_RING_DATA(ring), ring->size, head,
+		&consumer->tail, &record, &length);
+	if (result < 0)
+		consumer->broken = TRUE;
+
+	if (result <= 0) {
+		/* Any pad record skipped is given back */
+		ring->tail = consumer->tail;
+		return result;
+	}
+
+	/* A frame a record, or the frames one after another for a stream */
+	if (!streaming && length != frame_length(consumer->frame))
+		consumer->in_order = FALSE;
+
+	for (i = 0; i < length && consumer->in_order; i++) {
+		if (((unsigned char *)(record + 1))[i] != frame_byte(consumer->frame, consumer->offset))
+			consumer->in_order = FALSE;
+
+		if (++consumer->offset == frame_length(consumer->frame)) {
+			consumer->offset = 0;
+			consumer->frame++;
+			consumer->frames--;
+		}
+	}
+
+	consumer->records++;
+	consumer->bytes += length;
+
+	/* Done with the record before the space is given back */
+	__sync_synchronize();
+	consumer->tail += FSCC_RING_RECORD_SIZE(length);
+	ring->tail = consumer->tail;
+
+	return result;
+}
+
+static void *consume(void *context)
+{
+	struct consumer *consumer = context;
+
+	while (consumer->frames && consumer->in_order && !consumer->broken) {
+		if (consume_record(consumer) == 0)
+			sched_yield();
+	}
+
+	consumer->done = TRUE;
+
+	return 0;
+}
+
+static void start_card(BOOLEAN stream, UINT32 frames)
+{
+	streaming = stream;
+	frames_left = frames;
+	card_frame = 1;
+	card_offset = 0;
+	card_length = frame_length(1);
+}
+
+/*
+	One thread, with the consumer reading a few records at a time, so the
+	ring is often full and the producer has to stop at every kind of
+	boundary.
+*/
+static void test_full(BOOLEAN stream, UINT32 size, UINT32 start)
+{
+	struct consumer consumer;
+	struct fscc_ring *ring = new_ring(size);
+	UINT32 head, tail, i, count;
+	unsigned stalls = 0;
+
+	setup();
+	start_ring(ring, start);
+	start_card(stream, 20000);
+	start_consumer(&consumer, ring, 20000);
+
+	/* Stops if neither side gets anywhere, which would be a deadlock */
+	while (consumer.frames && consumer.in_order && !consumer.broken && stalls < 100) {
+		head = ring->head;
+		tail = ring->tail;
+
+		check(fscc_ring_fill_rx(&port) == 1);
+		check(ring->head - ring->tail <= size);
+
+		count = rand() % 8;
+		for (i = 0; i < count; i++) {
+			if (consume_record(&consumer) == 0)
+				break;
+		}
+
+		stalls = (ring->head == head && ring->tail == tail) ? stalls + 1 : 0;
+	}
+
+	check(consumer.frames == 0);
+	check(consumer.in_order);
+	check(!consumer.broken);
+	check(!ring_held && !rx_held);
+
+	free(ring);
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* fscc_ring_fill_rx and the consumer on their own threads */
+static void test_threads(BOOLEAN stream, UINT32 size, UINT32 start, UINT32 frames)
+{
+	struct consumer consumer;
+	struct fscc_ring *ring = new_ring(size);
+	pthread_t thread;
+	double elapsed;
+
+	setup();
+	start_ring(ring, start);
+	start_card(stream, frames);
+	start_consumer(&consumer, ring, frames);
+
+	elapsed = seconds();
+	pthread_create(&thread, NULL, consume, &consumer);
+
+	while (frames_left && !consumer.done) {
+		check(fscc_ring_fill_rx(&port) == 1);
+
+		if (ring->head - ring->tail > size / 2)
+			sched_yield();
+	}
+
+	pthread_join(thread, NULL);
+	elapsed = seconds() - elapsed;
+
+	check(consumer.in_order);
+	check(!consumer.broken);
+	check(consumer.frames == 0);
+	check(ring->head == ring->tail);
+	check(!ring_held && !rx_held);
+
+	/* Sanity check that the indices went around */
+	check((UINT32)(ring->head - start) > size);
+
+	printf("%s, %u byte ring: %u records, %.0f records and %.1f MB a second\n",
+		stream ? "Stream" : "Frames", size, consumer.records,
+		consumer.records / elapsed, consumer.bytes / elapsed / 1e6);
+
+	free(ring);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_map();
+	test_broken_tail();
+	test_broken_ring();
+	test_full(FALSE, 2048, 0xfffff800);
+	test_full(FALSE, 4096, 0);
+	test_full(TRUE, 64, 0xffffffc0);
+	test_full(TRUE, 4096, 0);
+	test_threads(FALSE, 4096, 0, 200000);
+	test_threads(FALSE, 1 << 16, 0xfffff000, 1000000);
+	test_threads(TRUE, 4096, 0xffffff00, 200000);
+	test_threads(TRUE, 1 << 20, 0, 400000);
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All rx ring tests passed\n");
+
+	return EXIT_SUCCESS;
+}
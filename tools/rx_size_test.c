@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "port.h"
+#include "io.h"
+#include "config.h"
+
+/*
+	Host tests for src/rxsize.c, which counts received frame sizes and
+	suggests the RxSize and RxNum that FSCC_GET_STATS reports.
+
+	Frames have to land in the power of two bucket that holds them. The
+	hint has to be the smallest size from 64 to 4096 bytes that holds 90%
+	of the frames in one descriptor, keep the same total memory and never
+	suggest fewer than 16 buffers. Last, a few frame size mixes are run
+	through the default memory and then through the memory it suggests,
+	and the descriptors a frame and buffer space used are printed for both.
+
+	Built from the driver's own rxsize.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/rx_size_test.c src/rxsize.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define STATUS_BYTES 2 /* Counted in each frame's size, like the card's */
+#define MIX_FRAMES 100000
+
+struct mix {
+	const char *name;
+	UINT32 (*size)(void);
+};
+
+static void reset(struct fscc_port *port, UINT32 rx_num, UINT32 rx_size)
+{
+	memset(port, 0, sizeof(*port));
+	port->memory.rx_num = rx_num;
+	port->memory.rx_size = rx_size;
+}
+
+static UINT32 descriptors(struct fscc_port *port, UINT32 size)
+{
+	return (size + port->memory.rx_size - 1) / port->memory.rx_size;
+}
+
+static void receive(struct fscc_port *port, UINT32 size)
+{
+	fscc_io_count_rx_frame(port, size, descriptors(port, size));
+}
+
+static void hint(struct fscc_port *port, struct fscc_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->rx_frames = port->rx_frames;
+	memcpy(stats->rx_frame_sizes, port->rx_frame_sizes, sizeof(stats->rx_frame_sizes));
+
+	fscc_port_get_rx_size_hint(port, stats);
+}
+
+static UINT32 uniform(UINT32 low, UINT32 high)
+{
+	return low + (UINT32)rand() % (high - low + 1);
+}
+
+static UINT32 tiny(void)
+{
+	return uniform(16, 64);
+}
+
+/* 7:4:1 of 64, 594 and 1518 bytes */
+static UINT32 imix(void)
+{
+	UINT32 pick = (UINT32)rand() % 12;
+
+	return pick < 7 ? 64 : pick < 11 ? 594 : 1518;
+}
+
+static UINT32 large(void)
+{
+	return uniform(1024, 4096);
+}
+
+/* Mostly small polls, now and then a large reply */
+static UINT32 polled(void)
+{
+	return rand() % 10 ? 32 : 2048;
+}
+
+static UINT32 ethernet(void)
+{
+	return uniform(64, 1518);
+}
+
+static UINT32 jumbo(void)
+{
+	return uniform(6000, 9000);
+}
+
+static const struct mix mixes[] = {
+	{ "16-64 B", tiny },
+	{ "IMIX", imix },
+	{ "64-1518 B", ethernet },
+	{ "1-4 KB", large },
+	{ "9:1 32 B/2 KB", polled },
+	{ "6-9 KB", jumbo },
+};
+
+static void test_buckets(void)
+{
+	struct fscc_port port;
+
+	reset(&port, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+
+	receive(&port, 1);
+	receive(&port, 16);
+	check(port.rx_frame_sizes[0] == 2);
+
+	receive(&port, 17);
+	receive(&port, 32);
+	check(port.rx_frame_sizes[1] == 2);
+
+	receive(&port, 256);
+	check(port.rx_frame_sizes[4] == 1);
+	receive(&port, 257);
+	check(port.rx_frame_sizes[5] == 1);
+
+	/* Past the last bucket's size is still the last bucket */
+	receive(&port, 16u << (FSCC_RX_FRAME_SIZE_BUCKETS - 1));
+	receive(&port, 0x1fffffff);
+	check(port.rx_frame_sizes[FSCC_RX_FRAME_SIZE_BUCKETS - 1] == 2);
+
+	check(port.rx_frames == 8);
+	check(port.rx_descriptors_used == 1 + 1 + 1 + 1 + 1 + 2 + 2048 + (0x1fffffff + 255) / 256);
+}
+
+static void test_hint(void)
+{
+	struct fscc_port port;
+	struct fscc_stats stats;
+	UINT32 i;
+
+	/* Nothing seen yet, keeps what it has */
+	reset(&port, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == DEFAULT_BUFFER_RX_SIZE);
+	check(stats.rx_num_hint == DEFAULT_BUFFER_RX_NUM);
+
+	/* Same memory in smaller buffers */
+	for (i = 0; i < 100; i++)
+		receive(&port, 100);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == 128);
+	check(stats.rx_num_hint == DEFAULT_BUFFER_RX_NUM * DEFAULT_BUFFER_RX_SIZE / 128);
+
+	/* Never under 64 bytes */
+	reset(&port, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	for (i = 0; i < 100; i++)
+		receive(&port, 10);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == 64);
+
+	/* Never over 4096 bytes, and never fewer than 16 buffers */
+	reset(&port, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	for (i = 0; i < 100; i++)
+		receive(&port, 9000);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == 4096);
+	check(stats.rx_num_hint == 16);
+
+	/* 90% of frames in one buffer, rounded up */
+	reset(&port, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	for (i = 0; i < 89; i++)
+		receive(&port, 200);
+	for (i = 0; i < 11; i++)
+		receive(&port, 2000);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == 2048);
+
+	for (i = 0; i < 10; i++)
+		receive(&port, 200);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == 256);
+
+	reset(&port, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	for (i = 0; i < 9; i++)
+		receive(&port, 200);
+	receive(&port, 2000);
+	hint(&port, &stats);
+	check(stats.rx_size_hint == 256);
+}
+
+/* Against the rule worked out from the frames themselves */
+static void test_hint_random(void)
+{
+	struct fscc_port port;
+	struct fscc_stats stats;
+	UINT32 sizes[1000];
+	UINT32 n, i, run, fit, half_fit;
+
+	for (run = 0; run < 10000; run++) {
+		reset(&port, 1 + (UINT32)rand() % 1000, 16u << (rand() % 10));
+
+		n = 1 + (UINT32)rand() % 1000;
+		for (i = 0; i < n; i++) {
+			sizes[i] = 1 + (UINT32)rand() % (16u << (rand() % 10));
+			receive(&port, sizes[i]);
+		}
+
+		hint(&port, &stats);
+
+		check(stats.rx_size_hint >= 64 && stats.rx_size_hint <= 4096);
+		check((stats.rx_size_hint & (stats.rx_size_hint - 1)) == 0);
+		check(stats.rx_num_hint >= 16);
+		check(stats.rx_num_hint == 16 ||
+			stats.rx_num_hint == port.memory.rx_num * port.memory.rx_size / stats.rx_size_hint);
+
+		fit = half_fit = 0;
+		for (i = 0; i < n; i++) {
+			fit += sizes[i] <= stats.rx_size_hint;
+			half_fit += sizes[i] <= stats.rx_size_hint / 2;
+		}
+
+		/* Holds 90% unless capped, and half as much wouldn't */
+		check(stats.rx_size_hint == 4096 || fit * 10 >= n * 9);
+		check(stats.rx_size_hint == 64 || half_fit * 10 < n * 9);
+	}
+}
+
+/* Runs a mix through one layout, and returns the descriptors a frame */
+static double run_mix(const struct mix *mix, UINT32 rx_num, UINT32 rx_size,
+	struct fscc_stats *stats, double *used)
+{
+	struct fscc_port port;
+	UINT64 bytes = 0;
+	UINT32 size, i;
+
+	reset(&port, rx_num, rx_size);
+	srand(1);
+
+	for (i = 0; i < MIX_FRAMES; i++) {
+		size = mix->size() + STATUS_BYTES;
+		bytes += size;
+		receive(&port, size);
+	}
+
+	hint(&port, stats);
+	*used = 100.0 * bytes / ((double)port.rx_descriptors_used * rx_size);
+
+	return (double)port.rx_descriptors_used / port.rx_frames;
+}
+
+static void model(void)
+{
+	struct fscc_stats before, after;
+	double hops, new_hops, used, new_used;
+	unsigned i;
+
+	printf("%u frames a mix, %u x %u byte buffers to start:\n",
+		MIX_FRAMES, DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	printf("%-14s %12s %8s %14s %12s %8s\n", "mix", "desc/frame", "used %",
+		"suggested", "desc/frame", "used %");
+
+	for (i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+		hops = run_mix(&mixes[i], DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE, &before, &used);
+		new_hops = run_mix(&mixes[i], before.rx_num_hint, before.rx_size_hint, &after, &new_used);
+
+		/* Following the hint again changes nothing */
+		check(after.rx_size_hint == before.rx_size_hint);
+		check(after.rx_num_hint == before.rx_num_hint);
+		check(new_hops <= hops || before.rx_size_hint < DEFAULT_BUFFER_RX_SIZE);
+
+		printf("%-14s %12.2f %8.1f %7u x %-5u %12.2f %8.1f\n", mixes[i].name, hops, used,
+			before.rx_size_hint, before.rx_num_hint, new_hops, new_used);
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_buckets();
+	test_hint();
+	test_hint_random();
+	model();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All rx size hint tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "port.h"
+
+/*
+	Host tests for the power transition snapshot in src/snapshot.c. Random
+	sets of registers and clock bits are written out and read back, the
+	layout is checked byte for byte, and broken, short or newer snapshots
+	have to be turned down without touching what they would be read into.
+
+	Built from the driver's own snapshot.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/snapshot_test.c src/snapshot.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define RUNS 10000
+
+static ULONG random32(void)
+{
+	return ((ULONG)rand() << 16) ^ (ULONG)rand();
+}
+
+static void random_clock(struct clock_data_fscc *clock_data)
+{
+	unsigned i;
+
+	clock_data->frequency = random32();
+	for (i = 0; i < sizeof(clock_data->clock_bits); i++)
+		clock_data->clock_bits[i] = (unsigned char)rand();
+}
+
+static BOOLEAN same_clock(const struct clock_data_fscc *a, const struct clock_data_fscc *b)
+{
+	return a->frequency == b->frequency &&
+		memcmp(a->clock_bits, b->clock_bits, sizeof(a->clock_bits)) == 0;
+}
+
+static ULONG get_le32(const UCHAR *p)
+{
+	return (ULONG)p[0] | ((ULONG)p[1] << 8) | ((ULONG)p[2] << 16) | ((ULONG)p[3] << 24);
+}
+
+static void put_le32(UCHAR *p, ULONG value)
+{
+	p[0] = (UCHAR)value;
+	p[1] = (UCHAR)(value >> 8);
+	p[2] = (UCHAR)(value >> 16);
+	p[3] = (UCHAR)(value >> 24);
+}
+
+static void test_round_trip(void)
+{
+	struct fscc_registers regs, parsed;
+	struct clock_data_fscc clock_data, parsed_clock;
+	fscc_register *values = (fscc_register *)&regs;
+	UCHAR blob[FSCC_SNAPSHOT_SIZE];
+	ULONG length;
+	int count, run;
+	unsigned i;
+
+	for (run = 0; run < RUNS; run++) {
+		FSCC_REGISTERS_INIT(regs);
+		count = 0;
+
+		for (i = 0; i < FSCC_SNAPSHOT_REGISTERS; i++) {
+			if (rand() % 2) {
+				values[i] = random32();
+				count++;
+			}
+		}
+
+		random_clock(&clock_data);
+
+		length = fscc_snapshot_serialize(&regs, &clock_data, blob);
+		check(length == (FSCC_SNAPSHOT_HEADER_WORDS + 2 * count + FSCC_SNAPSHOT_CLOCK_WORDS) * 4);
+
+		memset(&parsed, 0, sizeof(parsed));
+		check(fscc_snapshot_parse(blob, length, &parsed, &parsed_clock) == count);
+		check(memcmp(&parsed, &regs, sizeof(regs)) == 0);
+		check(same_clock(&parsed_clock, &clock_data));
+	}
+}
+
+/* What FsccEvtDeviceD0Exit reads, and every register at once */
+static void test_sizes(void)
+{
+	struct fscc_registers regs, parsed;
+	struct clock_data_fscc clock_data, parsed_clock;
+	UCHAR blob[FSCC_SNAPSHOT_SIZE];
+	ULONG length;
+
+	random_clock(&clock_data);
+
+	FSCC_REGISTERS_INIT(regs);
+	regs.FIFOT = 0x08001000;
+	regs.CCR0 = 0x0011201c;
+	regs.CCR1 = 0x00000018;
+	regs.CCR2 = 0;
+	regs.BGR = 0;
+	regs.SSR = 0x0000007e;
+	regs.SMR = 0;
+	regs.TSR = 0x0000007e;
+	regs.TMR = 0;
+	regs.RAR = 0;
+	regs.RAMR = 0;
+	regs.PPR = 0;
+	regs.TCR = 0;
+	regs.IMR = 0x0f000000;
+	regs.DPLLR = 0x00000004;
+	regs.FCR = 0;
+
+	length = fscc_snapshot_serialize(&regs, &clock_data, blob);
+	check(length == (FSCC_SNAPSHOT_HEADER_WORDS + 2 * 16 + FSCC_SNAPSHOT_CLOCK_WORDS) * 4);
+	check(fscc_snapshot_parse(blob, length, &parsed, &parsed_clock) == 16);
+	check(memcmp(&parsed, &regs, sizeof(regs)) == 0);
+
+	/* The size the port keeps room for */
+	memset(&regs, 0, sizeof(regs));
+	check(fscc_snapshot_serialize(&regs, &clock_data, blob) == FSCC_SNAPSHOT_SIZE);
+	check(fscc_snapshot_parse(blob, FSCC_SNAPSHOT_SIZE, &parsed, &parsed_clock) == (int)FSCC_SNAPSHOT_REGISTERS);
+
+	/* And none at all */
+	FSCC_REGISTERS_INIT(regs);
+	length = fscc_snapshot_serialize(&regs, &clock_data, blob);
+	check(length == (FSCC_SNAPSHOT_HEADER_WORDS + FSCC_SNAPSHOT_CLOCK_WORDS) * 4);
+	check(fscc_snapshot_parse(blob, length, &parsed, &parsed_clock) == 0);
+	check(memcmp(&parsed, &regs, sizeof(regs)) == 0);
+	check(same_clock(&parsed_clock, &clock_data));
+}
+
+/* Byte for byte, so other builds and tools can read it */
+static void test_layout(void)
+{
+	static const UCHAR expected[] = {
+		'F', 'S', 'C', 'S',
+		0x01, 0x00, 0x00, 0x00,
+		0x02, 0x00, 0x00, 0x00,
+		0x02, 0x00, 0x00, 0x00, /* FIFOT */
+		0x44, 0x33, 0x22, 0x11,
+		0x17, 0x00, 0x00, 0x00, /* FCR */
+		0x00, 0x00, 0x00, 0x80,
+		0x80, 0x96, 0x98, 0x00, /* 10 MHz */
+	};
+	struct fscc_registers regs;
+	struct clock_data_fscc clock_data;
+	UCHAR blob[FSCC_SNAPSHOT_SIZE];
+	unsigned i;
+
+	FSCC_REGISTERS_INIT(regs);
+	regs.FIFOT = 0x11223344;
+	regs.FCR = 0x80000000;
+
+	clock_data.frequency = 10000000;
+	for (i = 0; i < sizeof(clock_data.clock_bits); i++)
+		clock_data.clock_bits[i] = (unsigned char)(0xa0 + i);
+
+	check(fscc_snapshot_serialize(&regs, &clock_data, blob) == sizeof(expected) + sizeof(clock_data.clock_bits));
+	check(memcmp(blob, expected, sizeof(expected)) == 0);
+	check(memcmp(blob + sizeof(expected), clock_data.clock_bits, sizeof(clock_data.clock_bits)) == 0);
+}
+
+/* A snapshot that's turned down leaves regs and clock_data alone */
+static BOOLEAN turned_down(const UCHAR *blob, ULONG length)
+{
+	struct fscc_registers parsed;
+	struct clock_data_fscc parsed_clock, clock_before;
+	UCHAR before[sizeof(parsed)];
+
+	memset(&parsed, 0x5a, sizeof(parsed));
+	memset(&parsed_clock, 0x5a, sizeof(parsed_clock));
+	memcpy(before, &parsed, sizeof(parsed));
+	clock_before = parsed_clock;
+
+	if (fscc_snapshot_parse(blob, length, &parsed, &parsed_clock) != -1)
+		return FALSE;
+
+	return memcmp(before, &parsed, sizeof(parsed)) == 0 && same_clock(&clock_before, &parsed_clock);
+}
+
+static void test_broken(void)
+{
+	struct fscc_registers regs;
+	struct clock_data_fscc clock_data;
+	UCHAR blob[FSCC_SNAPSHOT_SIZE];
+	UCHAR copy[FSCC_SNAPSHOT_SIZE];
+	ULONG length;
+
+	FSCC_REGISTERS_INIT(regs);
+	regs.CCR0 = 0x0011201c;
+	regs.IMR = 0x0f000000;
+	random_clock(&clock_data);
+
+	length = fscc_snapshot_serialize(&regs, &clock_data, blob);
+	check(length > 0 && !turned_down(blob, length));
+
+	/* Short, down to nothing */
+	check(turned_down(blob, length - 1));
+	check(turned_down(blob, (FSCC_SNAPSHOT_HEADER_WORDS + FSCC_SNAPSHOT_CLOCK_WORDS) * 4));
+	check(turned_down(blob, 4));
+	check(turned_down(blob, 0));
+
+	/* Something else */
+	memcpy(copy, blob, length);
+	copy[0] ^= 1;
+	check(turned_down(copy, length));
+
+	/* A newer layout */
+	memcpy(copy, blob, length);
+	put_le32(copy + 4, get_le32(copy + 4) + 1);
+	check(turned_down(copy, length));
+
+	/* More registers than there are, or than it holds */
+	memcpy(copy, blob, length);
+	put_le32(copy + 8, FSCC_SNAPSHOT_REGISTERS + 1);
+	check(turned_down(copy, FSCC_SNAPSHOT_SIZE));
+
+	memcpy(copy, blob, length);
+	put_le32(copy + 8, 3);
+	check(turned_down(copy, length));
+
+	/* A register past the end of struct fscc_registers */
+	memcpy(copy, blob, length);
+	put_le32(copy + FSCC_SNAPSHOT_HEADER_WORDS * 4 + 8, FSCC_SNAPSHOT_REGISTERS);
+	check(turned_down(copy, length));
+
+	/* Room to spare is fine */
+	memcpy(copy, blob, length);
+	check(!turned_down(copy, sizeof(copy)));
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_round_trip();
+	test_sizes();
+	test_layout();
+	test_broken();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All snapshot tests passed\n");
+
+	return EXIT_SUCCESS;
+}
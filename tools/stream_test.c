@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "io.h"
+#include "port.h"
+#include "config.h"
+
+/*
+	Host tests for fscc_user_read_stream in src/stream.c, which reads a
+	transparent mode port's rx descriptors as one continuous stream.
+
+	A fake card fills the descriptors it owns with the next bytes of a known
+	stream, and reads of random sizes from 1 byte to 64 KB have to give the
+	stream back in order with nothing lost or repeated. A descriptor read
+	part way has to keep the rest at read_offset. Last, reads of each size
+	from 1 byte to 64 KB are timed against the version that moved the rest
+	of a partly read descriptor to its front, and the bytes a second of CPU
+	time are printed.
+
+	Built from the driver's own stream.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/stream_test.c src/stream.c src/utils.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define RX_LOCK ((WDFSPINLOCK)1)
+#define MAX_READ 65536
+
+static struct fscc_port port;
+static BOOLEAN rx_held;
+
+/* Next descriptor and stream position the fake card fills */
+static unsigned card_desc;
+static UINT64 card_position, read_position;
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	check(SpinLock == RX_LOCK);
+	check(!rx_held);
+	rx_held = TRUE;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	check(rx_held);
+	rx_held = FALSE;
+}
+
+static unsigned char stream_byte(UINT64 position)
+{
+	return (unsigned char)((position * 2654435761u) >> 13);
+}
+
+static void setup(unsigned rx_num, unsigned rx_size)
+{
+	unsigned i;
+
+	memset(&port, 0, sizeof(port));
+	port.board_rx_spinlock = RX_LOCK;
+	port.memory.rx_num = rx_num;
+	port.memory.rx_size = rx_size;
+	port.rx_descriptors = calloc(rx_num, sizeof(*port.rx_descriptors));
+
+	for (i = 0; i < rx_num; i++) {
+		struct dma_frame *frame = calloc(1, sizeof(*frame));
+
+		frame->desc = calloc(1, sizeof(*frame->desc));
+		frame->buffer = malloc(rx_size);
+		frame->data_size = rx_size;
+		frame->desc->control = DESC_HI_BIT;
+		frame->desc->data_count = rx_size;
+		port.rx_descriptors[i] = frame;
+	}
+
+	card_desc = 0;
+	card_position = 0;
+	read_position = 0;
+}
+
+static void teardown(void)
+{
+	unsigned i;
+
+	for (i = 0; i < port.memory.rx_num; i++) {
+		free(port.rx_descriptors[i]->desc);
+		free(port.rx_descriptors[i]->buffer);
+		free(port.rx_descriptors[i]);
+	}
+
+	free(port.rx_descriptors);
+}
+
+/*
+	Fills up to count free descriptors like the card does in transparent
+	mode. With write_data FALSE only the descriptors are given back, for
+	timing the reads alone.
+*/
+static unsigned card_fill(unsigned count, BOOLEAN write_data)
+{
+	unsigned filled = 0;
+	UINT32 i;
+
+	while (filled < count) {
+		struct dma_frame *frame = port.rx_descriptors[card_desc];
+
+		if (frame->desc->control & (DESC_FE_BIT | DESC_CSTOP_BIT))
+			break;
+
+		if (write_data) {
+			for (i = 0; i < frame->data_size; i++)
+				frame->buffer[i] = stream_byte(card_position + i);
+		}
+
+		card_position += frame->data_size;
+		frame->desc->data_count = frame->data_size;
+		frame->desc->control = DESC_CSTOP_BIT | frame->data_size;
+		filled++;
+
+		if (++card_desc == port.memory.rx_num)
+			card_desc = 0;
+	}
+
+	return filled;
+}
+
+/* fscc_user_read_stream before read_offset */
+static int old_read_stream(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	size_t i;
+	UINT32 receive_length = 0;
+	UINT32 control;
+
+	*out_length = 0;
+	WdfSpinLockAcquire(port->board_rx_spinlock);
+	for(i = 0; i < port->memory.rx_num; i++) {
+		control = port->rx_descriptors[port->user_rx_desc]->desc->control;
+
+		if(!(control&DESC_FE_BIT) && !(control&DESC_CSTOP_BIT))
+			break;
+
+		receive_length = min(port->rx_descriptors[port->user_rx_desc]->desc->data_count, buf_length - *out_length);
+
+		RtlCopyMemory(buf + *out_length, port->rx_descriptors[port->user_rx_desc]->buffer, receive_length);
+		*out_length += receive_length;
+
+		if(receive_length == port->rx_descriptors[port->user_rx_desc]->desc->data_count) {
+			port->rx_descriptors[port->user_rx_desc]->desc->data_count = port->rx_descriptors[port->user_rx_desc]->data_size;
+			if(i%2) port->rx_descriptors[port->user_rx_desc]->desc->control = DESC_HI_BIT;
+			else port->rx_descriptors[port->user_rx_desc]->desc->control = 0;
+		}
+		else {
+			int remaining = port->rx_descriptors[port->user_rx_desc]->desc->data_count - receive_length;
+			memmove(port->rx_descriptors[port->user_rx_desc]->buffer,
+			port->rx_descriptors[port->user_rx_desc]->buffer+receive_length,
+			remaining);
+			port->rx_descriptors[port->user_rx_desc]->desc->data_count = remaining;
+			break;
+		}
+
+		port->user_rx_desc++;
+		if(port->user_rx_desc == port->memory.rx_num)
+			port->user_rx_desc = 0;
+	}
+	WdfSpinLockRelease(port->board_rx_spinlock);
+
+	return STATUS_SUCCESS;
+}
+
+static UINT32 random_read_size(void)
+{
+	/* Mostly small, sometimes up to MAX_READ */
+	switch (rand() % 4) {
+	case 0:
+		return 1 + rand() % 16;
+	case 1:
+		return 1 + rand() % 512;
+	case 2:
+		return 1 + rand() % 4096;
+	default:
+		return 1 + rand() % MAX_READ;
+	}
+}
+
+static void test_stream(unsigned rx_num, unsigned rx_size)
+{
+	static char buf[MAX_READ];
+	UINT32 length, out_length, i;
+	unsigned reads, filled;
+	BOOLEAN in_order = TRUE;
+
+	setup(rx_num, rx_size);
+
+	for (reads = 0; reads < 200000; reads++) {
+		filled = card_fill(rand() % (rx_num + 1), TRUE);
+
+		length = random_read_size();
+		check(fscc_user_read_stream(&port, buf, length, &out_length) == STATUS_SUCCESS);
+
+		check(out_length <= length);
+		check(out_length <= card_position - read_position);
+
+		/* Everything there gets read, up to the size of the read */
+		check(out_length == min(length, (UINT32)(card_position - read_position)));
+
+		for (i = 0; i < out_length && in_order; i++)
+			in_order = ((unsigned char)buf[i] == stream_byte(read_position + i));
+
+		read_position += out_length;
+
+		/* A partly read descriptor keeps the rest where it was */
+		if (read_position % rx_size) {
+			struct dma_frame *frame = port.rx_descriptors[port.user_rx_desc];
+
+			check(frame->read_offset == read_position % rx_size);
+			check(frame->read_offset + frame->desc->data_count == frame->data_size);
+		}
+		else {
+			check(port.rx_descriptors[port.user_rx_desc]->read_offset == 0);
+		}
+
+		if (filled == 0 && card_position == read_position) {
+			check(fscc_user_read_stream(&port, buf, length, &out_length) == STATUS_SUCCESS);
+			check(out_length == 0);
+		}
+	}
+
+	check(in_order);
+	check(!rx_held);
+
+	/* Sanity check that the reads kept up with the card */
+	check(read_position > card_position / 2);
+
+	teardown();
+}
+
+static double cpu_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double time_reads(unsigned rx_size, UINT32 length, BOOLEAN old)
+{
+	static char buf[MAX_READ];
+	UINT64 total = min((UINT64)length * 100000, 64 << 20);
+	UINT32 out_length;
+	double start, elapsed;
+
+	setup(DEFAULT_BUFFER_RX_NUM, rx_size);
+	card_fill(DEFAULT_BUFFER_RX_NUM, TRUE);
+
+	start = cpu_seconds();
+
+	while (read_position < total) {
+		if (old)
+			old_read_stream(&port, buf, length, &out_length);
+		else
+			fscc_user_read_stream(&port, buf, length, &out_length);
+
+		read_position += out_length;
+
+		if (out_length < length)
+			card_fill(DEFAULT_BUFFER_RX_NUM, FALSE);
+	}
+
+	elapsed = cpu_seconds() - start;
+	teardown();
+
+	return read_position / elapsed;
+}
+
+static void test_timing(void)
+{
+	static const unsigned rx_sizes[] = { DEFAULT_BUFFER_RX_SIZE, 4096 };
+	UINT32 length;
+	unsigned i;
+
+	for (i = 0; i < sizeof(rx_sizes) / sizeof(rx_sizes[0]); i++) {
+		printf("%u byte descriptors, MB a second of CPU time:\n", rx_sizes[i]);
+		printf("%10s %12s %12s\n", "read size", "read_offset", "moving");
+
+		for (length = 1; length <= MAX_READ; length *= 4) {
+			printf("%10u %12.1f %12.1f\n", length,
+				time_reads(rx_sizes[i], length, FALSE) / 1e6,
+				time_reads(rx_sizes[i], length, TRUE) / 1e6);
+		}
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_stream(DEFAULT_BUFFER_RX_NUM, DEFAULT_BUFFER_RX_SIZE);
+	test_stream(4, 4096);
+	test_stream(64, 1);
+	test_timing();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All stream read tests passed\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "port.h"
+#include "io.h"
+#include "ring.h"
+#include "config.h"
+
+/*
+	Host tests for src/timer.c, which decides when the housekeeping timer
+	runs and when the clock has to be checked again.
+
+	fscc_port_needs_timer has to want the timer for each kind of work alone
+	and not at all on an idle port, and fscc_port_start_timer has to arm it
+	only once. The cached clock check has to go back to STAR once it is
+	CLOCK_PRESENT_TIMEOUT_MS old, and every time while there is no clock.
+	Both checks are timed, and last, ports with a mix of busy, bursty and
+	idle readers are run for a minute of simulated time, and the wakeups a
+	second are printed against the old timer that ran on every port.
+
+	Built from the driver's own timer.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/timer_test.c src/timer.c && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+/* KeQueryInterruptTime counts 100 ns units */
+#define TICKS_PER_US 10
+#define TICKS_PER_MS 10000
+#define MAX_PORTS 64
+
+struct model_port {
+	struct fscc_port port; /* First, so the port is the model_port */
+	BOOLEAN rx_mapped, tx_mapped, clock;
+	ULONG reads, writes; /* What read_queue2 and blocking_request_queue hold */
+	ULONGLONG due, read_done;
+	unsigned starts, star_reads;
+	enum { IDLE, BURSTY, BUSY } kind;
+};
+
+static struct model_port ports[MAX_PORTS];
+static ULONGLONG now;
+static volatile BOOLEAN sink;
+
+static struct model_port *model(struct fscc_port *port)
+{
+	return (struct model_port *)port;
+}
+
+ULONGLONG KeQueryInterruptTime(void)
+{
+	return now;
+}
+
+WDF_IO_QUEUE_STATE WdfIoQueueGetState(WDFQUEUE Queue, PULONG QueueRequests, PULONG DriverRequests)
+{
+	ULONG count = *(ULONG *)Queue;
+
+	if (QueueRequests)
+		*QueueRequests = count;
+
+	if (DriverRequests)
+		*DriverRequests = 0;
+
+	return count ? WdfIoQueueDriverNoRequests : WdfIoQueueNoRequests | WdfIoQueueDriverNoRequests;
+}
+
+BOOLEAN WdfTimerStart(WDFTIMER Timer, LONGLONG DueTime)
+{
+	struct model_port *port = (struct model_port *)Timer;
+
+	check(DueTime == WDF_REL_TIMEOUT_IN_US(port->port.timer_period));
+
+	port->due = now + (ULONGLONG)-DueTime;
+	port->starts++;
+
+	return FALSE;
+}
+
+BOOLEAN fscc_ring_rx_mapped(struct fscc_port *port)
+{
+	return model(port)->rx_mapped;
+}
+
+BOOLEAN fscc_ring_tx_mapped(struct fscc_port *port)
+{
+	return model(port)->tx_mapped;
+}
+
+BOOLEAN fscc_port_uses_dma(struct fscc_port *port)
+{
+	return port->has_dma;
+}
+
+UINT32 fscc_port_get_register(struct fscc_port *port, unsigned bar, unsigned register_offset)
+{
+	check(bar == 0 && register_offset == STAR_OFFSET);
+
+	model(port)->star_reads++;
+
+	return model(port)->clock ? 0 : CE_BIT;
+}
+
+static struct fscc_port *setup(unsigned i)
+{
+	struct model_port *port = &ports[i];
+
+	memset(port, 0, sizeof(*port));
+	port->port.timer = (WDFTIMER)port;
+	port->port.read_queue2 = (WDFQUEUE)&port->reads;
+	port->port.blocking_request_queue = (WDFQUEUE)&port->writes;
+	port->port.timer_period = DEFAULT_TIMER_PERIOD_VALUE;
+	port->port.has_dma = TRUE;
+	port->clock = TRUE;
+
+	return &port->port;
+}
+
+/* The end of timer_handler in isr.c */
+static void timer_fires(struct fscc_port *port)
+{
+	InterlockedIncrement64(&port->timer_wakeups);
+
+	InterlockedExchange(&port->timer_armed, 0);
+	fscc_port_start_timer(port);
+}
+
+static void test_needs_timer(void)
+{
+	struct fscc_port *port = setup(0);
+	struct model_port *m = model(port);
+
+	check(!fscc_port_needs_timer(port));
+
+	m->rx_mapped = TRUE;
+	check(fscc_port_needs_timer(port));
+	m->rx_mapped = FALSE;
+
+	m->tx_mapped = TRUE;
+	check(fscc_port_needs_timer(port));
+	m->tx_mapped = FALSE;
+
+	m->reads = 1;
+	check(fscc_port_needs_timer(port));
+	m->reads = 0;
+
+	m->writes = 3;
+	check(fscc_port_needs_timer(port));
+	m->writes = 0;
+
+	/* A partial frame in the FIFO only matters without DMA */
+	port->rx_bytes_in_frame = 10;
+	check(!fscc_port_needs_timer(port));
+	port->has_dma = FALSE;
+	check(fscc_port_needs_timer(port));
+	port->rx_bytes_in_frame = 0;
+	check(!fscc_port_needs_timer(port));
+
+	check(!fscc_port_needs_timer(0));
+}
+
+static void test_start_timer(void)
+{
+	struct fscc_port *port = setup(0);
+	struct model_port *m = model(port);
+
+	now = 12345;
+
+	/* Idle ports never wake up */
+	fscc_port_start_timer(port);
+	check(m->starts == 0 && port->timer_armed == 0);
+
+	m->reads = 1;
+	port->timer_period = 1000;
+	fscc_port_start_timer(port);
+	check(m->starts == 1 && port->timer_armed == 1);
+	check(m->due == now + 1000 * TICKS_PER_US);
+
+	/* Already armed */
+	fscc_port_start_timer(port);
+	check(m->starts == 1);
+
+	/* Re-arms while there is still work */
+	now = m->due;
+	timer_fires(port);
+	check(m->starts == 2 && port->timer_armed == 1);
+	check(port->timer_wakeups == 1);
+
+	/* And stops once there isn't */
+	m->reads = 0;
+	now = m->due;
+	timer_fires(port);
+	check(m->starts == 2 && port->timer_armed == 0);
+	check(port->timer_wakeups == 2);
+
+	/* Not created yet, or already gone */
+	m->reads = 1;
+	port->timer = 0;
+	fscc_port_start_timer(port);
+	check(m->starts == 2 && port->timer_armed == 0);
+}
+
+static void test_clock(void)
+{
+	struct fscc_port *port = setup(0);
+	struct model_port *m = model(port);
+
+	now = 1000 * TICKS_PER_MS;
+	fscc_port_set_clock_present(port, TRUE);
+	check(port->clock_present && port->clock_present_time == now);
+
+	now += 500 * TICKS_PER_MS - 1;
+	check(!fscc_port_clock_stale(port));
+	now++;
+	check(fscc_port_clock_stale(port));
+
+	/* A fresh result is used without reading STAR */
+	now = 5000 * TICKS_PER_MS;
+	fscc_port_set_clock_present(port, TRUE);
+	now += 100 * TICKS_PER_MS;
+	check(fscc_port_clock_timed_out(port) == 0);
+	check(m->star_reads == 0 && port->mmio_reads_avoided == 1);
+
+	/* A stale one is checked again, once when there is a clock */
+	now += 400 * TICKS_PER_MS;
+	check(fscc_port_clock_timed_out(port) == 0);
+	check(m->star_reads == 1 && port->clock_present_time == now);
+
+	/* Without a clock, every call reads STAR DEFAULT_TIMEOUT_VALUE times */
+	m->clock = FALSE;
+	now += 500 * TICKS_PER_MS;
+	check(fscc_port_clock_timed_out(port) == 1);
+	check(!port->clock_present && m->star_reads == 1 + DEFAULT_TIMEOUT_VALUE);
+	check(fscc_port_clock_timed_out(port) == 1);
+	check(m->star_reads == 1 + 2 * DEFAULT_TIMEOUT_VALUE);
+
+	/* And it is picked up again as soon as the clock is back */
+	m->clock = TRUE;
+	check(fscc_port_clock_timed_out(port) == 0);
+	check(port->clock_present && m->star_reads == 2 + 2 * DEFAULT_TIMEOUT_VALUE);
+	check(port->mmio_reads_avoided == 1);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void test_timing(void)
+{
+	struct fscc_port *port = setup(0);
+	unsigned i, count = 10000000;
+	BOOLEAN result = FALSE;
+	double needs, stale;
+
+	/* The slowest case for fscc_port_needs_timer checks everything */
+	port->has_dma = FALSE;
+	needs = seconds();
+	for (i = 0; i < count; i++)
+		result ^= fscc_port_needs_timer(port);
+	needs = seconds() - needs;
+
+	fscc_port_set_clock_present(port, TRUE);
+	stale = seconds();
+	for (i = 0; i < count; i++) {
+		now++;
+		result ^= fscc_port_clock_stale(port);
+	}
+	stale = seconds() - stale;
+
+	sink = result;
+
+	printf("fscc_port_needs_timer on an idle port takes %.1f ns, fscc_port_clock_stale %.1f ns\n",
+		needs * 1e9 / count, stale * 1e9 / count);
+}
+
+/*
+	Bursty ports get a read about every 200 ms that waits up to 50 ms for its
+	data, busy ones always have one waiting and idle ones never do. The read
+	is what calls fscc_port_start_timer in the driver.
+*/
+static void model_step(struct model_port *m)
+{
+	switch (m->kind) {
+	case BUSY:
+		if (!m->reads) {
+			m->reads = 1;
+			fscc_port_start_timer(&m->port);
+		}
+		break;
+
+	case BURSTY:
+		if (m->reads && now >= m->read_done)
+			m->reads = 0;
+
+		if (!m->reads && now % TICKS_PER_MS == 0 && rand() % 200 == 0) {
+			m->reads = 1;
+			m->read_done = now + (1 + rand() % 50) * TICKS_PER_MS;
+			fscc_port_start_timer(&m->port);
+		}
+		break;
+
+	case IDLE:
+		break;
+	}
+
+	if (m->port.timer_armed && now >= m->due)
+		timer_fires(&m->port);
+}
+
+static void run_model(unsigned count, UINT32 period, unsigned busy, unsigned bursty)
+{
+	const unsigned duration = 60;
+	const ULONGLONG step = 100 * TICKS_PER_US;
+	ULONGLONG end = (ULONGLONG)duration * 1000 * TICKS_PER_MS;
+	double old_rate, new_rate;
+	LONG64 wakeups = 0;
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		setup(i)->timer_period = period;
+		ports[i].kind = (i < busy) ? BUSY : (i < busy + bursty) ? BURSTY : IDLE;
+	}
+
+	for (now = 0; now < end; now += step) {
+		for (i = 0; i < count; i++)
+			model_step(&ports[i]);
+	}
+
+	for (i = 0; i < count; i++) {
+		/* Only the ports with something to do ever woke up */
+		if (ports[i].kind == IDLE) {
+			check(ports[i].port.timer_wakeups == 0);
+		}
+		else {
+			check(ports[i].port.timer_wakeups > 0);
+		}
+
+		/* Never more often than the period */
+		check(ports[i].port.timer_wakeups <= (LONG64)(end / (period * TICKS_PER_US)));
+
+		wakeups += ports[i].port.timer_wakeups;
+	}
+
+	/* The old timer fired every period on every port */
+	old_rate = count * 1e6 / period;
+	new_rate = (double)wakeups / duration;
+
+	if (busy == count) {
+		check(new_rate > old_rate * 0.99);
+	}
+
+	printf("%6u %6u %6u %6u %12.0f %12.1f %7.1f%%\n", period, busy, bursty,
+		count - busy - bursty, old_rate, new_rate, 100 * (1 - new_rate / old_rate));
+}
+
+static void test_model(void)
+{
+	static const UINT32 periods[] = { DEFAULT_TIMER_PERIOD_VALUE, 1000 };
+	unsigned i;
+
+	printf("Timer wakeups a second on %u ports:\n", MAX_PORTS);
+	printf("%6s %6s %6s %6s %12s %12s %8s\n", "period", "busy", "bursty", "idle", "old", "new", "saved");
+
+	for (i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+		run_model(MAX_PORTS, periods[i], MAX_PORTS, 0);
+		run_model(MAX_PORTS, periods[i], 8, 8);
+		run_model(MAX_PORTS, periods[i], 1, 4);
+		run_model(MAX_PORTS, periods[i], 0, 0);
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_needs_timer();
+	test_start_timer();
+	test_clock();
+	test_timing();
+	test_model();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All timer tests passed\n");
+
+	return EXIT_SUCCESS;
+}
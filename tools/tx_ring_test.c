@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ring.h"
+#include "port.h"
+#include "io.h"
+
+/*
+	Host tests for the tx ring in src/ring.c and src/ringlayout.h.
+
+	Mapping has to be refused while frames are being repeated. Records the
+	application broke have to stop fscc_ring_drain_tx before anything is
+	written. Then a reference producer built on fscc_ring_reserve and
+	fscc_ring_commit writes frames on one thread while fscc_ring_drain_tx
+	hands them to a fake card on another, which sometimes has no room or
+	is held back by the pacer. Every frame has to reach the card once, whole
+	and in order. Last, the frames a second the two threads get through are
+	printed.
+
+	Built from the driver's own ring.c, with the headers in tools/host
+	standing in for the WDK. Run from the repository root:
+
+	Linux: cc -O2 -Wno-multichar -Itools/host -Isrc tools/tx_ring_test.c src/ring.c -lpthread && ./a.out
+*/
+
+static int failures = 0;
+
+#define check(expr) \
+	if (expr) {} else \
+	{ \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	}
+
+#define RING_LOCK ((WDFSPINLOCK)1)
+#define RING_QUEUE ((WDFQUEUE)1)
+#define WAIT_QUEUE ((WDFQUEUE)2)
+#define FILE_OBJECT ((WDFFILEOBJECT)1)
+
+#define MAX_FRAME 1024
+
+static struct fscc_port port;
+static BOOLEAN ring_held;
+
+static void *request_buffer;
+static size_t request_length;
+static NTSTATUS completed_status;
+static int completed;
+
+static BOOLEAN repeat_running;
+
+/* The fake card, only used by the thread draining the ring */
+static UINT32 card_frame;
+static UINT64 card_bytes, paced_bytes;
+static BOOLEAN card_in_order = TRUE;
+static unsigned card_busy; /* Out of 16, how often there is no room */
+static unsigned card_seed = 1;
+static int writes, kicks;
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	check(SpinLock == RING_LOCK);
+	check(!ring_held);
+	ring_held = TRUE;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	check(ring_held);
+	ring_held = FALSE;
+}
+
+BOOLEAN WdfDpcEnqueue(WDFDPC Dpc)
+{
+	kicks++;
+
+	return TRUE;
+}
+
+void WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+	completed_status = Status;
+	completed++;
+}
+
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+	if (request_length < MinimumRequiredSize)
+		return STATUS_BUFFER_TOO_SMALL;
+
+	*Buffer = request_buffer;
+	*Length = request_length;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue)
+{
+	return STATUS_SUCCESS;
+}
+
+WDFFILEOBJECT WdfRequestGetFileObject(WDFREQUEST Request)
+{
+	return FILE_OBJECT;
+}
+
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest)
+{
+	check(Queue == WAIT_QUEUE);
+
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+NTSTATUS WdfIoQueueRetrieveFoundRequest(WDFQUEUE Queue, WDFREQUEST FoundRequest, WDFREQUEST *OutRequest)
+{
+	*OutRequest = FoundRequest;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoQueueRetrieveRequestByFileObject(WDFQUEUE Queue, WDFFILEOBJECT FileObject, WDFREQUEST *OutRequest)
+{
+	return STATUS_NO_MORE_ENTRIES;
+}
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue)
+{
+	return 0;
+}
+
+FSCC_PORT *WdfObjectGet_FSCC_PORT(WDFOBJECT handle)
+{
+	return &port;
+}
+
+void fscc_port_start_rx_poll(struct fscc_port *port)
+{
+}
+
+void fscc_port_start_timer(struct fscc_port *port)
+{
+}
+
+BOOLEAN fscc_repeat_running(struct fscc_port *port)
+{
+	return repeat_running;
+}
+
+/* Only the rx ring uses these */
+void fscc_filter_frames(struct fscc_port *port)
+{
+	check(0);
+}
+
+unsigned fscc_io_is_streaming(struct fscc_port *port)
+{
+	check(0);
+	return 0;
+}
+
+unsigned fscc_user_next_read_size(struct fscc_port *port, UINT32 *bytes)
+{
+	check(0);
+	return 0;
+}
+
+int fscc_user_read_frame(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	check(0);
+	return STATUS_UNSUCCESSFUL;
+}
+
+int fscc_user_read_stream(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	check(0);
+	return STATUS_UNSUCCESSFUL;
+}
+
+static unsigned card_random(void)
+{
+	return rand_r(&card_seed);
+}
+
+size_t fscc_user_get_tx_space(struct fscc_port *port)
+{
+	check(ring_held);
+
+	return (card_random() % 16 < card_busy) ? card_random() % MAX_FRAME : 65536;
+}
+
+BOOLEAN fscc_pacer_ready(struct fscc_port *port, UINT32 length)
+{
+	return card_random() % 16 >= card_busy;
+}
+
+void fscc_pacer_charge(struct fscc_port *port, UINT32 length)
+{
+	paced_bytes += length;
+}
+
+unsigned fscc_port_clock_timed_out(struct fscc_port *port)
+{
+	return 0;
+}
+
+BOOLEAN fscc_port_uses_dma(struct fscc_port *port)
+{
+	return port->has_dma;
+}
+
+static unsigned char frame_byte(UINT32 frame, UINT32 i)
+{
+	return (unsigned char)((frame * 31 + i) * 2654435761u >> 11);
+}
+
+static UINT32 frame_length(UINT32 frame)
+{
+	/* Mostly short, sometimes up to MAX_FRAME */
+	UINT32 mix = frame * 2654435761u;
+
+	return 1 + ((mix >> 8) % ((mix & 0x30) ? 64 : MAX_FRAME));
+}
+
+int fscc_user_write_frame(struct fscc_port *port, char *buf, UINT32 buf_length, UINT32 *out_length)
+{
+	UINT32 i;
+
+	check(ring_held);
+
+	if (buf_length != frame_length(card_frame))
+		card_in_order = FALSE;
+
+	for (i = 0; i < buf_length && card_in_order; i++) {
+		if ((unsigned char)buf[i] != frame_byte(card_frame, i))
+			card_in_order = FALSE;
+	}
+
+	card_frame++;
+	card_bytes += buf_length;
+	writes++;
+	*out_length = buf_length;
+
+	return STATUS_SUCCESS;
+}
+
+static void setup(void)
+{
+	memset(&port, 0, sizeof(port));
+	port.ring_spinlock = RING_LOCK;
+	port.ring_queue = RING_QUEUE;
+	port.tx_ring.wait_queue = WAIT_QUEUE;
+	port.memory.tx_num = 2;
+	port.memory.tx_size = MAX_FRAME;
+	port.has_dma = 1;
+
+	repeat_running = FALSE;
+	card_frame = 1;
+	card_bytes = 0;
+	paced_bytes = 0;
+	card_in_order = TRUE;
+	card_busy = 0;
+	writes = 0;
+	kicks = 0;
+}
+
+static struct fscc_ring *new_ring(UINT32 size)
+{
+	struct fscc_ring *ring = calloc(1, sizeof(*ring) + size);
+
+	ring->size = size;
+
+	return ring;
+}
+
+static void start_ring(struct fscc_ring *ring, UINT32 start)
+{
+	port.tx_ring.ring = ring;
+	port.tx_ring.size = ring->size;
+	port.tx_ring.index = start;
+	ring->head = start;
+	ring->tail = start;
+}
+
+static void test_map(void)
+{
+	struct fscc_ring *ring = new_ring(256);
+
+	setup();
+
+	request_buffer = ring;
+	request_length = sizeof(*ring) + 256;
+
+	/* Nothing can be written while frames are being repeated */
+	repeat_running = TRUE;
+	completed = 0;
+	fscc_ring_map_tx(&port, (WDFREQUEST)1);
+	check(completed == 1 && completed_status == STATUS_INVALID_DEVICE_STATE);
+	check(!fscc_ring_tx_mapped(&port));
+
+	/* Too small for a record and a pad record */
+	repeat_running = FALSE;
+	ring->size = 8;
+	completed = 0;
+	fscc_ring_map_tx(&port, (WDFREQUEST)1);
+	check(completed == 1 && completed_status == STATUS_INVALID_PARAMETER);
+
+	ring->size = 256;
+	completed = 0;
+	fscc_ring_map_tx(&port, (WDFREQUEST)1);
+	check(completed == 0);
+	check(fscc_ring_tx_mapped(&port));
+
+	check(fscc_ring_unmap_tx(&port) == STATUS_SUCCESS);
+	check(!fscc_ring_tx_mapped(&port));
+	check(!ring_held);
+
+	free(ring);
+}
+
+/* The reference producer, what an application would do. FALSE if it is full. */
+static BOOLEAN produce_frame(struct fscc_ring *ring, UINT32 *head, UINT32 frame)
+{
+	struct fscc_ring_record *record = 0;
+	UINT32 length = frame_length(frame);
+	UINT32 tail = 0, room = 0, i;
+
+	tail = ring->tail;
+	__sync_synchronize();
+
+	record = fscc_ring_reserve(FSCC_RING_DATA(ring), ring->size, head,
+		*head - tail, length, &room);
+
+	if (record) {
+		check(room >= length);
+
+		for (i = 0; i < length; i++)
+			((unsigned char *)(record + 1))[i] = frame_byte(frame, i);
+
+		fscc_ring_commit(record, head, length);
+	}
+
+	/* The records have to be visible before the new head, pad records too */
+	__sync_synchronize();
+	ring->head = *head;
+
+	return record ? TRUE : FALSE;
+}
+
+static void test_broken(void)
+{
+	struct fscc_ring *ring = new_ring(4096);
+	struct fscc_ring_record *record = (struct fscc_ring_record *)FSCC_RING_DATA(ring);
+	UINT32 head = 0;
+
+	setup();
+	start_ring(ring, 0);
+
+	/* Larger than the tx buffers can ever hold */
+	record->length = port.memory.tx_size * port.memory.tx_num + 1;
+	record->flags = 0;
+	ring->head = FSCC_RING_RECORD_SIZE(record->length);
+	fscc_ring_drain_tx(&port);
+	check(writes == 0 && ring->tail == 0);
+
+	/* Empty */
+	record->length = 0;
+	ring->head = 8;
+	fscc_ring_drain_tx(&port);
+	check(writes == 0 && ring->tail == 0);
+
+	/* Head not covering the record, or too far ahead */
+	record->length = 100;
+	ring->head = FSCC_RING_RECORD_SIZE(100) - FSCC_RING_ALIGN(1);
+	fscc_ring_drain_tx(&port);
+	check(writes == 0 && ring->tail == 0);
+
+	ring->head = 4096 + 8;
+	fscc_ring_drain_tx(&port);
+	check(writes == 0 && ring->tail == 0);
+
+	/* Fine once it is fixed */
+	ring->head = 0;
+	check(produce_frame(ring, &head, 1));
+	fscc_ring_drain_tx(&port);
+	check(writes == 1 && ring->tail == head && card_in_order);
+	check(kicks == 0);
+
+	/* Without DMA the oframe DPC does the writing */
+	port.has_dma = 0;
+	check(produce_frame(ring, &head, 2));
+	fscc_ring_drain_tx(&port);
+	check(writes == 2 && ring->tail == head && card_in_order);
+	check(kicks == 1);
+
+	check(paced_bytes == card_bytes);
+	check(!ring_held);
+
+	free(ring);
+}
+
+struct producer {
+	struct fscc_ring *ring;
+	UINT32 frames;
+	volatile BOOLEAN done;
+	volatile BOOLEAN stop;
+};
+
+static void *produce(void *context)
+{
+	struct producer *producer = context;
+	UINT32 head = producer->ring->head;
+	UINT32 frame = 1;
+
+	while (frame <= producer->frames && !producer->stop) {
+		if (produce_frame(producer->ring, &head, frame))
+			frame++;
+		else
+			sched_yield();
+	}
+
+	producer->done = TRUE;
+
+	return 0;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void test_threads(UINT32 size, UINT32 start, unsigned busy, UINT32 frames)
+{
+	struct producer producer;
+	struct fscc_ring *ring = new_ring(size);
+	pthread_t thread;
+	double elapsed, progress;
+	UINT32 last_frame = 0;
+
+	setup();
+	card_busy = busy;
+	start_ring(ring, start);
+
+	producer.ring = ring;
+	producer.frames = frames;
+	producer.done = FALSE;
+	producer.stop = FALSE;
+
+	elapsed = seconds();
+	progress = elapsed;
+	pthread_create(&thread, NULL, produce, &producer);
+
+	/* The doorbell, the timer and finished transmits all end up here */
+	while (card_frame <= frames && card_in_order) {
+		fscc_ring_drain_tx(&port);
+
+		if (card_frame != last_frame) {
+			last_frame = card_frame;
+			progress = seconds();
+		}
+		else if (seconds() - progress > 5) {
+			/* A broken ring stops the consumer for good */
+			check(!"tx ring stalled");
+			break;
+		}
+
+		if (ring->head == ring->tail)
+			sched_yield();
+	}
+
+	producer.stop = TRUE;
+	pthread_join(thread, NULL);
+	elapsed = seconds() - elapsed;
+
+	check(card_in_order);
+	check(card_frame == frames + 1);
+	check(ring->head == ring->tail);
+	check(paced_bytes == card_bytes);
+	check(!ring_held);
+
+	/* Sanity check that the indices went around */
+	check((UINT32)(ring->head - start) > size);
+
+	printf("%u byte ring, card busy %u/16: %.0f frames and %.1f MB a second\n",
+		size, busy, frames / elapsed, card_bytes / elapsed / 1e6);
+
+	free(ring);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_map();
+	test_broken();
+	test_threads(4096, 0, 0, 1000000);
+	test_threads(4096, 0xfffff000, 4, 500000);
+	test_threads(1 << 16, 0, 0, 1000000);
+	test_threads(1 << 16, 0xffffff00, 12, 200000);
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All tx ring tests passed\n");
+
+	return EXIT_SUCCESS;
+}